@@ -1,11 +1,21 @@
+#include <iso646.h>
+#include <monkey/c_emitter.h>
+#include <monkey/engine.h>
 #include <monkey/evaluator.h>
+#include <monkey/gc.h>
+#include <monkey/inference.h>
+#include <monkey/jit.h>
 #include <monkey/lexer.h>
+#include <monkey/optimizer.h>
+#include <monkey/parseint.h>
 #include <monkey/parser.h>
 #include <monkey/repl.h>
+#include <monkey/stack_evaluator.h>
 
 #include "./slurp.h"
 
-static bool eval_source(struct string program, struct environment* env) {
+// Parses `program`, reporting errors on stderr. Returns NULL if there were any.
+static struct ast_program* parse_source(struct string program) {
     struct lexer lexer;
     lexer_init(&lexer, program);
     struct parser parser;
@@ -17,36 +27,186 @@ static bool eval_source(struct string program, struct environment* env) {
             fprintf(stderr, "\t" STRING_FMT "\n", STRING_ARG(parser.errors.ptr[i]));
         }
         ast_node_decref(&ast->node);
-        parser_deinit(&parser);
-        return false;
+        ast = NULL;
     }
-    struct object* obj = eval(&ast->node, env);
-    object_free(obj);
-    ast_node_decref(&ast->node);
     parser_deinit(&parser);
+    return ast;
+}
+
+static bool eval_source(struct string program, struct environment* env, enum engine engine) {
+    struct ast_program* ast = parse_source(program);
+    if (ast == NULL) return false;
+    struct object* obj = engine_eval(engine, &ast->node, env);
+    object_decref(obj);
+    ast_node_decref(&ast->node);
+    return true;
+}
+
+static bool emit_source(struct string program) {
+    struct ast_program* ast = parse_source(program);
+    if (ast == NULL) return false;
+    struct string c = emit_c(ast);
+    fwrite(c.data, 1, c.length, stdout);
+    STRING_FREE(c);
+    ast_node_decref(&ast->node);
     return true;
 }
 
+static bool dump_types(struct string program) {
+    struct ast_program* ast = parse_source(program);
+    if (ast == NULL) return false;
+    optimize(ast, optimizer_level());
+    infer_types(ast);
+    struct string types = inferred_types_string(ast);
+    fwrite(types.data, 1, types.length, stdout);
+    STRING_FREE(types);
+    ast_node_decref(&ast->node);
+    return true;
+}
+
+static void print_gc_stats(const struct gc_stats* stats, void* data) {
+    (void)data;
+    fprintf(
+        stderr,
+        "gc: collection %zu freed %zu of %zu in %.3fms (max %.3fms, total %.3fms)\n",
+        stats->collections,
+        stats->collected,
+        stats->collected + stats->tracked,
+        (double)stats->pause_ns / 1e6,
+        (double)stats->max_pause_ns / 1e6,
+        (double)stats->total_pause_ns / 1e6
+    );
+}
+
+static void print_quickening_stats(void) {
+    struct quickening_stats stats = quickening_stats();
+    fprintf(
+        stderr,
+        "quickening: %zu nodes specialized, %zu hits, %zu misses, %zu deoptimizations\n",
+        stats.specializations,
+        stats.hits,
+        stats.misses,
+        stats.deoptimizations
+    );
+}
+
+static void print_alloc_stat(struct string name, struct object_alloc_stats stats) {
+    if (stats.allocated == 0) return;
+    fprintf(
+        stderr,
+        "alloc: " STRING_FMT " %zu allocated, %zu peak, %zu live\n",
+        STRING_ARG(name),
+        stats.allocated,
+        stats.peak,
+        stats.live
+    );
+}
+
+static void print_alloc_stats(void) {
+    for (int type = 0; type < OBJECT_TYPE_COUNT; type++) {
+        print_alloc_stat(object_type_string(type), object_alloc_stats(type));
+    }
+    print_alloc_stat(STRING_REF("ENVIRONMENT"), environment_alloc_stats());
+}
+
+// Matches `--flag=value` style arguments, storing what follows `flag` in `value`.
+static bool flag_value(struct string arg, struct string flag, struct string* value) {
+    if (arg.length < flag.length or memcmp(arg.data, flag.data, flag.length) != 0) return false;
+    *value = STRING_REF_DATA(arg.data + flag.length, arg.length - flag.length);
+    return true;
+}
+
+static void usage(void) {
+    fprintf(stderr, "Usage: monkey [--engine=");
+#define X(x, name, _fn) fprintf(stderr, "%s" name, ENGINE_##x == 0 ? "" : "|");
+#include <monkey/private/engine_types.inc>
+#undef X
+    fprintf(
+        stderr,
+        "] [-O0|-O1] [--stack-budget=<MiB>] [--gc-stats] [--quickening-stats] [--no-jit]\n"
+        "              [--perf-map] [--alloc-stats] [script]\n"
+        "       monkey [-O0|-O1] --emit-c|--dump-types script\n"
+    );
+    exit(1);
+}
+
 int main(int argc, char** argv) {
-    struct environment env;
-    environment_init(&env);
-    if (argc > 2) {
-        fprintf(stderr, "Usage: monkey [script]\n");
-        exit(1);
-    } else if (argc == 2) {
-        struct string initial_program = slurp_file(STRING_REF_FROM_C(argv[1]));
-        if (!eval_source(initial_program, &env)) {
+    enum engine engine = ENGINE_TREE;
+    bool quickening_stats_enabled = false;
+    bool alloc_stats_enabled = false;
+    bool emit = false;
+    bool types = false;
+    char* script = NULL;
+    for (int i = 1; i < argc; i++) {
+        struct string arg = STRING_REF_FROM_C(argv[i]);
+        struct string value;
+        if (flag_value(arg, STRING_REF("--engine="), &value)) {
+            if (!engine_from_name(value, &engine)) {
+                fprintf(stderr, "unknown engine: " STRING_FMT "\n", STRING_ARG(value));
+                usage();
+            }
+        } else if (flag_value(arg, STRING_REF("-O"), &value)) {
+            struct parse_i64_result level = parse_i64(value);
+            if (!level.ok or level.value < 0 or level.value > OPTIMIZER_MAX_LEVEL) {
+                fprintf(stderr, "invalid optimization level: " STRING_FMT "\n", STRING_ARG(value));
+                usage();
+            }
+            optimizer_set_level((int)level.value);
+        } else if (flag_value(arg, STRING_REF("--stack-budget="), &value)) {
+            struct parse_i64_result mib = parse_i64(value);
+            if (!mib.ok or mib.value <= 0 or mib.value > (int64_t)(SIZE_MAX >> 20)) {
+                fprintf(stderr, "invalid stack budget: " STRING_FMT "\n", STRING_ARG(value));
+                usage();
+            }
+            stack_eval_set_budget((size_t)mib.value << 20);
+        } else if (STRING_EQUAL(arg, STRING_REF("--gc-stats"))) {
+            gc_set_stats_callback(print_gc_stats, NULL);
+        } else if (STRING_EQUAL(arg, STRING_REF("--quickening-stats"))) {
+            quickening_stats_enabled = true;
+        } else if (STRING_EQUAL(arg, STRING_REF("--alloc-stats"))) {
+            alloc_stats_enabled = true;
+        } else if (STRING_EQUAL(arg, STRING_REF("--no-jit"))) {
+            jit_set_enabled(false);
+        } else if (STRING_EQUAL(arg, STRING_REF("--perf-map"))) {
+            jit_set_perf_map(true);
+        } else if (STRING_EQUAL(arg, STRING_REF("--emit-c"))) {
+            emit = true;
+        } else if (STRING_EQUAL(arg, STRING_REF("--dump-types"))) {
+            types = true;
+        } else if (script == NULL and (arg.length == 0 or arg.data[0] != '-')) {
+            script = argv[i];
+        } else {
+            usage();
+        }
+    }
+
+    if (emit or types) {
+        if (script == NULL or (emit and types)) usage();
+        struct string source = slurp_file(STRING_REF_FROM_C(script));
+        bool ok = emit ? emit_source(source) : dump_types(source);
+        STRING_FREE(source);
+        return ok ? 0 : 1;
+    }
+
+    struct environment* env = environment_new();
+    if (script != NULL) {
+        struct string initial_program = slurp_file(STRING_REF_FROM_C(script));
+        if (!eval_source(initial_program, env, engine)) {
             STRING_FREE(initial_program);
             exit(1);
         }
         STRING_FREE(initial_program);
-        repl_start(stdin, stdout, &env);
+        repl_start(stdin, stdout, env, engine);
     } else {
         printf(
             "Hello! This is the Monkey programming language!\n"
             "Feel free to type in commands\n"
         );
-        repl_start(stdin, stdout, &env);
+        repl_start(stdin, stdout, env, engine);
     }
-    environment_free(env);
+    environment_decref(env);
+    // whatever is left only survives through reference cycles
+    gc_collect();
+    if (quickening_stats_enabled) print_quickening_stats();
+    if (alloc_stats_enabled) print_alloc_stats();
 }
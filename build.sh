@@ -3,25 +3,50 @@
 export tup_vardict="$(cd $(dirname $0) && pwd)/tup-generate.vardict"
 cd "test"
 (clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -Iinclude -I../include -c ast.c -o ast.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -Iinclude -I../include -c c_emitter.c -o c_emitter.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -Iinclude -I../include -c code.c -o code.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -Iinclude -I../include -c compiler.c -o compiler.o)
 (clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -Iinclude -I../include -c evaluator.c -o evaluator.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -Iinclude -I../include -c framework.c -o framework.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -Iinclude -I../include -c gc.c -o gc.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -Iinclude -I../include -c inference.c -o inference.o)
 (clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -Iinclude -I../include -c lexer.c -o lexer.o)
 (clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -Iinclude -I../include -c main.c -o main.o)
 (clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -Iinclude -I../include -c object.c -o object.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -Iinclude -I../include -c optimizer.c -o optimizer.o)
 (clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -Iinclude -I../include -c parser.c -o parser.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -Iinclude -I../include -c resolver.c -o resolver.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -Iinclude -I../include -c specializer.c -o specializer.o)
 cd "../src"
 (clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c ast.c -o ast.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c builtins.c -o builtins.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c c_emitter.c -o c_emitter.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c code.c -o code.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c compiler.c -o compiler.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c engine.c -o engine.o)
 (clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c environment.c -o environment.o)
 (clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c evaluator.c -o evaluator.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c gc.c -o gc.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c inference.c -o inference.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c jit.c -o jit.o)
 (clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c lexer.c -o lexer.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c native.c -o native.o)
 (clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c object.c -o object.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c optimizer.c -o optimizer.o)
 (clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c parseint.c -o parseint.o)
 (clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c parser.c -o parser.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c pool.c -o pool.o)
 (clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c repl.c -o repl.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c resolver.c -o resolver.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c specializer.c -o specializer.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c stack_evaluator.c -o stack_evaluator.o)
 (clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c string.c -o string.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c thunk_evaluator.c -o thunk_evaluator.o)
 (clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c token.c -o token.o)
-(ar rcs libmonkey.a ast.o environment.o evaluator.o lexer.o object.o parseint.o parser.o repl.o string.o token.o)
+(clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c vm.c -o vm.o)
+(ar rcs libmonkey.a ast.o builtins.o c_emitter.o code.o compiler.o engine.o environment.o evaluator.o gc.o inference.o jit.o lexer.o native.o object.o optimizer.o parseint.o parser.o pool.o repl.o resolver.o specializer.o stack_evaluator.o string.o thunk_evaluator.o token.o vm.o)
 cd "../test"
-(clang -flto ast.o evaluator.o lexer.o main.o object.o parser.o ../src/libmonkey.a -o monkey-test)
+(clang -flto ast.o c_emitter.o code.o compiler.o evaluator.o framework.o gc.o inference.o lexer.o main.o object.o optimizer.o parser.o resolver.o specializer.o ../src/libmonkey.a -o monkey-test)
 cd "../app"
 (clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c main.c -o main.o)
 (clang -O3 -flto -march=native -mtune=native -fno-omit-frame-pointer -I../include -c slurp.c -o slurp.o)
@@ -1,6 +1,7 @@
 #ifndef MONKEY_AST_H_
 #define MONKEY_AST_H_
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "monkey/buf.h"
@@ -142,10 +143,22 @@ ast_expression_statement_init_base(struct token token, struct ast_expression* ex
     return &ast_expression_statement_init(token, expression)->statement;
 }
 
+// What an engine compiled a node to, cached on the node and released along with it.
+struct ast_code {
+    void (*free)(struct ast_code* code);
+};
+
 struct ast_block_statement {
     struct ast_statement statement;
     struct token token;
     struct ast_statement_buf statements;
+    // the block compiled as a function body, if an engine has needed it
+    struct ast_code* code;
+    // the versions of the function body made for constant arguments, if any call had some
+    struct ast_code* versions;
+    // the function this is the body of as written, printed in place of the block once the
+    // optimizer may have rewritten it
+    struct string source;
 };
 
 extern struct ast_block_statement*
@@ -155,10 +168,49 @@ ast_block_statement_init_base(struct token token, struct ast_statement_buf state
     return &ast_block_statement_init(token, statements)->statement;
 }
 
+// Where the resolver found a variable: in slot `slot` of the function `depth` functions out from
+// the reference. Variables of the global environment stay unresolved and are looked up by name.
+//
+// At run time a variable that closures capture lives apart from its call's frame, in the
+// environment of captured variables the closures share, so it's found `env_depth` environments
+// out from the frame of the reference, in slot `env_slot`. Any other variable is in the frame.
+struct ast_lexical_address {
+    bool resolved;
+    size_t depth;
+    size_t slot;
+    size_t env_depth;
+    size_t env_slot;
+};
+
+// The static types of values, found by inference. UNKNOWN is below every type: nothing is known
+// to flow there, as for a function that never returns. ANY is above every type.
+enum ast_type {
+#define X(x, _name) AST_TYPE_##x,
+#include "monkey/private/ast_types.inc"
+#undef X
+};
+
+extern struct string ast_type_string(enum ast_type type);
+
+struct environment;
+
+// Where a lookup by name last found the name: a bucket of an environment's table, good for as long
+// as the environment is at the version it was then.
+struct ast_lookup_cache {
+    struct environment* env;
+    size_t index;
+    uint64_t version;
+};
+
 struct ast_identifier {
     struct ast_expression expression;
     struct token token;
     struct string value;
+    struct ast_lexical_address address;
+    struct ast_lookup_cache cache;
+    // the type of the value read, or of the variable bound; a parameter's type is checked when
+    // the function is called
+    enum ast_type type;
 };
 
 extern struct ast_identifier* ast_identifier_init(struct token token, struct string value);
@@ -179,18 +231,54 @@ ast_integer_literal_init_base(struct token token, int64_t value) {
     return &ast_integer_literal_init(token, value)->expression;
 }
 
+enum ast_specialization {
+#define X(x) AST_SPECIALIZATION_##x,
+#include "monkey/private/ast_specializations.inc"
+#undef X
+};
+
+// The fast path an operator node has switched to after seeing the same operand types, kept by
+// the evaluators.
+struct ast_quickening {
+    enum ast_specialization specialization;
+    // times the operand types changed under a specialization
+    uint8_t deoptimizations;
+    // whether type inference proved the operands always have the specialization's types, so the
+    // fast path runs without checking them
+    bool proven;
+};
+
+// The operators of prefix and infix expressions, named after their tokens.
+enum ast_operator {
+#define X(x) AST_OPERATOR_##x,
+#include "monkey/private/ast_operators.inc"
+#undef X
+};
+
+enum {
+    AST_OPERATOR_COUNT = 0
+#define X(x) +1
+#include "monkey/private/ast_operators.inc"
+#undef X
+};
+
+extern struct string ast_operator_string(enum ast_operator op);
+// Aborts unless `type` is the token of an operator.
+extern enum ast_operator ast_operator_from_token(enum token_type type);
+
 struct ast_prefix_expression {
     struct ast_expression expression;
     struct token token;
-    struct string op;
+    enum ast_operator op;
     struct ast_expression* right;
+    struct ast_quickening quickening;
 };
 
 extern struct ast_prefix_expression*
-ast_prefix_expression_init(struct token token, struct string op, struct ast_expression* right);
+ast_prefix_expression_init(struct token token, enum ast_operator op, struct ast_expression* right);
 static inline struct ast_expression* ast_prefix_expression_init_base(
     struct token token,
-    struct string op,
+    enum ast_operator op,
     struct ast_expression* right
 ) {
     return &ast_prefix_expression_init(token, op, right)->expression;
@@ -200,20 +288,21 @@ struct ast_infix_expression {
     struct ast_expression expression;
     struct token token;
     struct ast_expression* left;
-    struct string op;
+    enum ast_operator op;
     struct ast_expression* right;
+    struct ast_quickening quickening;
 };
 
 extern struct ast_infix_expression* ast_infix_expression_init(
     struct token token,
     struct ast_expression* left,
-    struct string op,
+    enum ast_operator op,
     struct ast_expression* right
 );
 static inline struct ast_expression* ast_infix_expression_init_base(
     struct token token,
     struct ast_expression* left,
-    struct string op,
+    enum ast_operator op,
     struct ast_expression* right
 ) {
     return &ast_infix_expression_init(token, left, op, right)->expression;
@@ -260,6 +349,14 @@ struct ast_function_literal {
     struct token token;
     struct function_parameter_buf parameters;
     struct ast_block_statement* body;
+    // number of frame slots a call needs, set by the resolver
+    size_t locals;
+    // whether the body creates closures, set by the resolver; a call then keeps the `captured`
+    // variables they capture in an environment of their own, which can outlive the call
+    bool escapes;
+    size_t captured;
+    // the type of the values calls return, set by type inference
+    enum ast_type return_type;
 };
 
 extern struct ast_function_literal* ast_function_literal_init(
@@ -282,6 +379,8 @@ struct ast_call_expression {
     struct token token;
     struct ast_expression* function;
     struct ast_expression_buf arguments;
+    // which arguments are constants, once a call through it has been specialized
+    struct ast_code* constants;
 };
 
 extern struct ast_call_expression* ast_call_expression_init(
@@ -327,6 +426,7 @@ struct ast_index_expression {
     struct token token;
     struct ast_expression* left;
     struct ast_expression* index;
+    struct ast_quickening quickening;
 };
 
 extern struct ast_index_expression* ast_index_expression_init(
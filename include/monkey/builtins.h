@@ -0,0 +1,10 @@
+#ifndef MONKEY_BUILTINS_H_
+#define MONKEY_BUILTINS_H_
+
+#include "monkey/environment.h"
+
+// Binds every builtin function into `env`, replacing existing bindings of the same names. The
+// builtin objects are immortal and the same in every environment.
+extern void builtins_define(struct environment* env);
+
+#endif  // MONKEY_BUILTINS_H_
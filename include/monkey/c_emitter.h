@@ -0,0 +1,12 @@
+#ifndef MONKEY_C_EMITTER_H_
+#define MONKEY_C_EMITTER_H_
+
+#include "monkey/ast.h"
+#include "monkey/string.h"
+
+// Translates a program into a C translation unit that runs it against the runtime in
+// monkey/native.h, to be linked with libmonkey.a. Each function literal becomes a C function.
+// Optimizes and resolves `program` first, like engine_eval().
+extern struct string emit_c(struct ast_program* program);
+
+#endif  // MONKEY_C_EMITTER_H_
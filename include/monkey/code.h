@@ -0,0 +1,48 @@
+#ifndef MONKEY_CODE_H_
+#define MONKEY_CODE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "monkey/buf.h"
+#include "monkey/string.h"
+
+enum opcode {
+#define X(x, _count, _w0, _w1) OP_##x,
+#include "monkey/private/opcode_types.inc"
+#undef X
+};
+
+BUF_T(uint8_t, instruction);
+
+struct opcode_definition {
+    struct string name;
+    size_t operand_count;
+    size_t operand_widths[2];
+};
+
+extern const struct opcode_definition* opcode_lookup(uint8_t op);
+
+// Appends an instruction to `ins` and returns its position. Operands beyond the opcode's
+// operand count are ignored.
+extern size_t code_make(struct instruction_buf* ins, enum opcode op, size_t a, size_t b);
+
+// Reads the operands of the instruction starting at `ins`, returning the number of bytes read.
+extern size_t code_read_operands(
+    const struct opcode_definition* def,
+    const uint8_t* ins,
+    size_t operands[2]
+);
+
+extern struct string code_instructions_string(struct instruction_buf ins);
+
+static inline uint16_t code_read_u16(const uint8_t* ins) {
+    return (uint16_t)((ins[0] << 8) | ins[1]);
+}
+
+static inline void code_write_u16(uint8_t* ins, uint16_t value) {
+    ins[0] = (uint8_t)(value >> 8);
+    ins[1] = (uint8_t)(value & 0xff);
+}
+
+#endif  // MONKEY_CODE_H_
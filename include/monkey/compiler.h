@@ -0,0 +1,60 @@
+#ifndef MONKEY_COMPILER_H_
+#define MONKEY_COMPILER_H_
+
+#include <stdbool.h>
+
+#include "monkey/ast.h"
+#include "monkey/buf.h"
+#include "monkey/code.h"
+#include "monkey/object.h"
+#include "monkey/string.h"
+
+struct emitted_instruction {
+    enum opcode opcode;
+    size_t position;
+};
+
+// A global name interned in the constant pool of a function.
+struct global_name {
+    struct string name;
+    size_t index;
+};
+
+BUF_T(struct global_name, global_name);
+BUF_T(size_t, jump);
+
+struct compilation_scope {
+    struct instruction_buf instructions;
+    struct object_buf constants;
+    // constant pool indices of global names, so each name is interned once per function
+    struct global_name_buf global_names;
+    // the jumps out of the innermost `if` nested in an expression taken by a `return` in it, which
+    // is the value of the `if` rather than the end of the call; NULL outside of one
+    struct jump_buf* returns;
+    struct emitted_instruction last;
+    struct emitted_instruction previous;
+};
+
+BUF_T(struct compilation_scope, compilation_scope);
+BUF_T(struct string, compiler_error);
+
+struct compiler {
+    struct compilation_scope_buf scopes;
+    struct compiler_error_buf errors;
+};
+
+struct bytecode {
+    struct compiled_function* main;
+};
+
+extern void compiler_init(struct compiler* c);
+extern void compiler_deinit(struct compiler* c);
+// Resolves `node`, then compiles it into the top-level function. Returns false if errors were
+// recorded.
+extern bool compile(struct compiler* c, struct ast_node* node);
+// Finishes the top-level function and hands the result to the caller, who must release it
+// with bytecode_free().
+extern struct bytecode compiler_bytecode(struct compiler* c);
+extern void bytecode_free(struct bytecode bytecode);
+
+#endif  // MONKEY_COMPILER_H_
@@ -0,0 +1,25 @@
+#ifndef MONKEY_ENGINE_H_
+#define MONKEY_ENGINE_H_
+
+#include <stdbool.h>
+
+#include "monkey/ast.h"
+#include "monkey/environment.h"
+#include "monkey/object.h"
+#include "monkey/string.h"
+
+enum engine {
+#define X(x, _name, _fn) ENGINE_##x,
+#include "monkey/private/engine_types.inc"
+#undef X
+};
+
+extern struct string engine_name(enum engine engine);
+extern bool engine_from_name(struct string name, enum engine* out);
+extern struct object* engine_eval(
+    enum engine engine,
+    struct ast_node* node,
+    struct environment* env
+);
+
+#endif  // MONKEY_ENGINE_H_
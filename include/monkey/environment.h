@@ -2,6 +2,7 @@
 #define MONKEY_ENVIRONMENT_H_
 
 #include "monkey/buf.h"
+#include "monkey/gc.h"
 #include "monkey/object.h"
 #include "monkey/string.h"
 
@@ -12,21 +13,59 @@ struct environment_entry {
 
 BUF_T(struct environment_entry, environment_entry);
 
+// Environments are reference counted like objects; each function object holds a reference to the
+// environment it closes over, and each environment to its outer one. The global environment binds
+// names; the frame of a function call holds its variables in the slots the resolver assigned them.
+//
+// Nothing but its caller refers to a frame, so frames are pushed on a LIFO frame stack, out of the
+// collector's sight, and popped when their last reference is released. The variables closures
+// capture are kept apart, in a heap environment between the frame and the outer one: a closure
+// holds on to those variables alone, not to everything else its creating call had.
 struct environment {
     struct environment_entry_buf entries;
     size_t count;
+    // unset slots are NULL
+    struct object_buf slots;
     struct environment* outer;
+    // changes whenever a name is bound, and is never the same for two environments
+    uint64_t version;
     size_t rc;
+    bool on_frame_stack;
+    struct gc_node gc;
 };
 
-extern void environment_init(struct environment* env);
-extern void environment_init_enclosed(struct environment* env, struct environment* outer);
-extern void environment_free(struct environment env);
+extern struct environment* environment_new(void);
+extern struct environment* environment_new_enclosed(struct environment* outer, size_t slots);
+// Frame environments must be released in the reverse order they were pushed.
+extern struct environment* environment_push_frame(struct environment* outer, size_t slots);
+// The allocation counts of heap environments, which come from the object pools. Frames aren't
+// counted.
+extern struct object_alloc_stats environment_alloc_stats(void);
 
 extern void environment_incref(struct environment* env);
 extern size_t environment_decref(struct environment* env);
+// Drops every binding and the outer reference, leaving an empty environment. Used by the
+// collector to break cycles.
+extern void environment_clear(struct environment* env);
 
 extern void environment_set(struct environment* env, struct string name, struct object* value);
 extern struct object* environment_get(struct environment* env, struct string name);
+// Like environment_get(), but tries where `cache` says the name was found last first, and
+// remembers where it's found.
+extern struct object* environment_get_cached(
+    struct environment* env,
+    struct string name,
+    struct ast_lookup_cache* cache
+);
+
+// Takes ownership of `value`, releasing whatever the slot held before.
+extern void environment_set_slot(struct environment* env, size_t slot, struct object* value);
+static inline struct object*
+environment_get_slot(struct environment* env, size_t depth, size_t slot) {
+    for (size_t i = 0; i < depth; i++) {
+        env = env->outer;
+    }
+    return env->slots.ptr[slot];
+}
 
 #endif  // MONKEY_ENVIRONMENT_H_
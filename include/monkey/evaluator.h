@@ -7,4 +7,17 @@
 
 struct object* eval(struct ast_node* node, struct environment* env);
 
+// How well operator nodes in both tree evaluators have specialized to their operand types.
+struct quickening_stats {
+    // nodes that picked a fast path
+    size_t specializations;
+    // evaluations that took a fast path
+    size_t hits;
+    // evaluations whose operands no longer matched the node's fast path
+    size_t misses;
+    size_t deoptimizations;
+};
+
+extern struct quickening_stats quickening_stats(void);
+
 #endif  // MONKEY_EVALUATOR_H_
@@ -0,0 +1,50 @@
+#ifndef MONKEY_GC_H_
+#define MONKEY_GC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Objects and environments are reference counted, which frees almost everything promptly. The
+// collector reclaims what reference counting can't: cycles, which form whenever a closure is
+// stored in the environment it closes over.
+//
+// Everything that can hold references (environments, functions, arrays, hashes, closures and
+// return values) embeds a gc_node and stays on the collector's list while alive. A collection
+// finds the roots by trial deletion: any node with more references than the other tracked nodes
+// account for is held from outside, i.e. by the global environment's owner or by a local on the
+// evaluation stack. Whatever those roots can't reach is garbage.
+
+struct object;
+
+struct gc_node {
+    struct gc_node* prev;
+    struct gc_node* next;
+    // scratch space while collecting
+    size_t gc_refs;
+    // the owning object, or NULL for a struct environment
+    struct object* object;
+};
+
+struct gc_stats {
+    size_t collections;
+    // nodes currently tracked
+    size_t tracked;
+    // nodes reclaimed by the last collection
+    size_t collected;
+    uint64_t pause_ns;
+    uint64_t total_pause_ns;
+    uint64_t max_pause_ns;
+};
+
+// Called after every collection.
+typedef void gc_stats_callback_t(const struct gc_stats* stats, void* data);
+
+// Starts tracking a fully initialized node. May run a collection first.
+extern void gc_track(struct gc_node* node, struct object* object);
+extern void gc_untrack(struct gc_node* node);
+// Runs a full collection and returns the number of nodes reclaimed.
+extern size_t gc_collect(void);
+extern struct gc_stats gc_stats(void);
+extern void gc_set_stats_callback(gc_stats_callback_t* callback, void* data);
+
+#endif  // MONKEY_GC_H_
@@ -0,0 +1,26 @@
+#ifndef MONKEY_INFERENCE_H_
+#define MONKEY_INFERENCE_H_
+
+#include "monkey/ast.h"
+#include "monkey/string.h"
+
+// Static type inference. A variable's type is the join of the types of every value bound to it,
+// wherever the binding is, and a parameter's type the join of the arguments of every call the
+// inference can tie to its function. Calls it can't see are caught by checking the parameter types
+// on entry. Operator nodes whose operands are proven to have one type skip the dynamic checks of
+// their fast path.
+
+// Resolves `program`, then annotates its identifiers and function literals with their types and
+// proves what it can of its operator nodes.
+extern void infer_types(struct ast_program* program);
+
+// The types infer_types() found for the variables of `program`, one per line in source order,
+// with the parameters and variables of each function indented under it.
+extern struct string inferred_types_string(struct ast_program* program);
+
+// Gives up the types inferred for a function's parameters, and everything proven with them, once
+// a call passes arguments of other types.
+extern void
+forget_parameter_types(struct function_parameter_buf parameters, struct ast_block_statement* body);
+
+#endif  // MONKEY_INFERENCE_H_
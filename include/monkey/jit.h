@@ -0,0 +1,44 @@
+#ifndef MONKEY_JIT_H_
+#define MONKEY_JIT_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "monkey/environment.h"
+#include "monkey/object.h"
+
+// A baseline JIT for the tree evaluator on x86-64 Linux. Once a function has been called
+// JIT_DEFAULT_THRESHOLD times, its body is compiled to machine code by copying a stencil of
+// prebuilt instructions for each node and patching in its operands. Integer arithmetic,
+// comparisons, conditionals, variable reads and writes run inline, and a call of another compiled
+// function fills in its frame and runs it directly; everything else calls back into the
+// evaluator. With the perf map enabled, each compiled function is listed in /tmp/perf-<pid>.map
+// for perf.
+//
+// On other platforms nothing is ever compiled.
+
+#define JIT_DEFAULT_THRESHOLD 1000
+
+// A function body compiled to machine code.
+struct jit_code;
+
+struct jit_stats {
+    size_t compiled;
+    // bytes of machine code, excluding page padding
+    size_t code_bytes;
+};
+
+extern void jit_set_enabled(bool enabled);
+// Number of calls after which a function is compiled.
+extern void jit_set_threshold(size_t calls);
+// Whether to list compiled functions in perf's map file, off by default.
+extern void jit_set_perf_map(bool enabled);
+extern struct jit_stats jit_stats(void);
+
+// Counts a call of `fn`, compiling its body when it becomes hot. Returns the code to run the call
+// with, or NULL to interpret it.
+extern struct jit_code* jit_function(struct object_function* fn);
+// Runs compiled code in the call environment `env`, which holds the arguments.
+extern struct object* jit_run(struct jit_code* code, struct environment* env);
+
+#endif  // MONKEY_JIT_H_
@@ -11,6 +11,8 @@ struct lexer {
 };
 
 extern void lexer_init(struct lexer* lexer, struct string input);
+// The caller owns the token's literal, which never refers to the input: ASTs outlive their source,
+// and the specializer copies function bodies long after the source was freed.
 extern struct token lexer_next_token(struct lexer* lexer);
 
 #endif // MONKEY_LEXER_H_
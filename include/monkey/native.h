@@ -0,0 +1,84 @@
+#ifndef MONKEY_NATIVE_H_
+#define MONKEY_NATIVE_H_
+
+// The runtime of programs compiled to C by emit_c(). Like the evaluator, these take ownership of
+// the objects passed in unless noted, and return errors as objects.
+
+#include <iso646.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "monkey/ast.h"
+#include "monkey/environment.h"
+#include "monkey/object.h"
+
+static inline bool native_is_error(struct object* obj) {
+    return obj != NULL and object_type(obj) == OBJECT_ERROR;
+}
+
+// Releases the first `count` of `objects`.
+extern void native_release(struct object** objects, size_t count);
+
+// Looks up a name in the environment chain. Borrows `env`.
+extern struct object* native_name(struct environment* env, struct string name);
+// Reads a variable the resolver gave a slot, falling back to its name when the slot is unset, as
+// a `let` on a branch that wasn't taken leaves it. Borrows `env`.
+static inline struct object*
+native_slot(struct environment* env, size_t depth, size_t slot, struct string name) {
+    struct object* value = environment_get_slot(env, depth, slot);
+    if (value == NULL) return native_name(env, name);
+    return object_incref(value);
+}
+
+extern bool native_truthy(struct object* obj);
+extern struct object* native_prefix(enum ast_operator op, struct object* right);
+extern struct object* native_infix(enum ast_operator op, struct object* left, struct object* right);
+extern struct object* native_index(struct object* left, struct object* index);
+// Returns the error for a key that can't be hashed, or NULL. Borrows `key`.
+extern struct object* native_check_hash_key(struct object* key);
+extern struct object* native_hash(void);
+// Inserts into a hash literal under construction. `key` must be hashable.
+extern void native_hash_insert(struct object* hash, struct object* key, struct object* value);
+
+// Calls `fn`, and every call the callee hands back from tail position.
+extern struct object* native_call(struct object* fn, struct object_buf args);
+
+// Runs a compiled program in a fresh global environment and prints its value, or its error on
+// stderr. Returns the process exit status.
+extern int native_main(native_body_t* program);
+
+// Integer arithmetic with a guard on the operand types, falling back to native_infix().
+#define NATIVE_INTEGER_OPERATION(name, op, expression, init) \
+    static inline struct object* name(struct object* left, struct object* right) { \
+        if (left == NULL or right == NULL or object_type(left) != OBJECT_INTEGER or \
+            object_type(right) != OBJECT_INTEGER) { \
+            return native_infix(op, left, right); \
+        } \
+        int64_t l = object_int64_value(left); \
+        int64_t r = object_int64_value(right); \
+        object_decref(left); \
+        object_decref(right); \
+        return init(expression); \
+    }
+
+NATIVE_INTEGER_OPERATION(native_add, AST_OPERATOR_PLUS, l + r, object_int64_init_base)
+NATIVE_INTEGER_OPERATION(native_sub, AST_OPERATOR_MINUS, l - r, object_int64_init_base)
+NATIVE_INTEGER_OPERATION(native_mul, AST_OPERATOR_ASTERISK, l* r, object_int64_init_base)
+NATIVE_INTEGER_OPERATION(native_div, AST_OPERATOR_SLASH, l / r, object_int64_init_base)
+NATIVE_INTEGER_OPERATION(native_less_than, AST_OPERATOR_LT, l < r, object_boolean_init_base)
+NATIVE_INTEGER_OPERATION(native_greater_than, AST_OPERATOR_GT, l > r, object_boolean_init_base)
+NATIVE_INTEGER_OPERATION(native_equal, AST_OPERATOR_EQ, l == r, object_boolean_init_base)
+NATIVE_INTEGER_OPERATION(native_not_equal, AST_OPERATOR_NOT_EQ, l != r, object_boolean_init_base)
+
+#undef NATIVE_INTEGER_OPERATION
+
+static inline struct object* native_negate(struct object* right) {
+    if (right == NULL or object_type(right) != OBJECT_INTEGER) {
+        return native_prefix(AST_OPERATOR_MINUS, right);
+    }
+    int64_t value = object_int64_value(right);
+    object_decref(right);
+    return object_int64_init_base(-value);
+}
+
+#endif  // MONKEY_NATIVE_H_
@@ -1,11 +1,14 @@
 #ifndef MONKEY_OBJECT_H_
 #define MONKEY_OBJECT_H_
 
+#include <iso646.h>
 #include <stdbool.h>
 #include <stdint.h>
 
 #include "monkey/ast.h"
 #include "monkey/buf.h"
+#include "monkey/code.h"
+#include "monkey/gc.h"
 #include "monkey/string.h"
 
 enum object_type {
@@ -14,6 +17,13 @@ enum object_type {
 #undef X
 };
 
+enum {
+    OBJECT_TYPE_COUNT = 0
+#define X(x) +1
+#include "monkey/private/object_types.inc"
+#undef X
+};
+
 extern struct string object_type_string(enum object_type type);
 
 struct object;
@@ -27,32 +37,79 @@ extern bool object_hash_key_equal(struct object_hash_key a, struct object_hash_k
 
 typedef struct string object_inspect_callback_t(const struct object* object);
 typedef void object_free_callback_t(struct object* object);
-typedef struct object* object_dup_callback_t(const struct object* object);
 typedef struct object_hash_key object_hash_key_callback_t(const struct object* object);
 
+// Heap objects are shared and reference counted: object_incref() takes another reference and
+// object_decref() releases one, freeing the object with the last. Both ignore immediates.
 struct object {
     enum object_type type;
+    size_t rc;
     object_inspect_callback_t* inspect_callback;
     object_free_callback_t* free_callback;
-    object_dup_callback_t* dup_callback;
     object_hash_key_callback_t* hash_key_callback;
 };
 
+// Integers, booleans and null are immediates: they are encoded in the pointer itself and never
+// allocated. Heap objects are at least 8-byte aligned, which leaves the low bits free:
+//   ...xxx1  integer, stored in the remaining bits
+//   ...x010  boolean or null, see OBJECT_BITS_*
+// Integers that don't fit are boxed in a heap object_int64.
+#define OBJECT_TAG_INTEGER ((uintptr_t)1)
+#define OBJECT_TAG_MASK ((uintptr_t)7)
+#define OBJECT_TAG_SPECIAL ((uintptr_t)2)
+#define OBJECT_BITS_FALSE (OBJECT_TAG_SPECIAL | (0 << 3))
+#define OBJECT_BITS_TRUE (OBJECT_TAG_SPECIAL | (1 << 3))
+#define OBJECT_BITS_NULL (OBJECT_TAG_SPECIAL | (2 << 3))
+
+static inline bool object_is_immediate(const struct object* object) {
+    return ((uintptr_t)object & OBJECT_TAG_MASK) != 0;
+}
+
+static inline enum object_type object_type(const struct object* object) {
+    uintptr_t bits = (uintptr_t)object;
+    if (bits & OBJECT_TAG_INTEGER) return OBJECT_INTEGER;
+    if ((bits & OBJECT_TAG_MASK) == OBJECT_TAG_SPECIAL) {
+        return bits == OBJECT_BITS_NULL ? OBJECT_NULL : OBJECT_BOOLEAN;
+    }
+    return object->type;
+}
+
 extern struct object object_init(
     enum object_type type,
     object_inspect_callback_t* inspect_callback,
     object_free_callback_t* free_callback,
-    object_dup_callback_t* dup_callback,
     object_hash_key_callback_t* hash_key_callback
 );
 extern struct string object_inspect(const struct object* object);
-extern void object_free(struct object* object);
-extern struct object* object_dup(const struct object* object);
+extern struct object* object_incref(struct object* object);
+extern void object_decref(struct object* object);
+
+// Heap objects are allocated from size-class pools, see monkey/pool.h, and counted per type.
+struct object_alloc_stats {
+    // objects allocated and not yet freed
+    size_t live;
+    // the most that were ever live at once
+    size_t peak;
+    // objects allocated in all
+    size_t allocated;
+};
+
+// The counts for heap objects of `type`. Immediates are never allocated, so never counted.
+extern struct object_alloc_stats object_alloc_stats(enum object_type type);
+
+// The reference count of immortal objects, which no run of increments and decrements brings to
+// zero, so they're shared for the life of the program without a check on every reference.
+#define OBJECT_RC_IMMORTAL (SIZE_MAX / 2)
+
+// Makes a heap object immortal. It must be out of the collector's sight.
+extern struct object* object_make_immortal(struct object* object);
 extern struct object_hash_key object_hash_key(const struct object* object);
 static inline bool object_is_hashable(const struct object* object) {
+    if (object_is_immediate(object)) return object_type(object) != OBJECT_NULL;
     return object->hash_key_callback != NULL;
 }
 
+// Boxed integer, only used for values outside the immediate range.
 struct object_int64 {
     struct object object;
     int64_t value;
@@ -60,30 +117,33 @@ struct object_int64 {
 
 extern struct object_int64* object_int64_init(int64_t value);
 static inline struct object* object_int64_init_base(int64_t value) {
+    if (value >= INTPTR_MIN / 2 and value <= INTPTR_MAX / 2) {
+        return (struct object*)((uintptr_t)(value * 2) | OBJECT_TAG_INTEGER);
+    }
     return &object_int64_init(value)->object;
 }
+static inline int64_t object_int64_value(const struct object* object) {
+    if ((uintptr_t)object & OBJECT_TAG_INTEGER) {
+        // arithmetic shift restores the sign
+        return (int64_t)((intptr_t)object >> 1);
+    }
+    return ((const struct object_int64*)object)->value;
+}
 
-struct object_boolean {
-    struct object object;
-    bool value;
-};
-
-extern struct object_boolean* object_boolean_init(bool value);
 static inline struct object* object_boolean_init_base(bool value) {
-    return &object_boolean_init(value)->object;
+    return (struct object*)(value ? OBJECT_BITS_TRUE : OBJECT_BITS_FALSE);
+}
+static inline bool object_boolean_value(const struct object* object) {
+    return (uintptr_t)object == OBJECT_BITS_TRUE;
 }
 
-struct object_null {
-    struct object object;
-};
-
-extern struct object_null* object_null_init(void);
 static inline struct object* object_null_init_base(void) {
-    return &object_null_init()->object;
+    return (struct object*)OBJECT_BITS_NULL;
 }
 
 struct object_return_value {
     struct object object;
+    struct gc_node gc;
     struct object* value;
 };
 
@@ -107,24 +167,47 @@ struct environment;
 
 struct object_function {
     struct object object;
+    struct gc_node gc;
     struct function_parameter_buf parameters;
     struct ast_block_statement* body;
+    // frame slots a call needs
+    size_t locals;
+    // whether a call keeps `captured` variables of closures it creates apart from its frame
+    bool escapes;
+    size_t captured;
+    // owned reference to the environment the function closes over
     struct environment* env;
+    // owned reference to the version of the function last specialized for constant arguments,
+    // and the version it is
+    struct object* specialized;
+    const void* specialized_for;
 };
 
 extern struct object_function* object_function_init(
     struct function_parameter_buf parameters,
     struct ast_block_statement* body,
+    size_t locals,
+    bool escapes,
+    size_t captured,
     struct environment* env
 );
 static inline struct object* object_function_init_base(
     struct function_parameter_buf parameters,
     struct ast_block_statement* body,
+    size_t locals,
+    bool escapes,
+    size_t captured,
     struct environment* env
 ) {
-    return &object_function_init(parameters, body, env)->object;
+    return &object_function_init(parameters, body, locals, escapes, captured, env)->object;
 }
 
+// How a function with these parameters and body inspects: as written, if the body kept its source.
+extern struct string object_function_inspect_parts(
+    struct function_parameter_buf parameters,
+    struct ast_block_statement* body
+);
+
 struct object_string {
     struct object object;
     struct string value;
@@ -148,8 +231,24 @@ static inline struct object* object_builtin_init_base(builtin_function_callback_
     return &object_builtin_init(fn)->object;
 }
 
+// A call in tail position, handed back to the function application that reached it so the call
+// runs in that application's C frame instead of nesting another one.
+struct object_tail_call {
+    struct object object;
+    struct object* function;
+    struct object_buf args;
+};
+
+extern struct object_tail_call*
+object_tail_call_init(struct object* function, struct object_buf args);
+static inline struct object*
+object_tail_call_init_base(struct object* function, struct object_buf args) {
+    return &object_tail_call_init(function, args)->object;
+}
+
 struct object_array {
     struct object object;
+    struct gc_node gc;
     struct object_buf elements;
 };
 
@@ -188,6 +287,7 @@ object_hash_table_get(struct object_hash_table* table, struct object* key);
 
 struct object_hash {
     struct object object;
+    struct gc_node gc;
     struct object_hash_table pairs;
 };
 
@@ -196,4 +296,108 @@ static inline struct object* object_hash_init_base(struct object_hash_table pair
     return &object_hash_init(pairs)->object;
 }
 
+// Bytecode for a single function body, shared between the constant pool and every closure
+// created from it. Each function owns the constants its instructions refer to, so closures stay
+// valid after the program that created them is gone.
+struct compiled_function {
+    struct instruction_buf instructions;
+    struct object_buf constants;
+    size_t num_locals;
+    size_t num_parameters;
+    // Whether a call keeps the `num_captured` variables closures capture in an environment of its
+    // own, as the resolver decided for the literal.
+    bool escapes;
+    size_t num_captured;
+    // where each global name in the constant pool was last found, indexed like the constants
+    struct ast_lookup_cache* global_caches;
+    // Source literal, kept for inspection. NULL for the top-level program.
+    struct ast_function_literal* literal;
+    size_t rc;
+};
+
+extern struct compiled_function* compiled_function_init(
+    struct instruction_buf instructions,
+    struct object_buf constants,
+    size_t num_locals,
+    size_t num_parameters,
+    struct ast_function_literal* literal
+);
+extern struct compiled_function* compiled_function_incref(struct compiled_function* fn);
+extern void compiled_function_decref(struct compiled_function* fn);
+
+struct object_compiled_function {
+    struct object object;
+    struct compiled_function* fn;
+};
+
+extern struct object_compiled_function* object_compiled_function_init(
+    struct compiled_function* fn
+);
+static inline struct object* object_compiled_function_init_base(struct compiled_function* fn) {
+    return &object_compiled_function_init(fn)->object;
+}
+
+// A compiled function with the environment it closes over, like an object_function: the variables
+// it captures are shared with the call that created it, not copied.
+struct object_closure {
+    struct object object;
+    struct gc_node gc;
+    struct compiled_function* fn;
+    // owned reference, NULL for the top-level program
+    struct environment* env;
+};
+
+extern struct object_closure*
+object_closure_init(struct compiled_function* fn, struct environment* env);
+static inline struct object*
+object_closure_init_base(struct compiled_function* fn, struct environment* env) {
+    return &object_closure_init(fn, env)->object;
+}
+
+// The body of a function compiled to C ahead of time. It binds `args` in the call's environment
+// `env` itself, and borrows both.
+typedef struct object* native_body_t(struct environment* env, struct object_buf args);
+
+struct object_native_function {
+    struct object object;
+    struct gc_node gc;
+    native_body_t* body;
+    size_t arity;
+    // frame slots a call needs
+    size_t locals;
+    // whether a call keeps `captured` variables of closures it creates apart from its frame
+    bool escapes;
+    size_t captured;
+    // the function's source, for inspection
+    struct string source;
+    // owned reference to the environment the function closes over
+    struct environment* env;
+    // owned reference to the version of the function last specialized for constant arguments,
+    // and the version it is
+    struct object* specialized;
+    const void* specialized_for;
+};
+
+extern struct object_native_function* object_native_function_init(
+    native_body_t* body,
+    size_t arity,
+    size_t locals,
+    bool escapes,
+    size_t captured,
+    struct string source,
+    struct environment* env
+);
+static inline struct object* object_native_function_init_base(
+    native_body_t* body,
+    size_t arity,
+    size_t locals,
+    bool escapes,
+    size_t captured,
+    struct string source,
+    struct environment* env
+) {
+    return &object_native_function_init(body, arity, locals, escapes, captured, source, env)
+                ->object;
+}
+
 #endif  // MONKEY_OBJECT_H_
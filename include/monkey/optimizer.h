@@ -0,0 +1,50 @@
+#ifndef MONKEY_OPTIMIZER_H_
+#define MONKEY_OPTIMIZER_H_
+
+#include "monkey/ast.h"
+
+// Rewrites programs before they're evaluated. Every pass keeps the program's meaning on all
+// engines, including which errors it reports, so a pass only touches what it can prove.
+
+#define OPTIMIZER_MAX_LEVEL 1
+#define OPTIMIZER_DEFAULT_LEVEL 1
+
+typedef void optimizer_pass_t(struct ast_program* program);
+
+enum optimizer_pass {
+#define X(x, _name, _fn, _level) OPTIMIZER_PASS_##x,
+#include "monkey/private/optimizer_passes.inc"
+#undef X
+};
+
+// Replaces calls of small functions with their body when the function called is known: a
+// function literal, or one bound by a let in the enclosing function.
+extern optimizer_pass_t optimize_inline_functions;
+// Replaces infix and prefix expressions over literals with their value.
+extern optimizer_pass_t optimize_fold_constants;
+// Merges the constants of chained additions, subtractions and multiplications, as in
+// `x + 1 + 2` => `x + 3`.
+extern optimizer_pass_t optimize_simplify_algebra;
+// Drops the branches of `if` expressions with a literal condition that can never run.
+extern optimizer_pass_t optimize_prune_branches;
+// Moves the pure expressions a self-recursive function starts every call with out of the
+// recursion when they only read parameters each call passes on unchanged, so that they're
+// evaluated once per outside call.
+extern optimizer_pass_t optimize_hoist_invariants;
+// Evaluates a pure expression that a function body repeats once, where it first appears, and reads
+// its value from a variable after that. Expressions that can make new strings, arrays or hashes
+// aren't shared, since `==` tells them apart.
+extern optimizer_pass_t optimize_eliminate_common_subexpressions;
+// Drops `let`s in function bodies whose name is never used and whose value has no effects.
+extern optimizer_pass_t optimize_remove_unused_lets;
+
+extern struct string optimizer_pass_name(enum optimizer_pass pass);
+
+// Runs every pass enabled at `level`, in order. Level 0 leaves the program alone.
+extern void optimize(struct ast_program* program, int level);
+
+// Sets the level engine_eval() optimizes programs at.
+extern void optimizer_set_level(int level);
+extern int optimizer_level(void);
+
+#endif  // MONKEY_OPTIMIZER_H_
@@ -0,0 +1,22 @@
+#ifndef MONKEY_POOL_H_
+#define MONKEY_POOL_H_
+
+#include <stddef.h>
+
+// Size-class pools for the small fixed-size structs the interpreter makes and frees all the time:
+// objects and heap environments. Each class of POOL_GRANULE bytes keeps a freelist of the blocks
+// freed into it, and carves new blocks out of a slab when it runs dry. Slabs are never returned
+// to the system.
+//
+// Blocks of more than POOL_MAX_SIZE bytes, and all blocks under AddressSanitizer, come straight
+// from malloc(), so the sanitizer still sees every block's lifetime.
+
+#define POOL_GRANULE ((size_t)16)
+#define POOL_MAX_SIZE ((size_t)256)
+
+// Returns an uninitialized block of `size` bytes.
+extern void* pool_alloc(size_t size);
+// Returns a block to its pool; `size` must be the size it was allocated with.
+extern void pool_free(void* block, size_t size);
+
+#endif  // MONKEY_POOL_H_
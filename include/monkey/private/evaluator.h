@@ -0,0 +1,81 @@
+#ifndef MONKEY_PRIVATE_EVALUATOR_H_
+#define MONKEY_PRIVATE_EVALUATOR_H_
+
+// The non-recursive parts of the tree evaluator, shared with the stack evaluator so both give
+// programs the same meaning. Unless noted, functions take ownership of the objects passed in.
+
+#include <iso646.h>
+#include <stdbool.h>
+
+#include "monkey/ast.h"
+#include "monkey/environment.h"
+#include "monkey/object.h"
+
+static inline bool is_error(struct object* obj) {
+    return obj != NULL and object_type(obj) == OBJECT_ERROR;
+}
+
+// Borrows `obj`.
+extern bool is_truthy(struct object* obj);
+
+extern struct object* eval_prefix_expression(enum ast_operator op, struct object* right);
+extern struct object*
+eval_infix_expression(enum ast_operator op, struct object* left, struct object* right);
+extern struct object* eval_index_expression(struct object* left, struct object* index);
+
+// Like the above, but through the fast path the node has specialized itself to, if the operands
+// still have the types it was specialized for.
+extern struct object*
+eval_prefix_quickened(struct ast_prefix_expression* node, struct object* right);
+extern struct object* eval_infix_quickened(
+    struct ast_infix_expression* node,
+    struct object* left,
+    struct object* right
+);
+extern struct object* eval_index_quickened(
+    struct ast_index_expression* node,
+    struct object* left,
+    struct object* index
+);
+extern struct object* eval_identifier(struct ast_identifier* identifier, struct environment* env);
+extern struct object*
+eval_function_literal(struct ast_function_literal* func, struct environment* env);
+extern void
+bind_variable(struct ast_identifier* name, struct object* value, struct environment* env);
+
+// Returns the error for a call with the wrong number of arguments, or NULL. Borrows its arguments.
+extern struct object* check_arguments(struct object_function* function, struct object_buf args);
+// Checks `args` against the parameter types inference found for `function`, giving them up if any
+// argument doesn't match. Borrows its arguments.
+extern void check_parameter_types(struct object_function* function, struct object_buf args);
+// Borrows `fn`.
+extern struct object* not_a_function(struct object* fn);
+// Returns the error for a key that can't be hashed, releasing the key, or NULL.
+extern struct object* check_hash_key(struct object* key);
+
+// Pushes the frame of a call of a function with `locals` slots. If the function creates closures,
+// the `captured` variables they capture get a heap environment of their own between the frame and
+// `outer`, which the closures keep instead of the frame.
+extern struct environment*
+push_call_frame(struct environment* outer, size_t locals, bool escapes, size_t captured);
+
+// Binds `args` for a call to `fn` in a new frame. The frame of the previous call in a chain of
+// tail calls is reused when nothing else refers to it and it has the right shape; otherwise it's
+// released. Borrows `args`.
+extern struct environment* extend_function_env(
+    struct object_function* fn,
+    struct object_buf args,
+    struct environment* previous
+);
+extern struct object* unwrap_return_value(struct object* obj);
+// Makes the tail calls `result` hands back, the first one reusing `env`, then releases the last
+// callee environment.
+extern struct object* finish_call(struct object* result, struct environment* env);
+
+// The tree evaluator's evaluation of a nested expression and its calls, for the JIT to fall back
+// on.
+extern struct object*
+tree_eval_expression(struct ast_expression* expression, struct environment* env);
+extern struct object* tree_apply_function(struct object* fn, struct object_buf args);
+
+#endif  // MONKEY_PRIVATE_EVALUATOR_H_
@@ -17,6 +17,20 @@
 #endif
 #endif
 
+#ifdef __has_feature
+#if __has_feature(address_sanitizer)
+#define MONKEY_ASAN 1
+#endif
+#endif
+
+#if !defined(MONKEY_ASAN) && defined(__SANITIZE_ADDRESS__)
+#define MONKEY_ASAN 1
+#endif
+
+#ifndef MONKEY_ASAN
+#define MONKEY_ASAN 0
+#endif
+
 #ifndef ALLOW_UINT_OVERFLOW
 #define ALLOW_UINT_OVERFLOW
 #endif
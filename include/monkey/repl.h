@@ -1,9 +1,10 @@
 #ifndef MONKEY_REPL_H_
 #define MONKEY_REPL_H_
 
+#include <monkey/engine.h>
 #include <monkey/environment.h>
 #include <stdio.h>
 
-extern void repl_start(FILE* in, FILE* out, struct environment* env);
+extern void repl_start(FILE* in, FILE* out, struct environment* env, enum engine engine);
 
 #endif  // MONKEY_REPL_H_
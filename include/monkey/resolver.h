@@ -0,0 +1,27 @@
+#ifndef MONKEY_RESOLVER_H_
+#define MONKEY_RESOLVER_H_
+
+#include "monkey/ast.h"
+
+// Annotates every identifier under `node` with its lexical address and every function literal
+// with the number of slots its frame and captured variables need. The top level of `node` is the
+// global scope.
+extern void resolve(struct ast_node* node);
+
+// A variable of a function enclosing the one being resolved, `depth` functions out, which is in
+// slot `env_slot` of its call's captured variables.
+struct resolver_outer_name {
+    size_t depth;
+    size_t slot;
+    size_t env_slot;
+    struct string name;
+};
+
+BUF_T(struct resolver_outer_name, resolver_outer_name);
+
+// Resolves `function` as if nested in functions with the variables `outer`. Names found in neither
+// are left unresolved, as globals. Borrows the names.
+extern void
+resolve_nested(struct ast_function_literal* function, struct resolver_outer_name_buf outer);
+
+#endif  // MONKEY_RESOLVER_H_
@@ -0,0 +1,40 @@
+#ifndef MONKEY_SPECIALIZER_H_
+#define MONKEY_SPECIALIZER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "monkey/ast.h"
+#include "monkey/object.h"
+
+// Specialization of functions for the constant arguments of their calls. A call passing integer or
+// boolean literals, or function literals that only refer to globals, runs a version of the callee
+// with those arguments substituted for their parameters and the body optimized again. Versions are
+// made once per function and tuple of constants, and cached on the function body.
+//
+// Strings are never substituted: `==` tells apart the strings each evaluation of a literal makes.
+// Nothing is specialized at optimizer level 0.
+
+#define SPECIALIZER_MAX_VERSIONS 8
+
+struct specializer_stats {
+    // versions made
+    size_t versions;
+    // calls made through a version
+    size_t calls;
+};
+
+extern struct specializer_stats specializer_stats(void);
+
+// Returns the function to make `call` with: `fn`, or a version of it specialized for the call's
+// constant arguments. `*dropped` then marks the arguments the version doesn't take, which needn't
+// be evaluated; otherwise it's NULL. Takes ownership of `fn`.
+extern struct object*
+specialize_callee(struct ast_call_expression* call, struct object* fn, const bool** dropped);
+
+// Like specialize_callee(), for arguments already evaluated: those the version doesn't take are
+// released and removed from `args`.
+extern struct object*
+specialize_call(struct ast_call_expression* call, struct object* fn, struct object_buf* args);
+
+#endif  // MONKEY_SPECIALIZER_H_
@@ -0,0 +1,20 @@
+#ifndef MONKEY_STACK_EVALUATOR_H_
+#define MONKEY_STACK_EVALUATOR_H_
+
+#include <stddef.h>
+
+#include "monkey/ast.h"
+#include "monkey/environment.h"
+#include "monkey/object.h"
+
+#define STACK_EVAL_DEFAULT_BUDGET ((size_t)256 * 1024 * 1024)
+
+// Evaluates like eval(), but keeps pending work on a growable heap stack instead of the C stack,
+// so recursion is only as deep as the stack budget allows.
+extern struct object* stack_eval(struct ast_node* node, struct environment* env);
+
+// Sets how many bytes the evaluation stack may use before evaluation fails with a stack overflow
+// error.
+extern void stack_eval_set_budget(size_t bytes);
+
+#endif  // MONKEY_STACK_EVALUATOR_H_
@@ -0,0 +1,13 @@
+#ifndef MONKEY_THUNK_EVALUATOR_H_
+#define MONKEY_THUNK_EVALUATOR_H_
+
+#include "monkey/ast.h"
+#include "monkey/environment.h"
+#include "monkey/object.h"
+
+// Evaluates like eval(), but first compiles the tree into thunks: one per node, each a call to an
+// evaluator specialized for the node, with its children compiled ahead of it. Function bodies are
+// compiled on their first call and kept with the body.
+extern struct object* thunk_eval(struct ast_node* node, struct environment* env);
+
+#endif  // MONKEY_THUNK_EVALUATOR_H_
@@ -0,0 +1,16 @@
+#ifndef MONKEY_VM_H_
+#define MONKEY_VM_H_
+
+#include "monkey/ast.h"
+#include "monkey/compiler.h"
+#include "monkey/environment.h"
+#include "monkey/object.h"
+
+// Runs compiled bytecode. Globals are read from and written to `globals` by name, so state is
+// shared with the tree-walking evaluator's environment.
+extern struct object* vm_run(const struct bytecode* bytecode, struct environment* globals);
+
+// Compiles `node` and runs it on the VM. Drop-in replacement for eval().
+extern struct object* vm_eval(struct ast_node* node, struct environment* env);
+
+#endif  // MONKEY_VM_H_
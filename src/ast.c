@@ -330,6 +330,9 @@ static size_t block_statement_decref(struct ast_node* node) {
         }
     }
     BUF_FREE(self->statements);
+    if (self->code != NULL) self->code->free(self->code);
+    if (self->versions != NULL) self->versions->free(self->versions);
+    STRING_FREE(self->source);
     return 0;
 }
 
@@ -344,6 +347,9 @@ ast_block_statement_init(struct token token, struct ast_statement_buf statements
     );
     self->token = token;
     self->statements = statements;
+    self->code = NULL;
+    self->versions = NULL;
+    self->source = (struct string){0};
     return self;
 }
 
@@ -366,6 +372,17 @@ static size_t identifier_decref(struct ast_node* node) {
     return 0;
 }
 
+struct string ast_type_string(enum ast_type type) {
+    switch (type) {
+#define X(x, name) \
+    case AST_TYPE_##x: \
+        return STRING_REF(name);
+#include "monkey/private/ast_types.inc"
+#undef X
+    }
+    abort();
+}
+
 struct ast_identifier* ast_identifier_init(struct token token, struct string value) {
     struct ast_identifier* self = malloc(sizeof(*self));
     self->expression = ast_expression_init(
@@ -376,6 +393,9 @@ struct ast_identifier* ast_identifier_init(struct token token, struct string val
     );
     self->token = token;
     self->value = value;
+    self->address = (struct ast_lexical_address){0};
+    self->cache = (struct ast_lookup_cache){0};
+    self->type = AST_TYPE_UNKNOWN;
     return self;
 }
 
@@ -410,6 +430,29 @@ struct ast_integer_literal* ast_integer_literal_init(struct token token, int64_t
     return self;
 }
 
+struct string ast_operator_string(enum ast_operator op) {
+    switch (op) {
+#define X(x) \
+    case AST_OPERATOR_##x: \
+        return token_type_string(TOKEN_##x);
+#include "monkey/private/ast_operators.inc"
+#undef X
+    }
+    abort();
+}
+
+enum ast_operator ast_operator_from_token(enum token_type type) {
+    switch (type) {
+#define X(x) \
+    case TOKEN_##x: \
+        return AST_OPERATOR_##x;
+#include "monkey/private/ast_operators.inc"
+#undef X
+        default:
+            abort();
+    }
+}
+
 static struct string prefix_expression_token_literal(const struct ast_node* node) {
     const struct ast_prefix_expression* self = (const struct ast_prefix_expression*)node;
     return self->token.literal;
@@ -417,7 +460,7 @@ static struct string prefix_expression_token_literal(const struct ast_node* node
 
 static struct string prefix_expression_string(const struct ast_node* node) {
     const struct ast_prefix_expression* self = (const struct ast_prefix_expression*)node;
-    struct string buf = string_printf("(" STRING_FMT, STRING_ARG(self->op));
+    struct string buf = string_printf("(" STRING_FMT, STRING_ARG(ast_operator_string(self->op)));
     struct string right_str = ast_expression_string(self->right);
     string_append(&buf, right_str);
     STRING_FREE(right_str);
@@ -430,7 +473,6 @@ static size_t prefix_expression_decref(struct ast_node* node) {
     if (node->rc > 0) return node->rc;
     auto self = (struct ast_prefix_expression*)node;
     STRING_FREE(self->token.literal);
-    STRING_FREE(self->op);
     if (ast_expression_decref(self->right) == 0) {
         free(self->right);
     }
@@ -438,7 +480,7 @@ static size_t prefix_expression_decref(struct ast_node* node) {
 }
 
 struct ast_prefix_expression*
-ast_prefix_expression_init(struct token token, struct string op, struct ast_expression* right) {
+ast_prefix_expression_init(struct token token, enum ast_operator op, struct ast_expression* right) {
     struct ast_prefix_expression* self = malloc(sizeof(*self));
     self->expression = ast_expression_init(
         AST_EXPRESSION_PREFIX,
@@ -449,6 +491,7 @@ ast_prefix_expression_init(struct token token, struct string op, struct ast_expr
     self->token = token;
     self->op = op;
     self->right = right;
+    self->quickening = (struct ast_quickening){0};
     return self;
 }
 
@@ -463,7 +506,7 @@ static struct string infix_expression_string(const struct ast_node* node) {
     struct string left_str = ast_expression_string(self->left);
     string_append(&buf, left_str);
     STRING_FREE(left_str);
-    string_append_printf(&buf, " " STRING_FMT " ", STRING_ARG(self->op));
+    string_append_printf(&buf, " " STRING_FMT " ", STRING_ARG(ast_operator_string(self->op)));
     struct string right_str = ast_expression_string(self->right);
     string_append(&buf, right_str);
     STRING_FREE(right_str);
@@ -476,7 +519,6 @@ static size_t infix_expression_decref(struct ast_node* node) {
     if (node->rc > 0) return node->rc;
     auto self = (struct ast_infix_expression*)node;
     STRING_FREE(self->token.literal);
-    STRING_FREE(self->op);
     if (ast_expression_decref(self->left) == 0) {
         free(self->left);
     }
@@ -489,7 +531,7 @@ static size_t infix_expression_decref(struct ast_node* node) {
 struct ast_infix_expression* ast_infix_expression_init(
     struct token token,
     struct ast_expression* left,
-    struct string op,
+    enum ast_operator op,
     struct ast_expression* right
 ) {
     struct ast_infix_expression* self = malloc(sizeof(*self));
@@ -503,6 +545,7 @@ struct ast_infix_expression* ast_infix_expression_init(
     self->left = left;
     self->op = op;
     self->right = right;
+    self->quickening = (struct ast_quickening){0};
     return self;
 }
 
@@ -660,6 +703,10 @@ struct ast_function_literal* ast_function_literal_init(
     self->token = token;
     self->parameters = parameters;
     self->body = body;
+    self->locals = 0;
+    self->escapes = true;
+    self->captured = 0;
+    self->return_type = AST_TYPE_UNKNOWN;
     return self;
 }
 
@@ -698,6 +745,7 @@ static size_t call_expression_decref(struct ast_node* node) {
         }
     }
     BUF_FREE(self->arguments);
+    if (self->constants != NULL) self->constants->free(self->constants);
     return 0;
 }
 
@@ -716,6 +764,7 @@ struct ast_call_expression* ast_call_expression_init(
     self->token = token;
     self->function = function;
     self->arguments = arguments;
+    self->constants = NULL;
     return self;
 }
 
@@ -726,7 +775,7 @@ static struct string string_literal_token_literal(const struct ast_node* node) {
 
 static struct string string_literal_string(const struct ast_node* node) {
     auto self = (const struct ast_string_literal*)node;
-    return self->token.literal;
+    return string_dup(self->token.literal);
 }
 
 static size_t string_literal_decref(struct ast_node* node) {
@@ -847,6 +896,7 @@ struct ast_index_expression* ast_index_expression_init(
     self->token = token;
     self->left = left;
     self->index = index;
+    self->quickening = (struct ast_quickening){0};
     return self;
 }
 
@@ -0,0 +1,140 @@
+#include "monkey/builtins.h"
+
+#include <iso646.h>
+
+#include "monkey/buf.h"
+#include "monkey/private/stdc.h"
+
+static struct object* builtin_len(struct object_buf args) {
+    if (args.len != 1) {
+        return object_error_init_base(
+            string_printf("wrong number of arguments. got=%zu, want=1", args.len)
+        );
+    }
+
+    struct object* arg = args.ptr[0];
+    switch (object_type(arg)) {
+        case OBJECT_STRING:
+            return object_int64_init_base(((struct object_string*)arg)->value.length);
+        case OBJECT_ARRAY:
+            return object_int64_init_base(((struct object_array*)arg)->elements.len);
+        default:
+            return object_error_init_base(string_printf(
+                "argument to `len` not supported, got " STRING_FMT,
+                STRING_ARG(object_type_string(object_type(arg)))
+            ));
+    }
+}
+
+static struct object* builtin_first(struct object_buf args) {
+    if (args.len != 1) {
+        return object_error_init_base(
+            string_printf("wrong number of arguments. got=%zu, want=1", args.len)
+        );
+    }
+    if (object_type(args.ptr[0]) != OBJECT_ARRAY) {
+        return object_error_init_base(string_printf(
+            "argument to `first` must be ARRAY, got " STRING_FMT,
+            STRING_ARG(object_type_string(object_type(args.ptr[0])))
+        ));
+    }
+
+    struct object_array* arr = (struct object_array*)args.ptr[0];
+    if (arr->elements.len > 0) {
+        return object_incref(arr->elements.ptr[0]);
+    } else {
+        return object_null_init_base();
+    }
+}
+
+static struct object* builtin_last(struct object_buf args) {
+    if (args.len != 1) {
+        return object_error_init_base(
+            string_printf("wrong number of arguments. got=%zu, want=1", args.len)
+        );
+    }
+    if (object_type(args.ptr[0]) != OBJECT_ARRAY) {
+        return object_error_init_base(string_printf(
+            "argument to `last` must be ARRAY, got " STRING_FMT,
+            STRING_ARG(object_type_string(object_type(args.ptr[0])))
+        ));
+    }
+
+    struct object_array* arr = (struct object_array*)args.ptr[0];
+    if (arr->elements.len > 0) {
+        return object_incref(arr->elements.ptr[arr->elements.len - 1]);
+    } else {
+        return object_null_init_base();
+    }
+}
+
+static struct object* builtin_rest(struct object_buf args) {
+    if (args.len != 1) {
+        return object_error_init_base(
+            string_printf("wrong number of arguments. got=%zu, want=1", args.len)
+        );
+    }
+    if (object_type(args.ptr[0]) != OBJECT_ARRAY) {
+        return object_error_init_base(string_printf(
+            "argument to `rest` must be ARRAY, got " STRING_FMT,
+            STRING_ARG(object_type_string(object_type(args.ptr[0])))
+        ));
+    }
+
+    struct object_array* arr = (struct object_array*)args.ptr[0];
+    if (arr->elements.len > 0) {
+        struct object_buf elements = {0};
+        BUF_RESERVE(&elements, arr->elements.len - 1);
+        for (size_t i = 1; i < arr->elements.len; i += 1) {
+            BUF_PUSH(&elements, object_incref(arr->elements.ptr[i]));
+        }
+        return object_array_init_base(elements);
+    } else {
+        return object_null_init_base();
+    }
+}
+
+static struct object* builtin_push(struct object_buf args) {
+    if (args.len != 2) {
+        return object_error_init_base(
+            string_printf("wrong number of arguments. got=%zu, want=2", args.len)
+        );
+    }
+    if (object_type(args.ptr[0]) != OBJECT_ARRAY) {
+        return object_error_init_base(string_printf(
+            "argument to `push` must be ARRAY, got " STRING_FMT,
+            STRING_ARG(object_type_string(object_type(args.ptr[0])))
+        ));
+    }
+
+    struct object_array* arr = (struct object_array*)args.ptr[0];
+    size_t len = arr->elements.len;
+    struct object_buf elements = {0};
+    BUF_RESERVE(&elements, len + 1);
+    for (size_t i = 0; i < len; i += 1) {
+        BUF_PUSH(&elements, object_incref(arr->elements.ptr[i]));
+    }
+    BUF_PUSH(&elements, object_incref(args.ptr[1]));
+    return object_array_init_base(elements);
+}
+
+enum builtin {
+#define X(x) BUILTIN_##x,
+#include "monkey/private/builtin_names.inc"
+#undef X
+    BUILTIN_COUNT,
+};
+
+// Builtins are immortal: each is made once, the first time it's bound, and shared by every
+// environment after that.
+static struct object* builtins[BUILTIN_COUNT];
+
+void builtins_define(struct environment* env) {
+#define X(x) \
+    if (builtins[BUILTIN_##x] == NULL) { \
+        builtins[BUILTIN_##x] = object_make_immortal(object_builtin_init_base(&builtin_##x)); \
+    } \
+    environment_set(env, STRING_REF(#x), builtins[BUILTIN_##x]);
+#include "monkey/private/builtin_names.inc"
+#undef X
+}
@@ -0,0 +1,549 @@
+#include "monkey/c_emitter.h"
+
+#include <inttypes.h>
+#include <iso646.h>
+#include <stdint.h>
+
+#include "monkey/object.h"
+#include "monkey/optimizer.h"
+#include "monkey/private/stdc.h"
+#include "monkey/resolver.h"
+
+// The value of a statement that leaves none, such as an empty block.
+#define NO_VALUE SIZE_MAX
+
+// Where a node sits in the function being emitted, as in the tree evaluator. A call whose value
+// is the function's result hands itself back to native_call() as a tail call.
+enum position {
+    POSITION_PLAIN,
+    POSITION_BODY,
+    POSITION_TAIL,
+};
+
+// The C function being emitted. Values live in the temporaries `t`, each owned until MOVE()
+// takes it, and whatever is left is released at `exit`.
+struct function {
+    struct string code;
+    size_t temps;
+    int depth;
+    bool exits;
+    // whether it's a function literal's, rather than the program's
+    bool nested;
+};
+
+struct emitter {
+    struct string prototypes;
+    struct string functions;
+    size_t count;
+    struct function* fn;
+};
+
+static const char* const operator_names[] = {
+#define X(x) [AST_OPERATOR_##x] = "AST_OPERATOR_" #x,
+#include "monkey/private/ast_operators.inc"
+#undef X
+};
+
+#define LINE(e, ...) \
+    do { \
+        string_append_printf(&(e)->fn->code, "%*s", (e)->fn->depth * 4, ""); \
+        string_append_printf(&(e)->fn->code, __VA_ARGS__); \
+        string_append(&(e)->fn->code, STRING_REF("\n")); \
+    } while (false)
+
+// Appends `s` as a C string literal.
+static void append_literal(struct string* out, struct string s) {
+    string_append(out, STRING_REF("\""));
+    for (size_t i = 0; i < s.length; i++) {
+        unsigned char c = (unsigned char)s.data[i];
+        if (c == '"' or c == '\\') {
+            string_append_printf(out, "\\%c", c);
+        } else if (c >= ' ' and c <= '~') {
+            string_append_printf(out, "%c", c);
+        } else {
+            // always three digits, so a digit that follows isn't taken into the escape
+            string_append_printf(out, "\\%03o", c);
+        }
+    }
+    string_append(out, STRING_REF("\""));
+}
+
+static struct string literal(struct string s) {
+    struct string out = {0};
+    append_literal(&out, s);
+    return out;
+}
+
+static size_t temp(struct emitter* e) {
+    return e->fn->temps++;
+}
+
+static void check(struct emitter* e, size_t t) {
+    LINE(e, "CHECK(t[%zu]);", t);
+    e->fn->exits = true;
+}
+
+static size_t emit_expression(struct emitter* e, struct ast_expression* expression, enum position);
+static size_t emit_block(
+    struct emitter* e,
+    struct ast_block_statement* block,
+    enum position position,
+    bool want_value
+);
+
+// Emits each of `expressions` into a temporary and returns the expression for a buffer of their
+// values, for a callee that takes them.
+static struct string emit_values(struct emitter* e, struct ast_expression_buf expressions) {
+    struct string values = {0};
+    if (expressions.len == 0) {
+        string_append(&values, STRING_REF("(struct object_buf){0}"));
+        return values;
+    }
+    string_append(&values, STRING_REF("BUF_LIT(struct object_buf"));
+    for (size_t i = 0; i < expressions.len; i++) {
+        size_t t = emit_expression(e, expressions.ptr[i], POSITION_PLAIN);
+        string_append_printf(&values, ", MOVE(t[%zu])", t);
+    }
+    string_append(&values, STRING_REF(")"));
+    return values;
+}
+
+static size_t emit_function(struct emitter* e, struct ast_function_literal* function);
+
+// The environment a variable the current function binds is in: its frame, or the environment of
+// its captured variables after it.
+static const char* variable_env(struct ast_lexical_address address) {
+    return address.env_depth == 0 ? "env" : "env->outer";
+}
+
+static size_t emit_identifier(struct emitter* e, struct ast_identifier* identifier) {
+    size_t t = temp(e);
+    struct string name = literal(identifier->value);
+    if (identifier->address.resolved) {
+        LINE(
+            e,
+            "t[%zu] = native_slot(env, %zu, %zu, STRING_REF(" STRING_FMT "));",
+            t,
+            identifier->address.env_depth,
+            identifier->address.env_slot,
+            STRING_ARG(name)
+        );
+    } else {
+        LINE(e, "t[%zu] = native_name(env, STRING_REF(" STRING_FMT "));", t, STRING_ARG(name));
+    }
+    STRING_FREE(name);
+    check(e, t);
+    return t;
+}
+
+static const char* infix_function(enum ast_operator op) {
+    switch (op) {
+        case AST_OPERATOR_PLUS:
+            return "native_add";
+        case AST_OPERATOR_MINUS:
+            return "native_sub";
+        case AST_OPERATOR_ASTERISK:
+            return "native_mul";
+        case AST_OPERATOR_SLASH:
+            return "native_div";
+        case AST_OPERATOR_LT:
+            return "native_less_than";
+        case AST_OPERATOR_GT:
+            return "native_greater_than";
+        case AST_OPERATOR_EQ:
+            return "native_equal";
+        case AST_OPERATOR_NOT_EQ:
+            return "native_not_equal";
+        default:
+            return NULL;
+    }
+}
+
+static size_t emit_infix(struct emitter* e, struct ast_infix_expression* infix) {
+    size_t left = emit_expression(e, infix->left, POSITION_PLAIN);
+    size_t right = emit_expression(e, infix->right, POSITION_PLAIN);
+    size_t t = temp(e);
+    const char* function = infix_function(infix->op);
+    if (function != NULL) {
+        LINE(e, "t[%zu] = %s(MOVE(t[%zu]), MOVE(t[%zu]));", t, function, left, right);
+    } else {
+        LINE(
+            e,
+            "t[%zu] = native_infix(%s, MOVE(t[%zu]), MOVE(t[%zu]));",
+            t,
+            operator_names[infix->op],
+            left,
+            right
+        );
+    }
+    check(e, t);
+    return t;
+}
+
+static size_t emit_prefix(struct emitter* e, struct ast_prefix_expression* prefix) {
+    size_t right = emit_expression(e, prefix->right, POSITION_PLAIN);
+    size_t t = temp(e);
+    if (prefix->op == AST_OPERATOR_MINUS) {
+        LINE(e, "t[%zu] = native_negate(MOVE(t[%zu]));", t, right);
+    } else {
+        LINE(
+            e,
+            "t[%zu] = native_prefix(%s, MOVE(t[%zu]));",
+            t,
+            operator_names[prefix->op],
+            right
+        );
+    }
+    check(e, t);
+    return t;
+}
+
+static size_t emit_if(struct emitter* e, struct ast_if_expression* exp, enum position position) {
+    size_t condition = emit_expression(e, exp->condition, POSITION_PLAIN);
+    size_t t = temp(e);
+    LINE(e, "if (native_truthy(MOVE(t[%zu]))) {", condition);
+    e->fn->depth++;
+    size_t value = emit_block(e, exp->consequence, position, true);
+    if (value != NO_VALUE) LINE(e, "t[%zu] = MOVE(t[%zu]);", t, value);
+    e->fn->depth--;
+    LINE(e, "} else {");
+    e->fn->depth++;
+    if (exp->alternative != NULL) {
+        value = emit_block(e, exp->alternative, position, true);
+        if (value != NO_VALUE) LINE(e, "t[%zu] = MOVE(t[%zu]);", t, value);
+    } else {
+        LINE(e, "t[%zu] = object_null_init_base();", t);
+    }
+    e->fn->depth--;
+    LINE(e, "}");
+    return t;
+}
+
+static size_t
+emit_call(struct emitter* e, struct ast_call_expression* call, enum position position) {
+    size_t function = emit_expression(e, call->function, POSITION_PLAIN);
+    struct string args = emit_values(e, call->arguments);
+    size_t t = temp(e);
+    if (position == POSITION_TAIL) {
+        LINE(
+            e,
+            "t[%zu] = object_tail_call_init_base(MOVE(t[%zu]), " STRING_FMT ");",
+            t,
+            function,
+            STRING_ARG(args)
+        );
+    } else {
+        LINE(
+            e,
+            "t[%zu] = native_call(MOVE(t[%zu]), " STRING_FMT ");",
+            t,
+            function,
+            STRING_ARG(args)
+        );
+        check(e, t);
+    }
+    STRING_FREE(args);
+    return t;
+}
+
+static size_t emit_hash(struct emitter* e, struct ast_hash_literal* hash) {
+    size_t t = temp(e);
+    LINE(e, "t[%zu] = native_hash();", t);
+    for (const struct ast_expression_hash_bucket* bucket = ast_expression_hash_first(&hash->pairs);
+         bucket != NULL;
+         bucket = ast_expression_hash_next(&hash->pairs, bucket)) {
+        size_t key = emit_expression(e, bucket->key, POSITION_PLAIN);
+        size_t error = temp(e);
+        LINE(e, "t[%zu] = native_check_hash_key(t[%zu]);", error, key);
+        check(e, error);
+        size_t value = emit_expression(e, bucket->value, POSITION_PLAIN);
+        LINE(e, "native_hash_insert(t[%zu], MOVE(t[%zu]), MOVE(t[%zu]));", t, key, value);
+    }
+    return t;
+}
+
+// Emits `expression` into a temporary and returns it. Only conditionals and calls care about
+// their position.
+static size_t
+emit_expression(struct emitter* e, struct ast_expression* expression, enum position position) {
+    switch (expression->type) {
+        case AST_EXPRESSION_INTEGER_LITERAL: {
+            int64_t value = ((struct ast_integer_literal*)expression)->value;
+            size_t t = temp(e);
+            if (value == INT64_MIN) {
+                LINE(e, "t[%zu] = object_int64_init_base(INT64_MIN);", t);
+            } else {
+                LINE(e, "t[%zu] = object_int64_init_base(INT64_C(%" PRId64 "));", t, value);
+            }
+            return t;
+        }
+        case AST_EXPRESSION_BOOLEAN: {
+            size_t t = temp(e);
+            bool value = ((struct ast_boolean*)expression)->value;
+            LINE(e, "t[%zu] = object_boolean_init_base(%s);", t, value ? "true" : "false");
+            return t;
+        }
+        case AST_EXPRESSION_STRING: {
+            size_t t = temp(e);
+            struct string value = literal(((struct ast_string_literal*)expression)->value);
+            LINE(
+                e,
+                "t[%zu] = object_string_init_base(string_dup(STRING_REF(" STRING_FMT ")));",
+                t,
+                STRING_ARG(value)
+            );
+            STRING_FREE(value);
+            return t;
+        }
+        case AST_EXPRESSION_IDENTIFIER:
+            return emit_identifier(e, (struct ast_identifier*)expression);
+        case AST_EXPRESSION_PREFIX:
+            return emit_prefix(e, (struct ast_prefix_expression*)expression);
+        case AST_EXPRESSION_INFIX:
+            return emit_infix(e, (struct ast_infix_expression*)expression);
+        case AST_EXPRESSION_IF:
+            return emit_if(e, (struct ast_if_expression*)expression, position);
+        case AST_EXPRESSION_FUNCTION:
+            return emit_function(e, (struct ast_function_literal*)expression);
+        case AST_EXPRESSION_CALL:
+            return emit_call(e, (struct ast_call_expression*)expression, position);
+        case AST_EXPRESSION_ARRAY: {
+            auto array = (struct ast_array_literal*)expression;
+            struct string elements = emit_values(e, array->elements);
+            size_t t = temp(e);
+            LINE(e, "t[%zu] = object_array_init_base(" STRING_FMT ");", t, STRING_ARG(elements));
+            STRING_FREE(elements);
+            return t;
+        }
+        case AST_EXPRESSION_INDEX: {
+            auto exp = (struct ast_index_expression*)expression;
+            size_t left = emit_expression(e, exp->left, POSITION_PLAIN);
+            size_t index = emit_expression(e, exp->index, POSITION_PLAIN);
+            size_t t = temp(e);
+            LINE(e, "t[%zu] = native_index(MOVE(t[%zu]), MOVE(t[%zu]));", t, left, index);
+            check(e, t);
+            return t;
+        }
+        case AST_EXPRESSION_HASH:
+            return emit_hash(e, (struct ast_hash_literal*)expression);
+    }
+    abort();
+}
+
+// Emits `statement` and returns the temporary holding its value, or NO_VALUE when it leaves none
+// or `want_value` is false.
+static size_t emit_statement(
+    struct emitter* e,
+    struct ast_statement* statement,
+    enum position position,
+    bool want_value
+) {
+    switch (statement->type) {
+        case AST_STATEMENT_EXPRESSION: {
+            struct ast_expression* expression =
+                ((struct ast_expression_statement*)statement)->expression;
+            size_t t = emit_expression(e, expression, position);
+            if (want_value) return t;
+            LINE(e, "object_decref(MOVE(t[%zu]));", t);
+            return NO_VALUE;
+        }
+        case AST_STATEMENT_BLOCK:
+            return emit_block(e, (struct ast_block_statement*)statement, position, want_value);
+        case AST_STATEMENT_RETURN: {
+            // leaving the C function ends the call, or the program at the top level
+            size_t t = emit_expression(
+                e,
+                ((struct ast_return_statement*)statement)->return_value,
+                position == POSITION_PLAIN ? POSITION_PLAIN : POSITION_TAIL
+            );
+            LINE(e, "result = MOVE(t[%zu]);", t);
+            LINE(e, "goto exit;");
+            e->fn->exits = true;
+            return NO_VALUE;
+        }
+        case AST_STATEMENT_LET: {
+            auto let = (struct ast_let_statement*)statement;
+            size_t value = emit_expression(e, let->value, POSITION_PLAIN);
+            if (let->name->address.resolved) {
+                LINE(
+                    e,
+                    "environment_set_slot(%s, %zu, MOVE(t[%zu]));",
+                    variable_env(let->name->address),
+                    let->name->address.env_slot,
+                    value
+                );
+            } else {
+                struct string name = literal(let->name->value);
+                LINE(
+                    e,
+                    "environment_set(env, string_dup(STRING_REF(" STRING_FMT ")), MOVE(t[%zu]));",
+                    STRING_ARG(name),
+                    value
+                );
+                STRING_FREE(name);
+            }
+            if (!want_value) return NO_VALUE;
+            size_t t = temp(e);
+            LINE(e, "t[%zu] = object_null_init_base();", t);
+            return t;
+        }
+    }
+    abort();
+}
+
+static size_t emit_block(
+    struct emitter* e,
+    struct ast_block_statement* block,
+    enum position position,
+    bool want_value
+) {
+    size_t value = NO_VALUE;
+    for (size_t i = 0; i < block->statements.len; i++) {
+        bool last = i + 1 == block->statements.len;
+        // only the last statement inherits the tail position
+        enum position statement_position =
+            position == POSITION_TAIL and !last ? POSITION_BODY : position;
+        value = emit_statement(
+            e,
+            block->statements.ptr[i],
+            statement_position,
+            want_value and last
+        );
+    }
+    return value;
+}
+
+static void begin_function(struct emitter* e, struct function* fn) {
+    *fn = (struct function){.depth = 1, .nested = e->fn != NULL};
+    e->fn = fn;
+}
+
+// Appends the finished function `name` to the output and returns to `outer`.
+static void
+end_function(struct emitter* e, const char* name, size_t value, struct function* outer) {
+    struct function* fn = e->fn;
+    if (value != NO_VALUE) LINE(e, "result = MOVE(t[%zu]);", value);
+    size_t temps = fn->temps > 0 ? fn->temps : 1;
+    string_append_printf(
+        &e->prototypes,
+        "static struct object* %s(struct environment* env, struct object_buf args);\n",
+        name
+    );
+    string_append_printf(
+        &e->functions,
+        "\nstatic struct object* %s(struct environment* env, struct object_buf args) {\n"
+        "    (void)env;\n"
+        "    (void)args;\n"
+        "    struct object* result = NULL;\n"
+        "    struct object* t[%zu] = {0};\n",
+        name,
+        temps
+    );
+    string_append(&e->functions, fn->code);
+    string_append_printf(
+        &e->functions,
+        "%s    native_release(t, %zu);\n"
+        "    return result;\n"
+        "}\n",
+        fn->exits ? "exit:\n" : "",
+        temps
+    );
+    STRING_FREE(fn->code);
+    e->fn = outer;
+}
+
+// Emits the function as a C function of its own, and its creation in the current one.
+static size_t emit_function(struct emitter* e, struct ast_function_literal* function) {
+    struct function* outer = e->fn;
+    char name[32];
+    snprintf(name, sizeof(name), "fn_%zu", e->count++);
+
+    struct function fn;
+    begin_function(e, &fn);
+    for (size_t i = 0; i < function->parameters.len; i++) {
+        struct ast_lexical_address address = function->parameters.ptr[i]->address;
+        LINE(
+            e,
+            "environment_set_slot(%s, %zu, object_incref(args.ptr[%zu]));",
+            variable_env(address),
+            address.env_slot,
+            i
+        );
+    }
+    size_t value = emit_block(e, function->body, POSITION_TAIL, true);
+    end_function(e, name, value, outer);
+
+    size_t t = temp(e);
+    struct string source = object_function_inspect_parts(function->parameters, function->body);
+    struct string source_literal = literal(source);
+    LINE(
+        e,
+        "t[%zu] = object_native_function_init_base(%s, %zu, %zu, %s, %zu, STRING_REF(" STRING_FMT
+        "), %s);",
+        t,
+        name,
+        function->parameters.len,
+        function->locals,
+        function->escapes ? "true" : "false",
+        function->captured,
+        STRING_ARG(source_literal),
+        // made in a call, a closure keeps the call's captured variables rather than its frame
+        outer->nested ? "env->outer" : "env"
+    );
+    STRING_FREE(source_literal);
+    STRING_FREE(source);
+    return t;
+}
+
+struct string emit_c(struct ast_program* program) {
+    optimize(program, optimizer_level());
+    resolve(&program->node);
+
+    struct emitter e = {0};
+    struct function fn;
+    begin_function(&e, &fn);
+    size_t value = NO_VALUE;
+    for (size_t i = 0; i < program->statements.len; i++) {
+        bool last = i + 1 == program->statements.len;
+        value = emit_statement(&e, program->statements.ptr[i], POSITION_PLAIN, last);
+    }
+    end_function(&e, "program", value, NULL);
+
+    struct string out = string_dup(STRING_REF(
+        "// Generated by monkey --emit-c. Compile with the flags in Tuprules.tup and link with\n"
+        "// libmonkey.a.\n"
+        "#include <monkey/native.h>\n"
+        "\n"
+        "// Takes the value out of a temporary, leaving nothing for the exit to release.\n"
+        "#define MOVE(x) \\\n"
+        "    ({ \\\n"
+        "        struct object* moved_ = (x); \\\n"
+        "        (x) = NULL; \\\n"
+        "        moved_; \\\n"
+        "    })\n"
+        "\n"
+        "// An error ends the function, and with it every function up to the program.\n"
+        "#define CHECK(x) \\\n"
+        "    do { \\\n"
+        "        if (native_is_error(x)) { \\\n"
+        "            result = MOVE(x); \\\n"
+        "            goto exit; \\\n"
+        "        } \\\n"
+        "    } while (false)\n"
+        "\n"
+    ));
+    string_append(&out, e.prototypes);
+    string_append(&out, e.functions);
+    string_append(
+        &out,
+        STRING_REF(
+            "\n"
+            "int main(void) {\n"
+            "    return native_main(program);\n"
+            "}\n"
+        )
+    );
+    STRING_FREE(e.prototypes);
+    STRING_FREE(e.functions);
+    return out;
+}
@@ -0,0 +1,87 @@
+#include "monkey/code.h"
+
+#include <iso646.h>
+#include <stdlib.h>
+
+static const struct opcode_definition definitions[] = {
+#define X(x, count, w0, w1) \
+    [OP_##x] = {.name = STRING_REF_C(#x), .operand_count = (count), .operand_widths = {(w0), (w1)}},
+#include "monkey/private/opcode_types.inc"
+#undef X
+};
+
+const struct opcode_definition* opcode_lookup(uint8_t op) {
+    if (op >= sizeof(definitions) / sizeof(*definitions)) {
+        return NULL;
+    }
+    return &definitions[op];
+}
+
+size_t code_make(struct instruction_buf* ins, enum opcode op, size_t a, size_t b) {
+    const struct opcode_definition* def = &definitions[op];
+    size_t position = ins->len;
+    size_t operands[2] = {a, b};
+
+    BUF_PUSH(ins, (uint8_t)op);
+    for (size_t i = 0; i < def->operand_count; i++) {
+        switch (def->operand_widths[i]) {
+            case 2:
+                BUF_PUSH(ins, (uint8_t)(operands[i] >> 8));
+                BUF_PUSH(ins, (uint8_t)(operands[i] & 0xff));
+                break;
+            case 1:
+                BUF_PUSH(ins, (uint8_t)operands[i]);
+                break;
+            default:
+                abort();
+        }
+    }
+    return position;
+}
+
+size_t code_read_operands(
+    const struct opcode_definition* def,
+    const uint8_t* ins,
+    size_t operands[2]
+) {
+    size_t offset = 0;
+    for (size_t i = 0; i < def->operand_count; i++) {
+        switch (def->operand_widths[i]) {
+            case 2:
+                operands[i] = code_read_u16(ins + offset);
+                break;
+            case 1:
+                operands[i] = ins[offset];
+                break;
+            default:
+                abort();
+        }
+        offset += def->operand_widths[i];
+    }
+    return offset;
+}
+
+struct string code_instructions_string(struct instruction_buf ins) {
+    struct string out = {0};
+    size_t i = 0;
+    while (i < ins.len) {
+        const struct opcode_definition* def = opcode_lookup(ins.ptr[i]);
+        if (def == NULL) {
+            string_append_printf(&out, "ERROR: unknown opcode %u\n", ins.ptr[i]);
+            i++;
+            continue;
+        }
+
+        size_t operands[2] = {0};
+        size_t read = code_read_operands(def, ins.ptr + i + 1, operands);
+
+        string_append_printf(&out, "%04zu " STRING_FMT, i, STRING_ARG(def->name));
+        for (size_t j = 0; j < def->operand_count; j++) {
+            string_append_printf(&out, " %zu", operands[j]);
+        }
+        string_append(&out, STRING_REF("\n"));
+
+        i += 1 + read;
+    }
+    return out;
+}
@@ -0,0 +1,455 @@
+#include "monkey/compiler.h"
+
+#include <iso646.h>
+#include <stdint.h>
+
+#include "monkey/private/stdc.h"
+#include "monkey/resolver.h"
+
+static struct compilation_scope* current_scope(struct compiler* c) {
+    return &c->scopes.ptr[c->scopes.len - 1];
+}
+
+static struct instruction_buf* current_instructions(struct compiler* c) {
+    return &current_scope(c)->instructions;
+}
+
+static void enter_scope(struct compiler* c) {
+    struct compilation_scope scope = {0};
+    BUF_PUSH(&c->scopes, scope);
+}
+
+static void compilation_scope_free(struct compilation_scope scope) {
+    BUF_FREE(scope.instructions);
+    for (size_t i = 0; i < scope.constants.len; i++) {
+        object_decref(scope.constants.ptr[i]);
+    }
+    BUF_FREE(scope.constants);
+    BUF_FREE(scope.global_names);
+}
+
+// Pops the current scope; the caller takes over its instructions and constants.
+static struct compilation_scope leave_scope(struct compiler* c) {
+    struct compilation_scope scope = *current_scope(c);
+    BUF_FREE(scope.global_names);
+    c->scopes.len--;
+    return scope;
+}
+
+void compiler_init(struct compiler* c) {
+    *c = (struct compiler){0};
+    enter_scope(c);
+}
+
+void compiler_deinit(struct compiler* c) {
+    for (size_t i = 0; i < c->scopes.len; i++) {
+        compilation_scope_free(c->scopes.ptr[i]);
+    }
+    BUF_FREE(c->scopes);
+    for (size_t i = 0; i < c->errors.len; i++) {
+        STRING_FREE(c->errors.ptr[i]);
+    }
+    BUF_FREE(c->errors);
+}
+
+static void error(struct compiler* c, struct string message) {
+    BUF_PUSH(&c->errors, message);
+}
+
+static size_t add_constant(struct compiler* c, struct object* obj) {
+    struct object_buf* constants = &current_scope(c)->constants;
+    if (constants->len > UINT16_MAX) {
+        error(c, string_printf("too many constants"));
+    }
+    BUF_PUSH(constants, obj);
+    return constants->len - 1;
+}
+
+static size_t emit(struct compiler* c, enum opcode op, size_t a, size_t b) {
+    struct compilation_scope* scope = current_scope(c);
+    size_t position = code_make(&scope->instructions, op, a, b);
+    scope->previous = scope->last;
+    scope->last = (struct emitted_instruction){.opcode = op, .position = position};
+    return position;
+}
+
+static bool last_instruction_is(struct compiler* c, enum opcode op, size_t since) {
+    struct compilation_scope* scope = current_scope(c);
+    return scope->instructions.len > since and scope->last.position >= since and
+        scope->last.opcode == op;
+}
+
+static void remove_last_pop(struct compiler* c) {
+    struct compilation_scope* scope = current_scope(c);
+    scope->instructions.len = scope->last.position;
+    scope->last = scope->previous;
+}
+
+static void replace_last_pop_with_return(struct compiler* c) {
+    struct compilation_scope* scope = current_scope(c);
+    scope->instructions.ptr[scope->last.position] = OP_RETURN_VALUE;
+    scope->last.opcode = OP_RETURN_VALUE;
+}
+
+static void patch_jump(struct compiler* c, size_t position) {
+    struct instruction_buf* ins = current_instructions(c);
+    if (ins->len > UINT16_MAX) {
+        error(c, string_printf("function too large to compile"));
+        return;
+    }
+    code_write_u16(ins->ptr + position + 1, (uint16_t)ins->len);
+}
+
+static size_t global_name_index(struct compiler* c, struct string name) {
+    struct global_name_buf* global_names = &current_scope(c)->global_names;
+    for (size_t i = 0; i < global_names->len; i++) {
+        if (STRING_EQUAL(global_names->ptr[i].name, name)) {
+            return global_names->ptr[i].index;
+        }
+    }
+    auto str = (struct object_string*)object_string_init_base(string_dup(name));
+    size_t index = add_constant(c, &str->object);
+    struct global_name global_name = {.name = str->value, .index = index};
+    BUF_PUSH(global_names, global_name);
+    return index;
+}
+
+// Variables are where the resolver put them, as in the tree evaluator: globals by name, the
+// variables closures capture in the environment the calls creating the closures share with them,
+// and every other variable in its call's frame on the stack.
+static void load_variable(struct compiler* c, struct ast_identifier* identifier) {
+    struct ast_lexical_address address = identifier->address;
+    if (!address.resolved) {
+        emit(c, OP_GET_GLOBAL, global_name_index(c, identifier->value), 0);
+    } else if (address.env_depth == 0) {
+        emit(c, OP_GET_LOCAL, address.env_slot, 0);
+    } else {
+        if (address.env_depth - 1 > UINT8_MAX) {
+            error(c, string_printf("functions nested too deeply"));
+        }
+        emit(c, OP_GET_CAPTURED, address.env_depth - 1, address.env_slot);
+    }
+}
+
+// Binds the variable `name` declares to the value on top of the stack.
+static void store_variable(struct compiler* c, struct ast_identifier* name) {
+    struct ast_lexical_address address = name->address;
+    if (!address.resolved) {
+        emit(c, OP_SET_GLOBAL, global_name_index(c, name->value), 0);
+    } else if (address.env_depth == 0) {
+        emit(c, OP_SET_LOCAL, address.env_slot, 0);
+    } else {
+        emit(c, OP_SET_CAPTURED, address.env_slot, 0);
+    }
+}
+
+static void compile_statement(struct compiler* c, struct ast_statement* statement);
+static void compile_expression(struct compiler* c, struct ast_expression* expression);
+static void compile_if(struct compiler* c, struct ast_if_expression* exp);
+
+// Compiles the expression of a statement. An `if` there ends the call when one of its blocks
+// returns; anywhere else, the `return` only makes its value.
+static void compile_statement_expression(struct compiler* c, struct ast_expression* expression) {
+    if (expression->type == AST_EXPRESSION_IF) {
+        compile_if(c, (struct ast_if_expression*)expression);
+    } else {
+        compile_expression(c, expression);
+    }
+}
+
+// Jumps to the end of the `if` nested in an expression a `return` in it is the value of.
+static void emit_return_jump(struct compiler* c, enum opcode op) {
+    BUF_PUSH(current_scope(c)->returns, emit(c, op, 0xffff, 0));
+}
+
+static void compile_block(struct compiler* c, struct ast_block_statement* block) {
+    for (size_t i = 0; i < block->statements.len; i++) {
+        compile_statement(c, block->statements.ptr[i]);
+    }
+}
+
+// Compiles a block whose value is needed, leaving exactly one value on the stack.
+static void compile_block_value(struct compiler* c, struct ast_block_statement* block) {
+    size_t start = current_instructions(c)->len;
+    compile_block(c, block);
+    if (last_instruction_is(c, OP_POP, start)) {
+        remove_last_pop(c);
+    } else {
+        emit(c, OP_NULL, 0, 0);
+    }
+}
+
+// Turns the current scope into a function body: the value of the last expression statement is
+// returned, and anything else returns null.
+static void finish_body(struct compiler* c, size_t start) {
+    if (last_instruction_is(c, OP_POP, start)) {
+        replace_last_pop_with_return(c);
+    }
+    if (!last_instruction_is(c, OP_RETURN_VALUE, start)) {
+        emit(c, OP_RETURN, 0, 0);
+    }
+}
+
+static void compile_function_literal(struct compiler* c, struct ast_function_literal* literal) {
+    enter_scope(c);
+    // the arguments arrive in the first slots; move those whose parameter is captured, or repeated
+    // and so bound to the slot of its first occurrence
+    struct function_parameter_buf parameters = literal->parameters;
+    for (size_t i = 0; i < parameters.len; i++) {
+        struct ast_lexical_address address = parameters.ptr[i]->address;
+        if (address.env_depth == 0 and address.env_slot == i) continue;
+        emit(c, OP_GET_LOCAL, i, 0);
+        store_variable(c, parameters.ptr[i]);
+    }
+
+    compile_block(c, literal->body);
+    finish_body(c, 0);
+    struct compilation_scope scope = leave_scope(c);
+
+    size_t num_locals = literal->locals > parameters.len ? literal->locals : parameters.len;
+    if (num_locals > UINT8_MAX) {
+        error(c, string_printf("too many local bindings in function"));
+    }
+    if (literal->captured > UINT8_MAX) {
+        error(c, string_printf("too many captured variables in function"));
+    }
+
+    struct compiled_function* fn = compiled_function_init(
+        scope.instructions,
+        scope.constants,
+        num_locals,
+        parameters.len,
+        literal
+    );
+    size_t index = add_constant(c, object_compiled_function_init_base(fn));
+    emit(c, OP_CLOSURE, index, 0);
+}
+
+static bool infix_opcode(enum ast_operator op, enum opcode* out) {
+    switch (op) {
+        case AST_OPERATOR_PLUS:
+            *out = OP_ADD;
+            return true;
+        case AST_OPERATOR_MINUS:
+            *out = OP_SUB;
+            return true;
+        case AST_OPERATOR_ASTERISK:
+            *out = OP_MUL;
+            return true;
+        case AST_OPERATOR_SLASH:
+            *out = OP_DIV;
+            return true;
+        case AST_OPERATOR_EQ:
+            *out = OP_EQUAL;
+            return true;
+        case AST_OPERATOR_NOT_EQ:
+            *out = OP_NOT_EQUAL;
+            return true;
+        case AST_OPERATOR_GT:
+            *out = OP_GREATER_THAN;
+            return true;
+        case AST_OPERATOR_LT:
+            *out = OP_LESS_THAN;
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void compile_expression(struct compiler* c, struct ast_expression* expression) {
+    switch (expression->type) {
+        case AST_EXPRESSION_INTEGER_LITERAL: {
+            auto lit = (struct ast_integer_literal*)expression;
+            emit(c, OP_CONSTANT, add_constant(c, object_int64_init_base(lit->value)), 0);
+            break;
+        }
+        case AST_EXPRESSION_BOOLEAN:
+            emit(c, ((struct ast_boolean*)expression)->value ? OP_TRUE : OP_FALSE, 0, 0);
+            break;
+        case AST_EXPRESSION_STRING: {
+            auto lit = (struct ast_string_literal*)expression;
+            struct object* str = object_string_init_base(string_dup(lit->value));
+            emit(c, OP_CONSTANT, add_constant(c, str), 0);
+            break;
+        }
+        case AST_EXPRESSION_PREFIX: {
+            auto exp = (struct ast_prefix_expression*)expression;
+            compile_expression(c, exp->right);
+            if (exp->op == AST_OPERATOR_BANG) {
+                emit(c, OP_BANG, 0, 0);
+            } else if (exp->op == AST_OPERATOR_MINUS) {
+                emit(c, OP_MINUS, 0, 0);
+            } else {
+                error(
+                    c,
+                    string_printf(
+                        "unknown operator " STRING_FMT,
+                        STRING_ARG(ast_operator_string(exp->op))
+                    )
+                );
+            }
+            break;
+        }
+        case AST_EXPRESSION_INFIX: {
+            auto exp = (struct ast_infix_expression*)expression;
+            enum opcode op;
+            if (!infix_opcode(exp->op, &op)) {
+                error(
+                    c,
+                    string_printf(
+                        "unknown operator " STRING_FMT,
+                        STRING_ARG(ast_operator_string(exp->op))
+                    )
+                );
+                break;
+            }
+            compile_expression(c, exp->left);
+            compile_expression(c, exp->right);
+            emit(c, op, 0, 0);
+            break;
+        }
+        case AST_EXPRESSION_IF: {
+            // like the tree evaluator, a `return` in the blocks makes a wrapped value of the `if`
+            // instead of ending the call
+            struct jump_buf returns = {0};
+            struct jump_buf* outer = current_scope(c)->returns;
+            current_scope(c)->returns = &returns;
+            compile_if(c, (struct ast_if_expression*)expression);
+            current_scope(c)->returns = outer;
+            for (size_t i = 0; i < returns.len; i++) {
+                patch_jump(c, returns.ptr[i]);
+            }
+            BUF_FREE(returns);
+            break;
+        }
+        case AST_EXPRESSION_IDENTIFIER:
+            load_variable(c, (struct ast_identifier*)expression);
+            break;
+        case AST_EXPRESSION_FUNCTION:
+            compile_function_literal(c, (struct ast_function_literal*)expression);
+            break;
+        case AST_EXPRESSION_CALL: {
+            auto call = (struct ast_call_expression*)expression;
+            if (call->arguments.len > UINT8_MAX) {
+                error(c, string_printf("too many arguments in call"));
+                break;
+            }
+            compile_expression(c, call->function);
+            for (size_t i = 0; i < call->arguments.len; i++) {
+                compile_expression(c, call->arguments.ptr[i]);
+            }
+            emit(c, OP_CALL, call->arguments.len, 0);
+            break;
+        }
+        case AST_EXPRESSION_ARRAY: {
+            auto array = (struct ast_array_literal*)expression;
+            for (size_t i = 0; i < array->elements.len; i++) {
+                compile_expression(c, array->elements.ptr[i]);
+            }
+            emit(c, OP_ARRAY, array->elements.len, 0);
+            break;
+        }
+        case AST_EXPRESSION_INDEX: {
+            auto exp = (struct ast_index_expression*)expression;
+            compile_expression(c, exp->left);
+            compile_expression(c, exp->index);
+            emit(c, OP_INDEX, 0, 0);
+            break;
+        }
+        case AST_EXPRESSION_HASH: {
+            auto hash = (struct ast_hash_literal*)expression;
+            for (auto bucket = ast_expression_hash_first(&hash->pairs); bucket != NULL;
+                 bucket = ast_expression_hash_next(&hash->pairs, bucket)) {
+                compile_expression(c, bucket->key);
+                compile_expression(c, bucket->value);
+            }
+            emit(c, OP_HASH, hash->pairs.count * 2, 0);
+            break;
+        }
+    }
+}
+
+static void compile_if(struct compiler* c, struct ast_if_expression* exp) {
+    compile_expression(c, exp->condition);
+    size_t jump_not_truthy = emit(c, OP_JUMP_NOT_TRUTHY, 0xffff, 0);
+    compile_block_value(c, exp->consequence);
+    size_t jump = emit(c, OP_JUMP, 0xffff, 0);
+    patch_jump(c, jump_not_truthy);
+    if (exp->alternative != NULL) {
+        compile_block_value(c, exp->alternative);
+    } else {
+        emit(c, OP_NULL, 0, 0);
+    }
+    patch_jump(c, jump);
+}
+
+static void compile_statement(struct compiler* c, struct ast_statement* statement) {
+    switch (statement->type) {
+        case AST_STATEMENT_EXPRESSION:
+            compile_statement_expression(
+                c,
+                ((struct ast_expression_statement*)statement)->expression
+            );
+            // a wrapped return value ends the block, as a `return` would
+            if (current_scope(c)->returns != NULL) emit_return_jump(c, OP_JUMP_RETURNED);
+            emit(c, OP_POP, 0, 0);
+            break;
+        case AST_STATEMENT_BLOCK:
+            compile_block(c, (struct ast_block_statement*)statement);
+            break;
+        case AST_STATEMENT_RETURN:
+            compile_statement_expression(
+                c,
+                ((struct ast_return_statement*)statement)->return_value
+            );
+            if (current_scope(c)->returns != NULL) {
+                emit(c, OP_WRAP_RETURN, 0, 0);
+                emit_return_jump(c, OP_JUMP);
+            } else {
+                emit(c, OP_RETURN_VALUE, 0, 0);
+            }
+            break;
+        case AST_STATEMENT_LET: {
+            auto let = (struct ast_let_statement*)statement;
+            compile_expression(c, let->value);
+            store_variable(c, let->name);
+            break;
+        }
+    }
+}
+
+bool compile(struct compiler* c, struct ast_node* node) {
+    resolve(node);
+    switch (node->type) {
+        case AST_NODE_PROGRAM: {
+            auto program = (struct ast_program*)node;
+            for (size_t i = 0; i < program->statements.len; i++) {
+                compile_statement(c, program->statements.ptr[i]);
+            }
+            break;
+        }
+        case AST_NODE_STATEMENT:
+            compile_statement(c, (struct ast_statement*)node);
+            break;
+        case AST_NODE_EXPRESSION:
+            compile_expression(c, (struct ast_expression*)node);
+            emit(c, OP_POP, 0, 0);
+            break;
+    }
+    return c->errors.len == 0;
+}
+
+struct bytecode compiler_bytecode(struct compiler* c) {
+    finish_body(c, 0);
+    struct compilation_scope* scope = current_scope(c);
+    struct bytecode bytecode = {
+        .main = compiled_function_init(scope->instructions, scope->constants, 0, 0, NULL),
+    };
+    BUF_FREE(scope->global_names);
+    *scope = (struct compilation_scope){0};
+    return bytecode;
+}
+
+void bytecode_free(struct bytecode bytecode) {
+    compiled_function_decref(bytecode.main);
+}
@@ -0,0 +1,47 @@
+#include "monkey/engine.h"
+
+#include <stdlib.h>
+
+#include "monkey/evaluator.h"
+#include "monkey/inference.h"
+#include "monkey/optimizer.h"
+#include "monkey/stack_evaluator.h"
+#include "monkey/thunk_evaluator.h"
+#include "monkey/vm.h"
+
+struct string engine_name(enum engine engine) {
+    switch (engine) {
+#define X(x, name, _fn) \
+    case ENGINE_##x: \
+        return STRING_REF(name);
+#include "monkey/private/engine_types.inc"
+#undef X
+    }
+    abort();
+}
+
+bool engine_from_name(struct string name, enum engine* out) {
+#define X(x, engine_name, _fn) \
+    if (STRING_EQUAL(name, STRING_REF(engine_name))) { \
+        *out = ENGINE_##x; \
+        return true; \
+    }
+#include "monkey/private/engine_types.inc"
+#undef X
+    return false;
+}
+
+struct object* engine_eval(enum engine engine, struct ast_node* node, struct environment* env) {
+    if (node->type == AST_NODE_PROGRAM) {
+        optimize((struct ast_program*)node, optimizer_level());
+        infer_types((struct ast_program*)node);
+    }
+    switch (engine) {
+#define X(x, _name, fn) \
+    case ENGINE_##x: \
+        return fn(node, env);
+#include "monkey/private/engine_types.inc"
+#undef X
+    }
+    abort();
+}
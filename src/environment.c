@@ -1,8 +1,12 @@
 #include "monkey/environment.h"
 
 #include <iso646.h>
+#include <stdalign.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
+#include "monkey/pool.h"
 #include "monkey/private/stdc.h"
 
 const double MAX_LOAD_FACTOR = 0.75;
@@ -19,6 +23,9 @@ ALLOW_UINT_OVERFLOW static uint64_t fnv1a(struct string str) {
     return hash;
 }
 
+// Version 0 is never given out, so a zeroed cache never hits.
+static uint64_t last_version;
+
 static struct environment_entry*
 find_bucket(struct environment_entry_buf entries, struct string name) {
     uint64_t hash = fnv1a(name);
@@ -29,41 +36,174 @@ find_bucket(struct environment_entry_buf entries, struct string name) {
     return &entries.ptr[index];
 }
 
-void environment_init(struct environment* env) {
+struct environment* environment_new(void) {
+    return environment_new_enclosed(NULL, 0);
+}
+
+static struct object_alloc_stats alloc_stats;
+
+struct object_alloc_stats environment_alloc_stats(void) {
+    return alloc_stats;
+}
+
+struct environment* environment_new_enclosed(struct environment* outer, size_t slots) {
+    alloc_stats.allocated++;
+    if (++alloc_stats.live > alloc_stats.peak) alloc_stats.peak = alloc_stats.live;
+    struct environment* env = pool_alloc(sizeof(*env));
     env->entries = (struct environment_entry_buf){0};
     env->count = 0;
-    env->outer = NULL;
+    env->slots = (struct object_buf){0};
+    if (slots > 0) {
+        env->slots = BUF_OWNER(struct object_buf, calloc(slots, sizeof(struct object*)), slots);
+    }
+    env->outer = outer;
+    if (outer != NULL) {
+        environment_incref(outer);
+    }
+    env->version = ++last_version;
     env->rc = 1;
+    env->on_frame_stack = false;
+    gc_track(&env->gc, NULL);
+    return env;
+}
+
+// Frames are carved out of chunks of this many bytes, or of one bigger chunk for a huge frame.
+#define FRAME_CHUNK_SIZE ((size_t)64 * 1024)
+
+struct frame_chunk {
+    struct frame_chunk* prev;
+    char* top;
+    char* end;
+    alignas(max_align_t) char data[];
+};
+
+static struct frame_chunk* frame_chunks;
+// the last chunk emptied, kept so a call depth that hovers around a chunk boundary doesn't
+// allocate and free a chunk on every call
+static struct frame_chunk* spare_chunk;
+
+static struct frame_chunk* frame_chunk_new(size_t size) {
+    if (size < FRAME_CHUNK_SIZE) size = FRAME_CHUNK_SIZE;
+    struct frame_chunk* chunk;
+    if (spare_chunk != NULL and (size_t)(spare_chunk->end - spare_chunk->data) >= size) {
+        chunk = spare_chunk;
+        spare_chunk = NULL;
+    } else {
+        chunk = malloc(sizeof(*chunk) + size);
+        if (chunk == NULL) abort();
+        chunk->end = chunk->data + size;
+    }
+    chunk->prev = frame_chunks;
+    chunk->top = chunk->data;
+    frame_chunks = chunk;
+    return chunk;
 }
 
-void environment_init_enclosed(struct environment* env, struct environment* outer) {
-    environment_init(env);
+static size_t frame_size(size_t slots) {
+    size_t size = sizeof(struct environment) + slots * sizeof(struct object*);
+    return (size + alignof(max_align_t) - 1) / alignof(max_align_t) * alignof(max_align_t);
+}
+
+struct environment* environment_push_frame(struct environment* outer, size_t slots) {
+    size_t size = frame_size(slots);
+    struct frame_chunk* chunk = frame_chunks;
+    if (chunk == NULL or (size_t)(chunk->end - chunk->top) < size) {
+        chunk = frame_chunk_new(size);
+    }
+    auto env = (struct environment*)chunk->top;
+    chunk->top += size;
+
+    auto slot_data = (struct object**)(env + 1);
+    memset(slot_data, 0, slots * sizeof(*slot_data));
+    env->entries = (struct environment_entry_buf){0};
+    env->count = 0;
+    env->slots = BUF_REF(struct object_buf, slot_data, slots);
     env->outer = outer;
-    environment_incref(outer);
+    if (outer != NULL) {
+        environment_incref(outer);
+    }
+    env->version = ++last_version;
+    env->rc = 1;
+    env->on_frame_stack = true;
+    return env;
 }
 
-void environment_free(struct environment env) {
-    for (size_t i = 0; i < env.entries.len; i++) {
-        if (env.entries.ptr[i].name.length > 0) {
-            STRING_FREE(env.entries.ptr[i].name);
-            object_free(env.entries.ptr[i].value);
+static void pop_frame(struct environment* env, size_t size) {
+    struct frame_chunk* chunk = frame_chunks;
+    if (chunk == NULL or (char*)env + size != chunk->top) {
+        // released out of order; the frames above it are still in use
+        abort();
+    }
+    chunk->top = (char*)env;
+    if (chunk->top == chunk->data) {
+        frame_chunks = chunk->prev;
+        free(spare_chunk);
+        spare_chunk = chunk;
+    }
+}
+
+void environment_clear(struct environment* env) {
+    // detach everything first, so releasing a value can't observe a half-cleared environment
+    struct environment_entry_buf entries = env->entries;
+    struct object_buf slots = env->slots;
+    struct environment* outer = env->outer;
+    env->entries = (struct environment_entry_buf){0};
+    env->count = 0;
+    env->slots = (struct object_buf){0};
+    env->outer = NULL;
+    env->version = ++last_version;
+
+    for (size_t i = 0; i < entries.len; i++) {
+        if (entries.ptr[i].name.length > 0) {
+            STRING_FREE(entries.ptr[i].name);
+            object_decref(entries.ptr[i].value);
         }
     }
-    BUF_FREE(env.entries);
+    BUF_FREE(entries);
+    for (size_t i = 0; i < slots.len; i++) {
+        object_decref(slots.ptr[i]);
+    }
+    BUF_FREE(slots);
+    if (outer != NULL) {
+        environment_decref(outer);
+    }
 }
 
 void environment_incref(struct environment* env) {
     env->rc++;
 }
 
+BUF_T(struct environment*, environment);
+
+// Environments whose last reference goes away while another one is being released wait here, so
+// releasing a long chain of closures doesn't recurse once per link.
+static struct environment_buf release_queue;
+static bool releasing;
+
 size_t environment_decref(struct environment* env) {
     env->rc--;
-    if (env->rc == 0) {
-        environment_free(*env);
-        return 0;
-    } else {
+    if (env->rc > 0) {
         return env->rc;
     }
+    if (env->on_frame_stack) {
+        size_t size = frame_size(env->slots.len);
+        environment_clear(env);
+        pop_frame(env, size);
+        return 0;
+    }
+    gc_untrack(&env->gc);
+    BUF_PUSH(&release_queue, env);
+    if (releasing) return 0;
+
+    releasing = true;
+    while (release_queue.len > 0) {
+        struct environment* next = release_queue.ptr[--release_queue.len];
+        environment_clear(next);
+        alloc_stats.live--;
+        pool_free(next, sizeof(*next));
+    }
+    releasing = false;
+    return 0;
 }
 
 void environment_set(struct environment* env, struct string name, struct object* value) {
@@ -84,12 +224,13 @@ void environment_set(struct environment* env, struct string name, struct object*
         BUF_FREE(env->entries);
         env->entries = new_entries;
     }
+    env->version = ++last_version;
     struct environment_entry* bucket = find_bucket(env->entries, name);
     if (bucket->name.length == 0) {
         env->count++;
     } else {
         STRING_FREE(bucket->name);
-        object_free(bucket->value);
+        object_decref(bucket->value);
     }
     bucket->name = name;
     bucket->value = value;
@@ -109,3 +250,36 @@ struct object* environment_get(struct environment* env, struct string name) {
         return NULL;
     }
 }
+
+struct object* environment_get_cached(
+    struct environment* env,
+    struct string name,
+    struct ast_lookup_cache* cache
+) {
+    // only the first environment out that binds any names is cached, so a hit can't skip one
+    // that binds this name
+    while (env->count == 0 and env->outer != NULL) {
+        env = env->outer;
+    }
+    if (env == cache->env and env->version == cache->version) {
+        return env->entries.ptr[cache->index].value;
+    }
+    if (env->count > 0) {
+        struct environment_entry* bucket = find_bucket(env->entries, name);
+        if (bucket->name.length > 0) {
+            *cache = (struct ast_lookup_cache){
+                .env = env,
+                .index = (size_t)(bucket - env->entries.ptr),
+                .version = env->version,
+            };
+            return bucket->value;
+        }
+    }
+    return env->outer != NULL ? environment_get(env->outer, name) : NULL;
+}
+
+void environment_set_slot(struct environment* env, size_t slot, struct object* value) {
+    struct object* old = env->slots.ptr[slot];
+    env->slots.ptr[slot] = value;
+    object_decref(old);
+}
@@ -3,382 +3,349 @@
 #include <iso646.h>
 
 #include "monkey/buf.h"
+#include "monkey/builtins.h"
+#include "monkey/inference.h"
+#include "monkey/jit.h"
+#include "monkey/private/evaluator.h"
 #include "monkey/private/stdc.h"
+#include "monkey/resolver.h"
+#include "monkey/specializer.h"
 
-BUF_T(struct environment*, environment);
+// Operations consume their operands and may return an error.
+typedef struct object* prefix_operation_t(struct object* right);
+typedef struct object* infix_operation_t(struct object* left, struct object* right);
 
-struct evaluator {
-    struct environment_buf envs;
-};
-
-static struct object* builtin_len(struct object_buf args) {
-    if (args.len != 1) {
-        return object_error_init_base(
-            string_printf("wrong number of arguments. got=%zu, want=1", args.len)
-        );
-    }
-
-    struct object* arg = args.ptr[0];
-    switch (arg->type) {
-        case OBJECT_STRING:
-            return object_int64_init_base(((struct object_string*)arg)->value.length);
-        case OBJECT_ARRAY:
-            return object_int64_init_base(((struct object_array*)arg)->elements.len);
-        default:
-            return object_error_init_base(string_printf(
-                "argument to `len` not supported, got " STRING_FMT,
-                STRING_ARG(object_type_string(arg->type))
-            ));
-    }
+static struct object* logical_not(struct object* right) {
+    bool result = !is_truthy(right);
+    object_decref(right);
+    return object_boolean_init_base(result);
 }
 
-static struct object* builtin_first(struct object_buf args) {
-    if (args.len != 1) {
-        return object_error_init_base(
-            string_printf("wrong number of arguments. got=%zu, want=1", args.len)
-        );
-    }
-    if (args.ptr[0]->type != OBJECT_ARRAY) {
-        return object_error_init_base(string_printf(
-            "argument to `first` must be ARRAY, got " STRING_FMT,
-            STRING_ARG(object_type_string(args.ptr[0]->type))
-        ));
-    }
-
-    struct object_array* arr = (struct object_array*)args.ptr[0];
-    if (arr->elements.len > 0) {
-        return object_dup(arr->elements.ptr[0]);
-    } else {
-        return object_null_init_base();
-    }
+static struct object* integer_negate(struct object* right) {
+    int64_t value = object_int64_value(right);
+    object_decref(right);
+    return object_int64_init_base(-value);
 }
 
-static struct object* builtin_last(struct object_buf args) {
-    if (args.len != 1) {
-        return object_error_init_base(
-            string_printf("wrong number of arguments. got=%zu, want=1", args.len)
-        );
-    }
-    if (args.ptr[0]->type != OBJECT_ARRAY) {
-        return object_error_init_base(string_printf(
-            "argument to `last` must be ARRAY, got " STRING_FMT,
-            STRING_ARG(object_type_string(args.ptr[0]->type))
-        ));
-    }
+static prefix_operation_t* const prefix_operations[AST_OPERATOR_COUNT][OBJECT_TYPE_COUNT] = {
+    [AST_OPERATOR_BANG] =
+        {
+#define X(x) [OBJECT_##x] = logical_not,
+#include "monkey/private/object_types.inc"
+#undef X
+        },
+    [AST_OPERATOR_MINUS][OBJECT_INTEGER] = integer_negate,
+};
 
-    struct object_array* arr = (struct object_array*)args.ptr[0];
-    if (arr->elements.len > 0) {
-        return object_dup(arr->elements.ptr[arr->elements.len - 1]);
-    } else {
-        return object_null_init_base();
-    }
+struct object* eval_prefix_expression(enum ast_operator op, struct object* right) {
+    if (right == NULL) return object_null_init_base();
+    prefix_operation_t* operation = prefix_operations[op][object_type(right)];
+    if (operation != NULL) return operation(right);
+
+    struct string right_type = object_type_string(object_type(right));
+    object_decref(right);
+    return object_error_init_base(string_printf(
+        "unknown operator: " STRING_FMT STRING_FMT,
+        STRING_ARG(ast_operator_string(op)),
+        STRING_ARG(right_type)
+    ));
 }
 
-static struct object* builtin_rest(struct object_buf args) {
-    if (args.len != 1) {
-        return object_error_init_base(
-            string_printf("wrong number of arguments. got=%zu, want=1", args.len)
-        );
-    }
-    if (args.ptr[0]->type != OBJECT_ARRAY) {
-        return object_error_init_base(string_printf(
-            "argument to `rest` must be ARRAY, got " STRING_FMT,
-            STRING_ARG(object_type_string(args.ptr[0]->type))
-        ));
-    }
-
-    struct object_array* arr = (struct object_array*)args.ptr[0];
-    if (arr->elements.len > 0) {
-        struct object_buf elements = {0};
-        BUF_RESERVE(&elements, arr->elements.len - 1);
-        for (size_t i = 1; i < arr->elements.len; i += 1) {
-            BUF_PUSH(&elements, object_dup(arr->elements.ptr[i]));
-        }
-        return object_array_init_base(elements);
-    } else {
-        return object_null_init_base();
-    }
+#define INTEGER_OPERATION(name, expression, init) \
+    static struct object* name(struct object* left, struct object* right) { \
+        int64_t l = object_int64_value(left); \
+        int64_t r = object_int64_value(right); \
+        object_decref(left); \
+        object_decref(right); \
+        return init(expression); \
+    }
+
+INTEGER_OPERATION(integer_add, l + r, object_int64_init_base)
+INTEGER_OPERATION(integer_sub, l - r, object_int64_init_base)
+INTEGER_OPERATION(integer_mul, l* r, object_int64_init_base)
+INTEGER_OPERATION(integer_div, l / r, object_int64_init_base)
+INTEGER_OPERATION(integer_less_than, l < r, object_boolean_init_base)
+INTEGER_OPERATION(integer_greater_than, l > r, object_boolean_init_base)
+INTEGER_OPERATION(integer_equal, l == r, object_boolean_init_base)
+INTEGER_OPERATION(integer_not_equal, l != r, object_boolean_init_base)
+
+#undef INTEGER_OPERATION
+
+// Booleans and null are immediate values, so they hold no references.
+static struct object* boolean_equal(struct object* left, struct object* right) {
+    return object_boolean_init_base(object_boolean_value(left) == object_boolean_value(right));
 }
 
-static struct object* builtin_push(struct object_buf args) {
-    if (args.len != 2) {
-        return object_error_init_base(
-            string_printf("wrong number of arguments. got=%zu, want=2", args.len)
-        );
-    }
-    if (args.ptr[0]->type != OBJECT_ARRAY) {
-        return object_error_init_base(string_printf(
-            "argument to `push` must be ARRAY, got " STRING_FMT,
-            STRING_ARG(object_type_string(args.ptr[0]->type))
-        ));
-    }
-
-    struct object_array* arr = (struct object_array*)args.ptr[0];
-    size_t len = arr->elements.len;
-    struct object_buf elements = {0};
-    BUF_RESERVE(&elements, len + 1);
-    for (size_t i = 0; i < len; i += 1) {
-        BUF_PUSH(&elements, object_dup(arr->elements.ptr[i]));
-    }
-    BUF_PUSH(&elements, object_dup(args.ptr[1]));
-    return object_array_init_base(elements);
+static struct object* boolean_not_equal(struct object* left, struct object* right) {
+    return object_boolean_init_base(object_boolean_value(left) != object_boolean_value(right));
 }
 
-static struct evaluator evaluator_new(struct environment* env) {
-    struct evaluator evaluator = {
-        .envs = {0},
-    };
-    environment_set(env, STRING_REF("len"), object_builtin_init_base(&builtin_len));
-    environment_set(env, STRING_REF("first"), object_builtin_init_base(&builtin_first));
-    environment_set(env, STRING_REF("last"), object_builtin_init_base(&builtin_last));
-    environment_set(env, STRING_REF("rest"), object_builtin_init_base(&builtin_rest));
-    environment_set(env, STRING_REF("push"), object_builtin_init_base(&builtin_push));
-    return evaluator;
+static struct object* null_equal(struct object* left, struct object* right) {
+    (void)left;
+    (void)right;
+    return object_boolean_init_base(true);
 }
 
-static void evaluator_free(struct evaluator evaluator) {
-    for (size_t i = 0; i < evaluator.envs.len; i += 1) {
-        environment_free(*evaluator.envs.ptr[i]);
-        free(evaluator.envs.ptr[i]);
-    }
-    BUF_FREE(evaluator.envs);
+static struct object* null_not_equal(struct object* left, struct object* right) {
+    (void)left;
+    (void)right;
+    return object_boolean_init_base(false);
 }
 
-static bool objects_equal(struct object* left, struct object* right) {
-    bool result;
-    if (left == NULL and right == NULL) result = true;
-    if (left == NULL or right == NULL) result = false;
-    if (left->type != right->type) result = false;
-    switch (left->type) {
-        case OBJECT_INTEGER:
-            result = ((struct object_int64*)left)->value == ((struct object_int64*)right)->value;
-            break;
-        case OBJECT_BOOLEAN:
-            result =
-                ((struct object_boolean*)left)->value == ((struct object_boolean*)right)->value;
-            break;
-        case OBJECT_NULL:
-            result = true;
-            break;
-        default:
-            abort();
-    }
-    object_free(left);
-    object_free(right);
-    return result;
+static struct object* string_concat(struct object* left, struct object* right) {
+    struct string result = string_printf(
+        STRING_FMT STRING_FMT,
+        STRING_ARG(((struct object_string*)left)->value),
+        STRING_ARG(((struct object_string*)right)->value)
+    );
+    object_decref(left);
+    object_decref(right);
+    return object_string_init_base(result);
 }
 
-static bool is_error(struct object* obj) {
-    return obj != NULL and obj->type == OBJECT_ERROR;
+// Indexed by operator and operand types. Pairs without an entry compare by identity under `==`
+// and `!=`, and are an error under any other operator.
+static infix_operation_t* const
+    infix_operations[AST_OPERATOR_COUNT][OBJECT_TYPE_COUNT][OBJECT_TYPE_COUNT] = {
+#define X(op, left, right, operation) \
+    [AST_OPERATOR_##op][OBJECT_##left][OBJECT_##right] = operation,
+#include "monkey/private/infix_operations.inc"
+#undef X
+};
+
+struct object*
+eval_infix_expression(enum ast_operator op, struct object* left, struct object* right) {
+    if (left == NULL || right == NULL) {
+        object_decref(left);
+        object_decref(right);
+        return object_null_init_base();
+    }
+    infix_operation_t* operation = infix_operations[op][object_type(left)][object_type(right)];
+    if (operation != NULL) return operation(left, right);
+
+    if (op == AST_OPERATOR_EQ or op == AST_OPERATOR_NOT_EQ) {
+        bool identical = left == right;
+        object_decref(left);
+        object_decref(right);
+        return object_boolean_init_base(op == AST_OPERATOR_EQ ? identical : !identical);
+    }
+    struct string left_type = object_type_string(object_type(left));
+    struct string right_type = object_type_string(object_type(right));
+    bool mismatch = object_type(left) != object_type(right);
+    object_decref(left);
+    object_decref(right);
+    return object_error_init_base(string_printf(
+        "%s: " STRING_FMT " " STRING_FMT " " STRING_FMT,
+        mismatch ? "type mismatch" : "unknown operator",
+        STRING_ARG(left_type),
+        STRING_ARG(ast_operator_string(op)),
+        STRING_ARG(right_type)
+    ));
 }
 
-static struct object* eval_bang_operator_expression(struct object* right) {
-    if (right == NULL) return object_null_init_base();
-    bool result;
-    if (right->type == OBJECT_BOOLEAN) {
-        result = !((struct object_boolean*)right)->value;
-    } else if (right->type == OBJECT_NULL) {
-        result = true;
+bool is_truthy(struct object* obj) {
+    if (obj == NULL) return false;
+    if (object_type(obj) == OBJECT_BOOLEAN) {
+        return object_boolean_value(obj);
+    } else if (object_type(obj) == OBJECT_NULL) {
+        return false;
     } else {
-        result = false;
+        return true;
     }
-    object_free(right);
-    return object_boolean_init_base(result);
 }
 
-static struct object* eval_minus_prefix_operator_expression(struct object* right) {
-    if (right == NULL) return object_null_init_base();
-    if (right->type != OBJECT_INTEGER) {
-        struct string right_type = object_type_string(right->type);
-        object_free(right);
-        return object_error_init_base(
-            string_printf("unknown operator: -" STRING_FMT, STRING_ARG(right_type))
+struct object* eval_function_literal(struct ast_function_literal* func, struct environment* env) {
+    struct function_parameter_buf params = {0};
+    BUF_RESERVE(&params, func->parameters.len);
+    for (size_t i = 0; i < func->parameters.len; i++) {
+        BUF_PUSH(
+            &params,
+            (struct ast_identifier*)ast_node_incref(&func->parameters.ptr[i]->expression.node)
         );
     }
+    auto body = (struct ast_block_statement*)ast_node_incref(&func->body->statement.node);
+    // made in a call, a closure keeps the call's captured variables rather than its frame
+    if (env->on_frame_stack) env = env->outer;
+    return object_function_init_base(
+        params,
+        body,
+        func->locals,
+        func->escapes,
+        func->captured,
+        env
+    );
+}
 
-    int64_t value = ((struct object_int64*)right)->value;
-    object_free(right);
-    return object_int64_init_base(-value);
+// Binds a variable of the call whose frame is `env`, which is in the frame or, if captured, in the
+// environment after it.
+static void
+bind_slot(struct ast_lexical_address address, struct object* value, struct environment* env) {
+    environment_set_slot(address.env_depth == 0 ? env : env->outer, address.env_slot, value);
 }
 
-static struct object* eval_prefix_expression(struct string op, struct object* right) {
-    if (right == NULL) return object_null_init_base();
-    if (STRING_EQUAL(op, STRING_REF("!"))) {
-        return eval_bang_operator_expression(right);
-    } else if (STRING_EQUAL(op, STRING_REF("-"))) {
-        return eval_minus_prefix_operator_expression(right);
+void bind_variable(struct ast_identifier* name, struct object* value, struct environment* env) {
+    if (name->address.resolved) {
+        bind_slot(name->address, value, env);
     } else {
-        object_free(right);
-        return object_error_init_base(string_printf(
-            "unknown operator: " STRING_FMT STRING_FMT,
-            STRING_ARG(op),
-            STRING_ARG(object_type_string(right->type))
-        ));
+        environment_set(env, string_dup(name->value), value);
     }
 }
 
-static struct object* eval_integer_infix_expression(
-    struct string op,
-    struct object_int64* left,
-    struct object_int64* right
-) {
-    int64_t left_val = left->value;
-    int64_t right_val = right->value;
-    object_free(&left->object);
-    object_free(&right->object);
-
-    if (STRING_EQUAL(op, STRING_REF("+"))) {
-        return object_int64_init_base(left_val + right_val);
-    } else if (STRING_EQUAL(op, STRING_REF("-"))) {
-        return object_int64_init_base(left_val - right_val);
-    } else if (STRING_EQUAL(op, STRING_REF("*"))) {
-        return object_int64_init_base(left_val * right_val);
-    } else if (STRING_EQUAL(op, STRING_REF("/"))) {
-        return object_int64_init_base(left_val / right_val);
-    } else if (STRING_EQUAL(op, STRING_REF("<"))) {
-        return object_boolean_init_base(left_val < right_val);
-    } else if (STRING_EQUAL(op, STRING_REF(">"))) {
-        return object_boolean_init_base(left_val > right_val);
-    } else {
-        return object_error_init_base(string_printf(
-            "unknown operator: " STRING_FMT " " STRING_FMT " " STRING_FMT,
-            STRING_ARG(object_type_string(OBJECT_INTEGER)),
-            STRING_ARG(op),
-            STRING_ARG(object_type_string(OBJECT_INTEGER))
-        ));
-    }
+struct object* check_arguments(struct object_function* function, struct object_buf args) {
+    if (function->parameters.len == args.len) return NULL;
+    return object_error_init_base(string_printf(
+        "wrong number of arguments: expected %zu, got %zu",
+        function->parameters.len,
+        args.len
+    ));
 }
 
-static struct object* eval_string_infix_expression(
-    struct string op,
-    struct object_string* left,
-    struct object_string* right
-) {
-    if (STRING_EQUAL(op, STRING_REF("+"))) {
-        struct string result =
-            string_printf(STRING_FMT STRING_FMT, STRING_ARG(left->value), STRING_ARG(right->value));
-        object_free(&left->object);
-        object_free(&right->object);
-        return object_string_init_base(result);
-    } else {
-        object_free(&left->object);
-        object_free(&right->object);
-        return object_error_init_base(string_printf(
-            "unknown operator: " STRING_FMT " " STRING_FMT " " STRING_FMT,
-            STRING_ARG(object_type_string(OBJECT_STRING)),
-            STRING_ARG(op),
-            STRING_ARG(object_type_string(OBJECT_STRING))
-        ));
+// Whether `obj` has `type`. Functions aren't checked, since a function of any shape can be passed.
+static bool has_type(struct object* obj, enum ast_type type) {
+    switch (type) {
+        case AST_TYPE_INTEGER:
+            return object_type(obj) == OBJECT_INTEGER;
+        case AST_TYPE_BOOLEAN:
+            return object_type(obj) == OBJECT_BOOLEAN;
+        case AST_TYPE_STRING:
+            return object_type(obj) == OBJECT_STRING;
+        case AST_TYPE_NULL:
+            return object_type(obj) == OBJECT_NULL;
+        case AST_TYPE_ARRAY:
+            return object_type(obj) == OBJECT_ARRAY;
+        case AST_TYPE_HASH:
+            return object_type(obj) == OBJECT_HASH;
+        default:
+            return true;
     }
 }
 
-static struct object*
-eval_infix_expression(struct string op, struct object* left, struct object* right) {
-    if (left == NULL || right == NULL) {
-        object_free(left);
-        object_free(right);
-        return object_null_init_base();
-    }
-    if (STRING_EQUAL(op, STRING_REF("=="))) {
-        return object_boolean_init_base(objects_equal(left, right));
-    } else if (STRING_EQUAL(op, STRING_REF("!="))) {
-        return object_boolean_init_base(!objects_equal(left, right));
-    } else if (left->type == OBJECT_INTEGER and right->type == OBJECT_INTEGER) {
-        return eval_integer_infix_expression(
-            op,
-            (struct object_int64*)left,
-            (struct object_int64*)right
-        );
-    } else if (left->type == OBJECT_STRING and right->type == OBJECT_STRING) {
-        return eval_string_infix_expression(
-            op,
-            (struct object_string*)left,
-            (struct object_string*)right
-        );
-    } else if (left->type != right->type) {
-        struct string left_type = object_type_string(left->type);
-        object_free(left);
-        struct string right_type = object_type_string(right->type);
-        object_free(right);
-        return object_error_init_base(string_printf(
-            "type mismatch: " STRING_FMT " " STRING_FMT " " STRING_FMT,
-            STRING_ARG(left_type),
-            STRING_ARG(op),
-            STRING_ARG(right_type)
-        ));
-    } else {
-        struct string left_type = object_type_string(left->type);
-        object_free(left);
-        struct string right_type = object_type_string(right->type);
-        object_free(right);
-        return object_error_init_base(string_printf(
-            "unknown operator: " STRING_FMT " " STRING_FMT " " STRING_FMT,
-            STRING_ARG(left_type),
-            STRING_ARG(op),
-            STRING_ARG(right_type)
-        ));
+void check_parameter_types(struct object_function* function, struct object_buf args) {
+    for (size_t i = 0; i < args.len; i++) {
+        if (!has_type(args.ptr[i], function->parameters.ptr[i]->type)) {
+            forget_parameter_types(function->parameters, function->body);
+            return;
+        }
     }
 }
 
-static bool is_truthy(struct object* obj) {
-    if (obj == NULL) return false;
-    if (obj->type == OBJECT_BOOLEAN) {
-        return ((struct object_boolean*)obj)->value;
-    } else if (obj->type == OBJECT_NULL) {
-        return false;
-    } else {
-        return true;
+struct object* not_a_function(struct object* fn) {
+    return object_error_init_base(string_printf(
+        "not a function: " STRING_FMT,
+        STRING_ARG(object_type_string(object_type(fn)))
+    ));
+}
+
+struct object* check_hash_key(struct object* key) {
+    if (object_is_hashable(key)) return NULL;
+    struct string key_type = object_type_string(object_type(key));
+    object_decref(key);
+    return object_error_init_base(
+        string_printf("unusable as hash key: " STRING_FMT, STRING_ARG(key_type))
+    );
+}
+
+// Where a statement sits in the function being applied. A call whose value is the function's
+// result is handed back to apply_function as a tail call instead of nesting another C frame.
+enum position {
+    // outside any function body, or nested in an expression
+    POSITION_PLAIN,
+    // in a function body, where a `return` ends the call
+    POSITION_BODY,
+    // its value is the function's result
+    POSITION_TAIL,
+};
+
+// How a statement finished.
+enum completion_type {
+    // on to the next statement
+    COMPLETION_NORMAL,
+    // a `return` ended the function or program
+    COMPLETION_RETURN,
+    // an error was raised
+    COMPLETION_ERROR,
+};
+
+// A statement's value and how it finished. A `return` is told apart by its completion rather than
+// by wrapping its value, so leaving a function allocates nothing.
+struct completion {
+    enum completion_type type;
+    struct object* value;
+};
+
+// The completion of a statement whose value is `value`.
+static struct completion complete(struct object* value) {
+    if (value != NULL) {
+        switch (object_type(value)) {
+            case OBJECT_ERROR:
+                return (struct completion){COMPLETION_ERROR, value};
+            // a `return` in a block nested in an expression reaches its statement as a value
+            case OBJECT_RETURN_VALUE:
+                return (struct completion){COMPLETION_RETURN, object_return_value_unwrap(value)};
+            default:
+                break;
+        }
     }
+    return (struct completion){COMPLETION_NORMAL, value};
 }
 
-static struct object*
-eval_statement(struct evaluator* ev, struct ast_statement* statement, struct environment* env);
+static struct completion
+eval_statement(struct ast_statement* statement, struct environment* env, enum position position);
 
-static struct object* eval_block_statement(
-    struct evaluator* ev,
+static struct completion eval_block_statement(
     struct ast_block_statement* block,
-    struct environment* env
+    struct environment* env,
+    enum position position
 ) {
-    struct object* result = NULL;
+    struct completion result = {COMPLETION_NORMAL, NULL};
     for (size_t i = 0; i < block->statements.len; i++) {
-        object_free(result);
-        result = eval_statement(ev, block->statements.ptr[i], env);
-        if (result != NULL and
-            (result->type == OBJECT_RETURN_VALUE or result->type == OBJECT_ERROR)) {
-            return result;
-        }
+        object_decref(result.value);
+        // only the last statement inherits the tail position
+        enum position statement_position =
+            position == POSITION_TAIL and i + 1 < block->statements.len ? POSITION_BODY : position;
+        result = eval_statement(block->statements.ptr[i], env, statement_position);
+        if (result.type != COMPLETION_NORMAL) return result;
     }
     return result;
 }
 
-static struct object*
-eval_expression(struct evaluator* ev, struct ast_expression* expression, struct environment* env);
+static struct object* eval_expression(struct ast_expression* expression, struct environment* env);
 
-static struct object* eval_if_expression(
-    struct evaluator* ev,
+static struct completion eval_if_expression(
     struct ast_if_expression* expression,
-    struct environment* env
+    struct environment* env,
+    enum position position
 ) {
-    struct object* condition = eval_expression(ev, expression->condition, env);
-    if (is_error(condition)) return condition;
+    struct object* condition = eval_expression(expression->condition, env);
+    if (is_error(condition)) return (struct completion){COMPLETION_ERROR, condition};
 
     if (is_truthy(condition)) {
-        object_free(condition);
-        return eval_block_statement(ev, expression->consequence, env);
+        object_decref(condition);
+        return eval_block_statement(expression->consequence, env, position);
     } else {
-        object_free(condition);
+        object_decref(condition);
         if (expression->alternative != NULL) {
-            return eval_block_statement(ev, expression->alternative, env);
+            return eval_block_statement(expression->alternative, env, position);
         } else {
-            return object_null_init_base();
+            return (struct completion){COMPLETION_NORMAL, object_null_init_base()};
         }
     }
 }
 
-static struct object* eval_identifier(struct ast_identifier* identifier, struct environment* env) {
-    struct object* val = environment_get(env, identifier->value);
+struct object* eval_identifier(struct ast_identifier* identifier, struct environment* env) {
+    struct object* val = NULL;
+    if (identifier->address.resolved) {
+        val = environment_get_slot(
+            env,
+            identifier->address.env_depth,
+            identifier->address.env_slot
+        );
+    }
+    // an unset slot comes from a `let` on a branch that wasn't taken, which leaves the name bound
+    // wherever it was before
+    if (val == NULL) val = environment_get_cached(env, identifier->value, &identifier->cache);
     if (val != NULL) {
-        return object_dup(val);
+        return object_incref(val);
     } else {
         return object_error_init_base(
             string_printf("identifier not found: " STRING_FMT, STRING_ARG(identifier->value))
@@ -386,14 +353,20 @@ static struct object* eval_identifier(struct ast_identifier* identifier, struct
     }
 }
 
-static struct object_buf
-eval_expressions(struct evaluator* ev, struct ast_expression_buf exps, struct environment* env) {
+// Leaves out the expressions `dropped` marks, if it isn't NULL.
+static struct object_buf eval_expressions(
+    struct ast_expression_buf exps,
+    const bool* dropped,
+    struct environment* env
+) {
     struct object_buf result = {0};
+    BUF_RESERVE(&result, exps.len);
     for (size_t i = 0; i < exps.len; i++) {
-        struct object* evaluated = eval_expression(ev, exps.ptr[i], env);
+        if (dropped != NULL and dropped[i]) continue;
+        struct object* evaluated = eval_expression(exps.ptr[i], env);
         if (is_error(evaluated)) {
-            for (size_t j = 0; j < i; j++) {
-                object_free(result.ptr[j]);
+            for (size_t j = 0; j < result.len; j++) {
+                object_decref(result.ptr[j]);
             }
             BUF_FREE(result);
             result = (struct object_buf){0};
@@ -405,118 +378,439 @@ eval_expressions(struct evaluator* ev, struct ast_expression_buf exps, struct en
     return result;
 }
 
-static struct environment* extend_function_env(struct object_function* fn, struct object_buf args) {
-    struct environment* env = malloc(sizeof(*env));
-    environment_init_enclosed(env, fn->env);
+struct environment*
+push_call_frame(struct environment* outer, size_t locals, bool escapes, size_t captured) {
+    if (!escapes) return environment_push_frame(outer, locals);
+    struct environment* captures = environment_new_enclosed(outer, captured);
+    struct environment* frame = environment_push_frame(captures, locals);
+    environment_decref(captures);
+    return frame;
+}
+
+struct environment* extend_function_env(
+    struct object_function* fn,
+    struct object_buf args,
+    struct environment* previous
+) {
+    struct environment* env;
+    // the frame of a function that creates closures links to captured variables of its own
+    if (previous != NULL and previous->rc == 1 and previous->outer == fn->env and
+        previous->slots.len == fn->locals and !fn->escapes) {
+        env = previous;
+        for (size_t i = 0; i < env->slots.len; i++) {
+            environment_set_slot(env, i, NULL);
+        }
+    } else {
+        if (previous != NULL) environment_decref(previous);
+        env = push_call_frame(fn->env, fn->locals, fn->escapes, fn->captured);
+    }
 
     for (size_t i = 0; i < fn->parameters.len; i++) {
-        struct string param_name = string_dup(fn->parameters.ptr[i]->value);
-        struct object* arg = object_dup(args.ptr[i]);
-        environment_set(env, param_name, arg);
+        bind_slot(fn->parameters.ptr[i]->address, object_incref(args.ptr[i]), env);
     }
 
     return env;
 }
 
-static struct object* unwrap_return_value(struct object* obj) {
-    if (obj != NULL and obj->type == OBJECT_RETURN_VALUE) {
-        struct object* inner = ((struct object_return_value*)obj)->value;
-        ((struct object_return_value*)obj)->value = NULL;
-        object_free(obj);
-        return inner;
+struct object* unwrap_return_value(struct object* obj) {
+    if (obj != NULL and object_type(obj) == OBJECT_RETURN_VALUE) {
+        return object_return_value_unwrap(obj);
     } else {
         return obj;
     }
 }
 
+static struct object* run_function(struct object_function* function, struct environment* env) {
+    struct jit_code* code = jit_function(function);
+    if (code != NULL) return unwrap_return_value(jit_run(code, env));
+    return eval_statement(&function->body->statement, env, POSITION_TAIL).value;
+}
+
+// Makes one call, leaving the callee environment in `env` for the next call of a tail-call chain.
 static struct object*
-apply_function(struct evaluator* ev, struct object* fn, struct object_buf args) {
-    switch (fn->type) {
+call_function(struct object* fn, struct object_buf args, struct environment** env) {
+    switch (object_type(fn)) {
         case OBJECT_FUNCTION: {
             auto function = (struct object_function*)fn;
-            if (function->parameters.len != args.len) {
-                return object_error_init_base(string_printf(
-                    "wrong number of arguments: expected %zu, got %zu",
-                    function->parameters.len,
-                    args.len
-                ));
-            }
-            struct environment* extended_env = extend_function_env(function, args);
-            struct object* evaluated = eval_statement(ev, &function->body->statement, extended_env);
-            if (extended_env->outer->rc == 1) {
-                environment_free(*extended_env);
-                free(extended_env);
-            } else {
-                BUF_PUSH(&ev->envs, extended_env);
-            }
-            return unwrap_return_value(evaluated);
+            struct object* err = check_arguments(function, args);
+            if (err != NULL) return err;
+            check_parameter_types(function, args);
+            *env = extend_function_env(function, args, *env);
+            return run_function(function, *env);
         }
         case OBJECT_BUILTIN: {
             auto builtin = (struct object_builtin*)fn;
             return builtin->fn(args);
         }
         default:
-            return object_error_init_base(string_printf(
-                "not a function: " STRING_FMT,
-                STRING_ARG(object_type_string(fn->type))
-            ));
+            return not_a_function(fn);
     }
 }
 
+// Tail calls are made by this loop, so tail recursion runs in constant C stack.
+struct object* finish_call(struct object* result, struct environment* env) {
+    while (result != NULL and object_type(result) == OBJECT_TAIL_CALL) {
+        // a tail call is only ever referenced from here, so its call can be taken over
+        auto tail_call = (struct object_tail_call*)result;
+        struct object* fn = tail_call->function;
+        struct object_buf args = tail_call->args;
+        tail_call->function = NULL;
+        tail_call->args = (struct object_buf){0};
+        object_decref(result);
+
+        result = call_function(fn, args, &env);
+        object_decref(fn);
+        for (size_t i = 0; i < args.len; i++) {
+            object_decref(args.ptr[i]);
+        }
+        BUF_FREE(args);
+    }
+    // closures created during the call keep the environment alive on their own
+    if (env != NULL) environment_decref(env);
+    return result;
+}
+
+// Calls `fn`, taking ownership of it and `args`.
+static struct object* apply_function(struct object* fn, struct object_buf args) {
+    struct environment* env = NULL;
+    struct object* result = call_function(fn, args, &env);
+    object_decref(fn);
+    for (size_t i = 0; i < args.len; i++) {
+        object_decref(args.ptr[i]);
+    }
+    BUF_FREE(args);
+    return finish_call(result, env);
+}
+
 static struct object*
-eval_array_index_expression(struct object_array* array, struct object_int64* index) {
-    int64_t i = index->value;
-    size_t max = array->elements.len - 1;
-    object_free(&index->object);
-    if (i < 0 or (size_t) i > max) {
-        object_free(&array->object);
+eval_array_index_expression(struct object_array* array, struct object* index) {
+    int64_t i = object_int64_value(index);
+    object_decref(index);
+    if (i < 0 or (size_t)i >= array->elements.len) {
+        object_decref(&array->object);
         return object_null_init_base();
     } else {
-        struct object* result = object_dup(array->elements.ptr[i]);
-        object_free(&array->object);
+        struct object* result = object_incref(array->elements.ptr[i]);
+        object_decref(&array->object);
         return result;
     }
 }
 
-static struct object* eval_index_expression(struct object* left, struct object* index) {
-    if (left->type == OBJECT_ARRAY and index->type == OBJECT_INTEGER) {
-        return eval_array_index_expression((struct object_array*)left, (struct object_int64*)index);
+struct object* eval_index_expression(struct object* left, struct object* index) {
+    if (object_type(left) == OBJECT_ARRAY and object_type(index) == OBJECT_INTEGER) {
+        return eval_array_index_expression((struct object_array*)left, index);
     } else {
-        return object_error_init_base(string_printf(
-            "index operator not supported: " STRING_FMT,
-            STRING_ARG(object_type_string(left->type))
-        ));
+        struct string left_type = object_type_string(object_type(left));
+        object_decref(left);
+        object_decref(index);
+        return object_error_init_base(
+            string_printf("index operator not supported: " STRING_FMT, STRING_ARG(left_type))
+        );
+    }
+}
+
+// A node that keeps seeing new operand types stops specializing after this many changes.
+#define MAX_DEOPTIMIZATIONS 4
+
+static struct quickening_stats quickening;
+
+struct quickening_stats quickening_stats(void) {
+    return quickening;
+}
+
+static enum ast_specialization
+infix_specialization(enum ast_operator op, struct object* left, struct object* right) {
+    enum object_type type = object_type(left);
+    if (type != object_type(right)) return AST_SPECIALIZATION_GENERIC;
+    if (type == OBJECT_INTEGER) {
+        switch (op) {
+            case AST_OPERATOR_PLUS:
+                return AST_SPECIALIZATION_INTEGER_ADD;
+            case AST_OPERATOR_MINUS:
+                return AST_SPECIALIZATION_INTEGER_SUB;
+            case AST_OPERATOR_ASTERISK:
+                return AST_SPECIALIZATION_INTEGER_MUL;
+            case AST_OPERATOR_SLASH:
+                return AST_SPECIALIZATION_INTEGER_DIV;
+            case AST_OPERATOR_LT:
+                return AST_SPECIALIZATION_INTEGER_LT;
+            case AST_OPERATOR_GT:
+                return AST_SPECIALIZATION_INTEGER_GT;
+            case AST_OPERATOR_EQ:
+                return AST_SPECIALIZATION_INTEGER_EQ;
+            case AST_OPERATOR_NOT_EQ:
+                return AST_SPECIALIZATION_INTEGER_NOT_EQ;
+            default:
+                break;
+        }
+    } else if (type == OBJECT_BOOLEAN) {
+        if (op == AST_OPERATOR_EQ) return AST_SPECIALIZATION_BOOLEAN_EQ;
+        if (op == AST_OPERATOR_NOT_EQ) return AST_SPECIALIZATION_BOOLEAN_NOT_EQ;
+    } else if (type == OBJECT_STRING) {
+        if (op == AST_OPERATOR_PLUS) return AST_SPECIALIZATION_STRING_CONCAT;
+    }
+    return AST_SPECIALIZATION_GENERIC;
+}
+
+static enum ast_specialization prefix_specialization(enum ast_operator op, struct object* right) {
+    if (object_type(right) == OBJECT_INTEGER and op == AST_OPERATOR_MINUS) {
+        return AST_SPECIALIZATION_INTEGER_NEGATE;
+    }
+    if (object_type(right) == OBJECT_BOOLEAN and op == AST_OPERATOR_BANG) {
+        return AST_SPECIALIZATION_BOOLEAN_NOT;
+    }
+    return AST_SPECIALIZATION_GENERIC;
+}
+
+// The type every operand of a specialized node must have.
+static enum object_type specialization_operand_type(enum ast_specialization specialization) {
+    switch (specialization) {
+        case AST_SPECIALIZATION_INTEGER_ADD:
+        case AST_SPECIALIZATION_INTEGER_SUB:
+        case AST_SPECIALIZATION_INTEGER_MUL:
+        case AST_SPECIALIZATION_INTEGER_DIV:
+        case AST_SPECIALIZATION_INTEGER_LT:
+        case AST_SPECIALIZATION_INTEGER_GT:
+        case AST_SPECIALIZATION_INTEGER_EQ:
+        case AST_SPECIALIZATION_INTEGER_NOT_EQ:
+        case AST_SPECIALIZATION_INTEGER_NEGATE:
+            return OBJECT_INTEGER;
+        case AST_SPECIALIZATION_BOOLEAN_EQ:
+        case AST_SPECIALIZATION_BOOLEAN_NOT_EQ:
+        case AST_SPECIALIZATION_BOOLEAN_NOT:
+            return OBJECT_BOOLEAN;
+        case AST_SPECIALIZATION_STRING_CONCAT:
+            return OBJECT_STRING;
+        default:
+            abort();
+    }
+}
+
+// Specializes a node on its first evaluation.
+static void specialize(struct ast_quickening* q, enum ast_specialization specialization) {
+    q->specialization = specialization;
+    if (specialization != AST_SPECIALIZATION_GENERIC) quickening.specializations++;
+}
+
+// Returns whether a specialized node's fast path applies, counting the hit or the miss. A miss
+// sends the node back to be specialized again on its next evaluation.
+static bool guard(struct ast_quickening* q, bool holds) {
+    if (holds) {
+        quickening.hits++;
+        return true;
+    }
+    quickening.misses++;
+    quickening.deoptimizations++;
+    q->deoptimizations++;
+    q->specialization = q->deoptimizations >= MAX_DEOPTIMIZATIONS
+                            ? AST_SPECIALIZATION_GENERIC
+                            : AST_SPECIALIZATION_UNSPECIALIZED;
+    return false;
+}
+
+struct object* eval_infix_quickened(
+    struct ast_infix_expression* node,
+    struct object* left,
+    struct object* right
+) {
+    if (left == NULL or right == NULL) return eval_infix_expression(node->op, left, right);
+    struct ast_quickening* q = &node->quickening;
+    if (q->specialization == AST_SPECIALIZATION_UNSPECIALIZED) {
+        specialize(q, infix_specialization(node->op, left, right));
+    }
+    if (!q->proven and
+        (q->specialization == AST_SPECIALIZATION_GENERIC or
+         !guard(
+             q,
+             object_type(left) == specialization_operand_type(q->specialization) and
+                 object_type(right) == object_type(left)
+         ))) {
+        return eval_infix_expression(node->op, left, right);
+    }
+
+    if (q->specialization == AST_SPECIALIZATION_STRING_CONCAT) {
+        return string_concat(left, right);
+    }
+    if (q->specialization == AST_SPECIALIZATION_BOOLEAN_EQ or
+        q->specialization == AST_SPECIALIZATION_BOOLEAN_NOT_EQ) {
+        bool equal = object_boolean_value(left) == object_boolean_value(right);
+        return object_boolean_init_base(
+            q->specialization == AST_SPECIALIZATION_BOOLEAN_EQ ? equal : !equal
+        );
+    }
+
+    int64_t left_val = object_int64_value(left);
+    int64_t right_val = object_int64_value(right);
+    object_decref(left);
+    object_decref(right);
+    switch (q->specialization) {
+        case AST_SPECIALIZATION_INTEGER_ADD:
+            return object_int64_init_base(left_val + right_val);
+        case AST_SPECIALIZATION_INTEGER_SUB:
+            return object_int64_init_base(left_val - right_val);
+        case AST_SPECIALIZATION_INTEGER_MUL:
+            return object_int64_init_base(left_val * right_val);
+        case AST_SPECIALIZATION_INTEGER_DIV:
+            return object_int64_init_base(left_val / right_val);
+        case AST_SPECIALIZATION_INTEGER_LT:
+            return object_boolean_init_base(left_val < right_val);
+        case AST_SPECIALIZATION_INTEGER_GT:
+            return object_boolean_init_base(left_val > right_val);
+        case AST_SPECIALIZATION_INTEGER_EQ:
+            return object_boolean_init_base(left_val == right_val);
+        case AST_SPECIALIZATION_INTEGER_NOT_EQ:
+            return object_boolean_init_base(left_val != right_val);
+        default:
+            abort();
+    }
+}
+
+struct object* eval_prefix_quickened(struct ast_prefix_expression* node, struct object* right) {
+    if (right == NULL) return eval_prefix_expression(node->op, right);
+    struct ast_quickening* q = &node->quickening;
+    if (q->specialization == AST_SPECIALIZATION_UNSPECIALIZED) {
+        specialize(q, prefix_specialization(node->op, right));
+    }
+    if (!q->proven and
+        (q->specialization == AST_SPECIALIZATION_GENERIC or
+         !guard(q, object_type(right) == specialization_operand_type(q->specialization)))) {
+        return eval_prefix_expression(node->op, right);
+    }
+
+    if (q->specialization == AST_SPECIALIZATION_BOOLEAN_NOT) {
+        return object_boolean_init_base(!object_boolean_value(right));
+    }
+    int64_t value = object_int64_value(right);
+    object_decref(right);
+    return object_int64_init_base(-value);
+}
+
+struct object* eval_index_quickened(
+    struct ast_index_expression* node,
+    struct object* left,
+    struct object* index
+) {
+    struct ast_quickening* q = &node->quickening;
+    if (q->proven) return eval_array_index_expression((struct object_array*)left, index);
+    bool array_index =
+        object_type(left) == OBJECT_ARRAY and object_type(index) == OBJECT_INTEGER;
+    if (q->specialization == AST_SPECIALIZATION_UNSPECIALIZED) {
+        specialize(q, array_index ? AST_SPECIALIZATION_ARRAY_INDEX : AST_SPECIALIZATION_GENERIC);
+    }
+    if (q->specialization == AST_SPECIALIZATION_GENERIC or !guard(q, array_index)) {
+        return eval_index_expression(left, index);
+    }
+    return eval_array_index_expression((struct object_array*)left, index);
+}
+
+// Makes a call whose arity matches its callee, evaluating the arguments straight into the
+// parameter slots of the callee's frame rather than gathering them first. Takes ownership of `fn`.
+static struct object* call_in_frame(
+    struct ast_call_expression* call,
+    struct object_function* fn,
+    const bool* dropped,
+    struct environment* env
+) {
+    struct environment* frame = push_call_frame(fn->env, fn->locals, fn->escapes, fn->captured);
+    bool types_hold = true;
+    size_t parameter = 0;
+    for (size_t i = 0; i < call->arguments.len; i++) {
+        if (dropped != NULL and dropped[i]) continue;
+        struct object* evaluated = eval_expression(call->arguments.ptr[i], env);
+        if (is_error(evaluated)) {
+            environment_decref(frame);
+            object_decref(&fn->object);
+            return evaluated;
+        }
+        struct ast_identifier* p = fn->parameters.ptr[parameter++];
+        types_hold = types_hold and has_type(evaluated, p->type);
+        bind_slot(p->address, evaluated, frame);
     }
+    if (!types_hold) forget_parameter_types(fn->parameters, fn->body);
+
+    struct object* result = run_function(fn, frame);
+    object_decref(&fn->object);
+    return finish_call(result, frame);
+}
+
+// Makes a call to a builtin. Builtins only borrow their arguments, so the arguments are evaluated
+// into a frame of their own on the frame stack and the builtin is handed a view of its slots.
+// Takes ownership of `fn`.
+static struct object* call_builtin(
+    struct ast_call_expression* call,
+    struct object_builtin* fn,
+    struct environment* env
+) {
+    struct environment* frame = environment_push_frame(NULL, call->arguments.len);
+    struct object* result = NULL;
+    for (size_t i = 0; i < call->arguments.len; i++) {
+        struct object* evaluated = eval_expression(call->arguments.ptr[i], env);
+        if (is_error(evaluated)) {
+            result = evaluated;
+            break;
+        }
+        frame->slots.ptr[i] = evaluated;
+    }
+    if (result == NULL) result = fn->fn(frame->slots);
+    environment_decref(frame);
+    object_decref(&fn->object);
+    return result;
 }
 
 static struct object*
-eval_hash_literal(struct evaluator* ev, struct ast_hash_literal* hash, struct environment* env) {
+eval_call_expression(struct ast_call_expression* call, struct environment* env, bool tail) {
+    struct object* function = eval_expression(call->function, env);
+    if (is_error(function)) return function;
+    const bool* dropped;
+    function = specialize_callee(call, function, &dropped);
+    // a builtin returns at once, so even in tail position it needn't be handed back
+    if (object_type(function) == OBJECT_BUILTIN) {
+        return call_builtin(call, (struct object_builtin*)function, env);
+    }
+    if (!tail and object_type(function) == OBJECT_FUNCTION) {
+        auto fn = (struct object_function*)function;
+        size_t count = call->arguments.len;
+        for (size_t i = 0; dropped != NULL and i < call->arguments.len; i++) {
+            count -= dropped[i];
+        }
+        if (count == fn->parameters.len) return call_in_frame(call, fn, dropped, env);
+    }
+    struct object_buf args = eval_expressions(call->arguments, dropped, env);
+    if (args.len == 1 and is_error(args.ptr[0])) {
+        object_decref(function);
+        struct object* err = args.ptr[0];
+        BUF_FREE(args);
+        return err;
+    }
+
+    if (tail) return object_tail_call_init_base(function, args);
+    return apply_function(function, args);
+}
+
+static struct object* eval_hash_literal(struct ast_hash_literal* hash, struct environment* env) {
     struct object_hash_table table;
     object_hash_table_init(&table);
 
     for (const struct ast_expression_hash_bucket* bucket = ast_expression_hash_first(&hash->pairs);
          bucket != NULL;
          bucket = ast_expression_hash_next(&hash->pairs, bucket)) {
-        struct object* key = eval_expression(ev, bucket->key, env);
+        struct object* key = eval_expression(bucket->key, env);
         if (is_error(key)) {
             object_hash_table_free(&table);
             return key;
         }
-        if (!object_is_hashable(key)) {
+        struct object* err = check_hash_key(key);
+        if (err != NULL) {
             object_hash_table_free(&table);
-            object_free(key);
-            return object_error_init_base(string_printf(
-                "unusable as hash key: " STRING_FMT,
-                STRING_ARG(object_type_string(key->type))
-            ));
+            return err;
         }
 
         struct object_hash_key hash_key = object_hash_key(key);
 
-        struct object* value = eval_expression(ev, bucket->value, env);
+        struct object* value = eval_expression(bucket->value, env);
         if (is_error(value)) {
             object_hash_table_free(&table);
-            object_free(key);
+            object_decref(key);
             return value;
         }
 
@@ -526,8 +820,7 @@ eval_hash_literal(struct evaluator* ev, struct ast_hash_literal* hash, struct en
     return object_hash_init_base(table);
 }
 
-static struct object*
-eval_expression(struct evaluator* ev, struct ast_expression* expression, struct environment* env) {
+static struct object* eval_expression(struct ast_expression* expression, struct environment* env) {
     switch (expression->type) {
         case AST_EXPRESSION_INTEGER_LITERAL:
             return object_int64_init_base(((struct ast_integer_literal*)expression)->value);
@@ -535,68 +828,44 @@ eval_expression(struct evaluator* ev, struct ast_expression* expression, struct
             return object_boolean_init_base(((struct ast_boolean*)expression)->value);
         case AST_EXPRESSION_PREFIX: {
             auto exp = (struct ast_prefix_expression*)expression;
-            struct object* right = eval_expression(ev, exp->right, env);
+            struct object* right = eval_expression(exp->right, env);
             if (is_error(right)) return right;
 
-            return eval_prefix_expression(exp->op, right);
+            return eval_prefix_quickened(exp, right);
         }
         case AST_EXPRESSION_INFIX: {
             auto exp = (struct ast_infix_expression*)expression;
-            struct object* left = eval_expression(ev, exp->left, env);
+            struct object* left = eval_expression(exp->left, env);
             if (is_error(left)) return left;
-            struct object* right = eval_expression(ev, exp->right, env);
+            struct object* right = eval_expression(exp->right, env);
             if (is_error(right)) {
-                object_free(left);
+                object_decref(left);
                 return right;
             }
 
-            return eval_infix_expression(exp->op, left, right);
-        }
-        case AST_EXPRESSION_IF:
-            return eval_if_expression(ev, (struct ast_if_expression*)expression, env);
-        case AST_EXPRESSION_IDENTIFIER:
-            return eval_identifier((struct ast_identifier*)expression, env);
-        case AST_EXPRESSION_FUNCTION: {
-            auto func = (struct ast_function_literal*)expression;
-            struct function_parameter_buf params = {0};
-            BUF_RESERVE(&params, func->parameters.len);
-            for (size_t i = 0; i < func->parameters.len; i++) {
-                BUF_PUSH(
-                    &params,
-                    (struct ast_identifier*)
-                        ast_node_incref(&func->parameters.ptr[i]->expression.node)
-                );
-            }
-            auto body = (struct ast_block_statement*)ast_node_incref(&func->body->statement.node);
-            return object_function_init_base(params, body, env);
+            return eval_infix_quickened(exp, left, right);
         }
-        case AST_EXPRESSION_CALL: {
-            auto call = (struct ast_call_expression*)expression;
-            struct object* function = eval_expression(ev, call->function, env);
-            if (is_error(function)) return function;
-            struct object_buf args = eval_expressions(ev, call->arguments, env);
-            if (args.len == 1 and is_error(args.ptr[0])) {
-                object_free(function);
-                struct object* err = args.ptr[0];
-                BUF_FREE(args);
-                return err;
+        case AST_EXPRESSION_IF: {
+            struct completion result =
+                eval_if_expression((struct ast_if_expression*)expression, env, POSITION_PLAIN);
+            if (result.type == COMPLETION_RETURN) {
+                return object_return_value_init_base(result.value);
             }
-
-            struct object* result = apply_function(ev, function, args);
-            object_free(function);
-            for (size_t i = 0; i < args.len; i++) {
-                object_free(args.ptr[i]);
-            }
-            BUF_FREE(args);
-            return result;
+            return result.value;
         }
+        case AST_EXPRESSION_IDENTIFIER:
+            return eval_identifier((struct ast_identifier*)expression, env);
+        case AST_EXPRESSION_FUNCTION:
+            return eval_function_literal((struct ast_function_literal*)expression, env);
+        case AST_EXPRESSION_CALL:
+            return eval_call_expression((struct ast_call_expression*)expression, env, false);
         case AST_EXPRESSION_STRING:
             return object_string_init_base(
                 string_dup(((struct ast_string_literal*)expression)->value)
             );
         case AST_EXPRESSION_ARRAY: {
             auto array = (struct ast_array_literal*)expression;
-            struct object_buf elements = eval_expressions(ev, array->elements, env);
+            struct object_buf elements = eval_expressions(array->elements, NULL, env);
             if (elements.len == 1 and is_error(elements.ptr[0])) {
                 struct object* err = elements.ptr[0];
                 BUF_FREE(elements);
@@ -606,91 +875,119 @@ eval_expression(struct evaluator* ev, struct ast_expression* expression, struct
         }
         case AST_EXPRESSION_INDEX: {
             auto exp = (struct ast_index_expression*)expression;
-            struct object* left = eval_expression(ev, exp->left, env);
+            struct object* left = eval_expression(exp->left, env);
             if (is_error(left)) return left;
-            struct object* index = eval_expression(ev, exp->index, env);
+            struct object* index = eval_expression(exp->index, env);
             if (is_error(index)) {
-                object_free(left);
+                object_decref(left);
                 return index;
             }
 
-            return eval_index_expression(left, index);
+            return eval_index_quickened(exp, left, index);
         }
         case AST_EXPRESSION_HASH:
-            return eval_hash_literal(ev, (struct ast_hash_literal*)expression, env);
+            return eval_hash_literal((struct ast_hash_literal*)expression, env);
         default:
             // [TODO] eval_expression
             return object_null_init_base();
     }
 }
 
-static struct object*
-eval_statement(struct evaluator* ev, struct ast_statement* statement, struct environment* env) {
+// Evaluates an expression that is a statement of its own, or the value of one.
+static struct completion eval_expression_at(
+    struct ast_expression* expression,
+    struct environment* env,
+    enum position position
+) {
+    switch (expression->type) {
+        case AST_EXPRESSION_IF:
+            return eval_if_expression((struct ast_if_expression*)expression, env, position);
+        case AST_EXPRESSION_CALL: {
+            auto call = (struct ast_call_expression*)expression;
+            return complete(eval_call_expression(call, env, position == POSITION_TAIL));
+        }
+        default:
+            return complete(eval_expression(expression, env));
+    }
+}
+
+static struct completion
+eval_statement(struct ast_statement* statement, struct environment* env, enum position position) {
     switch (statement->type) {
         case AST_STATEMENT_EXPRESSION:
-            return eval_expression(
-                ev,
+            return eval_expression_at(
                 ((struct ast_expression_statement*)statement)->expression,
-                env
+                env,
+                position
             );
         case AST_STATEMENT_BLOCK:
-            return eval_block_statement(ev, (struct ast_block_statement*)statement, env);
+            return eval_block_statement((struct ast_block_statement*)statement, env, position);
         case AST_STATEMENT_RETURN: {
-            struct object* val =
-                eval_expression(ev, ((struct ast_return_statement*)statement)->return_value, env);
-            if (is_error(val)) return val;
-
-            return object_return_value_init_base(val);
+            struct ast_expression* return_value =
+                ((struct ast_return_statement*)statement)->return_value;
+            struct completion result = eval_expression_at(
+                return_value,
+                env,
+                position == POSITION_PLAIN ? POSITION_PLAIN : POSITION_TAIL
+            );
+            if (result.type == COMPLETION_NORMAL) result.type = COMPLETION_RETURN;
+            return result;
         }
         case AST_STATEMENT_LET: {
             struct ast_let_statement* let = (struct ast_let_statement*)statement;
-            struct object* val = eval_expression(ev, let->value, env);
-            if (is_error(val)) return val;
-            environment_set(env, string_dup(let->name->value), val);
-            return object_null_init_base();
+            struct object* val = eval_expression(let->value, env);
+            if (is_error(val)) return (struct completion){COMPLETION_ERROR, val};
+            bind_variable(let->name, val, env);
+            return (struct completion){COMPLETION_NORMAL, object_null_init_base()};
         }
         default:
             // [TODO] eval_statement
-            return object_null_init_base();
+            return (struct completion){COMPLETION_NORMAL, object_null_init_base()};
     }
 }
 
-static struct object*
-eval_program(struct evaluator* ev, struct ast_program* program, struct environment* env) {
+static struct object* eval_program(struct ast_program* program, struct environment* env) {
     struct object* result = NULL;
 
     for (size_t i = 0; i < program->statements.len; i++) {
-        object_free(result);
-        result = eval_statement(ev, program->statements.ptr[i], env);
-        if (result) {
-            switch (result->type) {
-                case OBJECT_RETURN_VALUE:
-                    return object_return_value_unwrap(result);
-                case OBJECT_ERROR:
-                    return result;
-                default:
-                    break;
-            }
-        }
+        object_decref(result);
+        struct completion completion =
+            eval_statement(program->statements.ptr[i], env, POSITION_PLAIN);
+        result = completion.value;
+        if (completion.type != COMPLETION_NORMAL) return result;
     }
 
     return result;
 }
 
+struct object* tree_eval_expression(struct ast_expression* expression, struct environment* env) {
+    return eval_expression(expression, env);
+}
+
+struct object* tree_apply_function(struct object* fn, struct object_buf args) {
+    return apply_function(fn, args);
+}
+
 struct object* eval(struct ast_node* node, struct environment* env) {
-    struct evaluator ev = evaluator_new(env);
+    builtins_define(env);
+    resolve(node);
     struct object* result;
     switch (node->type) {
         case AST_NODE_EXPRESSION:
-            result = eval_expression(&ev, (struct ast_expression*)node, env);
+            result = eval_expression((struct ast_expression*)node, env);
             break;
-        case AST_NODE_STATEMENT:
-            result = eval_statement(&ev, (struct ast_statement*)node, env);
+        case AST_NODE_STATEMENT: {
+            struct completion completion =
+                eval_statement((struct ast_statement*)node, env, POSITION_PLAIN);
+            // a lone `return` statement still evaluates to a return value
+            result = completion.type == COMPLETION_RETURN
+                         ? object_return_value_init_base(completion.value)
+                         : completion.value;
             break;
+        }
         case AST_NODE_PROGRAM:
-            result = eval_program(&ev, (struct ast_program*)node, env);
+            result = eval_program((struct ast_program*)node, env);
             break;
     }
-    evaluator_free(ev);
     return result;
 }
@@ -0,0 +1,309 @@
+#include "monkey/gc.h"
+
+#include <iso646.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+#include "monkey/environment.h"
+#include "monkey/object.h"
+#include "monkey/private/stdc.h"
+
+// Collect once this many nodes have been tracked since the last collection, or as many as
+// survived it, whichever is larger, so collection work stays proportional to allocation.
+#define GC_MIN_THRESHOLD 10000
+
+static struct gc_node tracked = {.prev = &tracked, .next = &tracked};
+static size_t allocations;
+static size_t threshold = GC_MIN_THRESHOLD;
+static bool collecting;
+static struct gc_stats stats;
+static gc_stats_callback_t* stats_callback;
+static void* stats_callback_data;
+
+static void list_append(struct gc_node* list, struct gc_node* node) {
+    node->prev = list->prev;
+    node->next = list;
+    list->prev->next = node;
+    list->prev = node;
+}
+
+static void list_unlink(struct gc_node* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node;
+    node->next = node;
+}
+
+static struct environment* node_environment(struct gc_node* node) {
+    return (struct environment*)((char*)node - offsetof(struct environment, gc));
+}
+
+static size_t* node_rc(struct gc_node* node) {
+    return node->object != NULL ? &node->object->rc : &node_environment(node)->rc;
+}
+
+static void node_incref(struct gc_node* node) {
+    ++*node_rc(node);
+}
+
+static void node_decref(struct gc_node* node) {
+    if (node->object != NULL) {
+        object_decref(node->object);
+    } else {
+        environment_decref(node_environment(node));
+    }
+}
+
+static struct gc_node* object_gc_node(struct object* obj) {
+    if (obj == NULL) return NULL;
+    switch (object_type(obj)) {
+        case OBJECT_RETURN_VALUE:
+            return &((struct object_return_value*)obj)->gc;
+        case OBJECT_FUNCTION:
+            return &((struct object_function*)obj)->gc;
+        case OBJECT_ARRAY:
+            return &((struct object_array*)obj)->gc;
+        case OBJECT_HASH:
+            return &((struct object_hash*)obj)->gc;
+        case OBJECT_CLOSURE:
+            return &((struct object_closure*)obj)->gc;
+        case OBJECT_NATIVE_FUNCTION:
+            return &((struct object_native_function*)obj)->gc;
+        default:
+            return NULL;
+    }
+}
+
+typedef void visit_t(struct gc_node* child);
+
+static void visit_object(struct object* obj, visit_t* visit) {
+    struct gc_node* child = object_gc_node(obj);
+    if (child != NULL) visit(child);
+}
+
+// Calls `visit` on every tracked node directly referenced by `node`.
+static void traverse(struct gc_node* node, visit_t* visit) {
+    if (node->object == NULL) {
+        struct environment* env = node_environment(node);
+        for (size_t i = 0; i < env->entries.len; i++) {
+            if (env->entries.ptr[i].name.length > 0) {
+                visit_object(env->entries.ptr[i].value, visit);
+            }
+        }
+        for (size_t i = 0; i < env->slots.len; i++) {
+            visit_object(env->slots.ptr[i], visit);
+        }
+        if (env->outer != NULL) visit(&env->outer->gc);
+        return;
+    }
+
+    struct object* obj = node->object;
+    switch (object_type(obj)) {
+        case OBJECT_RETURN_VALUE:
+            visit_object(((struct object_return_value*)obj)->value, visit);
+            break;
+        case OBJECT_FUNCTION: {
+            auto function = (struct object_function*)obj;
+            if (function->env != NULL) visit(&function->env->gc);
+            visit_object(function->specialized, visit);
+            break;
+        }
+        case OBJECT_NATIVE_FUNCTION: {
+            struct environment* env = ((struct object_native_function*)obj)->env;
+            if (env != NULL) visit(&env->gc);
+            break;
+        }
+        case OBJECT_ARRAY: {
+            auto array = (struct object_array*)obj;
+            for (size_t i = 0; i < array->elements.len; i++) {
+                visit_object(array->elements.ptr[i], visit);
+            }
+            break;
+        }
+        case OBJECT_HASH: {
+            struct object_hash_bucket_buf buckets = ((struct object_hash*)obj)->pairs.buckets;
+            for (size_t i = 0; i < buckets.len; i++) {
+                if (buckets.ptr[i].value.key == NULL) continue;
+                visit_object(buckets.ptr[i].value.key, visit);
+                visit_object(buckets.ptr[i].value.value, visit);
+            }
+            break;
+        }
+        case OBJECT_CLOSURE: {
+            struct environment* env = ((struct object_closure*)obj)->env;
+            if (env != NULL) visit(&env->gc);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Drops every reference `node` holds, leaving it valid but empty.
+static void clear(struct gc_node* node) {
+    if (node->object == NULL) {
+        environment_clear(node_environment(node));
+        return;
+    }
+
+    struct object* obj = node->object;
+    switch (object_type(obj)) {
+        case OBJECT_RETURN_VALUE: {
+            auto self = (struct object_return_value*)obj;
+            struct object* value = self->value;
+            self->value = NULL;
+            object_decref(value);
+            break;
+        }
+        case OBJECT_FUNCTION: {
+            auto self = (struct object_function*)obj;
+            struct environment* env = self->env;
+            struct object* specialized = self->specialized;
+            self->env = NULL;
+            self->specialized = NULL;
+            if (env != NULL) environment_decref(env);
+            object_decref(specialized);
+            break;
+        }
+        case OBJECT_NATIVE_FUNCTION: {
+            auto self = (struct object_native_function*)obj;
+            struct environment* env = self->env;
+            self->env = NULL;
+            if (env != NULL) environment_decref(env);
+            break;
+        }
+        case OBJECT_ARRAY: {
+            auto self = (struct object_array*)obj;
+            struct object_buf elements = self->elements;
+            self->elements = (struct object_buf){0};
+            for (size_t i = 0; i < elements.len; i++) {
+                object_decref(elements.ptr[i]);
+            }
+            BUF_FREE(elements);
+            break;
+        }
+        case OBJECT_HASH: {
+            auto self = (struct object_hash*)obj;
+            struct object_hash_table pairs = self->pairs;
+            object_hash_table_init(&self->pairs);
+            object_hash_table_free(&pairs);
+            break;
+        }
+        case OBJECT_CLOSURE: {
+            auto self = (struct object_closure*)obj;
+            struct environment* env = self->env;
+            self->env = NULL;
+            if (env != NULL) environment_decref(env);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void subtract_internal_ref(struct gc_node* child) {
+    child->gc_refs--;
+}
+
+static struct gc_node* reachable_list;
+
+static void rescue(struct gc_node* child) {
+    // gc_refs is only zero for nodes still on the unreachable list
+    if (child->gc_refs == 0) {
+        child->gc_refs = 1;
+        list_unlink(child);
+        list_append(reachable_list, child);
+    }
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * UINT64_C(1000000000) + (uint64_t)ts.tv_nsec;
+}
+
+void gc_track(struct gc_node* node, struct object* object) {
+    if (++allocations >= threshold and !collecting) {
+        gc_collect();
+    }
+    node->object = object;
+    node->gc_refs = 0;
+    list_append(&tracked, node);
+    stats.tracked++;
+}
+
+void gc_untrack(struct gc_node* node) {
+    list_unlink(node);
+    stats.tracked--;
+}
+
+size_t gc_collect(void) {
+    uint64_t start = now_ns();
+    collecting = true;
+
+    // Count the references that come from outside the tracked set.
+    for (struct gc_node* node = tracked.next; node != &tracked; node = node->next) {
+        node->gc_refs = *node_rc(node);
+    }
+    for (struct gc_node* node = tracked.next; node != &tracked; node = node->next) {
+        traverse(node, subtract_internal_ref);
+    }
+
+    // Nodes without outside references are garbage unless a root reaches them.
+    struct gc_node unreachable = {.prev = &unreachable, .next = &unreachable};
+    for (struct gc_node* node = tracked.next; node != &tracked;) {
+        struct gc_node* next = node->next;
+        if (node->gc_refs == 0) {
+            list_unlink(node);
+            list_append(&unreachable, node);
+        }
+        node = next;
+    }
+    // Rescued nodes are appended to `tracked`, so this walk also visits them.
+    reachable_list = &tracked;
+    for (struct gc_node* node = tracked.next; node != &tracked; node = node->next) {
+        traverse(node, rescue);
+    }
+
+    // Hold every garbage node while breaking the cycles, so none is freed before all are cleared.
+    size_t collected = 0;
+    for (struct gc_node* node = unreachable.next; node != &unreachable; node = node->next) {
+        node_incref(node);
+        collected++;
+    }
+    for (struct gc_node* node = unreachable.next; node != &unreachable; node = node->next) {
+        clear(node);
+    }
+    while (unreachable.next != &unreachable) {
+        struct gc_node* node = unreachable.next;
+        // freeing untracks the node, so move it back to where gc_untrack expects it
+        list_unlink(node);
+        list_append(&tracked, node);
+        node_decref(node);
+    }
+
+    collecting = false;
+    allocations = 0;
+    threshold = stats.tracked > GC_MIN_THRESHOLD ? stats.tracked : GC_MIN_THRESHOLD;
+
+    uint64_t end = now_ns();
+    // the clock isn't guaranteed to be monotonic
+    uint64_t pause = end > start ? end - start : 0;
+    stats.collections++;
+    stats.collected = collected;
+    stats.pause_ns = pause;
+    stats.total_pause_ns += pause;
+    if (pause > stats.max_pause_ns) stats.max_pause_ns = pause;
+    if (stats_callback != NULL) stats_callback(&stats, stats_callback_data);
+    return collected;
+}
+
+struct gc_stats gc_stats(void) {
+    return stats;
+}
+
+void gc_set_stats_callback(gc_stats_callback_t* callback, void* data) {
+    stats_callback = callback;
+    stats_callback_data = data;
+}
@@ -0,0 +1,688 @@
+#include "monkey/inference.h"
+
+#include <assert.h>
+#include <iso646.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "monkey/private/stdc.h"
+#include "monkey/resolver.h"
+
+// A slot of a function's environment.
+struct slot {
+    // the join of the types of everything bound to the slot
+    enum ast_type type;
+    // parameters and lets binding the slot
+    size_t bindings;
+    // the function literal bound by the slot's let, when that is its one binding
+    struct ast_function_literal* function;
+};
+
+struct function_types {
+    struct ast_function_literal* literal;
+    struct slot* slots;
+};
+
+BUF_T(struct function_types, function_types);
+
+// A function whose body is being walked.
+struct frame {
+    struct ast_function_literal* literal;
+    struct slot* slots;
+    // whether every path to the current node has bound each slot; a slot that isn't bound yet
+    // reads whatever its name is bound to outside
+    bool* assigned;
+};
+
+BUF_T(struct frame, frame);
+
+// A variable bound by a `let` outside every function.
+struct global {
+    struct string name;
+    size_t bindings;
+    struct ast_function_literal* function;
+};
+
+BUF_T(struct global, global);
+
+struct inference {
+    // every function literal, in the order the walk reaches them
+    struct function_types_buf functions;
+    size_t next_function;
+    // the functions around the current node, innermost last
+    struct frame_buf frames;
+    struct global_buf globals;
+    // whether this is the first walk, which finds the functions and counts their bindings
+    bool first;
+    // whether a type grew during this walk
+    bool changed;
+    // whether a return statement has been walked since the flag was last cleared
+    bool returned;
+    // whether this is the last walk, which proves operator nodes
+    bool annotate;
+};
+
+static enum ast_type join(enum ast_type a, enum ast_type b) {
+    if (a == b or b == AST_TYPE_UNKNOWN) return a;
+    if (a == AST_TYPE_UNKNOWN) return b;
+    return AST_TYPE_ANY;
+}
+
+static void widen(struct inference* inf, enum ast_type* type, enum ast_type with) {
+    enum ast_type joined = join(*type, with);
+    if (joined != *type) {
+        *type = joined;
+        inf->changed = true;
+    }
+}
+
+static struct global* find_global(struct inference* inf, struct string name) {
+    for (size_t i = 0; i < inf->globals.len; i++) {
+        if (STRING_EQUAL(inf->globals.ptr[i].name, name)) return &inf->globals.ptr[i];
+    }
+    return NULL;
+}
+
+// The function whose environment holds a resolved identifier, or NULL for a global.
+static struct frame* frame_of(struct inference* inf, struct ast_identifier* identifier) {
+    size_t depth = identifier->address.depth;
+    if (!identifier->address.resolved or depth >= inf->frames.len) return NULL;
+    return &inf->frames.ptr[inf->frames.len - 1 - depth];
+}
+
+static enum ast_specialization
+infix_specialization(enum ast_operator op, enum ast_type left, enum ast_type right) {
+    if (left != right) return AST_SPECIALIZATION_GENERIC;
+    if (left == AST_TYPE_INTEGER) {
+        switch (op) {
+            case AST_OPERATOR_PLUS:
+                return AST_SPECIALIZATION_INTEGER_ADD;
+            case AST_OPERATOR_MINUS:
+                return AST_SPECIALIZATION_INTEGER_SUB;
+            case AST_OPERATOR_ASTERISK:
+                return AST_SPECIALIZATION_INTEGER_MUL;
+            case AST_OPERATOR_SLASH:
+                return AST_SPECIALIZATION_INTEGER_DIV;
+            case AST_OPERATOR_LT:
+                return AST_SPECIALIZATION_INTEGER_LT;
+            case AST_OPERATOR_GT:
+                return AST_SPECIALIZATION_INTEGER_GT;
+            case AST_OPERATOR_EQ:
+                return AST_SPECIALIZATION_INTEGER_EQ;
+            case AST_OPERATOR_NOT_EQ:
+                return AST_SPECIALIZATION_INTEGER_NOT_EQ;
+            default:
+                break;
+        }
+    } else if (left == AST_TYPE_BOOLEAN) {
+        if (op == AST_OPERATOR_EQ) return AST_SPECIALIZATION_BOOLEAN_EQ;
+        if (op == AST_OPERATOR_NOT_EQ) return AST_SPECIALIZATION_BOOLEAN_NOT_EQ;
+    } else if (left == AST_TYPE_STRING) {
+        if (op == AST_OPERATOR_PLUS) return AST_SPECIALIZATION_STRING_CONCAT;
+    }
+    return AST_SPECIALIZATION_GENERIC;
+}
+
+// Proves a node's fast path when the operand types pick one, and takes back an earlier proof
+// otherwise.
+static void prove(struct ast_quickening* q, enum ast_specialization specialization) {
+    q->proven = specialization != AST_SPECIALIZATION_GENERIC;
+    if (q->proven) q->specialization = specialization;
+}
+
+// The type of an operator's result. An operator given operands it doesn't take gives an error,
+// which ends the program before anything can see it.
+static enum ast_type infix_type(enum ast_operator op, enum ast_type left, enum ast_type right) {
+    switch (op) {
+        case AST_OPERATOR_PLUS:
+            if (left == AST_TYPE_UNKNOWN or right == AST_TYPE_UNKNOWN) return AST_TYPE_UNKNOWN;
+            if (left == right and (left == AST_TYPE_INTEGER or left == AST_TYPE_STRING)) {
+                return left;
+            }
+            return AST_TYPE_ANY;
+        case AST_OPERATOR_MINUS:
+        case AST_OPERATOR_ASTERISK:
+        case AST_OPERATOR_SLASH:
+            return AST_TYPE_INTEGER;
+        default:
+            return AST_TYPE_BOOLEAN;
+    }
+}
+
+static enum ast_type infer_statement(struct inference* inf, struct ast_statement* statement);
+static enum ast_type infer_expression(struct inference* inf, struct ast_expression* expression);
+
+// The type of a block's value: that of its last statement. Unless the block is sure to run, its
+// lets don't count as bound after it.
+static enum ast_type
+infer_block(struct inference* inf, struct ast_block_statement* block, bool runs) {
+    struct frame* frame = inf->frames.len > 0 ? &inf->frames.ptr[inf->frames.len - 1] : NULL;
+    bool* assigned = frame != NULL ? frame->assigned : NULL;
+    size_t locals = frame != NULL ? frame->literal->locals : 0;
+    bool* saved = malloc(locals + 1);
+    if (assigned != NULL) memcpy(saved, assigned, locals);
+
+    // an empty block leaves no value at all
+    enum ast_type type = AST_TYPE_ANY;
+    for (size_t i = 0; i < block->statements.len; i++) {
+        type = infer_statement(inf, block->statements.ptr[i]);
+    }
+
+    if (assigned != NULL and !runs) memcpy(assigned, saved, locals);
+    free(saved);
+    return type;
+}
+
+// A branch that returns leaves the return value as the value of the `if`, which only a statement
+// passes on to the call.
+static enum ast_type
+infer_if(struct inference* inf, struct ast_if_expression* expression, bool statement) {
+    infer_expression(inf, expression->condition);
+    bool returned = inf->returned;
+    inf->returned = false;
+    // inlined calls and shared subexpressions are wrapped in `if (true)`
+    bool literal = expression->condition->type == AST_EXPRESSION_BOOLEAN;
+    bool runs = literal and ((struct ast_boolean*)expression->condition)->value;
+    enum ast_type consequence = infer_block(inf, expression->consequence, runs);
+    enum ast_type alternative = expression->alternative != NULL
+                                    ? infer_block(inf, expression->alternative, false)
+                                    : AST_TYPE_NULL;
+    enum ast_type type = join(consequence, alternative);
+    if (literal) {
+        type = ((struct ast_boolean*)expression->condition)->value ? consequence : alternative;
+    }
+    if (inf->returned and !statement) type = AST_TYPE_ANY;
+    inf->returned = inf->returned or returned;
+    return type;
+}
+
+static enum ast_type infer_function(struct inference* inf, struct ast_function_literal* literal) {
+    if (inf->first) {
+        struct function_types types = {
+            .literal = literal,
+            .slots = calloc(literal->locals + 1, sizeof(struct slot)),
+        };
+        BUF_PUSH(&inf->functions, types);
+    }
+    struct function_types* types = &inf->functions.ptr[inf->next_function++];
+    assert(types->literal == literal);
+
+    struct frame frame = {
+        .literal = literal,
+        .slots = types->slots,
+        .assigned = calloc(literal->locals + 1, sizeof(bool)),
+    };
+    for (size_t i = 0; i < literal->parameters.len; i++) {
+        struct ast_identifier* parameter = literal->parameters.ptr[i];
+        size_t slot = parameter->address.slot;
+        if (inf->first) frame.slots[slot].bindings++;
+        widen(inf, &frame.slots[slot].type, parameter->type);
+        frame.assigned[slot] = true;
+    }
+
+    BUF_PUSH(&inf->frames, frame);
+    bool returned = inf->returned;
+    widen(inf, &literal->return_type, infer_block(inf, literal->body, true));
+    inf->returned = returned;
+    inf->frames.len--;
+    free(frame.assigned);
+    return AST_TYPE_FUNCTION;
+}
+
+static enum ast_type infer_identifier(struct inference* inf, struct ast_identifier* identifier) {
+    struct frame* frame = frame_of(inf, identifier);
+    size_t slot = identifier->address.slot;
+    identifier->type =
+        frame != NULL and frame->assigned[slot] ? frame->slots[slot].type : AST_TYPE_ANY;
+    return identifier->type;
+}
+
+// Passes the argument types on to the parameters of the function called, when the callee names
+// it. A call returns the function's return type only if the callee is sure to be that function.
+static enum ast_type infer_call(struct inference* inf, struct ast_call_expression* call) {
+    infer_expression(inf, call->function);
+
+    struct ast_function_literal* function = NULL;
+    bool returns = false;
+    if (call->function->type == AST_EXPRESSION_FUNCTION) {
+        function = (struct ast_function_literal*)call->function;
+        returns = true;
+    } else if (call->function->type == AST_EXPRESSION_IDENTIFIER) {
+        auto identifier = (struct ast_identifier*)call->function;
+        struct frame* frame = frame_of(inf, identifier);
+        if (frame != NULL) {
+            struct slot* slot = &frame->slots[identifier->address.slot];
+            if (slot->bindings == 1) function = slot->function;
+            returns = frame->assigned[identifier->address.slot];
+        } else if (!identifier->address.resolved) {
+            // globals can be bound again by later programs, so only the parameters are guessed
+            struct global* global = find_global(inf, identifier->value);
+            if (global != NULL and global->bindings == 1) function = global->function;
+        }
+    }
+    if (function != NULL and function->parameters.len != call->arguments.len) function = NULL;
+
+    for (size_t i = 0; i < call->arguments.len; i++) {
+        enum ast_type type = infer_expression(inf, call->arguments.ptr[i]);
+        if (function != NULL) widen(inf, &function->parameters.ptr[i]->type, type);
+    }
+    return function != NULL and returns ? function->return_type : AST_TYPE_ANY;
+}
+
+static enum ast_type infer_expression(struct inference* inf, struct ast_expression* expression) {
+    switch (expression->type) {
+        case AST_EXPRESSION_IDENTIFIER:
+            return infer_identifier(inf, (struct ast_identifier*)expression);
+        case AST_EXPRESSION_INTEGER_LITERAL:
+            return AST_TYPE_INTEGER;
+        case AST_EXPRESSION_BOOLEAN:
+            return AST_TYPE_BOOLEAN;
+        case AST_EXPRESSION_STRING:
+            return AST_TYPE_STRING;
+        case AST_EXPRESSION_PREFIX: {
+            auto exp = (struct ast_prefix_expression*)expression;
+            enum ast_type right = infer_expression(inf, exp->right);
+            if (inf->annotate) {
+                enum ast_specialization specialization = AST_SPECIALIZATION_GENERIC;
+                if (exp->op == AST_OPERATOR_MINUS and right == AST_TYPE_INTEGER) {
+                    specialization = AST_SPECIALIZATION_INTEGER_NEGATE;
+                } else if (exp->op == AST_OPERATOR_BANG and right == AST_TYPE_BOOLEAN) {
+                    specialization = AST_SPECIALIZATION_BOOLEAN_NOT;
+                }
+                prove(&exp->quickening, specialization);
+            }
+            return exp->op == AST_OPERATOR_MINUS ? AST_TYPE_INTEGER : AST_TYPE_BOOLEAN;
+        }
+        case AST_EXPRESSION_INFIX: {
+            auto exp = (struct ast_infix_expression*)expression;
+            enum ast_type left = infer_expression(inf, exp->left);
+            enum ast_type right = infer_expression(inf, exp->right);
+            if (inf->annotate) prove(&exp->quickening, infix_specialization(exp->op, left, right));
+            return infix_type(exp->op, left, right);
+        }
+        case AST_EXPRESSION_IF:
+            return infer_if(inf, (struct ast_if_expression*)expression, false);
+        case AST_EXPRESSION_FUNCTION:
+            return infer_function(inf, (struct ast_function_literal*)expression);
+        case AST_EXPRESSION_CALL:
+            return infer_call(inf, (struct ast_call_expression*)expression);
+        case AST_EXPRESSION_ARRAY: {
+            auto array = (struct ast_array_literal*)expression;
+            for (size_t i = 0; i < array->elements.len; i++) {
+                infer_expression(inf, array->elements.ptr[i]);
+            }
+            return AST_TYPE_ARRAY;
+        }
+        case AST_EXPRESSION_INDEX: {
+            auto exp = (struct ast_index_expression*)expression;
+            enum ast_type left = infer_expression(inf, exp->left);
+            enum ast_type index = infer_expression(inf, exp->index);
+            if (inf->annotate) {
+                prove(
+                    &exp->quickening,
+                    left == AST_TYPE_ARRAY and index == AST_TYPE_INTEGER
+                        ? AST_SPECIALIZATION_ARRAY_INDEX
+                        : AST_SPECIALIZATION_GENERIC
+                );
+            }
+            return AST_TYPE_ANY;
+        }
+        case AST_EXPRESSION_HASH: {
+            auto hash = (struct ast_hash_literal*)expression;
+            for (auto bucket = ast_expression_hash_first(&hash->pairs); bucket != NULL;
+                 bucket = ast_expression_hash_next(&hash->pairs, bucket)) {
+                infer_expression(inf, bucket->key);
+                infer_expression(inf, bucket->value);
+            }
+            return AST_TYPE_HASH;
+        }
+    }
+    abort();
+}
+
+static void count_binding(struct inference* inf, struct ast_let_statement* let) {
+    struct ast_function_literal* function = let->value->type == AST_EXPRESSION_FUNCTION
+                                                ? (struct ast_function_literal*)let->value
+                                                : NULL;
+    struct frame* frame = frame_of(inf, let->name);
+    if (frame != NULL) {
+        struct slot* slot = &frame->slots[let->name->address.slot];
+        slot->bindings++;
+        slot->function = function;
+        return;
+    }
+    struct global* global = find_global(inf, let->name->value);
+    if (global == NULL) {
+        struct global new_global = {.name = let->name->value};
+        BUF_PUSH(&inf->globals, new_global);
+        global = &inf->globals.ptr[inf->globals.len - 1];
+    }
+    global->bindings++;
+    global->function = function;
+}
+
+static enum ast_type infer_let(struct inference* inf, struct ast_let_statement* let) {
+    if (inf->first) count_binding(inf, let);
+    struct frame* frame = frame_of(inf, let->name);
+    size_t slot = let->name->address.slot;
+    // a function can call itself through the name it's bound to
+    if (frame != NULL and let->value->type == AST_EXPRESSION_FUNCTION) {
+        frame->assigned[slot] = true;
+    }
+
+    enum ast_type type = infer_expression(inf, let->value);
+    // walking the value can move the frames
+    frame = frame_of(inf, let->name);
+    if (frame != NULL) {
+        widen(inf, &frame->slots[slot].type, type);
+        frame->assigned[slot] = true;
+        type = frame->slots[slot].type;
+    }
+    let->name->type = type;
+    return AST_TYPE_ANY;
+}
+
+static enum ast_type infer_statement(struct inference* inf, struct ast_statement* statement) {
+    switch (statement->type) {
+        case AST_STATEMENT_EXPRESSION: {
+            struct ast_expression* expression =
+                ((struct ast_expression_statement*)statement)->expression;
+            if (expression->type == AST_EXPRESSION_IF) {
+                return infer_if(inf, (struct ast_if_expression*)expression, true);
+            }
+            return infer_expression(inf, expression);
+        }
+        case AST_STATEMENT_BLOCK:
+            return infer_block(inf, (struct ast_block_statement*)statement, true);
+        case AST_STATEMENT_RETURN: {
+            enum ast_type type =
+                infer_expression(inf, ((struct ast_return_statement*)statement)->return_value);
+            if (inf->frames.len > 0) {
+                widen(inf, &inf->frames.ptr[inf->frames.len - 1].literal->return_type, type);
+            }
+            inf->returned = true;
+            // the value leaves with the return, so the block doesn't have one
+            return AST_TYPE_UNKNOWN;
+        }
+        case AST_STATEMENT_LET:
+            return infer_let(inf, (struct ast_let_statement*)statement);
+    }
+    abort();
+}
+
+static void walk(struct inference* inf, struct ast_program* program) {
+    inf->next_function = 0;
+    inf->changed = false;
+    inf->returned = false;
+    for (size_t i = 0; i < program->statements.len; i++) {
+        infer_statement(inf, program->statements.ptr[i]);
+    }
+    inf->first = false;
+}
+
+void infer_types(struct ast_program* program) {
+    resolve(&program->node);
+
+    struct inference inf = {.first = true};
+    // Types only grow, so walking until they stop reaches the least fixpoint. Parameters no call
+    // was tied to can be passed anything, which can grow other types again.
+    bool widened = true;
+    while (widened) {
+        do {
+            walk(&inf, program);
+        } while (inf.changed);
+
+        widened = false;
+        for (size_t i = 0; i < inf.functions.len; i++) {
+            struct function_parameter_buf parameters = inf.functions.ptr[i].literal->parameters;
+            for (size_t j = 0; j < parameters.len; j++) {
+                if (parameters.ptr[j]->type == AST_TYPE_UNKNOWN) {
+                    parameters.ptr[j]->type = AST_TYPE_ANY;
+                    widened = true;
+                }
+            }
+        }
+    }
+
+    inf.annotate = true;
+    walk(&inf, program);
+
+    for (size_t i = 0; i < inf.functions.len; i++) {
+        free(inf.functions.ptr[i].slots);
+    }
+    BUF_FREE(inf.functions);
+    BUF_FREE(inf.frames);
+    BUF_FREE(inf.globals);
+}
+
+static void forget_statement(struct ast_statement* statement);
+
+static void forget_block(struct ast_block_statement* block) {
+    for (size_t i = 0; i < block->statements.len; i++) {
+        forget_statement(block->statements.ptr[i]);
+    }
+}
+
+static void forget_expression(struct ast_expression* expression) {
+    switch (expression->type) {
+        case AST_EXPRESSION_PREFIX: {
+            auto exp = (struct ast_prefix_expression*)expression;
+            exp->quickening.proven = false;
+            forget_expression(exp->right);
+            break;
+        }
+        case AST_EXPRESSION_INFIX: {
+            auto exp = (struct ast_infix_expression*)expression;
+            exp->quickening.proven = false;
+            forget_expression(exp->left);
+            forget_expression(exp->right);
+            break;
+        }
+        case AST_EXPRESSION_IF: {
+            auto exp = (struct ast_if_expression*)expression;
+            forget_expression(exp->condition);
+            forget_block(exp->consequence);
+            if (exp->alternative != NULL) forget_block(exp->alternative);
+            break;
+        }
+        case AST_EXPRESSION_FUNCTION:
+            // closures read the variables of the function, so their proofs go too
+            forget_block(((struct ast_function_literal*)expression)->body);
+            break;
+        case AST_EXPRESSION_CALL: {
+            auto call = (struct ast_call_expression*)expression;
+            forget_expression(call->function);
+            for (size_t i = 0; i < call->arguments.len; i++) {
+                forget_expression(call->arguments.ptr[i]);
+            }
+            break;
+        }
+        case AST_EXPRESSION_ARRAY: {
+            auto array = (struct ast_array_literal*)expression;
+            for (size_t i = 0; i < array->elements.len; i++) {
+                forget_expression(array->elements.ptr[i]);
+            }
+            break;
+        }
+        case AST_EXPRESSION_INDEX: {
+            auto exp = (struct ast_index_expression*)expression;
+            exp->quickening.proven = false;
+            forget_expression(exp->left);
+            forget_expression(exp->index);
+            break;
+        }
+        case AST_EXPRESSION_HASH: {
+            auto hash = (struct ast_hash_literal*)expression;
+            for (auto bucket = ast_expression_hash_first(&hash->pairs); bucket != NULL;
+                 bucket = ast_expression_hash_next(&hash->pairs, bucket)) {
+                forget_expression(bucket->key);
+                forget_expression(bucket->value);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void forget_statement(struct ast_statement* statement) {
+    switch (statement->type) {
+        case AST_STATEMENT_EXPRESSION:
+            forget_expression(((struct ast_expression_statement*)statement)->expression);
+            break;
+        case AST_STATEMENT_BLOCK:
+            forget_block((struct ast_block_statement*)statement);
+            break;
+        case AST_STATEMENT_RETURN:
+            forget_expression(((struct ast_return_statement*)statement)->return_value);
+            break;
+        case AST_STATEMENT_LET:
+            forget_expression(((struct ast_let_statement*)statement)->value);
+            break;
+    }
+}
+
+void forget_parameter_types(
+    struct function_parameter_buf parameters,
+    struct ast_block_statement* body
+) {
+    for (size_t i = 0; i < parameters.len; i++) {
+        parameters.ptr[i]->type = AST_TYPE_ANY;
+    }
+    forget_block(body);
+}
+
+struct dump {
+    struct string out;
+    int depth;
+};
+
+static void dump_statement(struct dump* d, struct ast_statement* statement);
+static void dump_expression(struct dump* d, struct ast_expression* expression);
+
+static void dump_line(struct dump* d, struct string name, struct string type) {
+    string_append_printf(&d->out, "%*s", d->depth * 2, "");
+    if (name.length > 0) string_append_printf(&d->out, STRING_FMT ": ", STRING_ARG(name));
+    string_append_printf(&d->out, STRING_FMT "\n", STRING_ARG(type));
+}
+
+// Lists a function as `name: fn(<parameter types>) -> <return type>`, then its variables.
+static void
+dump_function(struct dump* d, struct string name, struct ast_function_literal* function) {
+    struct string signature = string_dup(STRING_REF("fn("));
+    for (size_t i = 0; i < function->parameters.len; i++) {
+        if (i > 0) string_append(&signature, STRING_REF(", "));
+        string_append(&signature, ast_type_string(function->parameters.ptr[i]->type));
+    }
+    string_append_printf(
+        &signature,
+        ") -> " STRING_FMT,
+        STRING_ARG(ast_type_string(function->return_type))
+    );
+    dump_line(d, name, signature);
+    STRING_FREE(signature);
+
+    d->depth++;
+    for (size_t i = 0; i < function->parameters.len; i++) {
+        struct ast_identifier* parameter = function->parameters.ptr[i];
+        dump_line(d, parameter->value, ast_type_string(parameter->type));
+    }
+    for (size_t i = 0; i < function->body->statements.len; i++) {
+        dump_statement(d, function->body->statements.ptr[i]);
+    }
+    d->depth--;
+}
+
+static void dump_block(struct dump* d, struct ast_block_statement* block) {
+    for (size_t i = 0; i < block->statements.len; i++) {
+        dump_statement(d, block->statements.ptr[i]);
+    }
+}
+
+static void dump_expression(struct dump* d, struct ast_expression* expression) {
+    switch (expression->type) {
+        case AST_EXPRESSION_PREFIX:
+            dump_expression(d, ((struct ast_prefix_expression*)expression)->right);
+            break;
+        case AST_EXPRESSION_INFIX: {
+            auto exp = (struct ast_infix_expression*)expression;
+            dump_expression(d, exp->left);
+            dump_expression(d, exp->right);
+            break;
+        }
+        case AST_EXPRESSION_IF: {
+            auto exp = (struct ast_if_expression*)expression;
+            dump_expression(d, exp->condition);
+            dump_block(d, exp->consequence);
+            if (exp->alternative != NULL) dump_block(d, exp->alternative);
+            break;
+        }
+        case AST_EXPRESSION_FUNCTION:
+            dump_function(d, STRING_REF(""), (struct ast_function_literal*)expression);
+            break;
+        case AST_EXPRESSION_CALL: {
+            auto call = (struct ast_call_expression*)expression;
+            dump_expression(d, call->function);
+            for (size_t i = 0; i < call->arguments.len; i++) {
+                dump_expression(d, call->arguments.ptr[i]);
+            }
+            break;
+        }
+        case AST_EXPRESSION_ARRAY: {
+            auto array = (struct ast_array_literal*)expression;
+            for (size_t i = 0; i < array->elements.len; i++) {
+                dump_expression(d, array->elements.ptr[i]);
+            }
+            break;
+        }
+        case AST_EXPRESSION_INDEX: {
+            auto exp = (struct ast_index_expression*)expression;
+            dump_expression(d, exp->left);
+            dump_expression(d, exp->index);
+            break;
+        }
+        case AST_EXPRESSION_HASH: {
+            auto hash = (struct ast_hash_literal*)expression;
+            for (auto bucket = ast_expression_hash_first(&hash->pairs); bucket != NULL;
+                 bucket = ast_expression_hash_next(&hash->pairs, bucket)) {
+                dump_expression(d, bucket->key);
+                dump_expression(d, bucket->value);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void dump_statement(struct dump* d, struct ast_statement* statement) {
+    switch (statement->type) {
+        case AST_STATEMENT_EXPRESSION:
+            dump_expression(d, ((struct ast_expression_statement*)statement)->expression);
+            break;
+        case AST_STATEMENT_BLOCK:
+            dump_block(d, (struct ast_block_statement*)statement);
+            break;
+        case AST_STATEMENT_RETURN:
+            dump_expression(d, ((struct ast_return_statement*)statement)->return_value);
+            break;
+        case AST_STATEMENT_LET: {
+            auto let = (struct ast_let_statement*)statement;
+            if (let->value->type == AST_EXPRESSION_FUNCTION) {
+                dump_function(d, let->name->value, (struct ast_function_literal*)let->value);
+            } else {
+                dump_line(d, let->name->value, ast_type_string(let->name->type));
+                dump_expression(d, let->value);
+            }
+            break;
+        }
+    }
+}
+
+struct string inferred_types_string(struct ast_program* program) {
+    struct dump d = {.out = EMPTY_STRING, .depth = 0};
+    for (size_t i = 0; i < program->statements.len; i++) {
+        dump_statement(&d, program->statements.ptr[i]);
+    }
+    return d.out;
+}
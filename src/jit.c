@@ -0,0 +1,1115 @@
+#include "monkey/jit.h"
+
+#include <inttypes.h>
+#include <iso646.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "monkey/private/evaluator.h"
+#include "monkey/private/stdc.h"
+#include "monkey/specializer.h"
+
+static bool enabled = true;
+static size_t threshold = JIT_DEFAULT_THRESHOLD;
+static bool perf_map_enabled = false;
+static struct jit_stats stats;
+
+void jit_set_enabled(bool value) {
+    enabled = value;
+}
+
+void jit_set_threshold(size_t calls) {
+    threshold = calls;
+}
+
+void jit_set_perf_map(bool value) {
+    perf_map_enabled = value;
+}
+
+struct jit_stats jit_stats(void) {
+    return stats;
+}
+
+#if defined(__x86_64__) and defined(__linux__)
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Compiled code is called with the call environment and an array of temporaries, zeroed, which
+// hold the values of the body's nodes. Like the C emitter's, each temporary is owned until the
+// code moves it out, and whatever is left is released by jit_run(). Throughout, rbx holds the
+// environment, r12 the temporaries and r13 the frame of a call being made.
+typedef struct object* jit_entry_t(struct environment* env, struct object** t);
+
+struct jit_code {
+    struct ast_code code;
+    // calls so far, until the body is compiled
+    size_t calls;
+    // NULL until compiled, or if the body couldn't be
+    jit_entry_t* entry;
+    bool failed;
+    size_t size;
+    size_t mapped;
+    size_t temps;
+    // whether compiled code can call the function directly: its parameters are the first slots of
+    // its frame, and it creates no closures
+    bool direct;
+};
+
+// Everything but the call into the evaluator is done by machine code stitched together from the
+// stencils below: instructions assembled ahead of time, with holes where the operands go.
+enum hole_kind {
+    HOLE_NONE,
+    HOLE_IMM8,
+    HOLE_IMM32,
+    HOLE_IMM64,
+    // displacement of a temporary from r12
+    HOLE_TEMP,
+    // rel32 to a label
+    HOLE_LABEL,
+};
+
+struct hole {
+    uint8_t offset;
+    uint8_t kind;
+    // which of the operands passed to emit_stencil() goes in the hole
+    uint8_t operand;
+};
+
+struct stencil {
+    const uint8_t* code;
+    size_t size;
+    struct hole holes[16];
+};
+
+#define HOLE4 0, 0, 0, 0
+#define HOLE8 HOLE4, HOLE4
+#define STENCIL(name, ...) \
+    static const struct stencil name = {name##_code, sizeof(name##_code), {__VA_ARGS__}}
+
+// push rbx; push r12; push r13; mov rbx, rdi; mov r12, rsi
+static const uint8_t prologue_code[] = {
+    0x53, 0x41, 0x54, 0x41, 0x55, 0x48, 0x89, 0xfb, 0x49, 0x89, 0xf4,
+};
+STENCIL(prologue);
+
+// pop r13; pop r12; pop rbx; ret
+static const uint8_t epilogue_code[] = {0x41, 0x5d, 0x41, 0x5c, 0x5b, 0xc3};
+STENCIL(epilogue);
+
+// mov rax, value; mov [r12 + dst], rax
+static const uint8_t constant_code[] = {0x48, 0xb8, HOLE8, 0x49, 0x89, 0x84, 0x24, HOLE4};
+// operands: dst, value
+STENCIL(constant, {2, HOLE_IMM64, 1}, {14, HOLE_TEMP, 0});
+
+// mov rax, [r12 + src]; mov [r12 + dst], rax; mov qword [r12 + src], 0
+static const uint8_t move_code[] = {
+    0x49, 0x8b, 0x84, 0x24, HOLE4, 0x49, 0x89, 0x84, 0x24, HOLE4,
+    0x49, 0xc7, 0x84, 0x24, HOLE4, 0x00, 0x00, 0x00, 0x00,
+};
+// operands: src, dst
+STENCIL(move, {4, HOLE_TEMP, 0}, {12, HOLE_TEMP, 1}, {20, HOLE_TEMP, 0});
+
+// mov rax, [r12 + src]; mov qword [r12 + src], 0; jmp exit
+static const uint8_t result_code[] = {
+    0x49, 0x8b, 0x84, 0x24, HOLE4, 0x49, 0xc7, 0x84, 0x24, HOLE4,
+    0x00, 0x00, 0x00, 0x00, 0xe9, HOLE4,
+};
+// operands: src, exit
+STENCIL(result, {4, HOLE_TEMP, 0}, {12, HOLE_TEMP, 0}, {21, HOLE_LABEL, 1});
+
+// xor eax, eax; jmp exit
+static const uint8_t no_result_code[] = {0x31, 0xc0, 0xe9, HOLE4};
+// operands: exit
+STENCIL(no_result, {3, HOLE_LABEL, 0});
+
+// jmp target
+static const uint8_t jump_code[] = {0xe9, HOLE4};
+// operands: target
+STENCIL(jump, {1, HOLE_LABEL, 0});
+
+// mov rdi, rbx; mov rsi, r12; mov rdx, a; mov rcx, b; mov r8, c; mov r9, d; mov rax, helper;
+// call rax; test rax, rax; jnz exit
+static const uint8_t call_code[] = {
+    0x48, 0x89, 0xdf, 0x4c, 0x89, 0xe6, 0x48, 0xba, HOLE8, 0x48, 0xb9, HOLE8,
+    0x49, 0xb8, HOLE8, 0x49, 0xb9, HOLE8, 0x48, 0xb8, HOLE8, 0xff, 0xd0,
+    0x48, 0x85, 0xc0, 0x0f, 0x85, HOLE4,
+};
+// operands: a, b, c, d, helper, exit
+STENCIL(
+    call,
+    {8, HOLE_IMM64, 0},
+    {18, HOLE_IMM64, 1},
+    {28, HOLE_IMM64, 2},
+    {38, HOLE_IMM64, 3},
+    {48, HOLE_IMM64, 4},
+    {63, HOLE_LABEL, 5}
+);
+
+// Releases the value of a statement, unless it's a wrapped return value, which ends the call like
+// a `return`: mov rax, [r12 + src]; mov qword [r12 + src], 0; test rax, rax; jz done;
+// test al, 7; jnz done; cmp dword [rax + type], OBJECT_RETURN_VALUE; je exit; mov rdi, rax;
+// mov rax, object_decref; call rax; done:
+static const uint8_t drop_code[] = {
+    0x49, 0x8b, 0x84, 0x24, HOLE4, 0x49, 0xc7, 0x84, 0x24, HOLE4, 0x00, 0x00, 0x00, 0x00,
+    0x48, 0x85, 0xc0, 0x74, 0x23, 0xa8, 0x07, 0x75, 0x1f, 0x81, 0xb8, HOLE4, HOLE4,
+    0x0f, 0x84, HOLE4, 0x48, 0x89, 0xc7, 0x48, 0xb8, HOLE8, 0xff, 0xd0,
+};
+// operands: src, exit, offset of type, OBJECT_RETURN_VALUE, object_decref
+STENCIL(
+    drop,
+    {4, HOLE_TEMP, 0},
+    {12, HOLE_TEMP, 0},
+    {31, HOLE_IMM32, 2},
+    {35, HOLE_IMM32, 3},
+    {41, HOLE_LABEL, 1},
+    {50, HOLE_IMM64, 4}
+);
+
+// Branches on the truthiness of a condition, deciding immediate booleans inline:
+// mov rax, [r12 + src]; cmp rax, true; je then; cmp rax, false; je else; mov rdi, rbx;
+// mov rsi, r12; mov rdx, src; mov rax, helper; call rax; test al, al; je else
+static const uint8_t branch_code[] = {
+    0x49, 0x8b, 0x84, 0x24, HOLE4, 0x48, 0x83, 0xf8, 0x00, 0x0f, 0x84, HOLE4,
+    0x48, 0x83, 0xf8, 0x00, 0x0f, 0x84, HOLE4, 0x48, 0x89, 0xdf, 0x4c, 0x89, 0xe6,
+    0x48, 0xba, HOLE8, 0x48, 0xb8, HOLE8, 0xff, 0xd0, 0x84, 0xc0, 0x0f, 0x84, HOLE4,
+};
+// operands: src, true, false, then, else, helper
+STENCIL(
+    branch,
+    {4, HOLE_TEMP, 0},
+    {11, HOLE_IMM8, 1},
+    {14, HOLE_LABEL, 3},
+    {21, HOLE_IMM8, 2},
+    {24, HOLE_LABEL, 4},
+    {36, HOLE_IMM64, 0},
+    {46, HOLE_IMM64, 5},
+    {60, HOLE_LABEL, 4}
+);
+
+// Loads two operands into rax and rcx, going to the slow path unless both are immediate
+// integers: mov rax, [r12 + left]; mov rcx, [r12 + right]; mov edx, eax; and edx, ecx;
+// test dl, 1; jz slow
+static const uint8_t integer_guard_code[] = {
+    0x49, 0x8b, 0x84, 0x24, HOLE4, 0x49, 0x8b, 0x8c, 0x24, HOLE4,
+    0x89, 0xc2, 0x21, 0xca, 0xf6, 0xc2, 0x01, 0x0f, 0x84, HOLE4,
+};
+// operands: left, right, slow
+STENCIL(integer_guard, {4, HOLE_TEMP, 0}, {12, HOLE_TEMP, 1}, {25, HOLE_LABEL, 2});
+
+// The integer operations leave their result in rdx, going to the slow path on overflow. An
+// integer n is tagged as 2n + 1.
+
+// lea rdx, [rax - 1]; add rdx, rcx; jo slow
+static const uint8_t integer_add_code[] = {
+    0x48, 0x8d, 0x50, 0xff, 0x48, 0x01, 0xca, 0x0f, 0x80, HOLE4,
+};
+// operands: slow
+STENCIL(integer_add, {9, HOLE_LABEL, 0});
+
+// mov rdx, rax; sub rdx, rcx; jo slow; or rdx, 1
+static const uint8_t integer_sub_code[] = {
+    0x48, 0x89, 0xc2, 0x48, 0x29, 0xca, 0x0f, 0x80, HOLE4, 0x48, 0x83, 0xca, 0x01,
+};
+// operands: slow
+STENCIL(integer_sub, {8, HOLE_LABEL, 0});
+
+// mov rdx, rax; sar rdx, 1; dec rcx; imul rdx, rcx; jo slow; or rdx, 1
+static const uint8_t integer_mul_code[] = {
+    0x48, 0x89, 0xc2, 0x48, 0xd1, 0xfa, 0x48, 0xff, 0xc9, 0x48, 0x0f, 0xaf, 0xd1,
+    0x0f, 0x80, HOLE4, 0x48, 0x83, 0xca, 0x01,
+};
+// operands: slow
+STENCIL(integer_mul, {15, HOLE_LABEL, 0});
+
+// Tagging preserves order, so tagged integers compare like the integers:
+// cmp rax, rcx; setcc dl; movzx edx, dl; shl edx, 3; or edx, false
+static const uint8_t integer_compare_code[] = {
+    0x48, 0x39, 0xc8, 0x0f, 0x00, 0xc2, 0x0f, 0xb6, 0xd2, 0xc1, 0xe2, 0x03, 0x83, 0xca, 0x00,
+};
+// operands: setcc opcode, false
+STENCIL(integer_compare, {4, HOLE_IMM8, 0}, {14, HOLE_IMM8, 1});
+
+#define SETL 0x9c
+#define SETG 0x9f
+#define SETE 0x94
+#define SETNE 0x95
+
+// mov [r12 + dst], rdx; jmp done
+static const uint8_t integer_result_code[] = {0x49, 0x89, 0x94, 0x24, HOLE4, 0xe9, HOLE4};
+// operands: dst, done
+STENCIL(integer_result, {4, HOLE_TEMP, 0}, {9, HOLE_LABEL, 1});
+
+// Variables are read and written through rax, which starts out as the call's environment and is
+// moved out one link at a time: mov rax, rbx
+static const uint8_t environment_code[] = {0x48, 0x89, 0xd8};
+STENCIL(environment);
+
+// mov rax, [rax + outer]
+static const uint8_t outer_code[] = {0x48, 0x8b, 0x80, HOLE4};
+// operands: offset of outer
+STENCIL(outer, {3, HOLE_IMM32, 0});
+
+// mov rax, [rax + slots]; mov rax, [rax + slot]
+static const uint8_t slot_code[] = {0x48, 0x8b, 0x80, HOLE4, 0x48, 0x8b, 0x80, HOLE4};
+// operands: offset of the slots, offset of the slot
+STENCIL(slot, {3, HOLE_IMM32, 0}, {10, HOLE_IMM32, 1});
+
+// Looks a global up through its identifier's cache, going to the slow path on a miss. Like
+// environment_get_cached(), it skips out past environments that bind no names:
+// mov rax, rbx; loop: cmp qword [rax + count], 0; jne found; mov rcx, [rax + outer];
+// test rcx, rcx; jz slow; mov rax, rcx; jmp loop; found: mov rsi, cache; cmp rax, [rsi + env];
+// jne slow; mov rcx, [rax + version]; cmp rcx, [rsi + version]; jne slow;
+// imul rcx, [rsi + index], entry size; add rcx, [rax + entries]; mov rax, [rcx + value]
+static const uint8_t global_code[] = {
+    0x48, 0x89, 0xd8, 0x48, 0x83, 0xb8, HOLE4, 0x00, 0x75, 0x15, 0x48, 0x8b, 0x88, HOLE4,
+    0x48, 0x85, 0xc9, 0x0f, 0x84, HOLE4, 0x48, 0x89, 0xc8, 0xeb, 0xe1, 0x48, 0xbe, HOLE8,
+    0x48, 0x3b, 0x86, HOLE4, 0x0f, 0x85, HOLE4, 0x48, 0x8b, 0x88, HOLE4, 0x48, 0x3b, 0x8e,
+    HOLE4, 0x0f, 0x85, HOLE4, 0x48, 0x69, 0x8e, HOLE4, HOLE4, 0x48, 0x03, 0x88, HOLE4,
+    0x48, 0x8b, 0x81, HOLE4,
+};
+// operands: slow, cache, offset of count, offset of outer, offset of the cached environment,
+// offset of version, offset of the cached version, offset of the cached index, entry size,
+// offset of the entries, offset of the value
+STENCIL(
+    global,
+    {6, HOLE_IMM32, 2},
+    {16, HOLE_IMM32, 3},
+    {25, HOLE_LABEL, 0},
+    {36, HOLE_IMM64, 1},
+    {47, HOLE_IMM32, 4},
+    {53, HOLE_LABEL, 0},
+    {60, HOLE_IMM32, 5},
+    {67, HOLE_IMM32, 6},
+    {73, HOLE_LABEL, 0},
+    {80, HOLE_IMM32, 7},
+    {84, HOLE_IMM32, 8},
+    {91, HOLE_IMM32, 9},
+    {98, HOLE_IMM32, 10}
+);
+
+// Takes a reference to the value read into rax, going to the slow path if it's unset:
+// test rax, rax; jz slow; test al, 7; jnz store; inc qword [rax + rc];
+// store: mov [r12 + dst], rax; jmp done
+static const uint8_t reference_code[] = {
+    0x48, 0x85, 0xc0, 0x0f, 0x84, HOLE4, 0xa8, 0x07, 0x75, 0x07, 0x48, 0xff, 0x80, HOLE4,
+    0x49, 0x89, 0x84, 0x24, HOLE4, 0xe9, HOLE4,
+};
+// operands: slow, offset of rc, dst, done
+STENCIL(
+    reference,
+    {5, HOLE_LABEL, 0},
+    {16, HOLE_IMM32, 1},
+    {24, HOLE_TEMP, 2},
+    {29, HOLE_LABEL, 3}
+);
+
+// Moves a temporary into a slot of the environment in rax, releasing the value it held:
+// mov rcx, [rax + slots]; mov rdx, [r12 + src]; mov qword [r12 + src], 0; mov rdi, [rcx + slot];
+// mov [rcx + slot], rdx; mov rax, object_decref; call rax
+static const uint8_t assign_code[] = {
+    0x48, 0x8b, 0x88, HOLE4, 0x49, 0x8b, 0x94, 0x24, HOLE4, 0x49, 0xc7, 0x84, 0x24, HOLE4,
+    0x00, 0x00, 0x00, 0x00, 0x48, 0x8b, 0xb9, HOLE4, 0x48, 0x89, 0x91, HOLE4, 0x48, 0xb8,
+    HOLE8, 0xff, 0xd0,
+};
+// operands: offset of the slots, src, offset of the slot, object_decref
+STENCIL(
+    assign,
+    {3, HOLE_IMM32, 0},
+    {11, HOLE_TEMP, 1},
+    {19, HOLE_TEMP, 1},
+    {30, HOLE_IMM32, 2},
+    {37, HOLE_IMM32, 2},
+    {43, HOLE_IMM64, 3}
+);
+
+// Guards a direct call, going to the slow path unless the callee is a compiled function that can
+// be called directly with `count` arguments, which it leaves in rdi:
+// mov rdi, [r12 + function]; test dil, 7; jnz slow; cmp dword [rdi + type], OBJECT_FUNCTION;
+// jne slow; cmp qword [rdi + parameters], count; jne slow; mov rax, [rdi + body];
+// mov rax, [rax + code]; test rax, rax; jz slow; mov rcx, free_code; cmp rcx, [rax + free];
+// jne slow; cmp byte [rax + direct], 0; je slow
+static const uint8_t direct_call_code[] = {
+    0x49, 0x8b, 0xbc, 0x24, HOLE4, 0x40, 0xf6, 0xc7, 0x07, 0x0f, 0x85, HOLE4, 0x81, 0xbf,
+    HOLE4, HOLE4, 0x0f, 0x85, HOLE4, 0x48, 0x81, 0xbf, HOLE4, HOLE4, 0x0f, 0x85, HOLE4,
+    0x48, 0x8b, 0x87, HOLE4, 0x48, 0x8b, 0x80, HOLE4, 0x48, 0x85, 0xc0, 0x0f, 0x84, HOLE4,
+    0x48, 0xb9, HOLE8, 0x48, 0x3b, 0x88, HOLE4, 0x0f, 0x85, HOLE4, 0x80, 0xb8, HOLE4, 0x00,
+    0x0f, 0x84, HOLE4,
+};
+// operands: function, count, slow, free_code, offset of type, OBJECT_FUNCTION,
+// offset of the parameter count, offset of body, offset of code, offset of free, offset of direct
+STENCIL(
+    direct_call,
+    {4, HOLE_TEMP, 0},
+    {14, HOLE_LABEL, 2},
+    {20, HOLE_IMM32, 4},
+    {24, HOLE_IMM32, 5},
+    {30, HOLE_LABEL, 2},
+    {37, HOLE_IMM32, 6},
+    {41, HOLE_IMM32, 1},
+    {47, HOLE_LABEL, 2},
+    {54, HOLE_IMM32, 7},
+    {61, HOLE_IMM32, 8},
+    {70, HOLE_LABEL, 2},
+    {76, HOLE_IMM64, 3},
+    {87, HOLE_IMM32, 9},
+    {93, HOLE_LABEL, 2},
+    {99, HOLE_IMM32, 10},
+    {106, HOLE_LABEL, 2}
+);
+
+// Pushes the frame of the function in rdi into r13:
+// mov rsi, [rdi + locals]; mov rdi, [rdi + env]; mov rax, environment_push_frame; call rax;
+// mov r13, rax
+static const uint8_t push_frame_code[] = {
+    0x48, 0x8b, 0xb7, HOLE4, 0x48, 0x8b, 0xbf, HOLE4, 0x48, 0xb8, HOLE8, 0xff, 0xd0,
+    0x49, 0x89, 0xc5,
+};
+// operands: offset of locals, offset of env, environment_push_frame
+STENCIL(push_frame, {3, HOLE_IMM32, 0}, {10, HOLE_IMM32, 1}, {16, HOLE_IMM64, 2});
+
+// Moves a temporary into a parameter slot of the frame in r13:
+// mov rax, [r12 + src]; mov qword [r12 + src], 0; mov rcx, [r13 + slots]; mov [rcx + slot], rax
+static const uint8_t argument_code[] = {
+    0x49, 0x8b, 0x84, 0x24, HOLE4, 0x49, 0xc7, 0x84, 0x24, HOLE4, 0x00, 0x00, 0x00, 0x00,
+    0x49, 0x8b, 0x8d, HOLE4, 0x48, 0x89, 0x81, HOLE4,
+};
+// operands: src, offset of the slots, offset of the slot
+STENCIL(argument, {4, HOLE_TEMP, 0}, {12, HOLE_TEMP, 0}, {23, HOLE_IMM32, 1}, {30, HOLE_IMM32, 2});
+
+// Makes the call with the frame in r13, like `call` but for the helper's last argument:
+// mov rdi, r12; mov rsi, dst; mov rdx, function; mov rcx, r13; mov rax, helper; call rax;
+// test rax, rax; jnz exit
+static const uint8_t enter_code[] = {
+    0x4c, 0x89, 0xe7, 0x48, 0xbe, HOLE8, 0x48, 0xba, HOLE8, 0x4c, 0x89, 0xe9, 0x48, 0xb8,
+    HOLE8, 0xff, 0xd0, 0x48, 0x85, 0xc0, 0x0f, 0x85, HOLE4,
+};
+// operands: dst, function, helper, exit
+STENCIL(enter, {5, HOLE_IMM64, 0}, {15, HOLE_IMM64, 1}, {28, HOLE_IMM64, 2}, {43, HOLE_LABEL, 3});
+
+#undef STENCIL
+#undef HOLE8
+#undef HOLE4
+
+// Helpers called from compiled code. Those that compute a value store it in a temporary and
+// return NULL, or return the error that ends the call.
+typedef struct object* helper_t(
+    struct environment* env,
+    struct object** t,
+    uintptr_t a,
+    uintptr_t b,
+    uintptr_t c,
+    uintptr_t d
+);
+
+static struct object* take(struct object** t, uintptr_t i) {
+    struct object* value = t[i];
+    t[i] = NULL;
+    return value;
+}
+
+static struct object* store(struct object** t, uintptr_t dst, struct object* value) {
+    if (is_error(value)) return value;
+    t[dst] = value;
+    return NULL;
+}
+
+static struct object* helper_eval(
+    struct environment* env,
+    struct object** t,
+    uintptr_t dst,
+    uintptr_t expression,
+    MONKEY_UNUSED uintptr_t c,
+    MONKEY_UNUSED uintptr_t d
+) {
+    return store(t, dst, tree_eval_expression((struct ast_expression*)expression, env));
+}
+
+static struct object* helper_identifier(
+    struct environment* env,
+    struct object** t,
+    uintptr_t dst,
+    uintptr_t identifier,
+    MONKEY_UNUSED uintptr_t c,
+    MONKEY_UNUSED uintptr_t d
+) {
+    return store(t, dst, eval_identifier((struct ast_identifier*)identifier, env));
+}
+
+static struct object* helper_infix(
+    MONKEY_UNUSED struct environment* env,
+    struct object** t,
+    uintptr_t dst,
+    uintptr_t node,
+    uintptr_t left,
+    uintptr_t right
+) {
+    auto infix = (struct ast_infix_expression*)node;
+    return store(t, dst, eval_infix_quickened(infix, take(t, left), take(t, right)));
+}
+
+static struct object* helper_index(
+    MONKEY_UNUSED struct environment* env,
+    struct object** t,
+    uintptr_t dst,
+    uintptr_t node,
+    uintptr_t left,
+    uintptr_t index
+) {
+    auto exp = (struct ast_index_expression*)node;
+    return store(t, dst, eval_index_quickened(exp, take(t, left), take(t, index)));
+}
+
+static struct object_buf take_arguments(struct object** t, uintptr_t first, uintptr_t count) {
+    struct object_buf args = {0};
+    BUF_RESERVE(&args, count);
+    for (size_t i = 0; i < count; i++) {
+        BUF_PUSH(&args, take(t, first + i));
+    }
+    return args;
+}
+
+static struct object* helper_call(
+    MONKEY_UNUSED struct environment* env,
+    struct object** t,
+    uintptr_t dst,
+    uintptr_t function,
+    uintptr_t first,
+    uintptr_t call
+) {
+    auto node = (struct ast_call_expression*)call;
+    struct object_buf args = take_arguments(t, first, node->arguments.len);
+    struct object* fn = specialize_call(node, take(t, function), &args);
+    return store(t, dst, tree_apply_function(fn, args));
+}
+
+static struct object* helper_tail_call(
+    MONKEY_UNUSED struct environment* env,
+    struct object** t,
+    uintptr_t dst,
+    uintptr_t function,
+    uintptr_t first,
+    uintptr_t call
+) {
+    auto node = (struct ast_call_expression*)call;
+    struct object_buf args = take_arguments(t, first, node->arguments.len);
+    t[dst] = object_tail_call_init_base(specialize_call(node, take(t, function), &args), args);
+    return NULL;
+}
+
+// Finishes a direct call: the callee's frame holds the arguments, and is released with the call.
+static struct object*
+helper_enter(struct object** t, uintptr_t dst, uintptr_t function, struct environment* frame) {
+    auto fn = (struct object_function*)take(t, function);
+    check_parameter_types(fn, BUF_REF(struct object_buf, frame->slots.ptr, fn->parameters.len));
+    struct object* result = unwrap_return_value(jit_run((struct jit_code*)fn->body->code, frame));
+    object_decref(&fn->object);
+    return store(t, dst, finish_call(result, frame));
+}
+
+static struct object* helper_let(
+    struct environment* env,
+    struct object** t,
+    uintptr_t name,
+    uintptr_t value,
+    MONKEY_UNUSED uintptr_t c,
+    MONKEY_UNUSED uintptr_t d
+) {
+    bind_variable((struct ast_identifier*)name, take(t, value), env);
+    return NULL;
+}
+
+static bool helper_truthy(MONKEY_UNUSED struct environment* env, struct object** t, uintptr_t src) {
+    struct object* condition = take(t, src);
+    bool truthy = is_truthy(condition);
+    object_decref(condition);
+    return truthy;
+}
+
+static void free_code(struct ast_code* ast_code);
+
+// The value of a statement that leaves none, such as an empty block.
+#define NO_VALUE SIZE_MAX
+
+enum position {
+    POSITION_PLAIN,
+    POSITION_BODY,
+    POSITION_TAIL,
+};
+
+BUF_T(uint8_t, machine_code);
+BUF_T(size_t, label);
+
+struct fixup {
+    size_t offset;
+    size_t label;
+};
+
+BUF_T(struct fixup, fixup);
+
+struct compiler {
+    struct machine_code_buf code;
+    // the offset of each label, or SIZE_MAX until it's bound
+    struct label_buf labels;
+    struct fixup_buf fixups;
+    size_t temps;
+    size_t exit;
+};
+
+static size_t label_new(struct compiler* c) {
+    BUF_PUSH(&c->labels, SIZE_MAX);
+    return c->labels.len - 1;
+}
+
+static void label_bind(struct compiler* c, size_t label) {
+    c->labels.ptr[label] = c->code.len;
+}
+
+static void patch(uint8_t* at, const void* value, size_t size) {
+    memcpy(at, value, size);
+}
+
+// Copies a stencil, patching its holes with `operands`.
+static void emit_stencil(struct compiler* c, const struct stencil* s, const uint64_t* operands) {
+    size_t start = c->code.len;
+    BUF_RESERVE(&c->code, start + s->size);
+    memcpy(c->code.ptr + start, s->code, s->size);
+    c->code.len += s->size;
+    uint8_t* code = c->code.ptr + start;
+    for (const struct hole* hole = s->holes; hole < s->holes + 16 and hole->kind != HOLE_NONE;
+         hole++) {
+        uint64_t operand = operands[hole->operand];
+        switch (hole->kind) {
+            case HOLE_IMM8: {
+                uint8_t value = (uint8_t)operand;
+                patch(code + hole->offset, &value, sizeof(value));
+                break;
+            }
+            case HOLE_IMM32: {
+                int32_t value = (int32_t)operand;
+                patch(code + hole->offset, &value, sizeof(value));
+                break;
+            }
+            case HOLE_IMM64:
+                patch(code + hole->offset, &operand, sizeof(operand));
+                break;
+            case HOLE_TEMP: {
+                int32_t value = (int32_t)(operand * sizeof(struct object*));
+                patch(code + hole->offset, &value, sizeof(value));
+                break;
+            }
+            case HOLE_LABEL: {
+                struct fixup fixup = {.offset = start + hole->offset, .label = operand};
+                BUF_PUSH(&c->fixups, fixup);
+                break;
+            }
+        }
+    }
+}
+
+#define EMIT(c, stencil, ...) emit_stencil(c, &stencil, (const uint64_t[]){__VA_ARGS__})
+
+static size_t temp(struct compiler* c) {
+    return c->temps++;
+}
+
+static void emit_helper(
+    struct compiler* c,
+    helper_t* helper,
+    uint64_t a,
+    uint64_t b,
+    uint64_t x,
+    uint64_t d
+) {
+    EMIT(c, call, a, b, x, d, (uint64_t)(uintptr_t)helper, c->exit);
+}
+
+// Whether the block could end the call: a `return` in it would, and so would a statement before
+// the last whose value is a wrapped return value. In an expression, the tree evaluator has either
+// make the value of the block instead, so such blocks are left to it.
+static bool returns(struct ast_block_statement* block) {
+    for (size_t i = 0; i < block->statements.len; i++) {
+        struct ast_statement* statement = block->statements.ptr[i];
+        bool last = i + 1 == block->statements.len;
+        switch (statement->type) {
+            case AST_STATEMENT_RETURN:
+                return true;
+            case AST_STATEMENT_BLOCK:
+                if (!last or returns((struct ast_block_statement*)statement)) return true;
+                break;
+            case AST_STATEMENT_EXPRESSION: {
+                if (!last) return true;
+                auto exp = ((struct ast_expression_statement*)statement)->expression;
+                if (exp->type != AST_EXPRESSION_IF) break;
+                auto if_exp = (struct ast_if_expression*)exp;
+                if (returns(if_exp->consequence) or
+                    (if_exp->alternative != NULL and returns(if_exp->alternative))) {
+                    return true;
+                }
+                break;
+            }
+            default:
+                break;
+        }
+    }
+    return false;
+}
+
+static size_t compile_expression(
+    struct compiler* c,
+    struct ast_expression* expression,
+    enum position position
+);
+static size_t compile_block(
+    struct compiler* c,
+    struct ast_block_statement* block,
+    enum position position,
+    bool want_value
+);
+
+static size_t compile_fallback(struct compiler* c, struct ast_expression* expression) {
+    size_t dst = temp(c);
+    emit_helper(c, helper_eval, dst, (uintptr_t)expression, 0, 0);
+    return dst;
+}
+
+// Leaves the environment `depth` links out from the call's in rax.
+static void emit_environment(struct compiler* c, size_t depth) {
+    EMIT(c, environment, 0);
+    for (size_t i = 0; i < depth; i++) {
+        EMIT(c, outer, offsetof(struct environment, outer));
+    }
+}
+
+static size_t compile_identifier(struct compiler* c, struct ast_identifier* identifier) {
+    size_t dst = temp(c);
+    size_t slow = label_new(c);
+    size_t done = label_new(c);
+    if (identifier->address.resolved) {
+        emit_environment(c, identifier->address.env_depth);
+        EMIT(
+            c,
+            slot,
+            offsetof(struct environment, slots.ptr),
+            identifier->address.env_slot * sizeof(struct object*)
+        );
+    } else {
+        EMIT(
+            c,
+            global,
+            slow,
+            (uintptr_t)&identifier->cache,
+            offsetof(struct environment, count),
+            offsetof(struct environment, outer),
+            offsetof(struct ast_lookup_cache, env),
+            offsetof(struct environment, version),
+            offsetof(struct ast_lookup_cache, version),
+            offsetof(struct ast_lookup_cache, index),
+            sizeof(struct environment_entry),
+            offsetof(struct environment, entries.ptr),
+            offsetof(struct environment_entry, value)
+        );
+    }
+    EMIT(c, reference, slow, offsetof(struct object, rc), dst, done);
+    label_bind(c, slow);
+    emit_helper(c, helper_identifier, dst, (uintptr_t)identifier, 0, 0);
+    label_bind(c, done);
+    return dst;
+}
+
+static size_t compile_infix(struct compiler* c, struct ast_infix_expression* infix) {
+    size_t left = compile_expression(c, infix->left, POSITION_PLAIN);
+    size_t right = compile_expression(c, infix->right, POSITION_PLAIN);
+    size_t dst = temp(c);
+    size_t slow = label_new(c);
+    size_t done = label_new(c);
+    if (infix->op != AST_OPERATOR_SLASH) {
+        EMIT(c, integer_guard, left, right, slow);
+        switch (infix->op) {
+            case AST_OPERATOR_PLUS:
+                EMIT(c, integer_add, slow);
+                break;
+            case AST_OPERATOR_MINUS:
+                EMIT(c, integer_sub, slow);
+                break;
+            case AST_OPERATOR_ASTERISK:
+                EMIT(c, integer_mul, slow);
+                break;
+            case AST_OPERATOR_LT:
+                EMIT(c, integer_compare, SETL, OBJECT_BITS_FALSE);
+                break;
+            case AST_OPERATOR_GT:
+                EMIT(c, integer_compare, SETG, OBJECT_BITS_FALSE);
+                break;
+            case AST_OPERATOR_EQ:
+                EMIT(c, integer_compare, SETE, OBJECT_BITS_FALSE);
+                break;
+            case AST_OPERATOR_NOT_EQ:
+                EMIT(c, integer_compare, SETNE, OBJECT_BITS_FALSE);
+                break;
+            default:
+                abort();
+        }
+        EMIT(c, integer_result, dst, done);
+    }
+    label_bind(c, slow);
+    emit_helper(c, helper_infix, dst, (uintptr_t)infix, left, right);
+    label_bind(c, done);
+    return dst;
+}
+
+static size_t
+compile_if(struct compiler* c, struct ast_if_expression* exp, enum position position) {
+    if (position == POSITION_PLAIN and
+        (returns(exp->consequence) or (exp->alternative != NULL and returns(exp->alternative)))) {
+        return compile_fallback(c, &exp->expression);
+    }
+    size_t condition = compile_expression(c, exp->condition, POSITION_PLAIN);
+    size_t dst = temp(c);
+    size_t then = label_new(c);
+    size_t otherwise = label_new(c);
+    size_t done = label_new(c);
+    EMIT(
+        c,
+        branch,
+        condition,
+        OBJECT_BITS_TRUE,
+        OBJECT_BITS_FALSE,
+        then,
+        otherwise,
+        (uint64_t)(uintptr_t)helper_truthy
+    );
+    label_bind(c, then);
+    size_t value = compile_block(c, exp->consequence, position, true);
+    if (value != NO_VALUE) EMIT(c, move, value, dst);
+    EMIT(c, jump, done);
+    label_bind(c, otherwise);
+    if (exp->alternative != NULL) {
+        value = compile_block(c, exp->alternative, position, true);
+        if (value != NO_VALUE) EMIT(c, move, value, dst);
+    } else {
+        EMIT(c, constant, dst, OBJECT_BITS_NULL);
+    }
+    label_bind(c, done);
+    return dst;
+}
+
+static size_t
+compile_call(struct compiler* c, struct ast_call_expression* call, enum position position) {
+    size_t function = compile_expression(c, call->function, POSITION_PLAIN);
+    size_t count = call->arguments.len;
+    size_t values[count > 0 ? count : 1];
+    for (size_t i = 0; i < count; i++) {
+        values[i] = compile_expression(c, call->arguments.ptr[i], POSITION_PLAIN);
+    }
+    // the helpers take the arguments from consecutive temporaries
+    size_t first = count > 0 ? values[0] : 0;
+    bool consecutive = true;
+    for (size_t i = 0; i < count; i++) {
+        consecutive = consecutive and values[i] == first + i;
+    }
+    if (!consecutive) {
+        first = c->temps;
+        c->temps += count;
+        for (size_t i = 0; i < count; i++) {
+            EMIT(c, move, values[i], first + i);
+        }
+    }
+    size_t dst = temp(c);
+    if (position == POSITION_TAIL) {
+        emit_helper(c, helper_tail_call, dst, function, first, (uintptr_t)call);
+        return dst;
+    }
+    // a compiled callee gets its frame filled and is run without going through the evaluator;
+    // anything else, such as a builtin or a call with the wrong number of arguments, takes the
+    // slow path
+    size_t slow = label_new(c);
+    size_t done = label_new(c);
+    EMIT(
+        c,
+        direct_call,
+        function,
+        count,
+        slow,
+        (uintptr_t)free_code,
+        offsetof(struct object, type),
+        OBJECT_FUNCTION,
+        offsetof(struct object_function, parameters.len),
+        offsetof(struct object_function, body),
+        offsetof(struct ast_block_statement, code),
+        offsetof(struct jit_code, code.free),
+        offsetof(struct jit_code, direct)
+    );
+    EMIT(
+        c,
+        push_frame,
+        offsetof(struct object_function, locals),
+        offsetof(struct object_function, env),
+        (uintptr_t)environment_push_frame
+    );
+    for (size_t i = 0; i < count; i++) {
+        EMIT(
+            c,
+            argument,
+            first + i,
+            offsetof(struct environment, slots.ptr),
+            i * sizeof(struct object*)
+        );
+    }
+    EMIT(c, enter, dst, function, (uintptr_t)helper_enter, c->exit);
+    EMIT(c, jump, done);
+    label_bind(c, slow);
+    emit_helper(c, helper_call, dst, function, first, (uintptr_t)call);
+    label_bind(c, done);
+    return dst;
+}
+
+static size_t compile_expression(
+    struct compiler* c,
+    struct ast_expression* expression,
+    enum position position
+) {
+    switch (expression->type) {
+        case AST_EXPRESSION_INTEGER_LITERAL: {
+            struct object* value =
+                object_int64_init_base(((struct ast_integer_literal*)expression)->value);
+            // boxed integers are allocated on each evaluation
+            if (!object_is_immediate(value)) {
+                object_decref(value);
+                return compile_fallback(c, expression);
+            }
+            size_t dst = temp(c);
+            EMIT(c, constant, dst, (uintptr_t)value);
+            return dst;
+        }
+        case AST_EXPRESSION_BOOLEAN: {
+            size_t dst = temp(c);
+            bool value = ((struct ast_boolean*)expression)->value;
+            EMIT(c, constant, dst, (uintptr_t)object_boolean_init_base(value));
+            return dst;
+        }
+        case AST_EXPRESSION_IDENTIFIER:
+            return compile_identifier(c, (struct ast_identifier*)expression);
+        case AST_EXPRESSION_INFIX:
+            return compile_infix(c, (struct ast_infix_expression*)expression);
+        case AST_EXPRESSION_IF:
+            return compile_if(c, (struct ast_if_expression*)expression, position);
+        case AST_EXPRESSION_CALL:
+            return compile_call(c, (struct ast_call_expression*)expression, position);
+        case AST_EXPRESSION_INDEX: {
+            auto exp = (struct ast_index_expression*)expression;
+            size_t left = compile_expression(c, exp->left, POSITION_PLAIN);
+            size_t index = compile_expression(c, exp->index, POSITION_PLAIN);
+            size_t dst = temp(c);
+            emit_helper(c, helper_index, dst, (uintptr_t)exp, left, index);
+            return dst;
+        }
+        default:
+            return compile_fallback(c, expression);
+    }
+}
+
+static size_t compile_statement(
+    struct compiler* c,
+    struct ast_statement* statement,
+    enum position position,
+    bool want_value
+) {
+    switch (statement->type) {
+        case AST_STATEMENT_EXPRESSION: {
+            struct ast_expression* expression =
+                ((struct ast_expression_statement*)statement)->expression;
+            size_t value = compile_expression(c, expression, position);
+            if (want_value) return value;
+            EMIT(
+                c,
+                drop,
+                value,
+                c->exit,
+                offsetof(struct object, type),
+                OBJECT_RETURN_VALUE,
+                (uint64_t)(uintptr_t)object_decref
+            );
+            return NO_VALUE;
+        }
+        case AST_STATEMENT_BLOCK:
+            return compile_block(c, (struct ast_block_statement*)statement, position, want_value);
+        case AST_STATEMENT_RETURN: {
+            // blocks that return from an expression are left to the evaluator
+            if (position == POSITION_PLAIN) abort();
+            auto ret = (struct ast_return_statement*)statement;
+            size_t value = compile_expression(c, ret->return_value, POSITION_TAIL);
+            EMIT(c, result, value, c->exit);
+            return NO_VALUE;
+        }
+        case AST_STATEMENT_LET: {
+            auto let = (struct ast_let_statement*)statement;
+            size_t value = compile_expression(c, let->value, POSITION_PLAIN);
+            struct ast_lexical_address address = let->name->address;
+            if (address.resolved) {
+                emit_environment(c, address.env_depth);
+                EMIT(
+                    c,
+                    assign,
+                    offsetof(struct environment, slots.ptr),
+                    value,
+                    address.env_slot * sizeof(struct object*),
+                    (uintptr_t)object_decref
+                );
+            } else {
+                emit_helper(c, helper_let, (uintptr_t)let->name, value, 0, 0);
+            }
+            if (!want_value) return NO_VALUE;
+            size_t dst = temp(c);
+            EMIT(c, constant, dst, OBJECT_BITS_NULL);
+            return dst;
+        }
+    }
+    abort();
+}
+
+static size_t compile_block(
+    struct compiler* c,
+    struct ast_block_statement* block,
+    enum position position,
+    bool want_value
+) {
+    size_t value = NO_VALUE;
+    for (size_t i = 0; i < block->statements.len; i++) {
+        bool last = i + 1 == block->statements.len;
+        // only the last statement inherits the tail position
+        enum position statement_position =
+            position == POSITION_TAIL and !last ? POSITION_BODY : position;
+        value = compile_statement(
+            c,
+            block->statements.ptr[i],
+            statement_position,
+            want_value and last
+        );
+    }
+    return value;
+}
+
+static FILE* perf_map;
+
+// Tells perf where the function's code is, as "start size name" lines.
+static void perf_map_add(struct object_function* fn, void* start, size_t size) {
+    if (!perf_map_enabled) return;
+    if (perf_map == NULL) {
+        char path[64];
+        snprintf(path, sizeof(path), "/tmp/perf-%ld.map", (long)getpid());
+        perf_map = fopen(path, "w");
+        if (perf_map == NULL) return;
+    }
+    fprintf(perf_map, "%" PRIxPTR " %zx monkey:fn(", (uintptr_t)start, size);
+    for (size_t i = 0; i < fn->parameters.len; i++) {
+        fprintf(
+            perf_map,
+            "%s" STRING_FMT,
+            i > 0 ? ", " : "",
+            STRING_ARG(fn->parameters.ptr[i]->value)
+        );
+    }
+    fprintf(perf_map, ")\n");
+    fflush(perf_map);
+}
+
+// Compiles the body into fresh executable pages, leaving `code->entry` NULL on failure.
+static void compile(struct jit_code* code, struct object_function* fn) {
+    struct compiler c = {0};
+    c.exit = label_new(&c);
+    EMIT(&c, prologue, 0);
+    size_t value = compile_block(&c, fn->body, POSITION_TAIL, true);
+    if (value != NO_VALUE) {
+        EMIT(&c, result, value, c.exit);
+    } else {
+        EMIT(&c, no_result, c.exit);
+    }
+    label_bind(&c, c.exit);
+    EMIT(&c, epilogue, 0);
+
+    for (size_t i = 0; i < c.fixups.len; i++) {
+        struct fixup fixup = c.fixups.ptr[i];
+        int32_t rel = (int32_t)(c.labels.ptr[fixup.label] - (fixup.offset + sizeof(rel)));
+        patch(c.code.ptr + fixup.offset, &rel, sizeof(rel));
+    }
+
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t mapped = (c.code.len + page - 1) / page * page;
+    void* memory = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory != MAP_FAILED) {
+        memcpy(memory, c.code.ptr, c.code.len);
+        if (mprotect(memory, mapped, PROT_READ | PROT_EXEC) == 0) {
+            code->entry = (jit_entry_t*)memory;
+            code->size = c.code.len;
+            code->mapped = mapped;
+            code->temps = c.temps;
+            code->direct = !fn->escapes;
+            for (size_t i = 0; i < fn->parameters.len; i++) {
+                struct ast_lexical_address address = fn->parameters.ptr[i]->address;
+                code->direct = code->direct and address.env_depth == 0 and address.env_slot == i;
+            }
+            stats.compiled++;
+            stats.code_bytes += c.code.len;
+            perf_map_add(fn, memory, c.code.len);
+        } else {
+            munmap(memory, mapped);
+        }
+    }
+    code->failed = code->entry == NULL;
+    BUF_FREE(c.code);
+    BUF_FREE(c.labels);
+    BUF_FREE(c.fixups);
+}
+
+static void free_code(struct ast_code* ast_code) {
+    auto code = (struct jit_code*)ast_code;
+    if (code->entry != NULL) munmap((void*)code->entry, code->mapped);
+    free(code);
+}
+
+struct jit_code* jit_function(struct object_function* fn) {
+    if (!enabled) return NULL;
+    struct ast_block_statement* body = fn->body;
+    // the call counter and the code are kept with the body, which belongs to one function
+    // literal, like the thunk engine's compiled bodies
+    if (body->code == NULL or body->code->free != free_code) {
+        if (body->code != NULL) body->code->free(body->code);
+        struct jit_code* code = malloc(sizeof(*code));
+        *code = (struct jit_code){.code = {.free = free_code}};
+        body->code = &code->code;
+    }
+    auto code = (struct jit_code*)body->code;
+    if (code->entry == NULL and !code->failed and ++code->calls > threshold) compile(code, fn);
+    return code->entry != NULL ? code : NULL;
+}
+
+struct object* jit_run(struct jit_code* code, struct environment* env) {
+    struct object* t[code->temps > 0 ? code->temps : 1];
+    for (size_t i = 0; i < code->temps; i++) {
+        t[i] = NULL;
+    }
+    struct object* result = code->entry(env, t);
+    // most temporaries have been moved out or hold immediates by now
+    for (size_t i = 0; i < code->temps; i++) {
+        if (t[i] != NULL and !object_is_immediate(t[i])) object_decref(t[i]);
+    }
+    return result;
+}
+
+#else
+
+struct jit_code* jit_function(struct object_function* fn) {
+    (void)fn;
+    return NULL;
+}
+
+struct object* jit_run(struct jit_code* code, struct environment* env) {
+    (void)code;
+    (void)env;
+    abort();
+}
+
+#endif
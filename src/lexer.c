@@ -44,7 +44,7 @@ static struct string read_identifier(struct lexer* l) {
     while (is_letter(l->ch)) {
         read_char(l);
     }
-    return STRING_REF_DATA(l->input.data + position, l->position - position);
+    return string_dup(STRING_REF_DATA(l->input.data + position, l->position - position));
 }
 
 static struct string read_number(struct lexer* l) {
@@ -52,7 +52,7 @@ static struct string read_number(struct lexer* l) {
     while (is_digit(l->ch)) {
         read_char(l);
     }
-    return STRING_REF_DATA(l->input.data + position, l->position - position);
+    return string_dup(STRING_REF_DATA(l->input.data + position, l->position - position));
 }
 
 static struct string read_string(struct lexer* l) {
@@ -63,7 +63,7 @@ static struct string read_string(struct lexer* l) {
             break;
         }
     }
-    return STRING_REF_DATA(l->input.data + position, l->position - position);
+    return string_dup(STRING_REF_DATA(l->input.data + position, l->position - position));
 }
 
 static void skip_whitespace(struct lexer* l) {
@@ -0,0 +1,135 @@
+#include "monkey/native.h"
+
+#include <stdio.h>
+
+#include "monkey/builtins.h"
+#include "monkey/gc.h"
+#include "monkey/private/evaluator.h"
+#include "monkey/private/stdc.h"
+
+void native_release(struct object** objects, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        object_decref(objects[i]);
+    }
+}
+
+struct object* native_name(struct environment* env, struct string name) {
+    struct object* value = environment_get(env, name);
+    if (value != NULL) return object_incref(value);
+    return object_error_init_base(
+        string_printf("identifier not found: " STRING_FMT, STRING_ARG(name))
+    );
+}
+
+bool native_truthy(struct object* obj) {
+    bool truthy = is_truthy(obj);
+    object_decref(obj);
+    return truthy;
+}
+
+struct object* native_prefix(enum ast_operator op, struct object* right) {
+    return eval_prefix_expression(op, right);
+}
+
+struct object* native_infix(enum ast_operator op, struct object* left, struct object* right) {
+    return eval_infix_expression(op, left, right);
+}
+
+struct object* native_index(struct object* left, struct object* index) {
+    return eval_index_expression(left, index);
+}
+
+struct object* native_check_hash_key(struct object* key) {
+    if (object_is_hashable(key)) return NULL;
+    return check_hash_key(object_incref(key));
+}
+
+struct object* native_hash(void) {
+    struct object_hash_table table;
+    object_hash_table_init(&table);
+    return object_hash_init_base(table);
+}
+
+void native_hash_insert(struct object* hash, struct object* key, struct object* value) {
+    auto self = (struct object_hash*)hash;
+    object_hash_table_insert(&self->pairs, object_hash_key(key), key, value);
+}
+
+// The environment for a call, which is the previous call's in a chain of tail calls when nothing
+// captured it and it has the right shape.
+static struct environment*
+call_env(struct object_native_function* fn, struct environment* previous) {
+    if (previous != NULL and previous->rc == 1 and previous->outer == fn->env and
+        previous->slots.len == fn->locals and !fn->escapes) {
+        for (size_t i = 0; i < previous->slots.len; i++) {
+            environment_set_slot(previous, i, NULL);
+        }
+        return previous;
+    }
+    if (previous != NULL) environment_decref(previous);
+    return push_call_frame(fn->env, fn->locals, fn->escapes, fn->captured);
+}
+
+static struct object*
+call_function(struct object* fn, struct object_buf args, struct environment** env) {
+    switch (object_type(fn)) {
+        case OBJECT_NATIVE_FUNCTION: {
+            auto function = (struct object_native_function*)fn;
+            if (function->arity != args.len) {
+                return object_error_init_base(string_printf(
+                    "wrong number of arguments: expected %zu, got %zu",
+                    function->arity,
+                    args.len
+                ));
+            }
+            *env = call_env(function, *env);
+            return function->body(*env, args);
+        }
+        case OBJECT_BUILTIN: {
+            auto builtin = (struct object_builtin*)fn;
+            return builtin->fn(args);
+        }
+        default:
+            return not_a_function(fn);
+    }
+}
+
+struct object* native_call(struct object* fn, struct object_buf args) {
+    struct environment* env = NULL;
+    while (true) {
+        struct object* result = call_function(fn, args, &env);
+        object_decref(fn);
+        native_release(args.ptr, args.len);
+        BUF_FREE(args);
+
+        if (result == NULL or object_type(result) != OBJECT_TAIL_CALL) {
+            if (env != NULL) environment_decref(env);
+            return result;
+        }
+        auto tail_call = (struct object_tail_call*)result;
+        fn = tail_call->function;
+        args = tail_call->args;
+        tail_call->function = NULL;
+        tail_call->args = (struct object_buf){0};
+        object_decref(result);
+    }
+}
+
+int native_main(native_body_t* program) {
+    struct environment* env = environment_new();
+    builtins_define(env);
+    struct object* result = program(env, (struct object_buf){0});
+    int status = 0;
+    if (result != NULL) {
+        // print the value like the REPL would, except that errors fail the program
+        status = native_is_error(result) ? 1 : 0;
+        struct string inspected = object_inspect(result);
+        fprintf(status == 0 ? stdout : stderr, STRING_FMT "\n", STRING_ARG(inspected));
+        STRING_FREE(inspected);
+    }
+    object_decref(result);
+    environment_decref(env);
+    // whatever is left only survives through reference cycles
+    gc_collect();
+    return status;
+}
@@ -5,6 +5,8 @@
 #include <stdlib.h>
 
 #include "monkey/environment.h"
+#include "monkey/gc.h"
+#include "monkey/pool.h"
 #include "monkey/private/stdc.h"
 
 #define DOWNCAST(T, obj) \
@@ -18,6 +20,8 @@ bool object_hash_key_equal(struct object_hash_key a, struct object_hash_key b) {
 }
 
 struct string object_type_string(enum object_type type) {
+    // the VM's closures and compiled C functions are user functions, named like the evaluator's
+    if (type == OBJECT_CLOSURE or type == OBJECT_NATIVE_FUNCTION) type = OBJECT_FUNCTION;
     switch (type) {
 #define X(x) \
     case OBJECT_##x: \
@@ -32,35 +36,121 @@ struct object object_init(
     enum object_type type,
     object_inspect_callback_t* inspect_callback,
     object_free_callback_t* free_callback,
-    object_dup_callback_t* dup_callback,
     object_hash_key_callback_t* hash_key_callback
 ) {
     struct object object = {
         .type = type,
+        .rc = 1,
         .inspect_callback = inspect_callback,
         .free_callback = free_callback,
-        .dup_callback = dup_callback,
         .hash_key_callback = hash_key_callback,
     };
     return object;
 }
 
 struct string object_inspect(const struct object* object) {
-    return object->inspect_callback(object);
+    if (!object_is_immediate(object)) {
+        return object->inspect_callback(object);
+    }
+    switch (object_type(object)) {
+        case OBJECT_INTEGER:
+            return string_printf("%" PRId64, object_int64_value(object));
+        case OBJECT_BOOLEAN:
+            return object_boolean_value(object) ? STRING_REF("true") : STRING_REF("false");
+        default:
+            return STRING_REF("null");
+    }
 }
 
-void object_free(struct object* object) {
-    if (object == NULL) return;
-    object->free_callback(object);
-    free(object);
+struct object* object_incref(struct object* object) {
+    if (object == NULL or object_is_immediate(object)) return object;
+    object->rc++;
+    return object;
 }
 
-struct object* object_dup(const struct object* object) {
-    if (object == NULL) return NULL;
-    return object->dup_callback(object);
+struct object* object_make_immortal(struct object* object) {
+    if (!object_is_immediate(object)) object->rc = OBJECT_RC_IMMORTAL;
+    return object;
+}
+
+static size_t object_size(enum object_type type) {
+    switch (type) {
+        case OBJECT_INTEGER:
+            return sizeof(struct object_int64);
+        case OBJECT_RETURN_VALUE:
+            return sizeof(struct object_return_value);
+        case OBJECT_ERROR:
+            return sizeof(struct object_error);
+        case OBJECT_FUNCTION:
+            return sizeof(struct object_function);
+        case OBJECT_STRING:
+            return sizeof(struct object_string);
+        case OBJECT_BUILTIN:
+            return sizeof(struct object_builtin);
+        case OBJECT_TAIL_CALL:
+            return sizeof(struct object_tail_call);
+        case OBJECT_ARRAY:
+            return sizeof(struct object_array);
+        case OBJECT_HASH:
+            return sizeof(struct object_hash);
+        case OBJECT_COMPILED_FUNCTION:
+            return sizeof(struct object_compiled_function);
+        case OBJECT_CLOSURE:
+            return sizeof(struct object_closure);
+        case OBJECT_NATIVE_FUNCTION:
+            return sizeof(struct object_native_function);
+        default:
+            abort();
+    }
+}
+
+static struct object_alloc_stats alloc_stats[OBJECT_TYPE_COUNT];
+
+struct object_alloc_stats object_alloc_stats(enum object_type type) {
+    return alloc_stats[type];
+}
+
+// Allocates the struct of a heap object of `type` from its pool.
+static void* object_alloc(enum object_type type) {
+    struct object_alloc_stats* stats = &alloc_stats[type];
+    stats->allocated++;
+    if (++stats->live > stats->peak) stats->peak = stats->live;
+    return pool_alloc(object_size(type));
+}
+
+// Objects whose last reference goes away while another one is being freed wait here, so freeing a
+// deeply nested structure doesn't recurse once per level.
+static struct object_buf free_queue;
+static bool freeing;
+
+void object_decref(struct object* object) {
+    if (object == NULL or object_is_immediate(object)) return;
+    if (--object->rc > 0) return;
+    BUF_PUSH(&free_queue, object);
+    if (freeing) return;
+
+    freeing = true;
+    while (free_queue.len > 0) {
+        struct object* next = free_queue.ptr[--free_queue.len];
+        enum object_type type = next->type;
+        next->free_callback(next);
+        alloc_stats[type].live--;
+        pool_free(next, object_size(type));
+    }
+    freeing = false;
 }
 
 extern struct object_hash_key object_hash_key(const struct object* obj) {
+    if (object_is_immediate(obj)) {
+        if (object_type(obj) == OBJECT_NULL) {
+            abort();
+        }
+        return (struct object_hash_key){
+            .type = object_type(obj),
+            .value = object_type(obj) == OBJECT_INTEGER ? (uint64_t)object_int64_value(obj)
+                                                        : object_boolean_value(obj),
+        };
+    }
     if (obj->hash_key_callback == NULL) {
         abort();
     }
@@ -74,10 +164,6 @@ static struct string int64_inspect(const struct object* obj) {
 }
 
 static void int64_free(MONKEY_UNUSED struct object* obj) {}
-static struct object* int64_dup(const struct object* obj) {
-    const struct object_int64* self = (const struct object_int64*)obj;
-    return object_int64_init_base(self->value);
-}
 
 static struct object_hash_key int64_hash_key(const struct object* obj) {
     auto self = (const struct object_int64*)obj;
@@ -88,57 +174,12 @@ static struct object_hash_key int64_hash_key(const struct object* obj) {
 }
 
 struct object_int64* object_int64_init(int64_t value) {
-    struct object_int64* self = malloc(sizeof(*self));
-    self->object =
-        object_init(OBJECT_INTEGER, int64_inspect, int64_free, int64_dup, int64_hash_key);
+    struct object_int64* self = object_alloc(OBJECT_INTEGER);
+    self->object = object_init(OBJECT_INTEGER, int64_inspect, int64_free, int64_hash_key);
     self->value = value;
     return self;
 }
 
-static struct string boolean_inspect(const struct object* obj) {
-    const struct object_boolean* self = (const struct object_boolean*)obj;
-    return string_printf("%s", self->value ? "true" : "false");
-}
-
-static void boolean_free(MONKEY_UNUSED struct object* obj) {}
-
-static struct object* boolean_dup(const struct object* obj) {
-    const struct object_boolean* self = (const struct object_boolean*)obj;
-    return object_boolean_init_base(self->value);
-}
-
-static struct object_hash_key boolean_hash_key(const struct object* obj) {
-    auto self = (const struct object_boolean*)obj;
-    return (struct object_hash_key){
-        .type = obj->type,
-        .value = self->value,
-    };
-}
-
-struct object_boolean* object_boolean_init(bool value) {
-    struct object_boolean* self = malloc(sizeof(*self));
-    self->object =
-        object_init(OBJECT_BOOLEAN, boolean_inspect, boolean_free, boolean_dup, boolean_hash_key);
-    self->value = value;
-    return self;
-}
-
-static struct string null_inspect(MONKEY_UNUSED const struct object* obj) {
-    return STRING_REF("null");
-}
-
-static void null_free(MONKEY_UNUSED struct object* obj) {}
-
-static struct object* null_dup(MONKEY_UNUSED const struct object* obj) {
-    return object_null_init_base();
-}
-
-struct object_null* object_null_init(void) {
-    struct object_null* self = malloc(sizeof(*self));
-    self->object = object_init(OBJECT_NULL, null_inspect, null_free, null_dup, NULL);
-    return self;
-}
-
 static struct string return_value_inspect(const struct object* obj) {
     const struct object_return_value* self = (const struct object_return_value*)obj;
     return object_inspect(self->value);
@@ -146,24 +187,15 @@ static struct string return_value_inspect(const struct object* obj) {
 
 static void return_value_free(struct object* obj) {
     struct object_return_value* self = DOWNCAST(struct object_return_value, obj);
-    object_free(self->value);
-}
-
-static struct object* return_value_dup(const struct object* obj) {
-    const struct object_return_value* self = (const struct object_return_value*)obj;
-    return object_return_value_init_base(object_dup(self->value));
+    gc_untrack(&self->gc);
+    object_decref(self->value);
 }
 
 struct object_return_value* object_return_value_init(struct object* value) {
-    struct object_return_value* self = malloc(sizeof(*self));
-    self->object = object_init(
-        OBJECT_RETURN_VALUE,
-        return_value_inspect,
-        return_value_free,
-        return_value_dup,
-        NULL
-    );
+    struct object_return_value* self = object_alloc(OBJECT_RETURN_VALUE);
+    self->object = object_init(OBJECT_RETURN_VALUE, return_value_inspect, return_value_free, NULL);
     self->value = value;
+    gc_track(&self->gc, &self->object);
     return self;
 }
 
@@ -171,8 +203,13 @@ struct object* object_return_value_unwrap(struct object* object) {
     if (object == NULL) return NULL;
     struct object_return_value* self = (struct object_return_value*)object;
     struct object* value = self->value;
-    self->value = NULL;
-    object_free(object);
+    if (self->object.rc == 1) {
+        // sole owner: steal the value instead of taking a new reference
+        self->value = NULL;
+    } else {
+        object_incref(value);
+    }
+    object_decref(object);
     return value;
 }
 
@@ -186,39 +223,44 @@ static void error_free(struct object* obj) {
     STRING_FREE(self->message);
 }
 
-static struct object* error_dup(const struct object* obj) {
-    auto self = (const struct object_error*)obj;
-    return object_error_init_base(self->message);
-}
-
 struct object_error* object_error_init(struct string message) {
-    struct object_error* self = malloc(sizeof(*self));
-    self->object = object_init(OBJECT_ERROR, error_inspect, error_free, error_dup, NULL);
+    struct object_error* self = object_alloc(OBJECT_ERROR);
+    self->object = object_init(OBJECT_ERROR, error_inspect, error_free, NULL);
     self->message = message;
     return self;
 }
 
-static struct string function_inspect(const struct object* obj) {
-    auto self = (const struct object_function*)obj;
+struct string object_function_inspect_parts(
+    struct function_parameter_buf parameters,
+    struct ast_block_statement* body
+) {
+    if (body->source.data != NULL) return string_dup(body->source);
     struct string out = string_dup(STRING_REF("fn("));
-    for (size_t i = 0; i < self->parameters.len; i++) {
-        struct string param = ast_expression_string(&self->parameters.ptr[i]->expression);
+    for (size_t i = 0; i < parameters.len; i++) {
+        struct string param = ast_expression_string(&parameters.ptr[i]->expression);
         string_append(&out, param);
-        if (i < self->parameters.len - 1) {
+        if (i < parameters.len - 1) {
             string_append(&out, STRING_REF(", "));
         }
         STRING_FREE(param);
     }
     string_append(&out, STRING_REF(") {\n"));
-    struct string body_str = ast_statement_string(&self->body->statement);
+    struct string body_str = ast_statement_string(&body->statement);
     string_append(&out, body_str);
     STRING_FREE(body_str);
     string_append(&out, STRING_REF("\n}"));
     return out;
 }
 
+static struct string function_inspect(const struct object* obj) {
+    auto self = (const struct object_function*)obj;
+    return object_function_inspect_parts(self->parameters, self->body);
+}
+
 static void function_free(struct object* obj) {
     auto self = DOWNCAST(struct object_function, obj);
+    gc_untrack(&self->gc);
+    object_decref(self->specialized);
     if (ast_statement_decref(&self->body->statement) == 0) {
         free(self->body);
     }
@@ -228,31 +270,31 @@ static void function_free(struct object* obj) {
         }
     }
     BUF_FREE(self->parameters);
-}
-
-static struct object* function_dup(const struct object* obj) {
-    auto self = (const struct object_function*)obj;
-    auto body = (struct ast_block_statement*)ast_node_incref(&self->body->statement.node);
-    struct function_parameter_buf parameters = {0};
-    for (size_t i = 0; i < self->parameters.len; i++) {
-        auto id =
-            (struct ast_identifier*)ast_node_incref(&self->parameters.ptr[i]->expression.node);
-        BUF_PUSH(&parameters, id);
+    if (self->env != NULL) {
+        environment_decref(self->env);
     }
-    return object_function_init_base(parameters, body, self->env);
 }
 
 extern struct object_function* object_function_init(
     struct function_parameter_buf parameters,
     struct ast_block_statement* body,
+    size_t locals,
+    bool escapes,
+    size_t captured,
     struct environment* env
 ) {
-    struct object_function* self = malloc(sizeof(*self));
-    self->object =
-        object_init(OBJECT_FUNCTION, function_inspect, function_free, function_dup, NULL);
+    struct object_function* self = object_alloc(OBJECT_FUNCTION);
+    self->object = object_init(OBJECT_FUNCTION, function_inspect, function_free, NULL);
     self->parameters = parameters;
     self->body = body;
+    self->locals = locals;
+    self->escapes = escapes;
+    self->captured = captured;
     self->env = env;
+    self->specialized = NULL;
+    self->specialized_for = NULL;
+    environment_incref(env);
+    gc_track(&self->gc, &self->object);
     return self;
 }
 
@@ -266,11 +308,6 @@ static void string_free(struct object* obj) {
     STRING_FREE(self->value);
 }
 
-static struct object* o_string_dup(const struct object* obj) {
-    auto self = (const struct object_string*)obj;
-    return object_string_init_base(self->value);
-}
-
 ALLOW_UINT_OVERFLOW static uint64_t fnv1a(const void* raw, size_t len) {
     const unsigned char* data = raw;
     uint64_t hash = UINT64_C(14695981039346656037);
@@ -292,9 +329,8 @@ static struct object_hash_key string_hash_key(const struct object* obj) {
 }
 
 struct object_string* object_string_init(struct string value) {
-    struct object_string* self = malloc(sizeof(*self));
-    self->object =
-        object_init(OBJECT_STRING, string_inspect, string_free, o_string_dup, string_hash_key);
+    struct object_string* self = object_alloc(OBJECT_STRING);
+    self->object = object_init(OBJECT_STRING, string_inspect, string_free, string_hash_key);
     self->value = value;
     return self;
 }
@@ -307,18 +343,46 @@ static void builtin_free(MONKEY_UNUSED struct object* obj) {
     // nothing to do
 }
 
-static struct object* builtin_dup(const struct object* obj) {
-    auto self = (const struct object_builtin*)obj;
-    return object_builtin_init_base(self->fn);
-}
-
 struct object_builtin* object_builtin_init(builtin_function_callback_t* fn) {
-    struct object_builtin* self = malloc(sizeof(*self));
-    self->object = object_init(OBJECT_BUILTIN, builtin_inspect, builtin_free, builtin_dup, NULL);
+    struct object_builtin* self = object_alloc(OBJECT_BUILTIN);
+    self->object = object_init(OBJECT_BUILTIN, builtin_inspect, builtin_free, NULL);
     self->fn = fn;
     return self;
 }
 
+static struct string tail_call_inspect(const struct object* obj) {
+    auto self = (const struct object_tail_call*)obj;
+    struct string out = object_inspect(self->function);
+    string_append(&out, STRING_REF("("));
+    for (size_t i = 0; i < self->args.len; i++) {
+        struct string arg = object_inspect(self->args.ptr[i]);
+        string_append(&out, arg);
+        STRING_FREE(arg);
+        if (i < self->args.len - 1) {
+            string_append(&out, STRING_REF(", "));
+        }
+    }
+    string_append(&out, STRING_REF(")"));
+    return out;
+}
+
+static void tail_call_free(struct object* obj) {
+    auto self = DOWNCAST(struct object_tail_call, obj);
+    object_decref(self->function);
+    for (size_t i = 0; i < self->args.len; i++) {
+        object_decref(self->args.ptr[i]);
+    }
+    BUF_FREE(self->args);
+}
+
+struct object_tail_call* object_tail_call_init(struct object* function, struct object_buf args) {
+    struct object_tail_call* self = object_alloc(OBJECT_TAIL_CALL);
+    self->object = object_init(OBJECT_TAIL_CALL, tail_call_inspect, tail_call_free, NULL);
+    self->function = function;
+    self->args = args;
+    return self;
+}
+
 static struct string array_inspect(const struct object* obj) {
     auto self = (const struct object_array*)obj;
     struct string out = string_dup(STRING_REF("["));
@@ -336,26 +400,18 @@ static struct string array_inspect(const struct object* obj) {
 
 static void array_free(struct object* obj) {
     auto self = DOWNCAST(struct object_array, obj);
+    gc_untrack(&self->gc);
     for (size_t i = 0; i < self->elements.len; i++) {
-        object_free(self->elements.ptr[i]);
+        object_decref(self->elements.ptr[i]);
     }
     BUF_FREE(self->elements);
 }
 
-static struct object* array_dup(const struct object* obj) {
-    auto self = (const struct object_array*)obj;
-    struct object_buf elements = {0};
-    BUF_RESERVE(&elements, self->elements.len);
-    for (size_t i = 0; i < self->elements.len; i++) {
-        BUF_PUSH(&elements, object_dup(self->elements.ptr[i]));
-    }
-    return object_array_init_base(elements);
-}
-
 struct object_array* object_array_init(struct object_buf elements) {
-    struct object_array* self = malloc(sizeof(*self));
-    self->object = object_init(OBJECT_ARRAY, array_inspect, array_free, array_dup, NULL);
+    struct object_array* self = object_alloc(OBJECT_ARRAY);
+    self->object = object_init(OBJECT_ARRAY, array_inspect, array_free, NULL);
     self->elements = elements;
+    gc_track(&self->gc, &self->object);
     return self;
 }
 
@@ -367,8 +423,8 @@ void object_hash_table_init(struct object_hash_table* table) {
 void object_hash_table_free(struct object_hash_table* table) {
     for (size_t i = 0; i < table->buckets.len; i++) {
         if (table->buckets.ptr[i].value.key == NULL) continue;
-        object_free(table->buckets.ptr[i].value.key);
-        object_free(table->buckets.ptr[i].value.value);
+        object_decref(table->buckets.ptr[i].value.key);
+        object_decref(table->buckets.ptr[i].value.value);
     }
     BUF_FREE(table->buckets);
 }
@@ -411,11 +467,13 @@ void object_hash_table_insert(
     }
 
     struct object_hash_bucket* bucket = object_hash_table_find_bucket(table->buckets, hash_key);
-    if (bucket->value.key != NULL) {
-        object_free(bucket->value.key);
+    if (bucket->value.key == NULL) {
+        table->count++;
+    } else {
+        object_decref(bucket->value.key);
     }
     if (bucket->value.value != NULL) {
-        object_free(bucket->value.value);
+        object_decref(bucket->value.value);
     }
     bucket->key = hash_key;
     bucket->value.key = key;
@@ -451,29 +509,149 @@ static struct string hash_inspect(const struct object* obj) {
 
 static void hash_free(struct object* obj) {
     auto self = DOWNCAST(struct object_hash, obj);
+    gc_untrack(&self->gc);
     object_hash_table_free(&self->pairs);
 }
 
-static struct object* hash_dup(const struct object* obj) {
-    auto self = (const struct object_hash*)obj;
-    struct object_hash_table pairs = {0};
-    object_hash_table_init(&pairs);
-    for (size_t i = 0; i < self->pairs.buckets.len; i++) {
-        struct object_hash_pair pair = self->pairs.buckets.ptr[i].value;
-        if (pair.key == NULL) continue;
-        object_hash_table_insert(
-            &pairs,
-            object_hash_key(pair.key),
-            object_dup(pair.key),
-            object_dup(pair.value)
-        );
+struct object_hash* object_hash_init(struct object_hash_table pairs) {
+    struct object_hash* self = object_alloc(OBJECT_HASH);
+    self->object = object_init(OBJECT_HASH, hash_inspect, hash_free, NULL);
+    self->pairs = pairs;
+    gc_track(&self->gc, &self->object);
+    return self;
+}
+
+struct compiled_function* compiled_function_init(
+    struct instruction_buf instructions,
+    struct object_buf constants,
+    size_t num_locals,
+    size_t num_parameters,
+    struct ast_function_literal* literal
+) {
+    struct compiled_function* self = malloc(sizeof(*self));
+    self->instructions = instructions;
+    self->constants = constants;
+    self->num_locals = num_locals;
+    self->num_parameters = num_parameters;
+    self->escapes = literal != NULL and literal->escapes;
+    self->num_captured = literal != NULL ? literal->captured : 0;
+    self->global_caches =
+        calloc(constants.len > 0 ? constants.len : 1, sizeof(struct ast_lookup_cache));
+    self->literal = literal;
+    if (literal != NULL) {
+        ast_node_incref(&literal->expression.node);
     }
-    return object_hash_init_base(pairs);
+    self->rc = 1;
+    return self;
 }
 
-struct object_hash* object_hash_init(struct object_hash_table pairs) {
-    struct object_hash* self = malloc(sizeof(*self));
-    self->object = object_init(OBJECT_HASH, hash_inspect, hash_free, hash_dup, NULL);
-    self->pairs = pairs;
+struct compiled_function* compiled_function_incref(struct compiled_function* fn) {
+    fn->rc++;
+    return fn;
+}
+
+void compiled_function_decref(struct compiled_function* fn) {
+    fn->rc--;
+    if (fn->rc > 0) return;
+    BUF_FREE(fn->instructions);
+    for (size_t i = 0; i < fn->constants.len; i++) {
+        object_decref(fn->constants.ptr[i]);
+    }
+    BUF_FREE(fn->constants);
+    free(fn->global_caches);
+    if (fn->literal != NULL and ast_expression_decref(&fn->literal->expression) == 0) {
+        free(fn->literal);
+    }
+    free(fn);
+}
+
+static struct string compiled_function_inspect(const struct object* obj) {
+    auto self = (const struct object_compiled_function*)obj;
+    return string_printf("CompiledFunction[%p]", (void*)self->fn);
+}
+
+static void compiled_function_free(struct object* obj) {
+    auto self = DOWNCAST(struct object_compiled_function, obj);
+    compiled_function_decref(self->fn);
+}
+
+struct object_compiled_function* object_compiled_function_init(struct compiled_function* fn) {
+    struct object_compiled_function* self = object_alloc(OBJECT_COMPILED_FUNCTION);
+    self->object = object_init(
+        OBJECT_COMPILED_FUNCTION,
+        compiled_function_inspect,
+        compiled_function_free,
+        NULL
+    );
+    self->fn = fn;
+    return self;
+}
+
+static struct string closure_inspect(const struct object* obj) {
+    auto self = (const struct object_closure*)obj;
+    if (self->fn->literal == NULL) {
+        return string_printf("Closure[%p]", (void*)self->fn);
+    }
+    return object_function_inspect_parts(self->fn->literal->parameters, self->fn->literal->body);
+}
+
+static void closure_free(struct object* obj) {
+    auto self = DOWNCAST(struct object_closure, obj);
+    gc_untrack(&self->gc);
+    compiled_function_decref(self->fn);
+    if (self->env != NULL) {
+        environment_decref(self->env);
+    }
+}
+
+struct object_closure* object_closure_init(struct compiled_function* fn, struct environment* env) {
+    struct object_closure* self = object_alloc(OBJECT_CLOSURE);
+    self->object = object_init(OBJECT_CLOSURE, closure_inspect, closure_free, NULL);
+    self->fn = fn;
+    self->env = env;
+    if (env != NULL) {
+        environment_incref(env);
+    }
+    gc_track(&self->gc, &self->object);
+    return self;
+}
+
+static struct string native_function_inspect(const struct object* obj) {
+    auto self = (const struct object_native_function*)obj;
+    return string_dup(self->source);
+}
+
+static void native_function_free(struct object* obj) {
+    auto self = DOWNCAST(struct object_native_function, obj);
+    gc_untrack(&self->gc);
+    STRING_FREE(self->source);
+    if (self->env != NULL) {
+        environment_decref(self->env);
+    }
+}
+
+struct object_native_function* object_native_function_init(
+    native_body_t* body,
+    size_t arity,
+    size_t locals,
+    bool escapes,
+    size_t captured,
+    struct string source,
+    struct environment* env
+) {
+    struct object_native_function* self = object_alloc(OBJECT_NATIVE_FUNCTION);
+    self->object =
+        object_init(OBJECT_NATIVE_FUNCTION, native_function_inspect, native_function_free, NULL);
+    self->body = body;
+    self->arity = arity;
+    self->locals = locals;
+    self->escapes = escapes;
+    self->captured = captured;
+    self->source = source;
+    self->env = env;
+    self->specialized = NULL;
+    self->specialized_for = NULL;
+    environment_incref(env);
+    gc_track(&self->gc, &self->object);
     return self;
 }
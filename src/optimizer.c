@@ -0,0 +1,2264 @@
+#include "monkey/optimizer.h"
+
+#include <inttypes.h>
+#include <iso646.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "monkey/private/evaluator.h"
+#include "monkey/private/stdc.h"
+
+static int configured_level = OPTIMIZER_DEFAULT_LEVEL;
+
+void optimizer_set_level(int level) {
+    configured_level = level;
+}
+
+int optimizer_level(void) {
+    return configured_level;
+}
+
+struct string optimizer_pass_name(enum optimizer_pass pass) {
+    switch (pass) {
+#define X(x, name, _fn, _level) \
+    case OPTIMIZER_PASS_##x: \
+        return STRING_REF(name);
+#include "monkey/private/optimizer_passes.inc"
+#undef X
+    }
+    abort();
+}
+
+static void keep_sources(struct ast_program* program);
+
+void optimize(struct ast_program* program, int level) {
+    if (level > 0) keep_sources(program);
+#define X(_x, _name, fn, min_level) \
+    if (level >= min_level) fn(program);
+#include "monkey/private/optimizer_passes.inc"
+#undef X
+}
+
+static void release_expression(struct ast_expression* expression) {
+    if (ast_expression_decref(expression) == 0) free(expression);
+}
+
+static void release_statement(struct ast_statement* statement) {
+    if (ast_statement_decref(statement) == 0) free(statement);
+}
+
+static void release_block(struct ast_block_statement* block) {
+    if (ast_statement_decref(&block->statement) == 0) free(block);
+}
+
+// Replaces `*slot` with `replacement`, which must be a part of it.
+static void replace_expression(struct ast_expression** slot, struct ast_expression* replacement) {
+    ast_node_incref(&replacement->node);
+    release_expression(*slot);
+    *slot = replacement;
+}
+
+// A bottom-up walk over a program. Passes hook in where they rewrite; any hook may be NULL.
+struct rewriter {
+    // may replace `*expression`
+    void (*expression)(struct rewriter* r, struct ast_expression** expression);
+    // may edit the statements of a block or of the program
+    void (*statements)(struct rewriter* r, struct ast_statement_buf* statements);
+    // called once the function's body has been walked
+    void (*function)(struct rewriter* r, struct ast_function_literal* function);
+    // whether to leave the bodies of nested functions alone
+    bool skip_functions;
+    void* data;
+};
+
+static void rewrite_statements(struct rewriter* r, struct ast_statement_buf* statements);
+
+static void rewrite_expression(struct rewriter* r, struct ast_expression** slot) {
+    struct ast_expression* expression = *slot;
+    switch (expression->type) {
+        case AST_EXPRESSION_PREFIX:
+            rewrite_expression(r, &((struct ast_prefix_expression*)expression)->right);
+            break;
+        case AST_EXPRESSION_INFIX: {
+            auto infix = (struct ast_infix_expression*)expression;
+            rewrite_expression(r, &infix->left);
+            rewrite_expression(r, &infix->right);
+            break;
+        }
+        case AST_EXPRESSION_IF: {
+            auto exp = (struct ast_if_expression*)expression;
+            rewrite_expression(r, &exp->condition);
+            rewrite_statements(r, &exp->consequence->statements);
+            if (exp->alternative != NULL) rewrite_statements(r, &exp->alternative->statements);
+            break;
+        }
+        case AST_EXPRESSION_FUNCTION: {
+            auto function = (struct ast_function_literal*)expression;
+            if (r->skip_functions) break;
+            rewrite_statements(r, &function->body->statements);
+            if (r->function != NULL) r->function(r, function);
+            break;
+        }
+        case AST_EXPRESSION_CALL: {
+            auto call = (struct ast_call_expression*)expression;
+            rewrite_expression(r, &call->function);
+            for (size_t i = 0; i < call->arguments.len; i++) {
+                rewrite_expression(r, &call->arguments.ptr[i]);
+            }
+            break;
+        }
+        case AST_EXPRESSION_ARRAY: {
+            auto array = (struct ast_array_literal*)expression;
+            for (size_t i = 0; i < array->elements.len; i++) {
+                rewrite_expression(r, &array->elements.ptr[i]);
+            }
+            break;
+        }
+        case AST_EXPRESSION_INDEX: {
+            auto exp = (struct ast_index_expression*)expression;
+            rewrite_expression(r, &exp->left);
+            rewrite_expression(r, &exp->index);
+            break;
+        }
+        case AST_EXPRESSION_HASH: {
+            // the table is only hashed on insertion, so the buckets can be rewritten in place
+            struct ast_expression_hash_bucket_buf buckets =
+                ((struct ast_hash_literal*)expression)->pairs.buckets;
+            for (size_t i = 0; i < buckets.len; i++) {
+                if (buckets.ptr[i].key == NULL) continue;
+                rewrite_expression(r, &buckets.ptr[i].key);
+                rewrite_expression(r, &buckets.ptr[i].value);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    if (r->expression != NULL) r->expression(r, slot);
+}
+
+static void rewrite_statement(struct rewriter* r, struct ast_statement* statement) {
+    switch (statement->type) {
+        case AST_STATEMENT_EXPRESSION: {
+            auto exp = (struct ast_expression_statement*)statement;
+            if (exp->expression != NULL) rewrite_expression(r, &exp->expression);
+            break;
+        }
+        case AST_STATEMENT_BLOCK:
+            rewrite_statements(r, &((struct ast_block_statement*)statement)->statements);
+            break;
+        case AST_STATEMENT_RETURN: {
+            auto ret = (struct ast_return_statement*)statement;
+            if (ret->return_value != NULL) rewrite_expression(r, &ret->return_value);
+            break;
+        }
+        case AST_STATEMENT_LET: {
+            auto let = (struct ast_let_statement*)statement;
+            if (let->value != NULL) rewrite_expression(r, &let->value);
+            break;
+        }
+    }
+}
+
+static void rewrite_statements(struct rewriter* r, struct ast_statement_buf* statements) {
+    for (size_t i = 0; i < statements->len; i++) {
+        rewrite_statement(r, statements->ptr[i]);
+    }
+    if (r->statements != NULL) r->statements(r, statements);
+}
+
+static void rewrite_program(struct rewriter* r, struct ast_program* program) {
+    rewrite_statements(r, &program->statements);
+}
+
+// Functions print as written however the passes rewrite their bodies.
+static void keep_source(MONKEY_UNUSED struct rewriter* r, struct ast_function_literal* function) {
+    if (function->body->source.data != NULL) return;
+    function->body->source = object_function_inspect_parts(function->parameters, function->body);
+}
+
+static void keep_sources(struct ast_program* program) {
+    struct rewriter r = {.function = keep_source};
+    rewrite_program(&r, program);
+}
+
+static bool is_literal(struct ast_expression* expression) {
+    switch (expression->type) {
+        case AST_EXPRESSION_INTEGER_LITERAL:
+        case AST_EXPRESSION_BOOLEAN:
+        case AST_EXPRESSION_STRING:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Returns the object a literal evaluates to.
+static struct object* literal_value(struct ast_expression* literal) {
+    switch (literal->type) {
+        case AST_EXPRESSION_INTEGER_LITERAL:
+            return object_int64_init_base(((struct ast_integer_literal*)literal)->value);
+        case AST_EXPRESSION_BOOLEAN:
+            return object_boolean_init_base(((struct ast_boolean*)literal)->value);
+        case AST_EXPRESSION_STRING:
+            return object_string_init_base(
+                string_dup(((struct ast_string_literal*)literal)->value)
+            );
+        default:
+            abort();
+    }
+}
+
+static struct ast_expression* integer_literal(int64_t value) {
+    struct token token = {TOKEN_INT, string_printf("%" PRId64, value)};
+    return ast_integer_literal_init_base(token, value);
+}
+
+static struct ast_expression* boolean_literal(bool value) {
+    struct token token = value ? (struct token){TOKEN_TRUE, string_dup(STRING_REF("true"))}
+                               : (struct token){TOKEN_FALSE, string_dup(STRING_REF("false"))};
+    return ast_boolean_init_base(token, value);
+}
+
+// Returns the literal for `value`, releasing it, or NULL if it has none.
+static struct ast_expression* value_literal(struct object* value) {
+    struct ast_expression* literal = NULL;
+    switch (object_type(value)) {
+        case OBJECT_INTEGER:
+            literal = integer_literal(object_int64_value(value));
+            break;
+        case OBJECT_BOOLEAN:
+            literal = boolean_literal(object_boolean_value(value));
+            break;
+        case OBJECT_STRING: {
+            struct string str = ((struct object_string*)value)->value;
+            struct token token = {TOKEN_STRING, string_dup(str)};
+            literal = ast_string_literal_init_base(token, string_dup(str));
+            break;
+        }
+        default:
+            break;
+    }
+    object_decref(value);
+    return literal;
+}
+
+// Whether evaluating `left op right` on integers gives a value rather than faulting.
+static bool
+integer_op_defined(enum ast_operator op, int64_t left, int64_t right, int64_t* result) {
+    int64_t scratch;
+    if (result == NULL) result = &scratch;
+    switch (op) {
+        case AST_OPERATOR_PLUS:
+            return !__builtin_add_overflow(left, right, result);
+        case AST_OPERATOR_MINUS:
+            return !__builtin_sub_overflow(left, right, result);
+        case AST_OPERATOR_ASTERISK:
+            return !__builtin_mul_overflow(left, right, result);
+        case AST_OPERATOR_SLASH:
+            if (right == 0 or (left == INT64_MIN and right == -1)) return false;
+            *result = left / right;
+            return true;
+        default:
+            return true;
+    }
+}
+
+// Whether folding `left op right` is safe: the evaluator must give the value it gives at runtime,
+// and the other engines must agree with it. Anything else is left to fail when it runs.
+static bool can_fold_infix(
+    enum ast_operator op,
+    struct ast_expression* left,
+    struct ast_expression* right
+) {
+    if (left->type != right->type) return false;
+    switch (left->type) {
+        case AST_EXPRESSION_INTEGER_LITERAL:
+            return integer_op_defined(
+                op,
+                ((struct ast_integer_literal*)left)->value,
+                ((struct ast_integer_literal*)right)->value,
+                NULL
+            );
+        case AST_EXPRESSION_BOOLEAN:
+            return op == AST_OPERATOR_EQ or op == AST_OPERATOR_NOT_EQ;
+        case AST_EXPRESSION_STRING:
+            return op == AST_OPERATOR_PLUS;
+        default:
+            return false;
+    }
+}
+
+static bool can_fold_prefix(enum ast_operator op, struct ast_expression* right) {
+    if (op == AST_OPERATOR_BANG) return true;
+    return op == AST_OPERATOR_MINUS and right->type == AST_EXPRESSION_INTEGER_LITERAL and
+           ((struct ast_integer_literal*)right)->value != INT64_MIN;
+}
+
+static void fold_expression(struct rewriter* r, struct ast_expression** slot) {
+    (void)r;
+    struct object* value;
+    if ((*slot)->type == AST_EXPRESSION_INFIX) {
+        auto infix = (struct ast_infix_expression*)*slot;
+        if (!is_literal(infix->left) or !is_literal(infix->right)) return;
+        if (!can_fold_infix(infix->op, infix->left, infix->right)) return;
+        value = eval_infix_expression(
+            infix->op,
+            literal_value(infix->left),
+            literal_value(infix->right)
+        );
+    } else if ((*slot)->type == AST_EXPRESSION_PREFIX) {
+        auto prefix = (struct ast_prefix_expression*)*slot;
+        if (!is_literal(prefix->right) or !can_fold_prefix(prefix->op, prefix->right)) return;
+        value = eval_prefix_expression(prefix->op, literal_value(prefix->right));
+    } else {
+        return;
+    }
+
+    struct ast_expression* literal = value_literal(value);
+    if (literal == NULL) return;
+    release_expression(*slot);
+    *slot = literal;
+}
+
+void optimize_fold_constants(struct ast_program* program) {
+    struct rewriter r = {.expression = fold_expression};
+    rewrite_program(&r, program);
+}
+
+static bool is_integer_literal(struct ast_expression* expression) {
+    return expression->type == AST_EXPRESSION_INTEGER_LITERAL;
+}
+
+// `(x op1 a) op2 b` => `x op1 c`. The inner operator is kept, so when `x` isn't an integer the
+// error reported is the same as before.
+static void simplify_expression(struct rewriter* r, struct ast_expression** slot) {
+    (void)r;
+    if ((*slot)->type != AST_EXPRESSION_INFIX) return;
+    auto outer = (struct ast_infix_expression*)*slot;
+    if (outer->left->type != AST_EXPRESSION_INFIX or !is_integer_literal(outer->right)) return;
+    auto inner = (struct ast_infix_expression*)outer->left;
+    if (!is_integer_literal(inner->right)) return;
+
+    bool outer_additive = outer->op == AST_OPERATOR_PLUS or outer->op == AST_OPERATOR_MINUS;
+    bool inner_additive = inner->op == AST_OPERATOR_PLUS or inner->op == AST_OPERATOR_MINUS;
+    enum ast_operator combine;
+    if (outer_additive and inner_additive) {
+        // x + a + b = x + (a + b) and x - a + b = x - (a - b)
+        combine = outer->op == inner->op ? AST_OPERATOR_PLUS : AST_OPERATOR_MINUS;
+    } else if (outer->op == AST_OPERATOR_ASTERISK and inner->op == AST_OPERATOR_ASTERISK) {
+        combine = AST_OPERATOR_ASTERISK;
+    } else {
+        return;
+    }
+
+    int64_t a = ((struct ast_integer_literal*)inner->right)->value;
+    int64_t b = ((struct ast_integer_literal*)outer->right)->value;
+    int64_t c;
+    if (!integer_op_defined(combine, a, b, &c)) return;
+
+    release_expression(inner->right);
+    inner->right = integer_literal(c);
+    replace_expression(slot, &inner->expression);
+}
+
+void optimize_simplify_algebra(struct ast_program* program) {
+    struct rewriter r = {.expression = simplify_expression};
+    rewrite_program(&r, program);
+}
+
+// Returns whether `condition` is a literal, storing its truthiness in `truthy`.
+static bool known_condition(struct ast_expression* condition, bool* truthy) {
+    if (!is_literal(condition)) return false;
+    struct object* value = literal_value(condition);
+    *truthy = is_truthy(value);
+    object_decref(value);
+    return true;
+}
+
+// The expression a block evaluates to, if it's nothing else.
+static struct ast_expression* sole_expression(struct ast_block_statement* block) {
+    if (block == NULL or block->statements.len != 1) return NULL;
+    struct ast_statement* statement = block->statements.ptr[0];
+    if (statement->type != AST_STATEMENT_EXPRESSION) return NULL;
+    return ((struct ast_expression_statement*)statement)->expression;
+}
+
+// Leaves a constant `if` either replaced by the expression of its branch, or with a true condition
+// and no alternative, or false and without one.
+static void prune_expression(struct rewriter* r, struct ast_expression** slot) {
+    (void)r;
+    if ((*slot)->type != AST_EXPRESSION_IF) return;
+    auto exp = (struct ast_if_expression*)*slot;
+    bool truthy;
+    if (!known_condition(exp->condition, &truthy)) return;
+
+    struct ast_block_statement* taken = truthy ? exp->consequence : exp->alternative;
+    struct ast_expression* value = sole_expression(taken);
+    if (value != NULL) {
+        replace_expression(slot, value);
+    } else if (truthy and exp->alternative != NULL) {
+        release_block(exp->alternative);
+        exp->alternative = NULL;
+    } else if (!truthy and exp->alternative != NULL) {
+        release_block(exp->consequence);
+        exp->consequence = exp->alternative;
+        exp->alternative = NULL;
+        release_expression(exp->condition);
+        exp->condition = boolean_literal(true);
+    }
+}
+
+// Splices the taken branch of constant `if` statements into the surrounding statements. Blocks
+// don't open a scope, so their `let`s mean the same either way.
+static void prune_statements(struct rewriter* r, struct ast_statement_buf* statements) {
+    (void)r;
+    struct ast_statement_buf pruned = {0};
+    for (size_t i = 0; i < statements->len; i++) {
+        struct ast_statement* statement = statements->ptr[i];
+        auto exp = (struct ast_expression_statement*)statement;
+        bool truthy;
+        if (statement->type != AST_STATEMENT_EXPRESSION or exp->expression == NULL or
+            exp->expression->type != AST_EXPRESSION_IF or
+            !known_condition(((struct ast_if_expression*)exp->expression)->condition, &truthy)) {
+            BUF_PUSH(&pruned, statement);
+            continue;
+        }
+
+        // prune_expression left only the consequence to run, if anything
+        struct ast_block_statement* taken =
+            truthy ? ((struct ast_if_expression*)exp->expression)->consequence : NULL;
+        bool empty = taken == NULL or taken->statements.len == 0;
+        // the last statement gives the block its value, which an empty branch makes null
+        if (empty and i == statements->len - 1) {
+            BUF_PUSH(&pruned, statement);
+            continue;
+        }
+        if (taken != NULL) {
+            BUF_APPEND(&pruned, taken->statements);
+            BUF_FREE(taken->statements);
+            taken->statements = (struct ast_statement_buf){0};
+        }
+        release_statement(statement);
+    }
+    BUF_FREE(*statements);
+    *statements = pruned;
+}
+
+void optimize_prune_branches(struct ast_program* program) {
+    struct rewriter r = {.expression = prune_expression, .statements = prune_statements};
+    rewrite_program(&r, program);
+}
+
+struct name_search {
+    struct string name;
+    bool found;
+};
+
+static void find_name(struct rewriter* r, struct ast_expression** slot) {
+    struct name_search* search = r->data;
+    if ((*slot)->type == AST_EXPRESSION_IDENTIFIER and
+        STRING_EQUAL(((struct ast_identifier*)*slot)->value, search->name)) {
+        search->found = true;
+    }
+}
+
+// Whether `name` is read anywhere in `statements`, including functions nested in them.
+static bool is_referenced(struct ast_statement_buf statements, struct string name) {
+    struct name_search search = {.name = name, .found = false};
+    struct rewriter r = {.expression = find_name, .data = &search};
+    rewrite_statements(&r, &statements);
+    return search.found;
+}
+
+// Whether `name` is bound by the time `function` runs its statement `index`: it's a parameter, or
+// a let of the body before that statement. Reading any other name can fail.
+static bool
+is_bound_local(struct ast_function_literal* function, size_t index, struct string name) {
+    for (size_t i = 0; i < function->parameters.len; i++) {
+        if (STRING_EQUAL(function->parameters.ptr[i]->value, name)) return true;
+    }
+    for (size_t i = 0; i < index; i++) {
+        auto let = (struct ast_let_statement*)function->body->statements.ptr[i];
+        if (let->statement.type == AST_STATEMENT_LET and STRING_EQUAL(let->name->value, name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Whether evaluating `expression` in statement `index` of `function` can't fail or have effects.
+static bool
+is_pure(struct ast_function_literal* function, size_t index, struct ast_expression* expression) {
+    switch (expression->type) {
+        case AST_EXPRESSION_INTEGER_LITERAL:
+        case AST_EXPRESSION_BOOLEAN:
+        case AST_EXPRESSION_STRING:
+        case AST_EXPRESSION_FUNCTION:
+            return true;
+        case AST_EXPRESSION_IDENTIFIER:
+            return is_bound_local(function, index, ((struct ast_identifier*)expression)->value);
+        case AST_EXPRESSION_ARRAY: {
+            auto array = (struct ast_array_literal*)expression;
+            for (size_t i = 0; i < array->elements.len; i++) {
+                if (!is_pure(function, index, array->elements.ptr[i])) return false;
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+// Globals are left alone, since later REPL input can still read them.
+static void remove_unused_lets(struct rewriter* r, struct ast_function_literal* function) {
+    (void)r;
+    struct ast_statement_buf* statements = &function->body->statements;
+    // dropping one let can leave the lets its value referred to unused
+    bool removed = true;
+    while (removed) {
+        removed = false;
+        // a let that ends the body gives the call its value
+        size_t i = 0;
+        while (i + 1 < statements->len) {
+            auto let = (struct ast_let_statement*)statements->ptr[i];
+            if (let->statement.type != AST_STATEMENT_LET or let->value == NULL or
+                !is_pure(function, i, let->value) or is_referenced(*statements, let->name->value)) {
+                i++;
+                continue;
+            }
+
+            release_statement(statements->ptr[i]);
+            memmove(
+                statements->ptr + i,
+                statements->ptr + i + 1,
+                (statements->len - i - 1) * sizeof(*statements->ptr)
+            );
+            statements->len--;
+            removed = true;
+        }
+    }
+}
+
+void optimize_remove_unused_lets(struct ast_program* program) {
+    struct rewriter r = {.function = remove_unused_lets};
+    rewrite_program(&r, program);
+}
+
+// Bodies with more nodes than this aren't inlined.
+#define INLINE_MAX_NODES 16
+
+BUF_T(struct string, inline_name);
+BUF_T(struct ast_let_statement*, inline_let);
+
+struct inline_scope {
+    struct inline_scope* outer;
+    // NULL for the global scope
+    struct ast_function_literal* function;
+    // every name declared in the scope, once per parameter or let
+    struct inline_name_buf names;
+    // the lets of inlinable functions evaluated so far
+    struct inline_let_buf known;
+};
+
+struct inliner {
+    struct inline_scope* scope;
+    // numbers the variables each inlined call binds its arguments to
+    size_t calls;
+};
+
+static void collect_declaration(struct rewriter* r, struct ast_statement_buf* statements) {
+    struct inline_name_buf* names = r->data;
+    for (size_t i = 0; i < statements->len; i++) {
+        if (statements->ptr[i]->type != AST_STATEMENT_LET) continue;
+        BUF_PUSH(names, ((struct ast_let_statement*)statements->ptr[i])->name->value);
+    }
+}
+
+static size_t count_names(struct inline_name_buf names, struct string name) {
+    size_t count = 0;
+    for (size_t i = 0; i < names.len; i++) {
+        if (STRING_EQUAL(names.ptr[i], name)) count++;
+    }
+    return count;
+}
+
+static size_t declarations(struct inline_scope* scope, struct string name) {
+    return count_names(scope->names, name);
+}
+
+static bool has_duplicate_parameters(struct ast_function_literal* function) {
+    struct function_parameter_buf parameters = function->parameters;
+    for (size_t i = 0; i < parameters.len; i++) {
+        for (size_t j = 0; j < i; j++) {
+            if (STRING_EQUAL(parameters.ptr[i]->value, parameters.ptr[j]->value)) return true;
+        }
+    }
+    return false;
+}
+
+// Whether `expression` can be copied into a call site: it binds nothing, and a branch of an `if`
+// in it is a single expression. Counts its nodes against `budget`.
+static bool is_inlinable_expression(struct ast_expression* expression, size_t* budget) {
+    if (*budget == 0) return false;
+    --*budget;
+    switch (expression->type) {
+        case AST_EXPRESSION_IDENTIFIER:
+        case AST_EXPRESSION_INTEGER_LITERAL:
+        case AST_EXPRESSION_BOOLEAN:
+        case AST_EXPRESSION_STRING:
+            return true;
+        case AST_EXPRESSION_PREFIX: {
+            auto prefix = (struct ast_prefix_expression*)expression;
+            return is_inlinable_expression(prefix->right, budget);
+        }
+        case AST_EXPRESSION_INFIX: {
+            auto infix = (struct ast_infix_expression*)expression;
+            return is_inlinable_expression(infix->left, budget) and
+                   is_inlinable_expression(infix->right, budget);
+        }
+        case AST_EXPRESSION_INDEX: {
+            auto exp = (struct ast_index_expression*)expression;
+            return is_inlinable_expression(exp->left, budget) and
+                   is_inlinable_expression(exp->index, budget);
+        }
+        case AST_EXPRESSION_IF: {
+            auto exp = (struct ast_if_expression*)expression;
+            struct ast_expression* consequence = sole_expression(exp->consequence);
+            struct ast_expression* alternative = sole_expression(exp->alternative);
+            return is_inlinable_expression(exp->condition, budget) and consequence != NULL and
+                   is_inlinable_expression(consequence, budget) and
+                   (exp->alternative == NULL or
+                    (alternative != NULL and is_inlinable_expression(alternative, budget)));
+        }
+        case AST_EXPRESSION_CALL: {
+            auto call = (struct ast_call_expression*)expression;
+            if (!is_inlinable_expression(call->function, budget)) return false;
+            for (size_t i = 0; i < call->arguments.len; i++) {
+                if (!is_inlinable_expression(call->arguments.ptr[i], budget)) return false;
+            }
+            return true;
+        }
+        case AST_EXPRESSION_ARRAY: {
+            auto array = (struct ast_array_literal*)expression;
+            for (size_t i = 0; i < array->elements.len; i++) {
+                if (!is_inlinable_expression(array->elements.ptr[i], budget)) return false;
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+static bool is_inlinable_function(struct ast_function_literal* function) {
+    struct ast_expression* body = sole_expression(function->body);
+    size_t budget = INLINE_MAX_NODES;
+    return body != NULL and !has_duplicate_parameters(function) and
+           is_inlinable_expression(body, &budget);
+}
+
+// A function bound by a let can be inlined if nothing else in its scope binds the name, so every
+// call after the let sees it. The global scope is left out: later REPL input can rebind globals
+// that functions defined now still refer to.
+static bool is_known_function(struct inline_scope* scope, struct ast_let_statement* let) {
+    if (scope->function == NULL or let->value == NULL) return false;
+    if (let->value->type != AST_EXPRESSION_FUNCTION) return false;
+    auto function = (struct ast_function_literal*)let->value;
+    struct ast_statement_buf body = function->body->statements;
+    return declarations(scope, let->name->value) == 1 and is_inlinable_function(function) and
+           !is_referenced(body, let->name->value);
+}
+
+static struct ast_function_literal* find_callee(
+    struct inline_scope* scope,
+    struct ast_expression* callee,
+    struct inline_scope** defined_in
+) {
+    if (callee->type == AST_EXPRESSION_FUNCTION) {
+        auto function = (struct ast_function_literal*)callee;
+        *defined_in = scope;
+        return is_inlinable_function(function) ? function : NULL;
+    }
+    if (callee->type != AST_EXPRESSION_IDENTIFIER) return NULL;
+
+    struct string name = ((struct ast_identifier*)callee)->value;
+    for (; scope != NULL; scope = scope->outer) {
+        if (declarations(scope, name) == 0) continue;
+        for (size_t i = 0; i < scope->known.len; i++) {
+            if (STRING_EQUAL(scope->known.ptr[i]->name->value, name)) {
+                *defined_in = scope;
+                return (struct ast_function_literal*)scope->known.ptr[i]->value;
+            }
+        }
+        return NULL;
+    }
+    return NULL;
+}
+
+struct inline_hygiene {
+    struct ast_function_literal* callee;
+    struct inline_scope* from;
+    struct inline_scope* to;
+    bool captured;
+};
+
+static bool is_parameter(struct ast_function_literal* function, struct string name) {
+    for (size_t i = 0; i < function->parameters.len; i++) {
+        if (STRING_EQUAL(function->parameters.ptr[i]->value, name)) return true;
+    }
+    return false;
+}
+
+static void check_free_name(struct rewriter* r, struct ast_expression** slot) {
+    struct inline_hygiene* hygiene = r->data;
+    if ((*slot)->type != AST_EXPRESSION_IDENTIFIER) return;
+    struct string name = ((struct ast_identifier*)*slot)->value;
+    if (is_parameter(hygiene->callee, name)) return;
+    for (struct inline_scope* scope = hygiene->from; scope != hygiene->to; scope = scope->outer) {
+        if (declarations(scope, name) > 0) hygiene->captured = true;
+    }
+}
+
+// Whether a variable the callee's body refers to is shadowed at the call site.
+static bool is_captured(
+    struct ast_function_literal* callee,
+    struct inline_scope* call_site,
+    struct inline_scope* defined_in
+) {
+    struct inline_hygiene hygiene = {
+        .callee = callee,
+        .from = call_site,
+        .to = defined_in,
+        .captured = false,
+    };
+    struct rewriter r = {.expression = check_free_name, .data = &hygiene};
+    rewrite_statements(&r, &callee->body->statements);
+    return hygiene.captured;
+}
+
+static struct ast_expression* clone_expression(
+    struct ast_expression* expression,
+    struct ast_function_literal* callee,
+    struct ast_expression** arguments
+);
+
+static struct ast_block_statement* clone_branch(
+    struct ast_block_statement* block,
+    struct ast_function_literal* callee,
+    struct ast_expression** arguments
+) {
+    if (block == NULL) return NULL;
+    auto statement = (struct ast_expression_statement*)block->statements.ptr[0];
+    struct ast_statement_buf statements = {0};
+    BUF_PUSH(
+        &statements,
+        ast_expression_statement_init_base(
+            token_dup(statement->token),
+            clone_expression(statement->expression, callee, arguments)
+        )
+    );
+    return ast_block_statement_init(token_dup(block->token), statements);
+}
+
+static struct ast_expression_buf clone_expressions(
+    struct ast_expression_buf expressions,
+    struct ast_function_literal* callee,
+    struct ast_expression** arguments
+) {
+    struct ast_expression_buf clones = {0};
+    for (size_t i = 0; i < expressions.len; i++) {
+        BUF_PUSH(&clones, clone_expression(expressions.ptr[i], callee, arguments));
+    }
+    return clones;
+}
+
+// Copies an inlinable body, replacing each parameter of `callee`, if any, with a copy of its
+// argument.
+static struct ast_expression* clone_expression(
+    struct ast_expression* expression,
+    struct ast_function_literal* callee,
+    struct ast_expression** arguments
+) {
+    switch (expression->type) {
+        case AST_EXPRESSION_IDENTIFIER: {
+            auto identifier = (struct ast_identifier*)expression;
+            for (size_t i = 0; callee != NULL and i < callee->parameters.len; i++) {
+                if (STRING_EQUAL(callee->parameters.ptr[i]->value, identifier->value)) {
+                    return clone_expression(arguments[i], NULL, NULL);
+                }
+            }
+            return ast_identifier_init_base(
+                token_dup(identifier->token),
+                string_dup(identifier->value)
+            );
+        }
+        case AST_EXPRESSION_INTEGER_LITERAL: {
+            auto literal = (struct ast_integer_literal*)expression;
+            return ast_integer_literal_init_base(token_dup(literal->token), literal->value);
+        }
+        case AST_EXPRESSION_BOOLEAN: {
+            auto literal = (struct ast_boolean*)expression;
+            return ast_boolean_init_base(token_dup(literal->token), literal->value);
+        }
+        case AST_EXPRESSION_STRING: {
+            auto literal = (struct ast_string_literal*)expression;
+            return ast_string_literal_init_base(
+                token_dup(literal->token),
+                string_dup(literal->value)
+            );
+        }
+        case AST_EXPRESSION_PREFIX: {
+            auto prefix = (struct ast_prefix_expression*)expression;
+            return ast_prefix_expression_init_base(
+                token_dup(prefix->token),
+                prefix->op,
+                clone_expression(prefix->right, callee, arguments)
+            );
+        }
+        case AST_EXPRESSION_INFIX: {
+            auto infix = (struct ast_infix_expression*)expression;
+            return ast_infix_expression_init_base(
+                token_dup(infix->token),
+                clone_expression(infix->left, callee, arguments),
+                infix->op,
+                clone_expression(infix->right, callee, arguments)
+            );
+        }
+        case AST_EXPRESSION_INDEX: {
+            auto exp = (struct ast_index_expression*)expression;
+            return ast_index_expression_init_base(
+                token_dup(exp->token),
+                clone_expression(exp->left, callee, arguments),
+                clone_expression(exp->index, callee, arguments)
+            );
+        }
+        case AST_EXPRESSION_IF: {
+            auto exp = (struct ast_if_expression*)expression;
+            return ast_if_expression_init_base(
+                token_dup(exp->token),
+                clone_expression(exp->condition, callee, arguments),
+                clone_branch(exp->consequence, callee, arguments),
+                clone_branch(exp->alternative, callee, arguments)
+            );
+        }
+        case AST_EXPRESSION_CALL: {
+            auto call = (struct ast_call_expression*)expression;
+            return ast_call_expression_init_base(
+                token_dup(call->token),
+                clone_expression(call->function, callee, arguments),
+                clone_expressions(call->arguments, callee, arguments)
+            );
+        }
+        case AST_EXPRESSION_ARRAY: {
+            auto array = (struct ast_array_literal*)expression;
+            return ast_array_literal_init_base(
+                token_dup(array->token),
+                clone_expressions(array->elements, callee, arguments)
+            );
+        }
+        default:
+            abort();
+    }
+}
+
+// Replaces the call in `*slot` with the callee's body. Literal arguments are substituted for
+// their parameters; every other argument is evaluated in order into a variable of its own first,
+// as in `if (true) { let a@1 = x; a@1 + 1 }`. The `@` keeps the names from clashing with any the
+// program can spell.
+static void inline_call(
+    struct inliner* in,
+    struct ast_expression** slot,
+    struct ast_function_literal* callee
+) {
+    auto call = (struct ast_call_expression*)*slot;
+    size_t count = call->arguments.len;
+    struct ast_expression** arguments = calloc(count, sizeof(*arguments));
+    struct ast_statement_buf statements = {0};
+    size_t call_number = ++in->calls;
+    for (size_t i = 0; i < count; i++) {
+        struct ast_expression* argument = call->arguments.ptr[i];
+        if (is_literal(argument)) {
+            ast_node_incref(&argument->node);
+            arguments[i] = argument;
+            continue;
+        }
+        struct string name = string_printf(
+            STRING_FMT "@%zu",
+            STRING_ARG(callee->parameters.ptr[i]->value),
+            call_number
+        );
+        arguments[i] = ast_identifier_init_base(
+            (struct token){TOKEN_IDENT, string_dup(name)},
+            string_dup(name)
+        );
+        ast_node_incref(&argument->node);
+        BUF_PUSH(
+            &statements,
+            ast_let_statement_init_base(
+                (struct token){TOKEN_LET, string_dup(STRING_REF("let"))},
+                ast_identifier_init((struct token){TOKEN_IDENT, string_dup(name)}, name),
+                argument
+            )
+        );
+    }
+
+    auto body_statement = (struct ast_expression_statement*)callee->body->statements.ptr[0];
+    struct ast_expression* body = clone_expression(body_statement->expression, callee, arguments);
+    // a function literal called directly goes with the call
+    struct token body_token = token_dup(body_statement->token);
+    for (size_t i = 0; i < count; i++) {
+        release_expression(arguments[i]);
+    }
+    free(arguments);
+    release_expression(*slot);
+
+    if (statements.len == 0) {
+        BUF_FREE(statements);
+        STRING_FREE(body_token.literal);
+        *slot = body;
+        return;
+    }
+    BUF_PUSH(&statements, ast_expression_statement_init_base(body_token, body));
+    *slot = ast_if_expression_init_base(
+        (struct token){TOKEN_IF, string_dup(STRING_REF("if"))},
+        boolean_literal(true),
+        ast_block_statement_init(
+            (struct token){TOKEN_LBRACE, string_dup(STRING_REF("{"))},
+            statements
+        ),
+        NULL
+    );
+}
+
+static void try_inline(struct inliner* in, struct ast_expression** slot) {
+    auto call = (struct ast_call_expression*)*slot;
+    struct inline_scope* defined_in;
+    struct ast_function_literal* callee = find_callee(in->scope, call->function, &defined_in);
+    if (callee == NULL or callee->parameters.len != call->arguments.len) return;
+    if (is_captured(callee, in->scope, defined_in)) return;
+
+    bool binds = false;
+    for (size_t i = 0; i < call->arguments.len; i++) {
+        if (!is_literal(call->arguments.ptr[i])) binds = true;
+    }
+    // binding arguments at the top level would leave them behind as globals
+    if (binds and in->scope->function == NULL) return;
+    inline_call(in, slot, callee);
+}
+
+static void inline_statements(struct inliner* in, struct ast_statement_buf* statements, bool top);
+
+static void inline_expression(struct inliner* in, struct ast_expression** slot);
+
+static void inline_function(struct inliner* in, struct ast_function_literal* function) {
+    struct inline_scope scope = {.outer = in->scope, .function = function};
+    for (size_t i = 0; i < function->parameters.len; i++) {
+        BUF_PUSH(&scope.names, function->parameters.ptr[i]->value);
+    }
+    struct rewriter collect = {
+        .statements = collect_declaration,
+        .skip_functions = true,
+        .data = &scope.names,
+    };
+    rewrite_statements(&collect, &function->body->statements);
+
+    in->scope = &scope;
+    inline_statements(in, &function->body->statements, true);
+    in->scope = scope.outer;
+    BUF_FREE(scope.names);
+    BUF_FREE(scope.known);
+}
+
+static void inline_expressions(struct inliner* in, struct ast_expression_buf expressions) {
+    for (size_t i = 0; i < expressions.len; i++) {
+        inline_expression(in, &expressions.ptr[i]);
+    }
+}
+
+static void inline_expression(struct inliner* in, struct ast_expression** slot) {
+    struct ast_expression* expression = *slot;
+    switch (expression->type) {
+        case AST_EXPRESSION_PREFIX:
+            inline_expression(in, &((struct ast_prefix_expression*)expression)->right);
+            break;
+        case AST_EXPRESSION_INFIX: {
+            auto infix = (struct ast_infix_expression*)expression;
+            inline_expression(in, &infix->left);
+            inline_expression(in, &infix->right);
+            break;
+        }
+        case AST_EXPRESSION_IF: {
+            auto exp = (struct ast_if_expression*)expression;
+            inline_expression(in, &exp->condition);
+            inline_statements(in, &exp->consequence->statements, false);
+            if (exp->alternative != NULL) {
+                inline_statements(in, &exp->alternative->statements, false);
+            }
+            break;
+        }
+        case AST_EXPRESSION_FUNCTION:
+            inline_function(in, (struct ast_function_literal*)expression);
+            break;
+        case AST_EXPRESSION_CALL: {
+            auto call = (struct ast_call_expression*)expression;
+            inline_expression(in, &call->function);
+            inline_expressions(in, call->arguments);
+            try_inline(in, slot);
+            break;
+        }
+        case AST_EXPRESSION_ARRAY:
+            inline_expressions(in, ((struct ast_array_literal*)expression)->elements);
+            break;
+        case AST_EXPRESSION_INDEX: {
+            auto exp = (struct ast_index_expression*)expression;
+            inline_expression(in, &exp->left);
+            inline_expression(in, &exp->index);
+            break;
+        }
+        case AST_EXPRESSION_HASH: {
+            struct ast_expression_hash_bucket_buf buckets =
+                ((struct ast_hash_literal*)expression)->pairs.buckets;
+            for (size_t i = 0; i < buckets.len; i++) {
+                if (buckets.ptr[i].key == NULL) continue;
+                inline_expression(in, &buckets.ptr[i].key);
+                inline_expression(in, &buckets.ptr[i].value);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// `top` is set for the statements that make up a scope, the only ones whose lets are sure to run.
+static void inline_statements(struct inliner* in, struct ast_statement_buf* statements, bool top) {
+    for (size_t i = 0; i < statements->len; i++) {
+        struct ast_statement* statement = statements->ptr[i];
+        switch (statement->type) {
+            case AST_STATEMENT_EXPRESSION: {
+                auto exp = (struct ast_expression_statement*)statement;
+                if (exp->expression != NULL) inline_expression(in, &exp->expression);
+                break;
+            }
+            case AST_STATEMENT_BLOCK:
+                inline_statements(in, &((struct ast_block_statement*)statement)->statements, false);
+                break;
+            case AST_STATEMENT_RETURN: {
+                auto ret = (struct ast_return_statement*)statement;
+                if (ret->return_value != NULL) inline_expression(in, &ret->return_value);
+                break;
+            }
+            case AST_STATEMENT_LET: {
+                auto let = (struct ast_let_statement*)statement;
+                if (let->value != NULL) inline_expression(in, &let->value);
+                if (top and is_known_function(in->scope, let)) BUF_PUSH(&in->scope->known, let);
+                break;
+            }
+        }
+    }
+}
+
+void optimize_inline_functions(struct ast_program* program) {
+    struct inline_scope global = {0};
+    struct rewriter collect = {
+        .statements = collect_declaration,
+        .skip_functions = true,
+        .data = &global.names,
+    };
+    rewrite_program(&collect, program);
+
+    struct inliner in = {.scope = &global, .calls = 0};
+    inline_statements(&in, &program->statements, true);
+    BUF_FREE(global.names);
+}
+
+// Monkey has no effects, so what one evaluation of an expression can share with another comes
+// down to its value. Ordered from least to most shareable.
+enum purity {
+    // it calls a function that isn't known, whose result can depend on more than its arguments
+    PURITY_UNKNOWN,
+    // the same variables give the same result, but it can be a new string, array, hash or
+    // closure each time, which `==` tells apart
+    PURITY_ALLOCATES,
+    // the same variables give the same value
+    PURITY_PURE,
+};
+
+static enum purity min_purity(enum purity a, enum purity b) {
+    return a < b ? a : b;
+}
+
+// The purity of an integer or boolean computed from values of purity `purity`.
+static enum purity scalar_purity(enum purity purity) {
+    return purity == PURITY_UNKNOWN ? PURITY_UNKNOWN : PURITY_PURE;
+}
+
+// A function bound by a let that nothing else in its function's scope binds.
+struct known_function {
+    struct string name;
+    struct ast_function_literal* function;
+    // the purity of its result when its arguments are pure
+    enum purity purity;
+    // set while its body is walked; until then `purity` is a guess that only holds for calls
+    // from the body itself
+    bool pending;
+};
+
+BUF_T(struct known_function*, known_function);
+
+struct purity_scope {
+    struct purity_scope* outer;
+    // NULL for the global scope
+    struct ast_function_literal* function;
+    // every name declared in the scope, once per parameter or let
+    struct inline_name_buf names;
+    // the names sure to be bound where the walk is
+    struct inline_name_buf bound;
+    // the known functions bound so far
+    struct known_function_buf known;
+    // whether the body reads a variable of an enclosing function that can differ between calls
+    bool unstable;
+};
+
+// What the callee of a call is, as far as the walk could tell.
+struct call_purity {
+    struct ast_call_expression* call;
+    struct known_function* callee;
+    // for other callees, the purity of the result when the arguments are pure
+    enum purity purity;
+    // whether the result is an integer or boolean whatever the arguments
+    bool scalar;
+};
+
+BUF_T(struct call_purity, call_purity);
+
+// A walk over a program that works out which calls are pure, for passes that share the values
+// of expressions. Passes hook in once the body of each function has been walked.
+struct purity_analysis {
+    struct purity_scope* scope;
+    struct call_purity_buf calls;
+    // owns every known function
+    struct known_function_buf known;
+    // expressions dropped by the hook, freed once the walk is done so that no node allocated in
+    // the meantime can be mistaken for a call in `calls`
+    struct ast_expression_buf garbage;
+    // `let` binds `function` if it's a known function, and is NULL otherwise
+    void (*function)(
+        struct purity_analysis* a,
+        struct ast_let_statement* let,
+        struct ast_function_literal* function
+    );
+    // numbers the variables the hook introduces
+    size_t variables;
+};
+
+// The builtins' results only depend on their arguments.
+static enum purity builtin_purity(struct string name, bool* scalar) {
+    *scalar = STRING_EQUAL(name, STRING_REF("len"));
+    if (*scalar or STRING_EQUAL(name, STRING_REF("first")) or
+        STRING_EQUAL(name, STRING_REF("last"))) {
+        return PURITY_PURE;
+    }
+    if (STRING_EQUAL(name, STRING_REF("rest")) or STRING_EQUAL(name, STRING_REF("push"))) {
+        return PURITY_ALLOCATES;
+    }
+    return PURITY_UNKNOWN;
+}
+
+static void record_call(struct purity_analysis* a, struct ast_call_expression* call) {
+    struct call_purity entry = {.call = call, .callee = NULL, .purity = PURITY_UNKNOWN};
+    if (call->function->type == AST_EXPRESSION_IDENTIFIER) {
+        struct string name = ((struct ast_identifier*)call->function)->value;
+        struct purity_scope* scope = a->scope;
+        while (scope != NULL and count_names(scope->names, name) == 0) scope = scope->outer;
+        // a name the program never declares is a builtin
+        if (scope == NULL) entry.purity = builtin_purity(name, &entry.scalar);
+        for (size_t i = 0; scope != NULL and i < scope->known.len; i++) {
+            if (STRING_EQUAL(scope->known.ptr[i]->name, name)) entry.callee = scope->known.ptr[i];
+        }
+    }
+    BUF_PUSH(&a->calls, entry);
+}
+
+static struct call_purity* find_call(struct purity_analysis* a, struct ast_call_expression* call) {
+    for (size_t i = a->calls.len; i-- > 0;) {
+        if (a->calls.ptr[i].call == call) return &a->calls.ptr[i];
+    }
+    return NULL;
+}
+
+// Whether reading `name` where the walk is gives the same value on every call of the function
+// being walked. A variable of an enclosing function can differ between calls if it's bound twice
+// or after the function is made; globals can't change while a function runs.
+static bool is_stable_read(struct purity_scope* scope, struct string name) {
+    for (struct purity_scope* s = scope; s != NULL; s = s->outer) {
+        size_t count = count_names(s->names, name);
+        if (count == 0) continue;
+        if (s->function == NULL) return true;
+        bool bound = count_names(s->bound, name) > 0;
+        // an unbound variable of the function's own is looked up further out
+        if (s == scope) {
+            if (bound) return true;
+            continue;
+        }
+        return count == 1 and bound;
+    }
+    return true;
+}
+
+struct purity_query {
+    struct purity_analysis* analysis;
+    // set when working out the result of this scope's function, whose lets can bind new objects
+    // on every call; otherwise variables are taken to keep their value
+    struct purity_scope* results_of;
+    // the purity of the values `return` statements give
+    enum purity returns;
+};
+
+static enum purity expression_purity(struct purity_query* q, struct ast_expression* expression);
+
+static enum purity
+expressions_purity(struct purity_query* q, struct ast_expression_buf expressions) {
+    enum purity purity = PURITY_PURE;
+    for (size_t i = 0; i < expressions.len; i++) {
+        purity = min_purity(purity, expression_purity(q, expressions.ptr[i]));
+    }
+    return purity;
+}
+
+// The purity of the value of `statements`; what the others evaluate to only matters if it's
+// unknown.
+static enum purity statements_purity(struct purity_query* q, struct ast_statement_buf statements) {
+    enum purity value = PURITY_PURE;
+    for (size_t i = 0; i < statements.len; i++) {
+        struct ast_statement* statement = statements.ptr[i];
+        enum purity purity = PURITY_PURE;
+        switch (statement->type) {
+            case AST_STATEMENT_EXPRESSION: {
+                auto exp = (struct ast_expression_statement*)statement;
+                if (exp->expression != NULL) purity = expression_purity(q, exp->expression);
+                break;
+            }
+            case AST_STATEMENT_BLOCK:
+                purity = statements_purity(q, ((struct ast_block_statement*)statement)->statements);
+                break;
+            case AST_STATEMENT_RETURN: {
+                auto ret = (struct ast_return_statement*)statement;
+                if (ret->return_value != NULL) purity = expression_purity(q, ret->return_value);
+                q->returns = min_purity(q->returns, purity);
+                break;
+            }
+            case AST_STATEMENT_LET: {
+                // a let evaluates to null
+                auto let = (struct ast_let_statement*)statement;
+                if (let->value != NULL) purity = scalar_purity(expression_purity(q, let->value));
+                break;
+            }
+        }
+        value = min_purity(value, i + 1 == statements.len ? purity : scalar_purity(purity));
+    }
+    return value;
+}
+
+// Whether `expression` evaluates to an integer, if it evaluates at all.
+static bool is_integer_valued(struct purity_analysis* a, struct ast_expression* expression) {
+    switch (expression->type) {
+        case AST_EXPRESSION_INTEGER_LITERAL:
+            return true;
+        case AST_EXPRESSION_PREFIX:
+            return ((struct ast_prefix_expression*)expression)->op == AST_OPERATOR_MINUS;
+        case AST_EXPRESSION_INFIX: {
+            auto infix = (struct ast_infix_expression*)expression;
+            switch (infix->op) {
+                case AST_OPERATOR_MINUS:
+                case AST_OPERATOR_ASTERISK:
+                case AST_OPERATOR_SLASH:
+                    return true;
+                case AST_OPERATOR_PLUS:
+                    return is_integer_valued(a, infix->left) or is_integer_valued(a, infix->right);
+                default:
+                    return false;
+            }
+        }
+        case AST_EXPRESSION_CALL: {
+            struct call_purity* call = find_call(a, (struct ast_call_expression*)expression);
+            return call != NULL and call->scalar;
+        }
+        default:
+            return false;
+    }
+}
+
+static enum purity call_purity(struct purity_query* q, struct ast_call_expression* call) {
+    enum purity arguments = expressions_purity(q, call->arguments);
+    struct call_purity* entry = find_call(q->analysis, call);
+    if (entry == NULL) return PURITY_UNKNOWN;
+    if (entry->callee != NULL) {
+        struct known_function* callee = entry->callee;
+        if (callee->pending and
+            (q->results_of == NULL or q->results_of->function != callee->function)) {
+            return PURITY_UNKNOWN;
+        }
+        return min_purity(callee->purity, arguments);
+    }
+    return min_purity(entry->purity, entry->scalar ? scalar_purity(arguments) : arguments);
+}
+
+static enum purity expression_purity(struct purity_query* q, struct ast_expression* expression) {
+    switch (expression->type) {
+        case AST_EXPRESSION_INTEGER_LITERAL:
+        case AST_EXPRESSION_BOOLEAN:
+            return PURITY_PURE;
+        case AST_EXPRESSION_STRING:
+        case AST_EXPRESSION_FUNCTION:
+            return PURITY_ALLOCATES;
+        case AST_EXPRESSION_IDENTIFIER: {
+            struct purity_scope* scope = q->results_of;
+            if (scope == NULL) return PURITY_PURE;
+            struct string name = ((struct ast_identifier*)expression)->value;
+            size_t parameters = is_parameter(scope->function, name) ? 1 : 0;
+            return count_names(scope->names, name) > parameters ? PURITY_ALLOCATES : PURITY_PURE;
+        }
+        case AST_EXPRESSION_PREFIX: {
+            auto prefix = (struct ast_prefix_expression*)expression;
+            return scalar_purity(expression_purity(q, prefix->right));
+        }
+        case AST_EXPRESSION_INFIX: {
+            auto infix = (struct ast_infix_expression*)expression;
+            enum purity operands =
+                min_purity(expression_purity(q, infix->left), expression_purity(q, infix->right));
+            // `+` makes a new string out of strings
+            if (infix->op == AST_OPERATOR_PLUS and
+                !is_integer_valued(q->analysis, infix->left) and
+                !is_integer_valued(q->analysis, infix->right)) {
+                return min_purity(operands, PURITY_ALLOCATES);
+            }
+            return scalar_purity(operands);
+        }
+        case AST_EXPRESSION_INDEX: {
+            auto exp = (struct ast_index_expression*)expression;
+            return min_purity(
+                expression_purity(q, exp->left),
+                scalar_purity(expression_purity(q, exp->index))
+            );
+        }
+        case AST_EXPRESSION_CALL:
+            return call_purity(q, (struct ast_call_expression*)expression);
+        case AST_EXPRESSION_ARRAY: {
+            auto array = (struct ast_array_literal*)expression;
+            return min_purity(expressions_purity(q, array->elements), PURITY_ALLOCATES);
+        }
+        case AST_EXPRESSION_HASH: {
+            struct ast_expression_hash_bucket_buf buckets =
+                ((struct ast_hash_literal*)expression)->pairs.buckets;
+            enum purity purity = PURITY_ALLOCATES;
+            for (size_t i = 0; i < buckets.len; i++) {
+                if (buckets.ptr[i].key == NULL) continue;
+                purity = min_purity(purity, expression_purity(q, buckets.ptr[i].key));
+                purity = min_purity(purity, expression_purity(q, buckets.ptr[i].value));
+            }
+            return purity;
+        }
+        case AST_EXPRESSION_IF: {
+            auto exp = (struct ast_if_expression*)expression;
+            enum purity purity = scalar_purity(expression_purity(q, exp->condition));
+            purity = min_purity(purity, statements_purity(q, exp->consequence->statements));
+            if (exp->alternative != NULL) {
+                purity = min_purity(purity, statements_purity(q, exp->alternative->statements));
+            }
+            return purity;
+        }
+    }
+    return PURITY_UNKNOWN;
+}
+
+static void
+analyze_statements(struct purity_analysis* a, struct ast_statement_buf statements, bool top);
+
+static void analyze_function(
+    struct purity_analysis* a,
+    struct ast_function_literal* function,
+    struct ast_let_statement* let,
+    struct known_function* known
+) {
+    struct purity_scope scope = {.outer = a->scope, .function = function};
+    for (size_t i = 0; i < function->parameters.len; i++) {
+        BUF_PUSH(&scope.names, function->parameters.ptr[i]->value);
+        BUF_PUSH(&scope.bound, function->parameters.ptr[i]->value);
+    }
+    struct rewriter collect = {
+        .statements = collect_declaration,
+        .skip_functions = true,
+        .data = &scope.names,
+    };
+    rewrite_statements(&collect, &function->body->statements);
+
+    a->scope = &scope;
+    analyze_statements(a, function->body->statements, true);
+    if (known != NULL) {
+        struct purity_query q = {.analysis = a, .results_of = &scope, .returns = PURITY_PURE};
+        enum purity result = statements_purity(&q, function->body->statements);
+        known->purity = scope.unstable ? PURITY_UNKNOWN : min_purity(result, q.returns);
+        known->pending = false;
+    }
+    if (a->function != NULL) a->function(a, let, function);
+    a->scope = scope.outer;
+    BUF_FREE(scope.names);
+    BUF_FREE(scope.bound);
+    BUF_FREE(scope.known);
+}
+
+static void analyze_expression(struct purity_analysis* a, struct ast_expression* expression);
+
+static void analyze_expressions(struct purity_analysis* a, struct ast_expression_buf expressions) {
+    for (size_t i = 0; i < expressions.len; i++) {
+        analyze_expression(a, expressions.ptr[i]);
+    }
+}
+
+static void analyze_expression(struct purity_analysis* a, struct ast_expression* expression) {
+    switch (expression->type) {
+        case AST_EXPRESSION_IDENTIFIER:
+            if (!is_stable_read(a->scope, ((struct ast_identifier*)expression)->value)) {
+                a->scope->unstable = true;
+            }
+            break;
+        case AST_EXPRESSION_PREFIX:
+            analyze_expression(a, ((struct ast_prefix_expression*)expression)->right);
+            break;
+        case AST_EXPRESSION_INFIX: {
+            auto infix = (struct ast_infix_expression*)expression;
+            analyze_expression(a, infix->left);
+            analyze_expression(a, infix->right);
+            break;
+        }
+        case AST_EXPRESSION_IF: {
+            auto exp = (struct ast_if_expression*)expression;
+            analyze_expression(a, exp->condition);
+            analyze_statements(a, exp->consequence->statements, false);
+            if (exp->alternative != NULL) {
+                analyze_statements(a, exp->alternative->statements, false);
+            }
+            break;
+        }
+        case AST_EXPRESSION_FUNCTION:
+            analyze_function(a, (struct ast_function_literal*)expression, NULL, NULL);
+            break;
+        case AST_EXPRESSION_CALL: {
+            auto call = (struct ast_call_expression*)expression;
+            analyze_expression(a, call->function);
+            analyze_expressions(a, call->arguments);
+            record_call(a, call);
+            break;
+        }
+        case AST_EXPRESSION_ARRAY:
+            analyze_expressions(a, ((struct ast_array_literal*)expression)->elements);
+            break;
+        case AST_EXPRESSION_INDEX: {
+            auto exp = (struct ast_index_expression*)expression;
+            analyze_expression(a, exp->left);
+            analyze_expression(a, exp->index);
+            break;
+        }
+        case AST_EXPRESSION_HASH: {
+            struct ast_expression_hash_bucket_buf buckets =
+                ((struct ast_hash_literal*)expression)->pairs.buckets;
+            for (size_t i = 0; i < buckets.len; i++) {
+                if (buckets.ptr[i].key == NULL) continue;
+                analyze_expression(a, buckets.ptr[i].key);
+                analyze_expression(a, buckets.ptr[i].value);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void analyze_let(struct purity_analysis* a, struct ast_let_statement* let, bool top) {
+    struct purity_scope* scope = a->scope;
+    struct string name = let->name->value;
+    if (let->value == NULL or let->value->type != AST_EXPRESSION_FUNCTION) {
+        if (let->value != NULL) analyze_expression(a, let->value);
+        BUF_PUSH(&scope->bound, name);
+        return;
+    }
+
+    // the function can only be called once it's bound
+    BUF_PUSH(&scope->bound, name);
+    auto function = (struct ast_function_literal*)let->value;
+    struct known_function* known = NULL;
+    // as with inlining, globals are left out since later REPL input can rebind them
+    if (top and scope->function != NULL and count_names(scope->names, name) == 1) {
+        known = malloc(sizeof(*known));
+        *known = (struct known_function){
+            .name = name,
+            .function = function,
+            .purity = PURITY_PURE,
+            .pending = true,
+        };
+        BUF_PUSH(&scope->known, known);
+        BUF_PUSH(&a->known, known);
+    }
+    analyze_function(a, function, known != NULL ? let : NULL, known);
+}
+
+// `top` is set for the statements that make up a scope, the only ones whose lets are sure to run.
+static void
+analyze_statements(struct purity_analysis* a, struct ast_statement_buf statements, bool top) {
+    size_t bound = a->scope->bound.len;
+    for (size_t i = 0; i < statements.len; i++) {
+        struct ast_statement* statement = statements.ptr[i];
+        switch (statement->type) {
+            case AST_STATEMENT_EXPRESSION: {
+                auto exp = (struct ast_expression_statement*)statement;
+                if (exp->expression != NULL) analyze_expression(a, exp->expression);
+                break;
+            }
+            case AST_STATEMENT_BLOCK:
+                analyze_statements(a, ((struct ast_block_statement*)statement)->statements, false);
+                break;
+            case AST_STATEMENT_RETURN: {
+                auto ret = (struct ast_return_statement*)statement;
+                if (ret->return_value != NULL) analyze_expression(a, ret->return_value);
+                break;
+            }
+            case AST_STATEMENT_LET:
+                analyze_let(a, (struct ast_let_statement*)statement, top);
+                break;
+        }
+    }
+    // the lets of a nested block may not have run after it
+    if (!top) a->scope->bound.len = bound;
+}
+
+static void analyze_program(struct purity_analysis* a, struct ast_program* program) {
+    struct purity_scope global = {0};
+    struct rewriter collect = {
+        .statements = collect_declaration,
+        .skip_functions = true,
+        .data = &global.names,
+    };
+    rewrite_program(&collect, program);
+
+    a->scope = &global;
+    analyze_statements(a, program->statements, true);
+    a->scope = NULL;
+    BUF_FREE(global.names);
+    BUF_FREE(global.bound);
+    BUF_FREE(global.known);
+    for (size_t i = 0; i < a->known.len; i++) {
+        free(a->known.ptr[i]);
+    }
+    BUF_FREE(a->known);
+    BUF_FREE(a->calls);
+    for (size_t i = 0; i < a->garbage.len; i++) {
+        release_expression(a->garbage.ptr[i]);
+    }
+    BUF_FREE(a->garbage);
+}
+
+static struct ast_expression* variable(struct string name) {
+    return ast_identifier_init_base(
+        (struct token){TOKEN_IDENT, string_dup(name)},
+        string_dup(name)
+    );
+}
+
+// Whether `expression` is one worth evaluating once: it calls or indexes.
+static bool has_access(struct ast_expression* expression) {
+    switch (expression->type) {
+        case AST_EXPRESSION_CALL:
+        case AST_EXPRESSION_INDEX:
+            return true;
+        case AST_EXPRESSION_PREFIX:
+            return has_access(((struct ast_prefix_expression*)expression)->right);
+        case AST_EXPRESSION_INFIX: {
+            auto infix = (struct ast_infix_expression*)expression;
+            return has_access(infix->left) or has_access(infix->right);
+        }
+        default:
+            return false;
+    }
+}
+
+static bool same_expressions(struct ast_expression_buf a, struct ast_expression_buf b);
+
+// Whether `a` and `b` are written the same. Branches, hashes and functions never are.
+static bool same_expression(struct ast_expression* a, struct ast_expression* b) {
+    if (a->type != b->type) return false;
+    switch (a->type) {
+        case AST_EXPRESSION_IDENTIFIER:
+            return STRING_EQUAL(
+                ((struct ast_identifier*)a)->value,
+                ((struct ast_identifier*)b)->value
+            );
+        case AST_EXPRESSION_INTEGER_LITERAL:
+            return ((struct ast_integer_literal*)a)->value ==
+                   ((struct ast_integer_literal*)b)->value;
+        case AST_EXPRESSION_BOOLEAN:
+            return ((struct ast_boolean*)a)->value == ((struct ast_boolean*)b)->value;
+        case AST_EXPRESSION_STRING:
+            return STRING_EQUAL(
+                ((struct ast_string_literal*)a)->value,
+                ((struct ast_string_literal*)b)->value
+            );
+        case AST_EXPRESSION_PREFIX: {
+            auto x = (struct ast_prefix_expression*)a;
+            auto y = (struct ast_prefix_expression*)b;
+            return x->op == y->op and same_expression(x->right, y->right);
+        }
+        case AST_EXPRESSION_INFIX: {
+            auto x = (struct ast_infix_expression*)a;
+            auto y = (struct ast_infix_expression*)b;
+            return x->op == y->op and same_expression(x->left, y->left) and
+                   same_expression(x->right, y->right);
+        }
+        case AST_EXPRESSION_INDEX: {
+            auto x = (struct ast_index_expression*)a;
+            auto y = (struct ast_index_expression*)b;
+            return same_expression(x->left, y->left) and same_expression(x->index, y->index);
+        }
+        case AST_EXPRESSION_CALL: {
+            auto x = (struct ast_call_expression*)a;
+            auto y = (struct ast_call_expression*)b;
+            return same_expression(x->function, y->function) and
+                   same_expressions(x->arguments, y->arguments);
+        }
+        case AST_EXPRESSION_ARRAY:
+            return same_expressions(
+                ((struct ast_array_literal*)a)->elements,
+                ((struct ast_array_literal*)b)->elements
+            );
+        default:
+            return false;
+    }
+}
+
+static bool same_expressions(struct ast_expression_buf a, struct ast_expression_buf b) {
+    if (a.len != b.len) return false;
+    for (size_t i = 0; i < a.len; i++) {
+        if (!same_expression(a.ptr[i], b.ptr[i])) return false;
+    }
+    return true;
+}
+
+// An expression in a function body whose value could be shared.
+struct occurrence {
+    struct ast_expression** slot;
+    // the statement of the body it's in
+    size_t statement;
+    // the innermost branch it's in
+    size_t region;
+    // the index of the first occurrence that isn't part of this one
+    size_t end;
+};
+
+BUF_T(struct occurrence, occurrence);
+BUF_T(size_t, region);
+
+// The calls, indexes and operators of a function body in the order they're evaluated, leaving out
+// hashes and functions.
+struct occurrences {
+    struct occurrence_buf found;
+    // the region each branch is in; the body is region 0
+    struct region_buf regions;
+};
+
+// Whether code in region `inner` only runs after the code of region `outer` before it.
+static bool is_within(struct occurrences* o, size_t inner, size_t outer) {
+    while (inner != outer and inner != 0) inner = o->regions.ptr[inner];
+    return inner == outer;
+}
+
+static size_t branch_region(struct occurrences* o, size_t region) {
+    BUF_PUSH(&o->regions, region);
+    return o->regions.len - 1;
+}
+
+static void collect_occurrences(
+    struct occurrences* o,
+    struct ast_expression** slot,
+    size_t statement,
+    size_t region
+);
+
+static void collect_statement_occurrences(
+    struct occurrences* o,
+    struct ast_statement* s,
+    size_t statement,
+    size_t region
+) {
+    switch (s->type) {
+        case AST_STATEMENT_EXPRESSION: {
+            auto exp = (struct ast_expression_statement*)s;
+            if (exp->expression != NULL) {
+                collect_occurrences(o, &exp->expression, statement, region);
+            }
+            break;
+        }
+        case AST_STATEMENT_BLOCK: {
+            struct ast_statement_buf statements = ((struct ast_block_statement*)s)->statements;
+            for (size_t i = 0; i < statements.len; i++) {
+                collect_statement_occurrences(o, statements.ptr[i], statement, region);
+            }
+            break;
+        }
+        case AST_STATEMENT_RETURN: {
+            auto ret = (struct ast_return_statement*)s;
+            if (ret->return_value != NULL) {
+                collect_occurrences(o, &ret->return_value, statement, region);
+            }
+            break;
+        }
+        case AST_STATEMENT_LET: {
+            auto let = (struct ast_let_statement*)s;
+            if (let->value != NULL) collect_occurrences(o, &let->value, statement, region);
+            break;
+        }
+    }
+}
+
+static void collect_block_occurrences(
+    struct occurrences* o,
+    struct ast_block_statement* block,
+    size_t statement,
+    size_t region
+) {
+    for (size_t i = 0; i < block->statements.len; i++) {
+        collect_statement_occurrences(o, block->statements.ptr[i], statement, region);
+    }
+}
+
+static void collect_occurrences(
+    struct occurrences* o,
+    struct ast_expression** slot,
+    size_t statement,
+    size_t region
+) {
+    struct ast_expression* expression = *slot;
+    size_t index = o->found.len;
+    bool shareable = expression->type == AST_EXPRESSION_CALL or
+                     expression->type == AST_EXPRESSION_INDEX or
+                     expression->type == AST_EXPRESSION_INFIX or
+                     expression->type == AST_EXPRESSION_PREFIX;
+    if (shareable) {
+        BUF_PUSH(
+            &o->found,
+            ((struct occurrence){.slot = slot, .statement = statement, .region = region})
+        );
+    }
+    switch (expression->type) {
+        case AST_EXPRESSION_PREFIX:
+            collect_occurrences(
+                o,
+                &((struct ast_prefix_expression*)expression)->right,
+                statement,
+                region
+            );
+            break;
+        case AST_EXPRESSION_INFIX: {
+            auto infix = (struct ast_infix_expression*)expression;
+            collect_occurrences(o, &infix->left, statement, region);
+            collect_occurrences(o, &infix->right, statement, region);
+            break;
+        }
+        case AST_EXPRESSION_INDEX: {
+            auto exp = (struct ast_index_expression*)expression;
+            collect_occurrences(o, &exp->left, statement, region);
+            collect_occurrences(o, &exp->index, statement, region);
+            break;
+        }
+        case AST_EXPRESSION_CALL: {
+            auto call = (struct ast_call_expression*)expression;
+            collect_occurrences(o, &call->function, statement, region);
+            for (size_t i = 0; i < call->arguments.len; i++) {
+                collect_occurrences(o, &call->arguments.ptr[i], statement, region);
+            }
+            break;
+        }
+        case AST_EXPRESSION_ARRAY: {
+            auto array = (struct ast_array_literal*)expression;
+            for (size_t i = 0; i < array->elements.len; i++) {
+                collect_occurrences(o, &array->elements.ptr[i], statement, region);
+            }
+            break;
+        }
+        case AST_EXPRESSION_IF: {
+            auto exp = (struct ast_if_expression*)expression;
+            collect_occurrences(o, &exp->condition, statement, region);
+            // the consequence of `if (true)` always runs
+            bool truthy;
+            bool known = known_condition(exp->condition, &truthy) and truthy;
+            collect_block_occurrences(
+                o,
+                exp->consequence,
+                statement,
+                known ? region : branch_region(o, region)
+            );
+            if (exp->alternative != NULL) {
+                collect_block_occurrences(
+                    o,
+                    exp->alternative,
+                    statement,
+                    branch_region(o, region)
+                );
+            }
+            break;
+        }
+        default:
+            break;
+    }
+    if (shareable) o->found.ptr[index].end = o->found.len;
+}
+
+static struct occurrences collect_body_occurrences(struct ast_statement_buf body) {
+    struct occurrences o = {0};
+    BUF_PUSH(&o.regions, 0);
+    for (size_t i = 0; i < body.len; i++) {
+        collect_statement_occurrences(&o, body.ptr[i], i, 0);
+    }
+    return o;
+}
+
+static void occurrences_free(struct occurrences* o) {
+    BUF_FREE(o->found);
+    BUF_FREE(o->regions);
+}
+
+struct fixed_names {
+    struct purity_scope* scope;
+    struct ast_statement_buf body;
+    size_t statement;
+    bool fixed;
+};
+
+// Whether `name` keeps its value throughout the body of the scope's function from the statement
+// on: it's a parameter or a variable from outside that the body doesn't rebind, or the body binds
+// it with a single let before the statement.
+static void check_fixed_name(struct rewriter* r, struct ast_expression** slot) {
+    struct fixed_names* check = r->data;
+    if ((*slot)->type != AST_EXPRESSION_IDENTIFIER) return;
+    struct string name = ((struct ast_identifier*)*slot)->value;
+    size_t count = count_names(check->scope->names, name);
+    if (count == 0 or (count == 1 and is_parameter(check->scope->function, name))) return;
+    if (count == 1) {
+        for (size_t i = 0; i < check->statement; i++) {
+            auto let = (struct ast_let_statement*)check->body.ptr[i];
+            if (let->statement.type == AST_STATEMENT_LET and STRING_EQUAL(let->name->value, name)) {
+                return;
+            }
+        }
+    }
+    check->fixed = false;
+}
+
+static bool is_pure_expression(struct purity_analysis* a, struct ast_expression* expression) {
+    struct purity_query q = {.analysis = a, .results_of = NULL, .returns = PURITY_PURE};
+    return expression_purity(&q, expression) == PURITY_PURE;
+}
+
+static bool is_shareable(
+    struct purity_analysis* a,
+    struct ast_statement_buf body,
+    struct occurrence occurrence
+) {
+    struct ast_expression* expression = *occurrence.slot;
+    if (!has_access(expression) or !is_pure_expression(a, expression)) return false;
+    struct fixed_names check = {
+        .scope = a->scope,
+        .body = body,
+        .statement = occurrence.statement,
+        .fixed = true,
+    };
+    struct rewriter r = {.expression = check_fixed_name, .skip_functions = true, .data = &check};
+    rewrite_expression(&r, occurrence.slot);
+    return check.fixed;
+}
+
+// Binds the value of `first` to a variable where it's evaluated, as in
+// `if (true) { let @cse1 = len(a); @cse1 }`, and returns the variable's name. A let of the
+// function's own that `first` is the value of already does.
+static struct string bind_occurrence(
+    struct purity_analysis* a,
+    struct ast_statement_buf body,
+    struct occurrence first
+) {
+    auto let = (struct ast_let_statement*)body.ptr[first.statement];
+    if (let->statement.type == AST_STATEMENT_LET and &let->value == first.slot and
+        count_names(a->scope->names, let->name->value) == 1) {
+        return string_dup(let->name->value);
+    }
+
+    struct string name = string_printf("@cse%zu", ++a->variables);
+    struct ast_let_statement* binding = ast_let_statement_init(
+        (struct token){TOKEN_LET, string_dup(STRING_REF("let"))},
+        ast_identifier_init((struct token){TOKEN_IDENT, string_dup(name)}, string_dup(name)),
+        *first.slot
+    );
+    BUF_PUSH(&a->scope->names, binding->name->value);
+    struct ast_statement_buf statements = {0};
+    BUF_PUSH(&statements, &binding->statement);
+    BUF_PUSH(
+        &statements,
+        ast_expression_statement_init_base(
+            (struct token){TOKEN_IDENT, string_dup(name)},
+            variable(name)
+        )
+    );
+    *first.slot = ast_if_expression_init_base(
+        (struct token){TOKEN_IF, string_dup(STRING_REF("if"))},
+        boolean_literal(true),
+        ast_block_statement_init(
+            (struct token){TOKEN_LBRACE, string_dup(STRING_REF("{"))},
+            statements
+        ),
+        NULL
+    );
+    return name;
+}
+
+// Shares the value of the first expression in the body that is sure to be evaluated before a copy
+// of it with the copies. Returns whether there was one.
+static bool share_common_subexpression(
+    struct purity_analysis* a,
+    struct ast_function_literal* function
+) {
+    struct ast_statement_buf body = function->body->statements;
+    struct occurrences o = collect_body_occurrences(body);
+    struct occurrence_buf found = o.found;
+    bool shared = false;
+    for (size_t i = 0; i < found.len and !shared; i++) {
+        struct occurrence first = found.ptr[i];
+        if (!is_shareable(a, body, first)) continue;
+        struct ast_expression* expression = *first.slot;
+        struct string name = EMPTY_STRING;
+        size_t j = first.end;
+        while (j < found.len) {
+            if (!same_expression(*found.ptr[j].slot, expression) or
+                !is_within(&o, found.ptr[j].region, first.region)) {
+                j++;
+                continue;
+            }
+            if (!shared) name = bind_occurrence(a, body, first);
+            shared = true;
+            BUF_PUSH(&a->garbage, *found.ptr[j].slot);
+            *found.ptr[j].slot = variable(name);
+            j = found.ptr[j].end;
+        }
+        if (shared) STRING_FREE(name);
+    }
+    occurrences_free(&o);
+    return shared;
+}
+
+// Only function bodies are rewritten: at the top level, lets bind globals.
+static void eliminate_common_subexpressions(
+    struct purity_analysis* a,
+    struct ast_let_statement* let,
+    struct ast_function_literal* function
+) {
+    (void)let;
+    while (share_common_subexpression(a, function)) {
+    }
+}
+
+void optimize_eliminate_common_subexpressions(struct ast_program* program) {
+    struct purity_analysis a = {.function = eliminate_common_subexpressions};
+    analyze_program(&a, program);
+}
+
+BUF_T(struct ast_call_expression*, self_call);
+BUF_T(struct ast_expression**, expression_slot);
+
+struct recursion {
+    struct string name;
+    size_t arity;
+    struct self_call_buf calls;
+    // how often the body mentions the function's name
+    size_t mentions;
+    bool closures;
+};
+
+static void find_self_call(struct rewriter* r, struct ast_expression** slot) {
+    struct recursion* recursion = r->data;
+    struct ast_expression* expression = *slot;
+    if (expression->type == AST_EXPRESSION_FUNCTION) recursion->closures = true;
+    if (expression->type == AST_EXPRESSION_IDENTIFIER and
+        STRING_EQUAL(((struct ast_identifier*)expression)->value, recursion->name)) {
+        recursion->mentions++;
+    }
+    if (expression->type != AST_EXPRESSION_CALL) return;
+    auto call = (struct ast_call_expression*)expression;
+    if (call->function->type == AST_EXPRESSION_IDENTIFIER and
+        STRING_EQUAL(((struct ast_identifier*)call->function)->value, recursion->name) and
+        call->arguments.len == recursion->arity) {
+        BUF_PUSH(&recursion->calls, call);
+    }
+}
+
+struct hoisting {
+    struct purity_analysis* analysis;
+    struct ast_function_literal* function;
+    struct string name;
+    // for each parameter, whether every call of the function from its body passes it on as is
+    bool* invariant;
+    struct expression_slot_buf found;
+    bool invariant_names;
+};
+
+static void check_invariant_name(struct rewriter* r, struct ast_expression** slot) {
+    struct hoisting* h = r->data;
+    if ((*slot)->type != AST_EXPRESSION_IDENTIFIER) return;
+    struct string name = ((struct ast_identifier*)*slot)->value;
+    struct function_parameter_buf parameters = h->function->parameters;
+    for (size_t i = 0; i < parameters.len; i++) {
+        if (STRING_EQUAL(parameters.ptr[i]->value, name) and h->invariant[i]) return;
+    }
+    if (STRING_EQUAL(name, h->name) or count_names(h->analysis->scope->names, name) > 0) {
+        h->invariant_names = false;
+    }
+}
+
+// Whether `expression` has the same value on every call in a recursion: it's pure, and reads
+// nothing but variables from outside and invariant parameters.
+static bool is_invariant(struct hoisting* h, struct ast_expression** slot) {
+    struct ast_expression* expression = *slot;
+    if (expression->type == AST_EXPRESSION_IDENTIFIER or !has_access(expression) or
+        !is_pure_expression(h->analysis, expression)) {
+        return false;
+    }
+    h->invariant_names = true;
+    struct rewriter r = {.expression = check_invariant_name, .data = h};
+    rewrite_expression(&r, slot);
+    return h->invariant_names;
+}
+
+static bool hoist_prefix_statements(struct hoisting* h, struct ast_statement_buf statements);
+
+// Walks the evaluations every call of the function starts with, in order, collecting the
+// invariant expressions among them. Returns false once an evaluation can fail or branch, since
+// evaluating an expression only the calls that get past it evaluate could report another error.
+static bool hoist_prefix(struct hoisting* h, struct ast_expression** slot) {
+    struct ast_expression* expression = *slot;
+    if (is_invariant(h, slot)) {
+        BUF_PUSH(&h->found, slot);
+        return true;
+    }
+    switch (expression->type) {
+        case AST_EXPRESSION_INTEGER_LITERAL:
+        case AST_EXPRESSION_BOOLEAN:
+        case AST_EXPRESSION_STRING:
+        case AST_EXPRESSION_FUNCTION:
+            return true;
+        case AST_EXPRESSION_IDENTIFIER:
+            return is_parameter(h->function, ((struct ast_identifier*)expression)->value);
+        case AST_EXPRESSION_PREFIX:
+            hoist_prefix(h, &((struct ast_prefix_expression*)expression)->right);
+            return false;
+        case AST_EXPRESSION_INFIX: {
+            auto infix = (struct ast_infix_expression*)expression;
+            if (hoist_prefix(h, &infix->left)) hoist_prefix(h, &infix->right);
+            return false;
+        }
+        case AST_EXPRESSION_INDEX: {
+            auto exp = (struct ast_index_expression*)expression;
+            if (hoist_prefix(h, &exp->left)) hoist_prefix(h, &exp->index);
+            return false;
+        }
+        case AST_EXPRESSION_CALL: {
+            auto call = (struct ast_call_expression*)expression;
+            if (!hoist_prefix(h, &call->function)) return false;
+            for (size_t i = 0; i < call->arguments.len; i++) {
+                if (!hoist_prefix(h, &call->arguments.ptr[i])) return false;
+            }
+            return false;
+        }
+        case AST_EXPRESSION_ARRAY: {
+            auto array = (struct ast_array_literal*)expression;
+            for (size_t i = 0; i < array->elements.len; i++) {
+                if (!hoist_prefix(h, &array->elements.ptr[i])) return false;
+            }
+            return true;
+        }
+        case AST_EXPRESSION_IF:
+            hoist_prefix(h, &((struct ast_if_expression*)expression)->condition);
+            return false;
+        default:
+            return false;
+    }
+}
+
+static bool hoist_prefix_statements(struct hoisting* h, struct ast_statement_buf statements) {
+    for (size_t i = 0; i < statements.len; i++) {
+        struct ast_statement* statement = statements.ptr[i];
+        switch (statement->type) {
+            case AST_STATEMENT_EXPRESSION: {
+                auto exp = (struct ast_expression_statement*)statement;
+                if (exp->expression != NULL and !hoist_prefix(h, &exp->expression)) return false;
+                break;
+            }
+            case AST_STATEMENT_BLOCK: {
+                auto block = (struct ast_block_statement*)statement;
+                if (!hoist_prefix_statements(h, block->statements)) return false;
+                break;
+            }
+            case AST_STATEMENT_RETURN: {
+                auto ret = (struct ast_return_statement*)statement;
+                if (ret->return_value != NULL) hoist_prefix(h, &ret->return_value);
+                return false;
+            }
+            case AST_STATEMENT_LET: {
+                auto let = (struct ast_let_statement*)statement;
+                if (let->value != NULL and !hoist_prefix(h, &let->value)) return false;
+                break;
+            }
+        }
+    }
+    return true;
+}
+
+// Binds each invariant expression found to a variable of the function, replacing every copy of it
+// in the body.
+static struct ast_statement_buf bind_invariants(struct hoisting* h) {
+    struct purity_analysis* a = h->analysis;
+    struct ast_statement_buf statements = {0};
+    for (size_t i = 0; i < h->found.len; i++) {
+        struct ast_expression* expression = *h->found.ptr[i];
+        // a copy of an earlier one
+        if (expression->type == AST_EXPRESSION_IDENTIFIER) continue;
+        ast_node_incref(&expression->node);
+        struct string name = string_printf("@inv%zu", ++a->variables);
+        struct occurrences o = collect_body_occurrences(h->function->body->statements);
+        struct occurrence_buf found = o.found;
+        size_t j = 0;
+        while (j < found.len) {
+            if (!same_expression(*found.ptr[j].slot, expression)) {
+                j++;
+                continue;
+            }
+            BUF_PUSH(&a->garbage, *found.ptr[j].slot);
+            *found.ptr[j].slot = variable(name);
+            j = found.ptr[j].end;
+        }
+        occurrences_free(&o);
+        BUF_PUSH(
+            &statements,
+            ast_let_statement_init_base(
+                (struct token){TOKEN_LET, string_dup(STRING_REF("let"))},
+                ast_identifier_init((struct token){TOKEN_IDENT, string_dup(name)}, name),
+                expression
+            )
+        );
+    }
+    return statements;
+}
+
+// Turns `let f = fn(n, k) { ...len(k)...; f(n - 1, k) }` into
+// `let f = fn(n, k) { let @inv1 = len(k); let f@loop = fn(n) { ...@inv1...; f@loop(n - 1) };
+// f@loop(n) }`, so that the recursion evaluates the invariant expressions it starts with once.
+static void hoist_invariants(
+    struct purity_analysis* a,
+    struct ast_let_statement* let,
+    struct ast_function_literal* function
+) {
+    if (let == NULL or has_duplicate_parameters(function)) return;
+    struct string name = let->name->value;
+    if (count_names(a->scope->names, name) > 0) return;
+    struct recursion recursion = {.name = name, .arity = function->parameters.len};
+    struct rewriter find = {.expression = find_self_call, .data = &recursion};
+    rewrite_statements(&find, &function->body->statements);
+    if (recursion.calls.len == 0 or recursion.mentions != recursion.calls.len or
+        recursion.closures) {
+        BUF_FREE(recursion.calls);
+        return;
+    }
+
+    size_t arity = function->parameters.len;
+    struct hoisting h = {
+        .analysis = a,
+        .function = function,
+        .name = name,
+        .invariant = calloc(arity ? arity : 1, sizeof(bool)),
+    };
+    for (size_t i = 0; i < arity; i++) {
+        struct string parameter = function->parameters.ptr[i]->value;
+        h.invariant[i] = count_names(a->scope->names, parameter) == 1;
+        for (size_t j = 0; j < recursion.calls.len; j++) {
+            struct ast_expression* argument = recursion.calls.ptr[j]->arguments.ptr[i];
+            if (argument->type != AST_EXPRESSION_IDENTIFIER or
+                !STRING_EQUAL(((struct ast_identifier*)argument)->value, parameter)) {
+                h.invariant[i] = false;
+            }
+        }
+    }
+    hoist_prefix_statements(&h, function->body->statements);
+    if (h.found.len == 0) {
+        free(h.invariant);
+        BUF_FREE(recursion.calls);
+        return;
+    }
+
+    struct ast_statement_buf statements = bind_invariants(&h);
+    struct string loop = string_printf(STRING_FMT "@loop", STRING_ARG(name));
+    for (size_t i = 0; i < recursion.calls.len; i++) {
+        struct ast_call_expression* call = recursion.calls.ptr[i];
+        BUF_PUSH(&a->garbage, call->function);
+        call->function = variable(loop);
+        struct ast_expression_buf arguments = {0};
+        for (size_t j = 0; j < arity; j++) {
+            if (h.invariant[j]) {
+                BUF_PUSH(&a->garbage, call->arguments.ptr[j]);
+            } else {
+                BUF_PUSH(&arguments, call->arguments.ptr[j]);
+            }
+        }
+        BUF_FREE(call->arguments);
+        call->arguments = arguments;
+    }
+
+    struct function_parameter_buf parameters = {0};
+    struct ast_expression_buf arguments = {0};
+    for (size_t i = 0; i < arity; i++) {
+        if (h.invariant[i]) continue;
+        struct ast_identifier* parameter = function->parameters.ptr[i];
+        BUF_PUSH(
+            &parameters,
+            ast_identifier_init(token_dup(parameter->token), string_dup(parameter->value))
+        );
+        BUF_PUSH(&arguments, variable(parameter->value));
+    }
+    BUF_PUSH(
+        &statements,
+        ast_let_statement_init_base(
+            (struct token){TOKEN_LET, string_dup(STRING_REF("let"))},
+            ast_identifier_init((struct token){TOKEN_IDENT, string_dup(loop)}, string_dup(loop)),
+            ast_function_literal_init_base(token_dup(function->token), parameters, function->body)
+        )
+    );
+    BUF_PUSH(
+        &statements,
+        ast_expression_statement_init_base(
+            (struct token){TOKEN_IDENT, string_dup(loop)},
+            ast_call_expression_init_base(
+                (struct token){TOKEN_LPAREN, string_dup(STRING_REF("("))},
+                variable(loop),
+                arguments
+            )
+        )
+    );
+    struct ast_block_statement* body = function->body;
+    function->body = ast_block_statement_init(token_dup(body->token), statements);
+    function->body->source = body->source;
+    body->source = (struct string){0};
+    STRING_FREE(loop);
+    free(h.invariant);
+    BUF_FREE(h.found);
+    BUF_FREE(recursion.calls);
+}
+
+void optimize_hoist_invariants(struct ast_program* program) {
+    struct purity_analysis a = {.function = hoist_invariants};
+    analyze_program(&a, program);
+}
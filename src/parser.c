@@ -134,7 +134,7 @@ static struct ast_expression* parse_boolean(struct parser* p) {
 
 static struct ast_expression* parse_prefix_expression(struct parser* p) {
     struct token token = take_cur(p);
-    struct string op = string_dup(token.literal);
+    enum ast_operator op = ast_operator_from_token(token.type);
 
     next_token(p);
 
@@ -146,7 +146,7 @@ static struct ast_expression* parse_prefix_expression(struct parser* p) {
 static struct ast_expression*
 parse_infix_expression(struct parser* p, struct ast_expression* left) {
     struct token token = take_cur(p);
-    struct string op = string_dup(token.literal);
+    enum ast_operator op = ast_operator_from_token(token.type);
 
     enum precedence precedence = cur_precedence(p);
     next_token(p);
@@ -0,0 +1,60 @@
+#include "monkey/pool.h"
+
+#include <iso646.h>
+#include <stdlib.h>
+
+#include "monkey/private/stdc.h"
+
+// Every class carves slabs of this many bytes.
+#define POOL_SLAB_SIZE ((size_t)64 * 1024)
+#define POOL_CLASSES (POOL_MAX_SIZE / POOL_GRANULE)
+
+struct pool_block {
+    struct pool_block* next;
+};
+
+struct pool {
+    struct pool_block* free;
+    // the unused end of the current slab
+    char* top;
+    char* end;
+};
+
+static struct pool pools[POOL_CLASSES];
+
+static struct pool* pool_for(size_t size) {
+    if (size == 0 or size > POOL_MAX_SIZE or MONKEY_ASAN) return NULL;
+    return &pools[(size - 1) / POOL_GRANULE];
+}
+
+static void* pool_carve(struct pool* pool, size_t block_size) {
+    if ((size_t)(pool->end - pool->top) < block_size) {
+        pool->top = malloc(POOL_SLAB_SIZE);
+        if (pool->top == NULL) abort();
+        pool->end = pool->top + POOL_SLAB_SIZE / block_size * block_size;
+    }
+    void* block = pool->top;
+    pool->top += block_size;
+    return block;
+}
+
+void* pool_alloc(size_t size) {
+    struct pool* pool = pool_for(size);
+    if (pool == NULL) return malloc(size);
+    struct pool_block* block = pool->free;
+    if (block == NULL) return pool_carve(pool, (size_t)(pool - pools + 1) * POOL_GRANULE);
+    pool->free = block->next;
+    return block;
+}
+
+void pool_free(void* block, size_t size) {
+    if (block == NULL) return;
+    struct pool* pool = pool_for(size);
+    if (pool == NULL) {
+        free(block);
+        return;
+    }
+    struct pool_block* freed = block;
+    freed->next = pool->free;
+    pool->free = freed;
+}
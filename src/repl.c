@@ -1,14 +1,13 @@
 #include "monkey/repl.h"
 
 #include <monkey/environment.h>
-#include <monkey/evaluator.h>
 #include <monkey/lexer.h>
 #include <monkey/parser.h>
 #include <monkey/string.h>
 
 const struct string PROMPT = STRING_REF_C(">> ");
 
-void repl_start(FILE* in, FILE* out, struct environment* env) {
+void repl_start(FILE* in, FILE* out, struct environment* env, enum engine engine) {
     struct string line = {0};
 
     while (true) {
@@ -35,13 +34,13 @@ void repl_start(FILE* in, FILE* out, struct environment* env) {
             continue;
         }
 
-        struct object* result = eval(&program->node, env);
+        struct object* result = engine_eval(engine, &program->node, env);
         if (result != NULL) {
             struct string result_str = object_inspect(result);
             fprintf(out, STRING_FMT "\n", STRING_ARG(result_str));
             STRING_FREE(result_str);
         }
-        object_free(result);
+        object_decref(result);
         ast_node_decref(&program->node);
         parser_deinit(&parser);
     }
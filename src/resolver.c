@@ -0,0 +1,319 @@
+#include "monkey/resolver.h"
+
+#include <iso646.h>
+#include <stdint.h>
+
+#include "monkey/private/stdc.h"
+
+BUF_T(struct string, scope_name);
+BUF_T(size_t, scope_slot);
+
+// Marks a variable no closure captures.
+#define NOT_CAPTURED SIZE_MAX
+
+// The variables of one function call, in slot order. Names are borrowed from the AST.
+struct scope {
+    struct scope* outer;
+    struct scope_name_buf names;
+    // for each variable, its slot among the captured variables, or NOT_CAPTURED; slots are given
+    // out once every reference is resolved
+    struct scope_slot_buf captured;
+    // the function whose call this is, NULL for the enclosing functions of resolve_nested(), whose
+    // captured slots are given
+    struct ast_function_literal* function;
+};
+
+// A resolved identifier, found in `target` from code in `scope`.
+struct reference {
+    struct ast_identifier* identifier;
+    struct scope* scope;
+    struct scope* target;
+};
+
+struct pending_function {
+    struct ast_function_literal* function;
+    struct scope* outer;
+};
+
+BUF_T(struct scope*, scope);
+BUF_T(struct pending_function, pending_function);
+BUF_T(struct reference, reference);
+
+// Function bodies are resolved only after the scope around them is complete, since they can refer
+// to variables their enclosing function declares after them.
+struct resolver {
+    struct scope* scope;
+    // the function being resolved, NULL at the top level
+    struct ast_function_literal* function;
+    struct pending_function_buf pending;
+    struct scope_buf scopes;
+    struct reference_buf references;
+};
+
+static bool find_slot(struct scope* scope, struct string name, size_t* slot) {
+    for (size_t i = 0; i < scope->names.len; i++) {
+        if (STRING_EQUAL(scope->names.ptr[i], name)) {
+            *slot = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static struct scope* new_scope(struct resolver* r, struct scope* outer) {
+    struct scope* scope = malloc(sizeof(*scope));
+    *scope = (struct scope){.outer = outer};
+    BUF_PUSH(&r->scopes, scope);
+    return scope;
+}
+
+static void add_variable(struct scope* scope, struct string name) {
+    BUF_PUSH(&scope->names, name);
+    BUF_PUSH(&scope->captured, NOT_CAPTURED);
+}
+
+// Resolves `identifier` to variable `slot` of `target`, `depth` functions out.
+static void refer(
+    struct resolver* r,
+    struct ast_identifier* identifier,
+    struct scope* target,
+    size_t depth,
+    size_t slot
+) {
+    identifier->address =
+        (struct ast_lexical_address){.resolved = true, .depth = depth, .slot = slot};
+    // a placeholder until every variable captured is known
+    if (depth > 0 and target->function != NULL) target->captured.ptr[slot] = 0;
+    struct reference reference = {.identifier = identifier, .scope = r->scope, .target = target};
+    BUF_PUSH(&r->references, reference);
+}
+
+static void declare(struct resolver* r, struct ast_identifier* identifier) {
+    if (r->scope == NULL) return;
+    size_t slot;
+    if (!find_slot(r->scope, identifier->value, &slot)) {
+        slot = r->scope->names.len;
+        add_variable(r->scope, identifier->value);
+    }
+    refer(r, identifier, r->scope, 0, slot);
+}
+
+static void resolve_identifier(struct resolver* r, struct ast_identifier* identifier) {
+    size_t depth = 0;
+    for (struct scope* scope = r->scope; scope != NULL; scope = scope->outer, depth++) {
+        size_t slot;
+        if (find_slot(scope, identifier->value, &slot)) {
+            refer(r, identifier, scope, depth, slot);
+            return;
+        }
+    }
+    identifier->address = (struct ast_lexical_address){0};
+}
+
+static void resolve_statement(struct resolver* r, struct ast_statement* statement);
+static void resolve_expression(struct resolver* r, struct ast_expression* expression);
+
+static void resolve_block(struct resolver* r, struct ast_block_statement* block) {
+    for (size_t i = 0; i < block->statements.len; i++) {
+        resolve_statement(r, block->statements.ptr[i]);
+    }
+}
+
+static void resolve_expressions(struct resolver* r, struct ast_expression_buf expressions) {
+    for (size_t i = 0; i < expressions.len; i++) {
+        resolve_expression(r, expressions.ptr[i]);
+    }
+}
+
+static void resolve_expression(struct resolver* r, struct ast_expression* expression) {
+    switch (expression->type) {
+        case AST_EXPRESSION_IDENTIFIER:
+            resolve_identifier(r, (struct ast_identifier*)expression);
+            break;
+        case AST_EXPRESSION_PREFIX:
+            resolve_expression(r, ((struct ast_prefix_expression*)expression)->right);
+            break;
+        case AST_EXPRESSION_INFIX: {
+            auto infix = (struct ast_infix_expression*)expression;
+            resolve_expression(r, infix->left);
+            resolve_expression(r, infix->right);
+            break;
+        }
+        case AST_EXPRESSION_IF: {
+            auto exp = (struct ast_if_expression*)expression;
+            resolve_expression(r, exp->condition);
+            resolve_block(r, exp->consequence);
+            if (exp->alternative != NULL) resolve_block(r, exp->alternative);
+            break;
+        }
+        case AST_EXPRESSION_FUNCTION: {
+            // the closure holds on to the environment of the call that creates it
+            if (r->function != NULL) r->function->escapes = true;
+            struct pending_function pending = {
+                .function = (struct ast_function_literal*)expression,
+                .outer = r->scope,
+            };
+            BUF_PUSH(&r->pending, pending);
+            break;
+        }
+        case AST_EXPRESSION_CALL: {
+            auto call = (struct ast_call_expression*)expression;
+            resolve_expression(r, call->function);
+            resolve_expressions(r, call->arguments);
+            break;
+        }
+        case AST_EXPRESSION_ARRAY:
+            resolve_expressions(r, ((struct ast_array_literal*)expression)->elements);
+            break;
+        case AST_EXPRESSION_INDEX: {
+            auto exp = (struct ast_index_expression*)expression;
+            resolve_expression(r, exp->left);
+            resolve_expression(r, exp->index);
+            break;
+        }
+        case AST_EXPRESSION_HASH: {
+            auto hash = (struct ast_hash_literal*)expression;
+            for (auto bucket = ast_expression_hash_first(&hash->pairs); bucket != NULL;
+                 bucket = ast_expression_hash_next(&hash->pairs, bucket)) {
+                resolve_expression(r, bucket->key);
+                resolve_expression(r, bucket->value);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+static void resolve_statement(struct resolver* r, struct ast_statement* statement) {
+    switch (statement->type) {
+        case AST_STATEMENT_EXPRESSION:
+            resolve_expression(r, ((struct ast_expression_statement*)statement)->expression);
+            break;
+        case AST_STATEMENT_BLOCK:
+            resolve_block(r, (struct ast_block_statement*)statement);
+            break;
+        case AST_STATEMENT_RETURN:
+            resolve_expression(r, ((struct ast_return_statement*)statement)->return_value);
+            break;
+        case AST_STATEMENT_LET: {
+            auto let = (struct ast_let_statement*)statement;
+            // the value still sees the previous binding of the name, like the evaluator
+            resolve_expression(r, let->value);
+            declare(r, let->name);
+            break;
+        }
+    }
+}
+
+static void resolve_function(struct resolver* r, struct pending_function pending) {
+    struct scope* scope = new_scope(r, pending.outer);
+    struct ast_function_literal* function = pending.function;
+    scope->function = function;
+
+    r->scope = scope;
+    r->function = function;
+    function->escapes = false;
+    for (size_t i = 0; i < function->parameters.len; i++) {
+        declare(r, function->parameters.ptr[i]);
+    }
+    resolve_block(r, function->body);
+    function->locals = scope->names.len;
+}
+
+// Gives each variable a closure captures a slot among the captured variables of its call.
+static void number_captured(struct scope* scope) {
+    size_t captured = 0;
+    for (size_t i = 0; i < scope->captured.len; i++) {
+        if (scope->captured.ptr[i] != NOT_CAPTURED) scope->captured.ptr[i] = captured++;
+    }
+    scope->function->captured = captured;
+}
+
+// Where a reference finds its variable at run time. The frame of a call links to the captured
+// variables of the call that created the function, which link to those of the call that created
+// that one, and so on out; a call that creates closures has its own captured variables in between.
+// Every function enclosing another creates closures, so there's one link per function out.
+static void locate(struct reference reference) {
+    struct ast_lexical_address* address = &reference.identifier->address;
+    size_t captured = reference.target->captured.ptr[address->slot];
+    if (captured == NOT_CAPTURED) {
+        address->env_depth = 0;
+        address->env_slot = address->slot;
+    } else {
+        address->env_depth = address->depth + reference.scope->function->escapes;
+        address->env_slot = captured;
+    }
+}
+
+// Resolves the functions queued so far and the ones nested in them, then places their variables.
+static void finish(struct resolver* r) {
+    // resolving a body can queue the functions nested in it
+    for (size_t i = 0; i < r->pending.len; i++) {
+        resolve_function(r, r->pending.ptr[i]);
+    }
+    for (size_t i = 0; i < r->scopes.len; i++) {
+        if (r->scopes.ptr[i]->function != NULL) number_captured(r->scopes.ptr[i]);
+    }
+    for (size_t i = 0; i < r->references.len; i++) {
+        locate(r->references.ptr[i]);
+    }
+
+    for (size_t i = 0; i < r->scopes.len; i++) {
+        BUF_FREE(r->scopes.ptr[i]->names);
+        BUF_FREE(r->scopes.ptr[i]->captured);
+        free(r->scopes.ptr[i]);
+    }
+    BUF_FREE(r->scopes);
+    BUF_FREE(r->pending);
+    BUF_FREE(r->references);
+}
+
+void resolve(struct ast_node* node) {
+    struct resolver r = {0};
+    switch (node->type) {
+        case AST_NODE_EXPRESSION:
+            resolve_expression(&r, (struct ast_expression*)node);
+            break;
+        case AST_NODE_STATEMENT:
+            resolve_statement(&r, (struct ast_statement*)node);
+            break;
+        case AST_NODE_PROGRAM: {
+            auto program = (struct ast_program*)node;
+            for (size_t i = 0; i < program->statements.len; i++) {
+                resolve_statement(&r, program->statements.ptr[i]);
+            }
+            break;
+        }
+    }
+
+    finish(&r);
+}
+
+void resolve_nested(struct ast_function_literal* function, struct resolver_outer_name_buf outer) {
+    struct resolver r = {0};
+    size_t depth = 0;
+    for (size_t i = 0; i < outer.len; i++) {
+        if (outer.ptr[i].depth > depth) depth = outer.ptr[i].depth;
+    }
+    // a scope for each enclosing function, holding the variables named at their slots
+    for (size_t i = 0; i < depth; i++) {
+        struct scope* scope = new_scope(&r, NULL);
+        if (i > 0) r.scopes.ptr[i - 1]->outer = scope;
+    }
+    for (size_t i = 0; i < outer.len; i++) {
+        struct scope* scope = r.scopes.ptr[outer.ptr[i].depth - 1];
+        struct string unknown = EMPTY_STRING;
+        while (scope->names.len <= outer.ptr[i].slot) {
+            add_variable(scope, unknown);
+        }
+        scope->names.ptr[outer.ptr[i].slot] = outer.ptr[i].name;
+        scope->captured.ptr[outer.ptr[i].slot] = outer.ptr[i].env_slot;
+    }
+    struct pending_function pending = {
+        .function = function,
+        .outer = depth > 0 ? r.scopes.ptr[0] : NULL,
+    };
+    BUF_PUSH(&r.pending, pending);
+    finish(&r);
+}
@@ -0,0 +1,773 @@
+#include "monkey/specializer.h"
+
+#include <iso646.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "monkey/optimizer.h"
+#include "monkey/private/evaluator.h"
+#include "monkey/private/stdc.h"
+#include "monkey/resolver.h"
+
+static struct specializer_stats stats;
+
+struct specializer_stats specializer_stats(void) {
+    return stats;
+}
+
+BUF_T(struct string, specializer_name);
+
+enum constant_kind {
+    CONSTANT_NONE,
+    CONSTANT_INTEGER,
+    CONSTANT_BOOLEAN,
+    CONSTANT_FUNCTION,
+};
+
+// An argument known before the call is made. Function literals are told apart by their text.
+struct constant {
+    enum constant_kind kind;
+    int64_t value;
+    struct string text;
+};
+
+struct constant_argument {
+    struct constant constant;
+    struct ast_expression* expression;
+    // the globals a function literal refers to, borrowed from the AST
+    struct specializer_name_buf globals;
+};
+
+// The arguments of a call that are constants, cached on the call.
+struct call_constants {
+    struct ast_code code;
+    size_t count;
+    struct constant_argument arguments[];
+};
+
+// What a parameter can be replaced with.
+enum parameter_use {
+    // nothing: the function rebinds it, or has another parameter of the same name
+    USE_NONE,
+    // integers and booleans
+    USE_VALUE,
+    // function literals too: the body only calls it, or passes it on to one call. Anything else
+    // could compare the closures that copies of the literal make.
+    USE_CALLEE,
+};
+
+struct version {
+    // one constant per parameter, CONSTANT_NONE where the version still takes an argument
+    struct constant* key;
+    // the parameters with a constant
+    bool* dropped;
+    struct ast_function_literal* function;
+};
+
+BUF_T(struct version*, version);
+
+// The versions of a function body, cached on the body.
+struct versions {
+    struct ast_code code;
+    size_t count;
+    enum parameter_use* uses;
+    // every name the function binds or refers to in enclosing functions; a function literal
+    // referring to a global of the same name can't be moved into the body
+    struct specializer_name_buf bound;
+    struct version_buf versions;
+};
+
+static void call_constants_free(struct ast_code* code) {
+    auto self = (struct call_constants*)code;
+    for (size_t i = 0; i < self->count; i++) {
+        STRING_FREE(self->arguments[i].constant.text);
+        BUF_FREE(self->arguments[i].globals);
+    }
+    free(self);
+}
+
+static void versions_free(struct ast_code* code) {
+    auto self = (struct versions*)code;
+    for (size_t i = 0; i < self->versions.len; i++) {
+        struct version* version = self->versions.ptr[i];
+        for (size_t j = 0; j < self->count; j++) {
+            STRING_FREE(version->key[j].text);
+        }
+        free(version->key);
+        free(version->dropped);
+        if (ast_expression_decref(&version->function->expression) == 0) free(version->function);
+        free(version);
+    }
+    BUF_FREE(self->versions);
+    for (size_t i = 0; i < self->bound.len; i++) {
+        STRING_FREE(self->bound.ptr[i]);
+    }
+    BUF_FREE(self->bound);
+    free(self->uses);
+    free(self);
+}
+
+// Walks everything under a function literal, `nesting` functions in from it.
+struct walk {
+    void (*identifier)(struct walk* w, struct ast_identifier* identifier, size_t nesting);
+    // the names bound by lets and parameters
+    void (*binding)(struct walk* w, struct ast_identifier* name, size_t nesting);
+    void (*call)(struct walk* w, struct ast_call_expression* call, size_t nesting);
+    void* data;
+};
+
+static void walk_expression(struct walk* w, struct ast_expression* expression, size_t nesting);
+
+static void walk_statement(struct walk* w, struct ast_statement* statement, size_t nesting) {
+    switch (statement->type) {
+        case AST_STATEMENT_LET: {
+            auto let = (struct ast_let_statement*)statement;
+            walk_expression(w, let->value, nesting);
+            if (w->binding != NULL) w->binding(w, let->name, nesting);
+            break;
+        }
+        case AST_STATEMENT_RETURN:
+            walk_expression(w, ((struct ast_return_statement*)statement)->return_value, nesting);
+            break;
+        case AST_STATEMENT_EXPRESSION:
+            walk_expression(w, ((struct ast_expression_statement*)statement)->expression, nesting);
+            break;
+        case AST_STATEMENT_BLOCK: {
+            auto block = (struct ast_block_statement*)statement;
+            for (size_t i = 0; i < block->statements.len; i++) {
+                walk_statement(w, block->statements.ptr[i], nesting);
+            }
+            break;
+        }
+    }
+}
+
+static void
+walk_expressions(struct walk* w, struct ast_expression_buf expressions, size_t nesting) {
+    for (size_t i = 0; i < expressions.len; i++) {
+        walk_expression(w, expressions.ptr[i], nesting);
+    }
+}
+
+static void walk_function(struct walk* w, struct ast_function_literal* function, size_t nesting) {
+    for (size_t i = 0; w->binding != NULL and i < function->parameters.len; i++) {
+        w->binding(w, function->parameters.ptr[i], nesting);
+    }
+    walk_statement(w, &function->body->statement, nesting);
+}
+
+static void walk_expression(struct walk* w, struct ast_expression* expression, size_t nesting) {
+    switch (expression->type) {
+        case AST_EXPRESSION_IDENTIFIER:
+            if (w->identifier != NULL) {
+                w->identifier(w, (struct ast_identifier*)expression, nesting);
+            }
+            break;
+        case AST_EXPRESSION_PREFIX:
+            walk_expression(w, ((struct ast_prefix_expression*)expression)->right, nesting);
+            break;
+        case AST_EXPRESSION_INFIX: {
+            auto infix = (struct ast_infix_expression*)expression;
+            walk_expression(w, infix->left, nesting);
+            walk_expression(w, infix->right, nesting);
+            break;
+        }
+        case AST_EXPRESSION_IF: {
+            auto exp = (struct ast_if_expression*)expression;
+            walk_expression(w, exp->condition, nesting);
+            walk_statement(w, &exp->consequence->statement, nesting);
+            if (exp->alternative != NULL) {
+                walk_statement(w, &exp->alternative->statement, nesting);
+            }
+            break;
+        }
+        case AST_EXPRESSION_FUNCTION:
+            walk_function(w, (struct ast_function_literal*)expression, nesting + 1);
+            break;
+        case AST_EXPRESSION_CALL: {
+            auto call = (struct ast_call_expression*)expression;
+            if (w->call != NULL) {
+                w->call(w, call, nesting);
+                break;
+            }
+            walk_expression(w, call->function, nesting);
+            walk_expressions(w, call->arguments, nesting);
+            break;
+        }
+        case AST_EXPRESSION_ARRAY:
+            walk_expressions(w, ((struct ast_array_literal*)expression)->elements, nesting);
+            break;
+        case AST_EXPRESSION_INDEX: {
+            auto exp = (struct ast_index_expression*)expression;
+            walk_expression(w, exp->left, nesting);
+            walk_expression(w, exp->index, nesting);
+            break;
+        }
+        case AST_EXPRESSION_HASH: {
+            auto hash = (struct ast_hash_literal*)expression;
+            for (auto bucket = ast_expression_hash_first(&hash->pairs); bucket != NULL;
+                 bucket = ast_expression_hash_next(&hash->pairs, bucket)) {
+                walk_expression(w, bucket->key, nesting);
+                walk_expression(w, bucket->value, nesting);
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+struct closure_check {
+    struct specializer_name_buf globals;
+    bool closed;
+};
+
+static void check_closed(struct walk* w, struct ast_identifier* identifier, size_t nesting) {
+    struct closure_check* check = w->data;
+    if (!identifier->address.resolved) {
+        BUF_PUSH(&check->globals, identifier->value);
+    } else if (identifier->address.depth > nesting) {
+        check->closed = false;
+    }
+}
+
+static struct constant_argument constant_argument(struct ast_expression* expression) {
+    struct constant_argument argument = {.expression = expression};
+    switch (expression->type) {
+        case AST_EXPRESSION_INTEGER_LITERAL:
+            argument.constant.kind = CONSTANT_INTEGER;
+            argument.constant.value = ((struct ast_integer_literal*)expression)->value;
+            break;
+        case AST_EXPRESSION_BOOLEAN:
+            argument.constant.kind = CONSTANT_BOOLEAN;
+            argument.constant.value = ((struct ast_boolean*)expression)->value;
+            break;
+        case AST_EXPRESSION_FUNCTION: {
+            // only a literal that refers to nothing but globals means the same wherever it's moved
+            struct closure_check check = {.globals = {0}, .closed = true};
+            struct walk w = {.identifier = check_closed, .data = &check};
+            walk_function(&w, (struct ast_function_literal*)expression, 0);
+            if (!check.closed) {
+                BUF_FREE(check.globals);
+                break;
+            }
+            argument.constant.kind = CONSTANT_FUNCTION;
+            argument.constant.text = ast_node_string(&expression->node);
+            argument.globals = check.globals;
+            break;
+        }
+        default:
+            break;
+    }
+    return argument;
+}
+
+static struct call_constants* call_constants(struct ast_call_expression* call) {
+    if (call->constants != NULL) return (struct call_constants*)call->constants;
+    size_t count = call->arguments.len;
+    struct call_constants* self =
+        malloc(sizeof(*self) + count * sizeof(struct constant_argument));
+    self->code.free = call_constants_free;
+    self->count = count;
+    for (size_t i = 0; i < count; i++) {
+        self->arguments[i] = constant_argument(call->arguments.ptr[i]);
+    }
+    call->constants = &self->code;
+    return self;
+}
+
+// How the body uses each parameter, counted through the identifiers that resolve to it.
+struct parameter_scan {
+    struct function_parameter_buf parameters;
+    struct versions* versions;
+    size_t* passed;
+    bool* used;
+    bool* rebound;
+};
+
+static size_t parameter_index(
+    struct parameter_scan* scan,
+    struct ast_identifier* identifier,
+    size_t nesting
+) {
+    struct ast_lexical_address address = identifier->address;
+    if (!address.resolved or address.depth != nesting) return SIZE_MAX;
+    for (size_t i = 0; i < scan->parameters.len; i++) {
+        if (scan->parameters.ptr[i]->address.slot == address.slot) return i;
+    }
+    return SIZE_MAX;
+}
+
+static void bind_name(struct parameter_scan* scan, struct string name) {
+    struct specializer_name_buf* bound = &scan->versions->bound;
+    for (size_t i = 0; i < bound->len; i++) {
+        if (STRING_EQUAL(bound->ptr[i], name)) return;
+    }
+    BUF_PUSH(bound, string_dup(name));
+}
+
+static void scan_identifier(struct walk* w, struct ast_identifier* identifier, size_t nesting) {
+    struct parameter_scan* scan = w->data;
+    size_t i = parameter_index(scan, identifier, nesting);
+    if (i != SIZE_MAX) scan->used[i] = true;
+    if (identifier->address.resolved and identifier->address.depth > nesting) {
+        bind_name(scan, identifier->value);
+    }
+}
+
+static void scan_binding(struct walk* w, struct ast_identifier* name, size_t nesting) {
+    struct parameter_scan* scan = w->data;
+    bind_name(scan, name->value);
+    if (nesting > 0) return;
+    size_t i = parameter_index(scan, name, nesting);
+    if (i != SIZE_MAX) scan->rebound[i] = true;
+}
+
+static void scan_call(struct walk* w, struct ast_call_expression* call, size_t nesting) {
+    struct parameter_scan* scan = w->data;
+    if (call->function->type == AST_EXPRESSION_IDENTIFIER) {
+        // calling a parameter doesn't count as a use
+        auto callee = (struct ast_identifier*)call->function;
+        if (callee->address.resolved and callee->address.depth > nesting) {
+            bind_name(scan, callee->value);
+        }
+    } else {
+        walk_expression(w, call->function, nesting);
+    }
+    for (size_t i = 0; i < call->arguments.len; i++) {
+        struct ast_expression* argument = call->arguments.ptr[i];
+        size_t parameter = argument->type == AST_EXPRESSION_IDENTIFIER
+                               ? parameter_index(scan, (struct ast_identifier*)argument, nesting)
+                               : SIZE_MAX;
+        if (parameter == SIZE_MAX) {
+            walk_expression(w, argument, nesting);
+        } else {
+            scan->passed[parameter]++;
+        }
+    }
+}
+
+static struct versions* versions_new(struct object_function* function) {
+    size_t count = function->parameters.len;
+    struct versions* self = malloc(sizeof(*self));
+    *self = (struct versions){
+        .code = {.free = versions_free},
+        .count = count,
+        .uses = calloc(count > 0 ? count : 1, sizeof(enum parameter_use)),
+        .bound = {0},
+        .versions = {0},
+    };
+    struct parameter_scan scan = {
+        .parameters = function->parameters,
+        .versions = self,
+        .passed = calloc(count > 0 ? count : 1, sizeof(size_t)),
+        .used = calloc(count > 0 ? count : 1, sizeof(bool)),
+        .rebound = calloc(count > 0 ? count : 1, sizeof(bool)),
+    };
+    for (size_t i = 0; i < count; i++) {
+        struct ast_identifier* parameter = function->parameters.ptr[i];
+        bind_name(&scan, parameter->value);
+        for (size_t j = 0; j < i; j++) {
+            if (function->parameters.ptr[j]->address.slot == parameter->address.slot) {
+                scan.rebound[i] = scan.rebound[j] = true;
+            }
+        }
+    }
+    struct walk w = {
+        .identifier = scan_identifier,
+        .binding = scan_binding,
+        .call = scan_call,
+        .data = &scan,
+    };
+    walk_statement(&w, &function->body->statement, 0);
+    for (size_t i = 0; i < count; i++) {
+        if (scan.rebound[i]) {
+            self->uses[i] = USE_NONE;
+        } else if (scan.used[i] or scan.passed[i] > 1) {
+            self->uses[i] = USE_VALUE;
+        } else {
+            self->uses[i] = USE_CALLEE;
+        }
+    }
+    free(scan.passed);
+    free(scan.used);
+    free(scan.rebound);
+    return self;
+}
+
+static bool same_constant(struct constant a, struct constant b) {
+    if (a.kind != b.kind) return false;
+    switch (a.kind) {
+        case CONSTANT_NONE:
+            return true;
+        case CONSTANT_FUNCTION:
+            return STRING_EQUAL(a.text, b.text);
+        default:
+            return a.value == b.value;
+    }
+}
+
+static struct version* find_version(struct versions* versions, struct constant* key) {
+    for (size_t i = 0; i < versions->versions.len; i++) {
+        struct version* version = versions->versions.ptr[i];
+        bool same = true;
+        for (size_t j = 0; same and j < versions->count; j++) {
+            same = same_constant(version->key[j], key[j]);
+        }
+        if (same) return version;
+    }
+    return NULL;
+}
+
+static bool is_captured(struct versions* versions, struct constant_argument* argument) {
+    for (size_t i = 0; i < argument->globals.len; i++) {
+        for (size_t j = 0; j < versions->bound.len; j++) {
+            if (STRING_EQUAL(argument->globals.ptr[i], versions->bound.ptr[j])) return true;
+        }
+    }
+    return false;
+}
+
+// Copies a function body, replacing the parameters that have a constant with a copy of the literal
+// and noting the variables of enclosing functions it refers to.
+struct cloner {
+    struct function_parameter_buf parameters;
+    struct call_constants* constants;
+    struct constant* key;
+    struct resolver_outer_name_buf outer;
+};
+
+static struct ast_expression*
+clone_expression(struct cloner* c, struct ast_expression* expression, size_t nesting);
+static struct ast_statement*
+clone_statement(struct cloner* c, struct ast_statement* statement, size_t nesting);
+
+static struct ast_block_statement*
+clone_block(struct cloner* c, struct ast_block_statement* block, size_t nesting) {
+    if (block == NULL) return NULL;
+    struct ast_statement_buf statements = {0};
+    for (size_t i = 0; i < block->statements.len; i++) {
+        BUF_PUSH(&statements, clone_statement(c, block->statements.ptr[i], nesting));
+    }
+    struct ast_block_statement* clone =
+        ast_block_statement_init(token_dup(block->token), statements);
+    if (block->source.data != NULL) clone->source = string_dup(block->source);
+    return clone;
+}
+
+static struct ast_identifier* clone_identifier(struct ast_identifier* identifier) {
+    return ast_identifier_init(token_dup(identifier->token), string_dup(identifier->value));
+}
+
+static struct ast_expression_buf
+clone_expressions(struct cloner* c, struct ast_expression_buf expressions, size_t nesting) {
+    struct ast_expression_buf clones = {0};
+    for (size_t i = 0; i < expressions.len; i++) {
+        BUF_PUSH(&clones, clone_expression(c, expressions.ptr[i], nesting));
+    }
+    return clones;
+}
+
+static struct ast_function_literal*
+clone_function(struct cloner* c, struct ast_function_literal* function, size_t nesting) {
+    struct function_parameter_buf parameters = {0};
+    for (size_t i = 0; i < function->parameters.len; i++) {
+        BUF_PUSH(&parameters, clone_identifier(function->parameters.ptr[i]));
+    }
+    return ast_function_literal_init(
+        token_dup(function->token),
+        parameters,
+        clone_block(c, function->body, nesting)
+    );
+}
+
+static struct ast_expression*
+clone_expression(struct cloner* c, struct ast_expression* expression, size_t nesting) {
+    switch (expression->type) {
+        case AST_EXPRESSION_IDENTIFIER: {
+            auto identifier = (struct ast_identifier*)expression;
+            struct ast_lexical_address address = identifier->address;
+            if (c->key != NULL and address.resolved and address.depth == nesting) {
+                for (size_t i = 0; i < c->parameters.len; i++) {
+                    if (c->key[i].kind == CONSTANT_NONE or
+                        c->parameters.ptr[i]->address.slot != address.slot) {
+                        continue;
+                    }
+                    // the literal is copied without substitutions of its own
+                    struct cloner literal = {.key = NULL};
+                    return clone_expression(&literal, c->constants->arguments[i].expression, 0);
+                }
+            }
+            if (c->key != NULL and address.resolved and address.depth > nesting) {
+                struct resolver_outer_name outer = {
+                    .depth = address.depth - nesting,
+                    .slot = address.slot,
+                    .env_slot = address.env_slot,
+                    .name = identifier->value,
+                };
+                BUF_PUSH(&c->outer, outer);
+            }
+            return &clone_identifier(identifier)->expression;
+        }
+        case AST_EXPRESSION_INTEGER_LITERAL: {
+            auto literal = (struct ast_integer_literal*)expression;
+            return ast_integer_literal_init_base(token_dup(literal->token), literal->value);
+        }
+        case AST_EXPRESSION_BOOLEAN: {
+            auto literal = (struct ast_boolean*)expression;
+            return ast_boolean_init_base(token_dup(literal->token), literal->value);
+        }
+        case AST_EXPRESSION_STRING: {
+            auto literal = (struct ast_string_literal*)expression;
+            return ast_string_literal_init_base(
+                token_dup(literal->token),
+                string_dup(literal->value)
+            );
+        }
+        case AST_EXPRESSION_PREFIX: {
+            auto prefix = (struct ast_prefix_expression*)expression;
+            return ast_prefix_expression_init_base(
+                token_dup(prefix->token),
+                prefix->op,
+                clone_expression(c, prefix->right, nesting)
+            );
+        }
+        case AST_EXPRESSION_INFIX: {
+            auto infix = (struct ast_infix_expression*)expression;
+            return ast_infix_expression_init_base(
+                token_dup(infix->token),
+                clone_expression(c, infix->left, nesting),
+                infix->op,
+                clone_expression(c, infix->right, nesting)
+            );
+        }
+        case AST_EXPRESSION_IF: {
+            auto exp = (struct ast_if_expression*)expression;
+            return ast_if_expression_init_base(
+                token_dup(exp->token),
+                clone_expression(c, exp->condition, nesting),
+                clone_block(c, exp->consequence, nesting),
+                clone_block(c, exp->alternative, nesting)
+            );
+        }
+        case AST_EXPRESSION_FUNCTION:
+            return &clone_function(c, (struct ast_function_literal*)expression, nesting + 1)
+                        ->expression;
+        case AST_EXPRESSION_CALL: {
+            auto call = (struct ast_call_expression*)expression;
+            return ast_call_expression_init_base(
+                token_dup(call->token),
+                clone_expression(c, call->function, nesting),
+                clone_expressions(c, call->arguments, nesting)
+            );
+        }
+        case AST_EXPRESSION_ARRAY: {
+            auto array = (struct ast_array_literal*)expression;
+            return ast_array_literal_init_base(
+                token_dup(array->token),
+                clone_expressions(c, array->elements, nesting)
+            );
+        }
+        case AST_EXPRESSION_INDEX: {
+            auto exp = (struct ast_index_expression*)expression;
+            return ast_index_expression_init_base(
+                token_dup(exp->token),
+                clone_expression(c, exp->left, nesting),
+                clone_expression(c, exp->index, nesting)
+            );
+        }
+        case AST_EXPRESSION_HASH: {
+            // the pairs keep their buckets, so they're evaluated in the same order
+            auto hash = (struct ast_hash_literal*)expression;
+            struct ast_expression_hash_bucket_buf buckets = hash->pairs.buckets;
+            struct ast_expression_hash pairs = {
+                .buckets = BUF_OWNER(
+                    struct ast_expression_hash_bucket_buf,
+                    calloc(buckets.len > 0 ? buckets.len : 1, sizeof(*buckets.ptr)),
+                    buckets.len
+                ),
+                .count = hash->pairs.count,
+            };
+            for (size_t i = 0; i < buckets.len; i++) {
+                if (buckets.ptr[i].key == NULL) continue;
+                pairs.buckets.ptr[i].key = clone_expression(c, buckets.ptr[i].key, nesting);
+                pairs.buckets.ptr[i].value = clone_expression(c, buckets.ptr[i].value, nesting);
+            }
+            return ast_hash_literal_init_base(token_dup(hash->token), pairs);
+        }
+    }
+    abort();
+}
+
+static struct ast_statement*
+clone_statement(struct cloner* c, struct ast_statement* statement, size_t nesting) {
+    switch (statement->type) {
+        case AST_STATEMENT_LET: {
+            auto let = (struct ast_let_statement*)statement;
+            return ast_let_statement_init_base(
+                token_dup(let->token),
+                clone_identifier(let->name),
+                clone_expression(c, let->value, nesting)
+            );
+        }
+        case AST_STATEMENT_RETURN: {
+            auto ret = (struct ast_return_statement*)statement;
+            return ast_return_statement_init_base(
+                token_dup(ret->token),
+                clone_expression(c, ret->return_value, nesting)
+            );
+        }
+        case AST_STATEMENT_EXPRESSION: {
+            auto exp = (struct ast_expression_statement*)statement;
+            return ast_expression_statement_init_base(
+                token_dup(exp->token),
+                clone_expression(c, exp->expression, nesting)
+            );
+        }
+        case AST_STATEMENT_BLOCK:
+            return &clone_block(c, (struct ast_block_statement*)statement, nesting)->statement;
+    }
+    abort();
+}
+
+// Makes the version of `function` for `key`: a copy taking only the parameters without a
+// constant, optimized on its own and resolved in the place of the original.
+static struct ast_function_literal* make_version(
+    struct object_function* function,
+    struct call_constants* constants,
+    struct constant* key
+) {
+    struct cloner c = {
+        .parameters = function->parameters,
+        .constants = constants,
+        .key = key,
+        .outer = {0},
+    };
+    struct function_parameter_buf parameters = {0};
+    for (size_t i = 0; i < function->parameters.len; i++) {
+        if (key[i].kind == CONSTANT_NONE) {
+            BUF_PUSH(&parameters, clone_identifier(function->parameters.ptr[i]));
+        }
+    }
+    struct ast_function_literal* version = ast_function_literal_init(
+        (struct token){TOKEN_FUNCTION, string_dup(STRING_REF("fn"))},
+        parameters,
+        clone_block(&c, function->body, 0)
+    );
+
+    ast_node_incref(&version->expression.node);
+    struct ast_statement_buf statements = {0};
+    BUF_PUSH(
+        &statements,
+        ast_expression_statement_init_base(
+            (struct token){TOKEN_FUNCTION, string_dup(STRING_REF("fn"))},
+            &version->expression
+        )
+    );
+    struct ast_program* program = ast_program_init(statements);
+    optimize(program, optimizer_level());
+    ast_node_decref(&program->node);
+
+    resolve_nested(version, c.outer);
+    BUF_FREE(c.outer);
+    return version;
+}
+
+static struct version* add_version(
+    struct versions* versions,
+    struct object_function* function,
+    struct call_constants* constants,
+    struct constant* key
+) {
+    struct version* version = malloc(sizeof(*version));
+    version->key = malloc(versions->count * sizeof(struct constant));
+    version->dropped = malloc(versions->count * sizeof(bool));
+    version->function = make_version(function, constants, key);
+    for (size_t i = 0; i < versions->count; i++) {
+        version->dropped[i] = key[i].kind != CONSTANT_NONE;
+        version->key[i] = key[i];
+        version->key[i].text = key[i].kind == CONSTANT_FUNCTION ? string_dup(key[i].text)
+                                                                : (struct string)EMPTY_STRING;
+    }
+    BUF_PUSH(&versions->versions, version);
+    stats.versions++;
+    return version;
+}
+
+static struct version* find_or_add_version(
+    struct versions* versions,
+    struct object_function* function,
+    struct call_constants* constants
+) {
+    size_t count = versions->count;
+    struct constant key[count];
+    bool any = false;
+    for (size_t i = 0; i < count; i++) {
+        key[i] = constants->arguments[i].constant;
+        bool usable = versions->uses[i] == USE_CALLEE or
+                      (versions->uses[i] == USE_VALUE and key[i].kind != CONSTANT_FUNCTION);
+        if (!usable) key[i].kind = CONSTANT_NONE;
+        any = any or key[i].kind != CONSTANT_NONE;
+    }
+    if (!any) return NULL;
+    struct version* version = find_version(versions, key);
+    if (version != NULL) return version;
+
+    // a version for a literal exists only once it's known not to be captured
+    any = false;
+    for (size_t i = 0; i < count; i++) {
+        if (key[i].kind == CONSTANT_FUNCTION and is_captured(versions, &constants->arguments[i])) {
+            key[i].kind = CONSTANT_NONE;
+        }
+        any = any or key[i].kind != CONSTANT_NONE;
+    }
+    if (!any) return NULL;
+    version = find_version(versions, key);
+    if (version != NULL) return version;
+    if (versions->versions.len == SPECIALIZER_MAX_VERSIONS) return NULL;
+    return add_version(versions, function, constants, key);
+}
+
+struct object*
+specialize_callee(struct ast_call_expression* call, struct object* fn, const bool** dropped) {
+    *dropped = NULL;
+    size_t count = call->arguments.len;
+    if (optimizer_level() == 0 or count == 0 or object_type(fn) != OBJECT_FUNCTION) return fn;
+    auto function = (struct object_function*)fn;
+    if (function->parameters.len != count) return fn;
+    struct call_constants* constants = call_constants(call);
+    struct ast_block_statement* body = function->body;
+    if (body->versions == NULL) body->versions = &versions_new(function)->code;
+    struct version* version =
+        find_or_add_version((struct versions*)body->versions, function, constants);
+    if (version == NULL) return fn;
+
+    // recursive calls keep finding the same function, so its last version is kept on it
+    if (function->specialized_for != version) {
+        object_decref(function->specialized);
+        function->specialized = eval_function_literal(version->function, function->env);
+        function->specialized_for = version;
+    }
+    struct object* specialized = object_incref(function->specialized);
+    object_decref(fn);
+    stats.calls++;
+    *dropped = version->dropped;
+    return specialized;
+}
+
+struct object*
+specialize_call(struct ast_call_expression* call, struct object* fn, struct object_buf* args) {
+    const bool* dropped;
+    fn = specialize_callee(call, fn, &dropped);
+    if (dropped == NULL) return fn;
+    size_t len = 0;
+    for (size_t i = 0; i < args->len; i++) {
+        if (dropped[i]) {
+            object_decref(args->ptr[i]);
+        } else {
+            args->ptr[len++] = args->ptr[i];
+        }
+    }
+    args->len = len;
+    return fn;
+}
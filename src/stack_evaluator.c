@@ -0,0 +1,521 @@
+#include "monkey/stack_evaluator.h"
+
+#include <iso646.h>
+
+#include "monkey/builtins.h"
+#include "monkey/private/evaluator.h"
+#include "monkey/private/stdc.h"
+#include "monkey/resolver.h"
+#include "monkey/specializer.h"
+
+// Each frame is the rest of the work of one node of the tree evaluator's recursion, waiting for
+// the value of a child.
+enum frame_type {
+    FRAME_PREFIX,
+    FRAME_INFIX_LEFT,
+    FRAME_INFIX_RIGHT,
+    FRAME_IF,
+    FRAME_CALL_FUNCTION,
+    FRAME_CALL_ARGUMENTS,
+    // the body of a called function; owns the callee and its environment
+    FRAME_CALL_RETURN,
+    FRAME_ARRAY,
+    FRAME_INDEX_LEFT,
+    FRAME_INDEX_RIGHT,
+    FRAME_HASH_KEY,
+    FRAME_HASH_VALUE,
+    FRAME_RETURN,
+    FRAME_LET,
+    FRAME_BLOCK,
+    FRAME_PROGRAM,
+};
+
+struct frame {
+    enum frame_type type;
+    struct ast_node* node;
+    struct environment* env;
+    // progress through the node's children
+    union {
+        size_t index;
+        const struct ast_expression_hash_bucket* bucket;
+    } at;
+    // partial results the frame owns: an operand, the callee, the hash being built and its key
+    struct object* value;
+    struct object* key;
+    // evaluated arguments or elements
+    struct object_buf values;
+};
+
+BUF_T(struct frame, frame);
+
+enum step {
+    STEP_EXPRESSION,
+    STEP_STATEMENT,
+    STEP_VALUE,
+};
+
+struct machine {
+    struct frame_buf frames;
+    // evaluate `expression` or `statement` in `env`, or hand `value` to the top frame
+    enum step step;
+    struct ast_expression* expression;
+    struct ast_statement* statement;
+    struct environment* env;
+    struct object* value;
+};
+
+static size_t budget = STACK_EVAL_DEFAULT_BUDGET;
+
+void stack_eval_set_budget(size_t bytes) {
+    budget = bytes;
+}
+
+static void eval_expression_next(
+    struct machine* m,
+    struct ast_expression* expression,
+    struct environment* env
+) {
+    m->step = STEP_EXPRESSION;
+    m->expression = expression;
+    m->env = env;
+}
+
+static void eval_statement_next(
+    struct machine* m,
+    struct ast_statement* statement,
+    struct environment* env
+) {
+    m->step = STEP_STATEMENT;
+    m->statement = statement;
+    m->env = env;
+}
+
+static void give(struct machine* m, struct object* value) {
+    m->step = STEP_VALUE;
+    m->value = value;
+}
+
+static struct frame* top(struct machine* m) {
+    return &m->frames.ptr[m->frames.len - 1];
+}
+
+static struct frame pop(struct machine* m) {
+    return m->frames.ptr[--m->frames.len];
+}
+
+static void release_values(struct object_buf values) {
+    for (size_t i = 0; i < values.len; i++) {
+        object_decref(values.ptr[i]);
+    }
+    BUF_FREE(values);
+}
+
+static void release_frame(struct frame frame) {
+    object_decref(frame.value);
+    object_decref(frame.key);
+    release_values(frame.values);
+    if (frame.type == FRAME_CALL_RETURN) environment_decref(frame.env);
+}
+
+// Pushes a frame, unless that would take the stack over budget, in which case the frame's
+// partial results are released and evaluation fails.
+static bool push(struct machine* m, struct frame frame) {
+    if (m->frames.len + 1 > budget / sizeof(struct frame)) {
+        release_frame(frame);
+        give(
+            m,
+            object_error_init_base(string_printf(
+                "stack overflow: evaluation needs more than %zu bytes of stack",
+                budget
+            ))
+        );
+        return false;
+    }
+    BUF_PUSH(&m->frames, frame);
+    return true;
+}
+
+static struct frame
+frame_init(enum frame_type type, struct ast_node* node, struct environment* env) {
+    return (struct frame){.type = type, .node = node, .env = env};
+}
+
+// Calls `fn`, taking ownership of it and `args`. A call whose caller has nothing left to do but
+// return takes over the caller's frame, so tail recursion runs in constant stack.
+static void apply_function(struct machine* m, struct object* fn, struct object_buf args) {
+    switch (object_type(fn)) {
+        case OBJECT_FUNCTION: {
+            auto function = (struct object_function*)fn;
+            struct object* err = check_arguments(function, args);
+            if (err != NULL) {
+                object_decref(fn);
+                release_values(args);
+                give(m, err);
+                return;
+            }
+            check_parameter_types(function, args);
+            if (m->frames.len > 0 and top(m)->type == FRAME_CALL_RETURN) {
+                struct frame* frame = top(m);
+                frame->env = extend_function_env(function, args, frame->env);
+                object_decref(frame->value);
+                frame->value = fn;
+            } else {
+                struct frame frame = frame_init(
+                    FRAME_CALL_RETURN,
+                    &function->body->statement.node,
+                    extend_function_env(function, args, NULL)
+                );
+                frame.value = fn;
+                if (!push(m, frame)) {
+                    release_values(args);
+                    return;
+                }
+            }
+            release_values(args);
+            eval_statement_next(m, &function->body->statement, top(m)->env);
+            return;
+        }
+        case OBJECT_BUILTIN: {
+            auto builtin = (struct object_builtin*)fn;
+            struct object* result = builtin->fn(args);
+            object_decref(fn);
+            release_values(args);
+            give(m, result);
+            return;
+        }
+        default:
+            give(m, not_a_function(fn));
+            object_decref(fn);
+            release_values(args);
+            return;
+    }
+}
+
+static void step_expression(struct machine* m) {
+    struct ast_expression* expression = m->expression;
+    struct environment* env = m->env;
+    switch (expression->type) {
+        case AST_EXPRESSION_INTEGER_LITERAL:
+            give(m, object_int64_init_base(((struct ast_integer_literal*)expression)->value));
+            break;
+        case AST_EXPRESSION_BOOLEAN:
+            give(m, object_boolean_init_base(((struct ast_boolean*)expression)->value));
+            break;
+        case AST_EXPRESSION_STRING:
+            give(
+                m,
+                object_string_init_base(string_dup(((struct ast_string_literal*)expression)->value))
+            );
+            break;
+        case AST_EXPRESSION_IDENTIFIER:
+            give(m, eval_identifier((struct ast_identifier*)expression, env));
+            break;
+        case AST_EXPRESSION_FUNCTION:
+            give(m, eval_function_literal((struct ast_function_literal*)expression, env));
+            break;
+        case AST_EXPRESSION_PREFIX:
+            if (push(m, frame_init(FRAME_PREFIX, &expression->node, env))) {
+                eval_expression_next(m, ((struct ast_prefix_expression*)expression)->right, env);
+            }
+            break;
+        case AST_EXPRESSION_INFIX:
+            if (push(m, frame_init(FRAME_INFIX_LEFT, &expression->node, env))) {
+                eval_expression_next(m, ((struct ast_infix_expression*)expression)->left, env);
+            }
+            break;
+        case AST_EXPRESSION_IF:
+            if (push(m, frame_init(FRAME_IF, &expression->node, env))) {
+                eval_expression_next(m, ((struct ast_if_expression*)expression)->condition, env);
+            }
+            break;
+        case AST_EXPRESSION_CALL:
+            if (push(m, frame_init(FRAME_CALL_FUNCTION, &expression->node, env))) {
+                eval_expression_next(m, ((struct ast_call_expression*)expression)->function, env);
+            }
+            break;
+        case AST_EXPRESSION_ARRAY: {
+            auto array = (struct ast_array_literal*)expression;
+            if (array->elements.len == 0) {
+                give(m, object_array_init_base((struct object_buf){0}));
+            } else if (push(m, frame_init(FRAME_ARRAY, &expression->node, env))) {
+                eval_expression_next(m, array->elements.ptr[0], env);
+            }
+            break;
+        }
+        case AST_EXPRESSION_INDEX:
+            if (push(m, frame_init(FRAME_INDEX_LEFT, &expression->node, env))) {
+                eval_expression_next(m, ((struct ast_index_expression*)expression)->left, env);
+            }
+            break;
+        case AST_EXPRESSION_HASH: {
+            auto hash = (struct ast_hash_literal*)expression;
+            struct object_hash_table table;
+            object_hash_table_init(&table);
+            struct frame frame = frame_init(FRAME_HASH_KEY, &expression->node, env);
+            frame.at.bucket = ast_expression_hash_first(&hash->pairs);
+            if (frame.at.bucket == NULL) {
+                give(m, object_hash_init_base(table));
+                break;
+            }
+            // the frame fills in the hash object as pairs arrive
+            frame.value = object_hash_init_base(table);
+            if (push(m, frame)) eval_expression_next(m, frame.at.bucket->key, env);
+            break;
+        }
+        default:
+            // [TODO] eval_expression
+            give(m, object_null_init_base());
+            break;
+    }
+}
+
+static void step_statement(struct machine* m) {
+    struct ast_statement* statement = m->statement;
+    struct environment* env = m->env;
+    switch (statement->type) {
+        case AST_STATEMENT_EXPRESSION:
+            eval_expression_next(m, ((struct ast_expression_statement*)statement)->expression, env);
+            break;
+        case AST_STATEMENT_BLOCK: {
+            auto block = (struct ast_block_statement*)statement;
+            if (block->statements.len == 0) {
+                give(m, NULL);
+            } else if (block->statements.len == 1) {
+                eval_statement_next(m, block->statements.ptr[0], env);
+            } else if (push(m, frame_init(FRAME_BLOCK, &statement->node, env))) {
+                eval_statement_next(m, block->statements.ptr[0], env);
+            }
+            break;
+        }
+        case AST_STATEMENT_RETURN:
+            if (push(m, frame_init(FRAME_RETURN, &statement->node, env))) {
+                eval_expression_next(
+                    m,
+                    ((struct ast_return_statement*)statement)->return_value,
+                    env
+                );
+            }
+            break;
+        case AST_STATEMENT_LET:
+            if (push(m, frame_init(FRAME_LET, &statement->node, env))) {
+                eval_expression_next(m, ((struct ast_let_statement*)statement)->value, env);
+            }
+            break;
+        default:
+            // [TODO] eval_statement
+            give(m, object_null_init_base());
+            break;
+    }
+}
+
+// Hands the value of a child to the frame waiting for it. Errors never reach here; they unwind the
+// whole stack, as they do in the tree evaluator.
+static void step_value(struct machine* m) {
+    struct object* value = m->value;
+    struct frame* frame = top(m);
+    switch (frame->type) {
+        case FRAME_PREFIX: {
+            struct frame done = pop(m);
+            auto prefix = (struct ast_prefix_expression*)done.node;
+            give(m, eval_prefix_quickened(prefix, value));
+            break;
+        }
+        case FRAME_INFIX_LEFT:
+            frame->type = FRAME_INFIX_RIGHT;
+            frame->value = value;
+            eval_expression_next(m, ((struct ast_infix_expression*)frame->node)->right, frame->env);
+            break;
+        case FRAME_INFIX_RIGHT: {
+            struct frame done = pop(m);
+            auto infix = (struct ast_infix_expression*)done.node;
+            give(m, eval_infix_quickened(infix, done.value, value));
+            break;
+        }
+        case FRAME_IF: {
+            // the chosen branch's value is the if's value, so the frame can go first
+            struct frame done = pop(m);
+            auto exp = (struct ast_if_expression*)done.node;
+            bool truthy = is_truthy(value);
+            object_decref(value);
+            if (truthy) {
+                eval_statement_next(m, &exp->consequence->statement, done.env);
+            } else if (exp->alternative != NULL) {
+                eval_statement_next(m, &exp->alternative->statement, done.env);
+            } else {
+                give(m, object_null_init_base());
+            }
+            break;
+        }
+        case FRAME_CALL_FUNCTION: {
+            auto call = (struct ast_call_expression*)frame->node;
+            if (call->arguments.len == 0) {
+                pop(m);
+                apply_function(m, value, (struct object_buf){0});
+                break;
+            }
+            frame->type = FRAME_CALL_ARGUMENTS;
+            frame->value = value;
+            frame->at.index = 0;
+            BUF_RESERVE(&frame->values, call->arguments.len);
+            eval_expression_next(m, call->arguments.ptr[0], frame->env);
+            break;
+        }
+        case FRAME_CALL_ARGUMENTS: {
+            auto call = (struct ast_call_expression*)frame->node;
+            BUF_PUSH(&frame->values, value);
+            if (++frame->at.index < call->arguments.len) {
+                eval_expression_next(m, call->arguments.ptr[frame->at.index], frame->env);
+                break;
+            }
+            struct frame done = pop(m);
+            struct object* fn = specialize_call(call, done.value, &done.values);
+            apply_function(m, fn, done.values);
+            break;
+        }
+        case FRAME_CALL_RETURN: {
+            release_frame(pop(m));
+            give(m, unwrap_return_value(value));
+            break;
+        }
+        case FRAME_ARRAY: {
+            auto array = (struct ast_array_literal*)frame->node;
+            BUF_PUSH(&frame->values, value);
+            if (++frame->at.index < array->elements.len) {
+                eval_expression_next(m, array->elements.ptr[frame->at.index], frame->env);
+                break;
+            }
+            give(m, object_array_init_base(pop(m).values));
+            break;
+        }
+        case FRAME_INDEX_LEFT:
+            frame->type = FRAME_INDEX_RIGHT;
+            frame->value = value;
+            eval_expression_next(m, ((struct ast_index_expression*)frame->node)->index, frame->env);
+            break;
+        case FRAME_INDEX_RIGHT: {
+            struct frame done = pop(m);
+            auto index = (struct ast_index_expression*)done.node;
+            give(m, eval_index_quickened(index, done.value, value));
+            break;
+        }
+        case FRAME_HASH_KEY: {
+            struct object* err = check_hash_key(value);
+            if (err != NULL) {
+                give(m, err);
+                break;
+            }
+            frame->type = FRAME_HASH_VALUE;
+            frame->key = value;
+            eval_expression_next(m, frame->at.bucket->value, frame->env);
+            break;
+        }
+        case FRAME_HASH_VALUE: {
+            auto hash = (struct ast_hash_literal*)frame->node;
+            struct object* key = frame->key;
+            frame->key = NULL;
+            object_hash_table_insert(
+                &((struct object_hash*)frame->value)->pairs,
+                object_hash_key(key),
+                key,
+                value
+            );
+            frame->at.bucket = ast_expression_hash_next(&hash->pairs, frame->at.bucket);
+            if (frame->at.bucket != NULL) {
+                frame->type = FRAME_HASH_KEY;
+                eval_expression_next(m, frame->at.bucket->key, frame->env);
+                break;
+            }
+            give(m, pop(m).value);
+            break;
+        }
+        case FRAME_RETURN:
+            pop(m);
+            give(m, object_return_value_init_base(value));
+            break;
+        case FRAME_LET: {
+            struct frame done = pop(m);
+            bind_variable(((struct ast_let_statement*)done.node)->name, value, done.env);
+            give(m, object_null_init_base());
+            break;
+        }
+        case FRAME_BLOCK: {
+            auto block = (struct ast_block_statement*)frame->node;
+            if (value != NULL and object_type(value) == OBJECT_RETURN_VALUE) {
+                pop(m);
+                give(m, value);
+                break;
+            }
+            object_decref(value);
+            size_t next = ++frame->at.index;
+            struct environment* env = frame->env;
+            // the last statement's value is the block's value, so the frame can go first
+            if (next + 1 == block->statements.len) pop(m);
+            eval_statement_next(m, block->statements.ptr[next], env);
+            break;
+        }
+        case FRAME_PROGRAM: {
+            auto program = (struct ast_program*)frame->node;
+            if (value != NULL and object_type(value) == OBJECT_RETURN_VALUE) {
+                pop(m);
+                give(m, object_return_value_unwrap(value));
+                break;
+            }
+            if (++frame->at.index == program->statements.len) {
+                pop(m);
+                give(m, value);
+                break;
+            }
+            object_decref(value);
+            eval_statement_next(m, program->statements.ptr[frame->at.index], frame->env);
+            break;
+        }
+    }
+}
+
+struct object* stack_eval(struct ast_node* node, struct environment* env) {
+    builtins_define(env);
+    resolve(node);
+
+    struct machine m = {0};
+    switch (node->type) {
+        case AST_NODE_EXPRESSION:
+            eval_expression_next(&m, (struct ast_expression*)node, env);
+            break;
+        case AST_NODE_STATEMENT:
+            eval_statement_next(&m, (struct ast_statement*)node, env);
+            break;
+        case AST_NODE_PROGRAM: {
+            auto program = (struct ast_program*)node;
+            if (program->statements.len == 0) {
+                give(&m, NULL);
+            } else if (push(&m, frame_init(FRAME_PROGRAM, node, env))) {
+                eval_statement_next(&m, program->statements.ptr[0], env);
+            }
+            break;
+        }
+    }
+
+    while (true) {
+        switch (m.step) {
+            case STEP_EXPRESSION:
+                step_expression(&m);
+                break;
+            case STEP_STATEMENT:
+                step_statement(&m);
+                break;
+            case STEP_VALUE:
+                if (m.frames.len == 0) {
+                    BUF_FREE(m.frames);
+                    return m.value;
+                }
+                if (is_error(m.value)) {
+                    while (m.frames.len > 0) {
+                        release_frame(pop(&m));
+                    }
+                    break;
+                }
+                step_value(&m);
+                break;
+        }
+    }
+}
@@ -54,7 +54,8 @@ void string_append_printf(struct string* buf, const char* fmt, ...)
     va_end(args);
 
     size_t old_cap = buf->capacity;
-    while (buf->length + length > buf->capacity) {
+    // vsnprintf needs room for the terminator
+    while (buf->length + length + 1 > buf->capacity) {
         buf->capacity = buf->capacity * 2 + 1;
     }
     if (buf->capacity > old_cap) {
@@ -0,0 +1,551 @@
+#include "monkey/thunk_evaluator.h"
+
+#include <iso646.h>
+#include <stdlib.h>
+
+#include "monkey/builtins.h"
+#include "monkey/private/evaluator.h"
+#include "monkey/private/stdc.h"
+#include "monkey/resolver.h"
+#include "monkey/specializer.h"
+
+// Calls with at most this many arguments keep them on the C stack.
+#define INLINE_ARGUMENTS 8
+
+struct thunk;
+
+typedef struct object* thunk_eval_t(struct thunk* self, struct environment* env);
+
+struct thunk {
+    thunk_eval_t* eval;
+    // the node the thunk was compiled from; the tree outlives its thunks
+    struct ast_node* node;
+    // the value of a constant
+    struct object* value;
+    // the address of a resolved identifier
+    size_t depth;
+    size_t slot;
+    size_t count;
+    struct thunk* children[];
+};
+
+// A function body compiled once and cached on its block.
+struct compiled_body {
+    struct ast_code code;
+    struct thunk* thunk;
+};
+
+// Where a node sits in the function being applied, as in the tree evaluator. A call whose value
+// is the function's result is compiled to hand itself back to apply_function as a tail call.
+enum position {
+    POSITION_PLAIN,
+    POSITION_BODY,
+    POSITION_TAIL,
+};
+
+static struct thunk* thunk_new(thunk_eval_t* eval, struct ast_node* node, size_t count) {
+    struct thunk* self = malloc(sizeof(*self) + count * sizeof(*self->children));
+    *self = (struct thunk){.eval = eval, .node = node, .count = count};
+    for (size_t i = 0; i < count; i++) {
+        self->children[i] = NULL;
+    }
+    return self;
+}
+
+static void thunk_free(struct thunk* self) {
+    if (self == NULL) return;
+    for (size_t i = 0; i < self->count; i++) {
+        thunk_free(self->children[i]);
+    }
+    object_decref(self->value);
+    free(self);
+}
+
+static struct object* run(struct thunk* thunk, struct environment* env) {
+    return thunk->eval(thunk, env);
+}
+
+static struct object* eval_constant(struct thunk* self, struct environment* env) {
+    (void)env;
+    return object_incref(self->value);
+}
+
+static struct object* eval_string(struct thunk* self, struct environment* env) {
+    (void)env;
+    return object_string_init_base(string_dup(((struct ast_string_literal*)self->node)->value));
+}
+
+// An unset slot is left by a `let` on a branch that wasn't taken, so the lookup falls back to the
+// name.
+static struct object* eval_local(struct thunk* self, struct environment* env) {
+    struct object* value = env->slots.ptr[self->slot];
+    if (value == NULL) return eval_identifier((struct ast_identifier*)self->node, env);
+    return object_incref(value);
+}
+
+static struct object* eval_captured(struct thunk* self, struct environment* env) {
+    struct object* value = environment_get_slot(env, self->depth, self->slot);
+    if (value == NULL) return eval_identifier((struct ast_identifier*)self->node, env);
+    return object_incref(value);
+}
+
+static struct object* eval_name(struct thunk* self, struct environment* env) {
+    return eval_identifier((struct ast_identifier*)self->node, env);
+}
+
+static struct object* eval_prefix(struct thunk* self, struct environment* env) {
+    struct object* right = run(self->children[0], env);
+    if (is_error(right)) return right;
+    return eval_prefix_quickened((struct ast_prefix_expression*)self->node, right);
+}
+
+static struct object* eval_infix(struct thunk* self, struct environment* env) {
+    struct object* left = run(self->children[0], env);
+    if (is_error(left)) return left;
+    struct object* right = run(self->children[1], env);
+    if (is_error(right)) {
+        object_decref(left);
+        return right;
+    }
+    return eval_infix_quickened((struct ast_infix_expression*)self->node, left, right);
+}
+
+static struct object* eval_index(struct thunk* self, struct environment* env) {
+    struct object* left = run(self->children[0], env);
+    if (is_error(left)) return left;
+    struct object* index = run(self->children[1], env);
+    if (is_error(index)) {
+        object_decref(left);
+        return index;
+    }
+    return eval_index_quickened((struct ast_index_expression*)self->node, left, index);
+}
+
+static struct object* eval_if(struct thunk* self, struct environment* env) {
+    struct object* condition = run(self->children[0], env);
+    if (is_error(condition)) return condition;
+    bool truthy = is_truthy(condition);
+    object_decref(condition);
+    if (truthy) return run(self->children[1], env);
+    if (self->children[2] != NULL) return run(self->children[2], env);
+    return object_null_init_base();
+}
+
+static struct object* eval_function(struct thunk* self, struct environment* env) {
+    return eval_function_literal((struct ast_function_literal*)self->node, env);
+}
+
+// Evaluates the children from `first` on into `values`, which has room for them. On an error the
+// values so far are released and the error returned.
+static struct object* eval_children(
+    struct thunk* self,
+    size_t first,
+    struct environment* env,
+    struct object_buf values
+) {
+    for (size_t i = first; i < self->count; i++) {
+        struct object* value = run(self->children[i], env);
+        if (is_error(value)) {
+            for (size_t j = 0; j < i - first; j++) {
+                object_decref(values.ptr[j]);
+            }
+            return value;
+        }
+        values.ptr[i - first] = value;
+    }
+    return NULL;
+}
+
+static struct object_buf values_alloc(size_t len) {
+    return BUF_OWNER(struct object_buf, malloc(len * sizeof(struct object*)), len);
+}
+
+static struct object* eval_array(struct thunk* self, struct environment* env) {
+    struct object_buf elements = values_alloc(self->count);
+    struct object* err = eval_children(self, 0, env, elements);
+    if (err != NULL) {
+        BUF_FREE(elements);
+        return err;
+    }
+    return object_array_init_base(elements);
+}
+
+// Keys and values alternate among the children.
+static struct object* eval_hash(struct thunk* self, struct environment* env) {
+    struct object_hash_table table;
+    object_hash_table_init(&table);
+
+    for (size_t i = 0; i < self->count; i += 2) {
+        struct object* key = run(self->children[i], env);
+        if (is_error(key)) {
+            object_hash_table_free(&table);
+            return key;
+        }
+        struct object* err = check_hash_key(key);
+        if (err != NULL) {
+            object_hash_table_free(&table);
+            return err;
+        }
+
+        struct object_hash_key hash_key = object_hash_key(key);
+
+        struct object* value = run(self->children[i + 1], env);
+        if (is_error(value)) {
+            object_hash_table_free(&table);
+            object_decref(key);
+            return value;
+        }
+
+        object_hash_table_insert(&table, hash_key, key, value);
+    }
+
+    return object_hash_init_base(table);
+}
+
+static struct thunk* compile_statement(struct ast_statement* statement, enum position position);
+
+static void free_compiled_body(struct ast_code* code) {
+    auto body = (struct compiled_body*)code;
+    thunk_free(body->thunk);
+    free(body);
+}
+
+static struct thunk* body_thunk(struct ast_block_statement* block) {
+    if (block->code != NULL and block->code->free == free_compiled_body) {
+        return ((struct compiled_body*)block->code)->thunk;
+    }
+    // compiled by another engine
+    if (block->code != NULL) block->code->free(block->code);
+    struct compiled_body* body = malloc(sizeof(*body));
+    body->code = (struct ast_code){.free = free_compiled_body};
+    body->thunk = compile_statement(&block->statement, POSITION_TAIL);
+    block->code = &body->code;
+    return body->thunk;
+}
+
+// Makes one call, leaving the callee environment in `env` for the next call of a tail-call chain.
+static struct object*
+call_function(struct object* fn, struct object_buf args, struct environment** env) {
+    switch (object_type(fn)) {
+        case OBJECT_FUNCTION: {
+            auto function = (struct object_function*)fn;
+            struct object* err = check_arguments(function, args);
+            if (err != NULL) return err;
+            check_parameter_types(function, args);
+            struct thunk* body = body_thunk(function->body);
+            *env = extend_function_env(function, args, *env);
+            return unwrap_return_value(run(body, *env));
+        }
+        case OBJECT_BUILTIN: {
+            auto builtin = (struct object_builtin*)fn;
+            return builtin->fn(args);
+        }
+        default:
+            return not_a_function(fn);
+    }
+}
+
+// Calls `fn`, taking ownership of it and `args`, and makes the tail calls the body hands back.
+static struct object* apply_function(struct object* fn, struct object_buf args) {
+    struct environment* env = NULL;
+    while (true) {
+        struct object* result = call_function(fn, args, &env);
+        object_decref(fn);
+        for (size_t i = 0; i < args.len; i++) {
+            object_decref(args.ptr[i]);
+        }
+        BUF_FREE(args);
+
+        if (result == NULL or object_type(result) != OBJECT_TAIL_CALL) {
+            if (env != NULL) environment_decref(env);
+            return result;
+        }
+        auto tail_call = (struct object_tail_call*)result;
+        fn = tail_call->function;
+        args = tail_call->args;
+        tail_call->function = NULL;
+        tail_call->args = (struct object_buf){0};
+        object_decref(result);
+    }
+}
+
+// The callee is the first child and the arguments the rest.
+// Evaluates the arguments of a call into `args`, leaving out those `dropped` marks, if it isn't
+// NULL. Returns the error an argument gave, or NULL.
+static struct object* eval_arguments(
+    struct thunk* self,
+    const bool* dropped,
+    struct environment* env,
+    struct object_buf* args
+) {
+    if (dropped == NULL) return eval_children(self, 1, env, *args);
+    size_t len = 0;
+    for (size_t i = 1; i < self->count; i++) {
+        if (dropped[i - 1]) continue;
+        struct object* value = run(self->children[i], env);
+        if (is_error(value)) {
+            for (size_t j = 0; j < len; j++) {
+                object_decref(args->ptr[j]);
+            }
+            return value;
+        }
+        args->ptr[len++] = value;
+    }
+    args->len = len;
+    return NULL;
+}
+
+static struct object* eval_call(struct thunk* self, struct environment* env) {
+    struct object* function = run(self->children[0], env);
+    if (is_error(function)) return function;
+    const bool* dropped;
+    function = specialize_callee((struct ast_call_expression*)self->node, function, &dropped);
+    size_t argc = self->count - 1;
+    struct object* inline_args[INLINE_ARGUMENTS];
+    struct object_buf args = argc <= INLINE_ARGUMENTS
+                                 ? BUF_REF(struct object_buf, inline_args, argc)
+                                 : values_alloc(argc);
+    struct object* err = eval_arguments(self, dropped, env, &args);
+    if (err != NULL) {
+        object_decref(function);
+        BUF_FREE(args);
+        return err;
+    }
+    return apply_function(function, args);
+}
+
+// The arguments of a tail call outlive this frame, so they're always on the heap.
+static struct object* eval_tail_call(struct thunk* self, struct environment* env) {
+    struct object* function = run(self->children[0], env);
+    if (is_error(function)) return function;
+    const bool* dropped;
+    function = specialize_callee((struct ast_call_expression*)self->node, function, &dropped);
+    struct object_buf args = values_alloc(self->count - 1);
+    struct object* err = eval_arguments(self, dropped, env, &args);
+    if (err != NULL) {
+        object_decref(function);
+        BUF_FREE(args);
+        return err;
+    }
+    return object_tail_call_init_base(function, args);
+}
+
+static struct object* eval_block(struct thunk* self, struct environment* env) {
+    struct object* result = NULL;
+    for (size_t i = 0; i < self->count; i++) {
+        object_decref(result);
+        result = run(self->children[i], env);
+        if (result != NULL and
+            (object_type(result) == OBJECT_RETURN_VALUE or object_type(result) == OBJECT_ERROR)) {
+            return result;
+        }
+    }
+    return result;
+}
+
+static struct object* eval_return(struct thunk* self, struct environment* env) {
+    struct object* value = run(self->children[0], env);
+    if (is_error(value)) return value;
+    return object_return_value_init_base(value);
+}
+
+static struct object* eval_let(struct thunk* self, struct environment* env) {
+    struct object* value = run(self->children[0], env);
+    if (is_error(value)) return value;
+    bind_variable(((struct ast_let_statement*)self->node)->name, value, env);
+    return object_null_init_base();
+}
+
+static struct object* eval_program(struct thunk* self, struct environment* env) {
+    struct object* result = NULL;
+    for (size_t i = 0; i < self->count; i++) {
+        object_decref(result);
+        result = run(self->children[i], env);
+        if (result != NULL and object_type(result) == OBJECT_RETURN_VALUE) {
+            return object_return_value_unwrap(result);
+        }
+        if (is_error(result)) return result;
+    }
+    return result;
+}
+
+static struct thunk* compile_expression(struct ast_expression* expression, enum position position);
+
+static struct thunk* compile_block(struct ast_block_statement* block, enum position position) {
+    // a block of one statement has the value of that statement
+    if (block->statements.len == 1) return compile_statement(block->statements.ptr[0], position);
+    struct thunk* self = thunk_new(eval_block, &block->statement.node, block->statements.len);
+    for (size_t i = 0; i < block->statements.len; i++) {
+        // only the last statement inherits the tail position
+        enum position statement_position =
+            position == POSITION_TAIL and i + 1 < block->statements.len ? POSITION_BODY : position;
+        self->children[i] = compile_statement(block->statements.ptr[i], statement_position);
+    }
+    return self;
+}
+
+static struct thunk* compile_identifier(struct ast_identifier* identifier) {
+    if (!identifier->address.resolved) return thunk_new(eval_name, &identifier->expression.node, 0);
+    struct thunk* self = thunk_new(
+        identifier->address.env_depth == 0 ? eval_local : eval_captured,
+        &identifier->expression.node,
+        0
+    );
+    self->depth = identifier->address.env_depth;
+    self->slot = identifier->address.env_slot;
+    return self;
+}
+
+static struct thunk* compile_call(struct ast_call_expression* call, enum position position) {
+    struct thunk* self = thunk_new(
+        position == POSITION_TAIL ? eval_tail_call : eval_call,
+        &call->expression.node,
+        call->arguments.len + 1
+    );
+    self->children[0] = compile_expression(call->function, POSITION_PLAIN);
+    for (size_t i = 0; i < call->arguments.len; i++) {
+        self->children[i + 1] = compile_expression(call->arguments.ptr[i], POSITION_PLAIN);
+    }
+    return self;
+}
+
+static struct thunk* compile_hash(struct ast_hash_literal* hash) {
+    size_t count = 0;
+    for (const struct ast_expression_hash_bucket* bucket = ast_expression_hash_first(&hash->pairs);
+         bucket != NULL;
+         bucket = ast_expression_hash_next(&hash->pairs, bucket)) {
+        count += 2;
+    }
+    struct thunk* self = thunk_new(eval_hash, &hash->expression.node, count);
+    size_t i = 0;
+    for (const struct ast_expression_hash_bucket* bucket = ast_expression_hash_first(&hash->pairs);
+         bucket != NULL;
+         bucket = ast_expression_hash_next(&hash->pairs, bucket)) {
+        self->children[i++] = compile_expression(bucket->key, POSITION_PLAIN);
+        self->children[i++] = compile_expression(bucket->value, POSITION_PLAIN);
+    }
+    return self;
+}
+
+// Only conditionals and calls care about their position.
+static struct thunk* compile_expression(struct ast_expression* expression, enum position position) {
+    struct ast_node* node = &expression->node;
+    switch (expression->type) {
+        case AST_EXPRESSION_INTEGER_LITERAL: {
+            struct thunk* self = thunk_new(eval_constant, node, 0);
+            self->value = object_int64_init_base(((struct ast_integer_literal*)expression)->value);
+            return self;
+        }
+        case AST_EXPRESSION_BOOLEAN: {
+            struct thunk* self = thunk_new(eval_constant, node, 0);
+            self->value = object_boolean_init_base(((struct ast_boolean*)expression)->value);
+            return self;
+        }
+        case AST_EXPRESSION_STRING:
+            return thunk_new(eval_string, node, 0);
+        case AST_EXPRESSION_IDENTIFIER:
+            return compile_identifier((struct ast_identifier*)expression);
+        case AST_EXPRESSION_PREFIX: {
+            auto exp = (struct ast_prefix_expression*)expression;
+            struct thunk* self = thunk_new(eval_prefix, node, 1);
+            self->children[0] = compile_expression(exp->right, POSITION_PLAIN);
+            return self;
+        }
+        case AST_EXPRESSION_INFIX: {
+            auto exp = (struct ast_infix_expression*)expression;
+            struct thunk* self = thunk_new(eval_infix, node, 2);
+            self->children[0] = compile_expression(exp->left, POSITION_PLAIN);
+            self->children[1] = compile_expression(exp->right, POSITION_PLAIN);
+            return self;
+        }
+        case AST_EXPRESSION_INDEX: {
+            auto exp = (struct ast_index_expression*)expression;
+            struct thunk* self = thunk_new(eval_index, node, 2);
+            self->children[0] = compile_expression(exp->left, POSITION_PLAIN);
+            self->children[1] = compile_expression(exp->index, POSITION_PLAIN);
+            return self;
+        }
+        case AST_EXPRESSION_IF: {
+            auto exp = (struct ast_if_expression*)expression;
+            struct thunk* self = thunk_new(eval_if, node, 3);
+            self->children[0] = compile_expression(exp->condition, POSITION_PLAIN);
+            self->children[1] = compile_block(exp->consequence, position);
+            if (exp->alternative != NULL) {
+                self->children[2] = compile_block(exp->alternative, position);
+            }
+            return self;
+        }
+        case AST_EXPRESSION_FUNCTION:
+            return thunk_new(eval_function, node, 0);
+        case AST_EXPRESSION_CALL:
+            return compile_call((struct ast_call_expression*)expression, position);
+        case AST_EXPRESSION_ARRAY: {
+            auto array = (struct ast_array_literal*)expression;
+            struct thunk* self = thunk_new(eval_array, node, array->elements.len);
+            for (size_t i = 0; i < array->elements.len; i++) {
+                self->children[i] = compile_expression(array->elements.ptr[i], POSITION_PLAIN);
+            }
+            return self;
+        }
+        case AST_EXPRESSION_HASH:
+            return compile_hash((struct ast_hash_literal*)expression);
+    }
+    abort();
+}
+
+static struct thunk* compile_statement(struct ast_statement* statement, enum position position) {
+    switch (statement->type) {
+        case AST_STATEMENT_EXPRESSION:
+            return compile_expression(
+                ((struct ast_expression_statement*)statement)->expression,
+                position
+            );
+        case AST_STATEMENT_BLOCK:
+            return compile_block((struct ast_block_statement*)statement, position);
+        case AST_STATEMENT_RETURN: {
+            struct thunk* self = thunk_new(eval_return, &statement->node, 1);
+            self->children[0] = compile_expression(
+                ((struct ast_return_statement*)statement)->return_value,
+                position == POSITION_PLAIN ? POSITION_PLAIN : POSITION_TAIL
+            );
+            return self;
+        }
+        case AST_STATEMENT_LET: {
+            struct thunk* self = thunk_new(eval_let, &statement->node, 1);
+            self->children[0] =
+                compile_expression(((struct ast_let_statement*)statement)->value, POSITION_PLAIN);
+            return self;
+        }
+    }
+    abort();
+}
+
+static struct thunk* compile_program(struct ast_program* program) {
+    struct thunk* self = thunk_new(eval_program, &program->node, program->statements.len);
+    for (size_t i = 0; i < program->statements.len; i++) {
+        self->children[i] = compile_statement(program->statements.ptr[i], POSITION_PLAIN);
+    }
+    return self;
+}
+
+struct object* thunk_eval(struct ast_node* node, struct environment* env) {
+    builtins_define(env);
+    resolve(node);
+    struct thunk* thunk;
+    switch (node->type) {
+        case AST_NODE_EXPRESSION:
+            thunk = compile_expression((struct ast_expression*)node, POSITION_PLAIN);
+            break;
+        case AST_NODE_STATEMENT:
+            thunk = compile_statement((struct ast_statement*)node, POSITION_PLAIN);
+            break;
+        case AST_NODE_PROGRAM:
+            thunk = compile_program((struct ast_program*)node);
+            break;
+        default:
+            abort();
+    }
+    struct object* result = run(thunk, env);
+    thunk_free(thunk);
+    return result;
+}
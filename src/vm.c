@@ -0,0 +1,468 @@
+#include "monkey/vm.h"
+
+#include <iso646.h>
+
+#include "monkey/builtins.h"
+#include "monkey/private/evaluator.h"
+#include "monkey/private/stdc.h"
+
+#ifdef __GNUC__
+#define VM_COMPUTED_GOTO 1
+#else
+#define VM_COMPUTED_GOTO 0
+#endif
+
+struct frame {
+    struct object_closure* closure;
+    const uint8_t* ip;
+    size_t base;
+    // The environment the call's captured variables are in, with those of the calls creating the
+    // closure further out. A call that creates closures owns one of its own; any other call
+    // borrows its closure's.
+    struct environment* env;
+};
+
+BUF_T(struct frame, frame);
+
+struct vm {
+    struct object_buf stack;
+    struct frame_buf frames;
+    struct environment* globals;
+};
+
+// The operator a binary opcode applies, which the VM evaluates like the tree evaluator.
+static enum ast_operator infix_operator(enum opcode op) {
+    switch (op) {
+        case OP_ADD:
+            return AST_OPERATOR_PLUS;
+        case OP_SUB:
+            return AST_OPERATOR_MINUS;
+        case OP_MUL:
+            return AST_OPERATOR_ASTERISK;
+        case OP_DIV:
+            return AST_OPERATOR_SLASH;
+        case OP_GREATER_THAN:
+            return AST_OPERATOR_GT;
+        case OP_LESS_THAN:
+            return AST_OPERATOR_LT;
+        case OP_EQUAL:
+            return AST_OPERATOR_EQ;
+        case OP_NOT_EQUAL:
+            return AST_OPERATOR_NOT_EQ;
+        default:
+            abort();
+    }
+}
+
+// The fast path of the binary opcodes, for two integers.
+static struct object* integer_operation(enum opcode op, int64_t l, int64_t r) {
+    switch (op) {
+        case OP_ADD:
+            return object_int64_init_base(l + r);
+        case OP_SUB:
+            return object_int64_init_base(l - r);
+        case OP_MUL:
+            return object_int64_init_base(l * r);
+        case OP_DIV:
+            return object_int64_init_base(l / r);
+        case OP_GREATER_THAN:
+            return object_boolean_init_base(l > r);
+        case OP_LESS_THAN:
+            return object_boolean_init_base(l < r);
+        case OP_EQUAL:
+            return object_boolean_init_base(l == r);
+        case OP_NOT_EQUAL:
+            return object_boolean_init_base(l != r);
+        default:
+            abort();
+    }
+}
+
+// Only heap objects can be wrapped return values, which keeps the check short for immediates.
+static bool is_return_value(const struct object* obj) {
+    return obj != NULL and !object_is_immediate(obj) and obj->type == OBJECT_RETURN_VALUE;
+}
+
+static struct object* build_hash(struct object** elements, size_t len) {
+    struct object_hash_table table;
+    object_hash_table_init(&table);
+    for (size_t i = 0; i < len; i += 2) {
+        struct object* key = elements[i];
+        struct object* value = elements[i + 1];
+        if (!object_is_hashable(key)) {
+            struct object* err = object_error_init_base(string_printf(
+                "unusable as hash key: " STRING_FMT,
+                STRING_ARG(object_type_string(object_type(key)))
+            ));
+            for (size_t j = i; j < len; j++) {
+                object_decref(elements[j]);
+            }
+            object_hash_table_free(&table);
+            return err;
+        }
+        object_hash_table_insert(&table, object_hash_key(key), key, value);
+    }
+    return object_hash_init_base(table);
+}
+
+static void unwind(struct vm* vm) {
+    // the closures on the stack tell which environments are owned, so release those first
+    for (size_t i = 1; i < vm->frames.len; i++) {
+        if (vm->frames.ptr[i].closure->fn->escapes) environment_decref(vm->frames.ptr[i].env);
+    }
+    for (size_t i = 0; i < vm->stack.len; i++) {
+        object_decref(vm->stack.ptr[i]);
+    }
+    BUF_FREE(vm->stack);
+    BUF_FREE(vm->frames);
+}
+
+struct object* vm_run(const struct bytecode* bytecode, struct environment* globals) {
+    struct vm vm_storage = {.globals = globals};
+    struct vm* vm = &vm_storage;
+
+    struct object_closure* main_closure =
+        object_closure_init(compiled_function_incref(bytecode->main), NULL);
+    // functions created at the top level close over the globals
+    struct frame main_frame = {
+        .closure = main_closure,
+        .ip = bytecode->main->instructions.ptr,
+        .base = 0,
+        .env = globals,
+    };
+    BUF_PUSH(&vm->frames, main_frame);
+
+    struct frame* frame = &vm->frames.ptr[0];
+    const uint8_t* ip = frame->ip;
+    struct object** constants = bytecode->main->constants.ptr;
+    struct object* result = NULL;
+
+#define PUSH(obj) BUF_PUSH(&vm->stack, (obj))
+#define POP() (vm->stack.ptr[--vm->stack.len])
+#define PEEK(n) (vm->stack.ptr[vm->stack.len - 1 - (n)])
+#define READ_U8() (ip += 1, ip[-1])
+#define READ_U16() (ip += 2, code_read_u16(ip - 2))
+#define FAIL(obj) \
+    do { \
+        result = (obj); \
+        goto error; \
+    } while (false)
+
+#if VM_COMPUTED_GOTO
+    static void* const dispatch_table[] = {
+#define X(x, _count, _w0, _w1) [OP_##x] = &&op_##x,
+#include "monkey/private/opcode_types.inc"
+#undef X
+    };
+#define DISPATCH() goto* dispatch_table[*ip++]
+#define CASE(x) op_##x:
+    DISPATCH();
+#else
+#define DISPATCH() goto dispatch
+#define CASE(x) case OP_##x:
+dispatch:
+    switch (*ip++) {
+#endif
+
+    CASE(CONSTANT) {
+        uint16_t index = READ_U16();
+        PUSH(object_incref(constants[index]));
+        DISPATCH();
+    }
+    CASE(POP) {
+        struct object* value = POP();
+        // a `return` nested in an expression reaches its statement as a wrapped value, and ends
+        // the call all the same
+        if (is_return_value(value)) {
+            PUSH(value);
+            goto return_value;
+        }
+        object_decref(value);
+        DISPATCH();
+    }
+    CASE(ADD)
+    CASE(SUB)
+    CASE(MUL)
+    CASE(DIV)
+    CASE(GREATER_THAN)
+    CASE(LESS_THAN)
+    CASE(EQUAL)
+    CASE(NOT_EQUAL) {
+        struct object* right = POP();
+        struct object* left = POP();
+        if (object_type(left) == OBJECT_INTEGER and object_type(right) == OBJECT_INTEGER) {
+            int64_t l = object_int64_value(left);
+            int64_t r = object_int64_value(right);
+            object_decref(left);
+            object_decref(right);
+            PUSH(integer_operation(ip[-1], l, r));
+            DISPATCH();
+        }
+        struct object* value = eval_infix_expression(infix_operator(ip[-1]), left, right);
+        if (object_type(value) == OBJECT_ERROR) FAIL(value);
+        PUSH(value);
+        DISPATCH();
+    }
+    CASE(TRUE) {
+        PUSH(object_boolean_init_base(true));
+        DISPATCH();
+    }
+    CASE(FALSE) {
+        PUSH(object_boolean_init_base(false));
+        DISPATCH();
+    }
+    CASE(NULL) {
+        PUSH(object_null_init_base());
+        DISPATCH();
+    }
+    CASE(MINUS) {
+        struct object* right = POP();
+        if (object_type(right) != OBJECT_INTEGER) {
+            FAIL(eval_prefix_expression(AST_OPERATOR_MINUS, right));
+        }
+        int64_t value = object_int64_value(right);
+        object_decref(right);
+        PUSH(object_int64_init_base(-value));
+        DISPATCH();
+    }
+    CASE(BANG) {
+        struct object* right = POP();
+        bool value = !is_truthy(right);
+        object_decref(right);
+        PUSH(object_boolean_init_base(value));
+        DISPATCH();
+    }
+    CASE(JUMP_NOT_TRUTHY) {
+        uint16_t target = READ_U16();
+        struct object* condition = POP();
+        if (!is_truthy(condition)) {
+            ip = frame->closure->fn->instructions.ptr + target;
+        }
+        object_decref(condition);
+        DISPATCH();
+    }
+    CASE(JUMP) {
+        uint16_t target = READ_U16();
+        ip = frame->closure->fn->instructions.ptr + target;
+        DISPATCH();
+    }
+    CASE(JUMP_RETURNED) {
+        uint16_t target = READ_U16();
+        struct object* value = PEEK(0);
+        if (is_return_value(value)) {
+            ip = frame->closure->fn->instructions.ptr + target;
+        }
+        DISPATCH();
+    }
+    CASE(GET_GLOBAL) {
+        uint16_t index = READ_U16();
+        struct string name = ((struct object_string*)constants[index])->value;
+        struct object* value = environment_get_cached(
+            vm->globals,
+            name,
+            &frame->closure->fn->global_caches[index]
+        );
+        if (value == NULL) {
+            FAIL(object_error_init_base(
+                string_printf("identifier not found: " STRING_FMT, STRING_ARG(name))
+            ));
+        }
+        PUSH(object_incref(value));
+        DISPATCH();
+    }
+    CASE(SET_GLOBAL) {
+        struct string name = ((struct object_string*)constants[READ_U16()])->value;
+        environment_set(vm->globals, string_dup(name), POP());
+        DISPATCH();
+    }
+    CASE(GET_LOCAL) {
+        struct object* value = vm->stack.ptr[frame->base + READ_U8()];
+        // a local whose `let` has not run yet, e.g. one bound in an untaken branch
+        PUSH(value != NULL ? object_incref(value) : object_null_init_base());
+        DISPATCH();
+    }
+    CASE(SET_LOCAL) {
+        size_t slot = frame->base + READ_U8();
+        struct object* value = POP();
+        object_decref(vm->stack.ptr[slot]);
+        vm->stack.ptr[slot] = value;
+        DISPATCH();
+    }
+    CASE(GET_CAPTURED) {
+        uint8_t depth = READ_U8();
+        struct object* value = environment_get_slot(frame->env, depth, READ_U8());
+        PUSH(value != NULL ? object_incref(value) : object_null_init_base());
+        DISPATCH();
+    }
+    CASE(SET_CAPTURED) {
+        environment_set_slot(frame->env, READ_U8(), POP());
+        DISPATCH();
+    }
+    CASE(ARRAY) {
+        uint16_t len = READ_U16();
+        struct object_buf elements = {0};
+        BUF_RESERVE(&elements, len);
+        for (size_t i = vm->stack.len - len; i < vm->stack.len; i++) {
+            BUF_PUSH(&elements, vm->stack.ptr[i]);
+        }
+        vm->stack.len -= len;
+        PUSH(object_array_init_base(elements));
+        DISPATCH();
+    }
+    CASE(HASH) {
+        uint16_t len = READ_U16();
+        vm->stack.len -= len;
+        struct object* hash = build_hash(vm->stack.ptr + vm->stack.len, len);
+        if (object_type(hash) == OBJECT_ERROR) FAIL(hash);
+        PUSH(hash);
+        DISPATCH();
+    }
+    CASE(INDEX) {
+        struct object* index = POP();
+        struct object* left = POP();
+        if (object_type(left) == OBJECT_ARRAY and object_type(index) == OBJECT_INTEGER) {
+            auto array = (struct object_array*)left;
+            int64_t i = object_int64_value(index);
+            if (i < 0 or (size_t)i >= array->elements.len) {
+                PUSH(object_null_init_base());
+            } else {
+                PUSH(object_incref(array->elements.ptr[i]));
+            }
+            object_decref(left);
+            object_decref(index);
+            DISPATCH();
+        }
+        struct string type = object_type_string(object_type(left));
+        object_decref(left);
+        object_decref(index);
+        FAIL(object_error_init_base(
+            string_printf("index operator not supported: " STRING_FMT, STRING_ARG(type))
+        ));
+    }
+    CASE(CALL) {
+        uint8_t argc = READ_U8();
+        struct object* callee = PEEK(argc);
+        switch (object_type(callee)) {
+            case OBJECT_CLOSURE: {
+                auto closure = (struct object_closure*)callee;
+                if (closure->fn->num_parameters != argc) {
+                    FAIL(object_error_init_base(string_printf(
+                        "wrong number of arguments: expected %zu, got %zu",
+                        closure->fn->num_parameters,
+                        (size_t)argc
+                    )));
+                }
+                frame->ip = ip;
+                struct frame callee_frame = {
+                    .closure = closure,
+                    .ip = closure->fn->instructions.ptr,
+                    .base = vm->stack.len - argc,
+                    .env = closure->fn->escapes
+                               ? environment_new_enclosed(closure->env, closure->fn->num_captured)
+                               : closure->env,
+                };
+                BUF_PUSH(&vm->frames, callee_frame);
+                frame = &vm->frames.ptr[vm->frames.len - 1];
+                ip = frame->ip;
+                constants = closure->fn->constants.ptr;
+                for (size_t i = argc; i < closure->fn->num_locals; i++) {
+                    PUSH(NULL);
+                }
+                DISPATCH();
+            }
+            case OBJECT_BUILTIN: {
+                struct object_buf args =
+                    BUF_REF(struct object_buf, &vm->stack.ptr[vm->stack.len - argc], argc);
+                struct object* value = ((struct object_builtin*)callee)->fn(args);
+                for (size_t i = 0; i <= argc; i++) {
+                    object_decref(POP());
+                }
+                if (object_type(value) == OBJECT_ERROR) FAIL(value);
+                PUSH(value);
+                DISPATCH();
+            }
+            default:
+                FAIL(object_error_init_base(string_printf(
+                    "not a function: " STRING_FMT,
+                    STRING_ARG(object_type_string(object_type(callee)))
+                )));
+        }
+    }
+    CASE(WRAP_RETURN) {
+        struct object* value = POP();
+        PUSH(object_return_value_init_base(value));
+        DISPATCH();
+    }
+    CASE(RETURN) {
+        PUSH(object_null_init_base());
+        goto return_value;
+    }
+    CASE(RETURN_VALUE)
+    return_value: {
+        struct object* value = POP();
+        if (is_return_value(value)) {
+            value = object_return_value_unwrap(value);
+        }
+        if (vm->frames.len == 1) {
+            result = value;
+            goto done;
+        }
+        if (frame->closure->fn->escapes) environment_decref(frame->env);
+        // drop the callee along with its locals and temporaries
+        while (vm->stack.len > frame->base - 1) {
+            object_decref(POP());
+        }
+        vm->frames.len--;
+        frame = &vm->frames.ptr[vm->frames.len - 1];
+        ip = frame->ip;
+        constants = frame->closure->fn->constants.ptr;
+        PUSH(value);
+        DISPATCH();
+    }
+    CASE(CLOSURE) {
+        auto fn = (struct object_compiled_function*)constants[READ_U16()];
+        PUSH(object_closure_init_base(compiled_function_incref(fn->fn), frame->env));
+        DISPATCH();
+    }
+
+#if !VM_COMPUTED_GOTO
+    }
+#endif
+
+#undef CASE
+#undef DISPATCH
+#undef FAIL
+#undef READ_U16
+#undef READ_U8
+#undef PEEK
+#undef POP
+#undef PUSH
+
+error:
+done:
+    unwind(vm);
+    object_decref(&main_closure->object);
+    return result;
+}
+
+struct object* vm_eval(struct ast_node* node, struct environment* env) {
+    if (node->type == AST_NODE_PROGRAM and ((struct ast_program*)node)->statements.len == 0) {
+        return NULL;
+    }
+
+    builtins_define(env);
+
+    struct compiler compiler;
+    compiler_init(&compiler);
+    if (!compile(&compiler, node)) {
+        struct object* err = object_error_init_base(string_dup(compiler.errors.ptr[0]));
+        compiler_deinit(&compiler);
+        return err;
+    }
+    struct bytecode bytecode = compiler_bytecode(&compiler);
+    compiler_deinit(&compiler);
+
+    struct object* result = vm_run(&bytecode, env);
+    bytecode_free(bytecode);
+    return result;
+}
@@ -0,0 +1,162 @@
+#include "monkey/test/c_emitter.h"
+
+#include <iso646.h>
+#include <monkey/builtins.h>
+#include <monkey/c_emitter.h>
+#include <monkey/native.h>
+#include <string.h>
+
+#include "monkey/test/framework.h"
+
+#define S(s) STRING_REF(s)
+
+static bool contains(struct string haystack, struct string needle) {
+    if (needle.length > haystack.length) return false;
+    for (size_t i = 0; i + needle.length <= haystack.length; i++) {
+        if (memcmp(haystack.data + i, needle.data, needle.length) == 0) return true;
+    }
+    return false;
+}
+
+static TEST_FUNC(state, emits, struct string input, struct string expected) {
+    struct ast_program* program;
+    RUN_SUBTEST(state, parse, NO_CLEANUP, input, &program);
+
+    struct string c = emit_c(program);
+    ast_node_decref(&program->node);
+    TEST_ASSERT(
+        state,
+        contains(c, expected),
+        CLEANUP(STRING_FREE(c)),
+        "expected \"" STRING_FMT "\" in:\n" STRING_FMT,
+        STRING_ARG(expected),
+        STRING_ARG(c)
+    );
+    STRING_FREE(c);
+    PASS();
+}
+
+// fn(n) { if (n == 0) { n } else { countdown(n - 1) } }, written the way emit_c() would.
+static struct object* countdown(struct environment* env, struct object_buf args) {
+    int64_t n = object_int64_value(args.ptr[0]);
+    if (n == 0) return object_incref(args.ptr[0]);
+    struct object* self = native_name(env, S("countdown"));
+    return object_tail_call_init_base(
+        self,
+        BUF_LIT(struct object_buf, object_int64_init_base(n - 1))
+    );
+}
+
+static TEST_FUNC(state, native_call, struct object_buf args, struct string expected) {
+    struct environment* env = environment_new();
+    builtins_define(env);
+    environment_set(
+        env,
+        string_dup(S("countdown")),
+        object_native_function_init_base(countdown, 1, 1, false, 0, S("fn(n) { ... }"), env)
+    );
+    struct object* fn = native_name(env, S("countdown"));
+    struct object* result = native_call(fn, args);
+    struct string actual = object_inspect(result);
+    object_decref(result);
+    environment_decref(env);
+    TEST_ASSERT(
+        state,
+        STRING_EQUAL(actual, expected),
+        CLEANUP(STRING_FREE(actual)),
+        "expected=\"" STRING_FMT "\", got=\"" STRING_FMT "\"",
+        STRING_ARG(expected),
+        STRING_ARG(actual)
+    );
+    STRING_FREE(actual);
+    PASS();
+}
+
+static TEST_FUNC(state, native_type_name, struct string expected) {
+    struct environment* env = environment_new();
+    environment_set(
+        env,
+        string_dup(S("countdown")),
+        object_native_function_init_base(countdown, 1, 1, false, 0, S("fn(n) { ... }"), env)
+    );
+    struct object* result = native_infix(
+        AST_OPERATOR_ASTERISK,
+        object_int64_init_base(2),
+        native_name(env, S("countdown"))
+    );
+    struct string actual = object_inspect(result);
+    object_decref(result);
+    environment_decref(env);
+    TEST_ASSERT(
+        state,
+        STRING_EQUAL(actual, expected),
+        CLEANUP(STRING_FREE(actual)),
+        "expected=\"" STRING_FMT "\", got=\"" STRING_FMT "\"",
+        STRING_ARG(expected),
+        STRING_ARG(actual)
+    );
+    STRING_FREE(actual);
+    PASS();
+}
+
+SUITE_FUNC(state, c_emitter) {
+    struct {
+        struct string input;
+        struct string expected;
+    } emit_tests[] = {
+        {S("1 + 2 * x"), S("native_add(")},
+        {S("x < y"), S("native_less_than(")},
+        {S("-x"), S("native_negate(")},
+        {S("!x"), S("native_prefix(AST_OPERATOR_BANG, ")},
+        {S("\"a\tb\""), S("STRING_REF(\"a\\011b\")")},
+        {S("\"a\\b\""), S("STRING_REF(\"a\\\\b\")")},
+        {S("-9223372036854775807 - 1"), S("INT64_MIN")},
+        {S("let f = fn(a) { a }; f(1)"), S("static struct object* fn_0(")},
+        {S("let f = fn(a) { a }; f(1)"), S("environment_set(env, string_dup(STRING_REF(\"f\"))")},
+        {S("fn(a, b) { a }"), S("object_native_function_init_base(fn_0, 2, 2, false, ")},
+        {S("fn(a) { fn() { a } }"), S("native_slot(env, 1, 0, STRING_REF(\"a\"))")},
+        // closures keep only the captured variables, which are bound apart from the frame
+        {S("fn(a, b) { fn() { a } }"), S("object_native_function_init_base(fn_0, 2, 2, true, 1, ")},
+        {S("fn(a) { fn() { a } }"), S("environment_set_slot(env->outer, 0, object_incref(")},
+        {S("fn(a) { fn() { a } }"), S("\"), env->outer);")},
+        // calls in tail position are handed back to native_call()
+        {S("fn(f) { f(1) }"), S("object_tail_call_init_base(")},
+        {S("fn(f) { f(1) + 1 }"), S("native_call(")},
+        {S("{\"a\": 1}"), S("native_check_hash_key(")},
+        {S("1"), S("return native_main(program);")},
+    };
+    for (size_t i = 0; i < sizeof(emit_tests) / sizeof(*emit_tests); i++) {
+        RUN_TEST(
+            state,
+            emits,
+            string_printf(
+                "emits " STRING_FMT " for \"" STRING_FMT "\"",
+                STRING_ARG(emit_tests[i].expected),
+                STRING_ARG(emit_tests[i].input)
+            ),
+            emit_tests[i].input,
+            emit_tests[i].expected
+        );
+    }
+
+    RUN_TEST(
+        state,
+        native_call,
+        string_dup(S("native_call() runs tail calls")),
+        BUF_LIT(struct object_buf, object_int64_init_base(100000)),
+        S("0")
+    );
+    RUN_TEST(
+        state,
+        native_call,
+        string_dup(S("native_call() checks arity")),
+        BUF_LIT(struct object_buf, object_int64_init_base(1), object_int64_init_base(2)),
+        S("ERROR: wrong number of arguments: expected 1, got 2")
+    );
+    RUN_TEST(
+        state,
+        native_type_name,
+        string_dup(S("native functions are named FUNCTION in errors")),
+        S("ERROR: type mismatch: INTEGER * FUNCTION")
+    );
+}
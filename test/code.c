@@ -0,0 +1,128 @@
+#include "monkey/test/code.h"
+
+#include <monkey/code.h>
+
+#include "monkey/test/framework.h"
+
+static TEST_FUNC0(state, make) {
+    struct {
+        enum opcode op;
+        size_t operands[2];
+        uint8_t expected[4];
+        size_t expected_len;
+    } tests[] = {
+        {OP_CONSTANT, {65534}, {OP_CONSTANT, 255, 254}, 3},
+        {OP_ADD, {0}, {OP_ADD}, 1},
+        {OP_GET_LOCAL, {255}, {OP_GET_LOCAL, 255}, 2},
+        {OP_CLOSURE, {65534}, {OP_CLOSURE, 255, 254}, 3},
+        {OP_GET_CAPTURED, {255, 254}, {OP_GET_CAPTURED, 255, 254}, 3},
+    };
+
+    for (size_t i = 0; i < sizeof(tests) / sizeof(*tests); i++) {
+        struct instruction_buf ins = {0};
+        code_make(&ins, tests[i].op, tests[i].operands[0], tests[i].operands[1]);
+        TEST_ASSERT(
+            state,
+            ins.len == tests[i].expected_len,
+            CLEANUP(BUF_FREE(ins)),
+            "instruction has wrong length. want=%zu, got=%zu",
+            tests[i].expected_len,
+            ins.len
+        );
+        for (size_t j = 0; j < ins.len; j++) {
+            TEST_ASSERT(
+                state,
+                ins.ptr[j] == tests[i].expected[j],
+                CLEANUP(BUF_FREE(ins)),
+                "wrong byte at pos %zu. want=%u, got=%u",
+                j,
+                tests[i].expected[j],
+                ins.ptr[j]
+            );
+        }
+        BUF_FREE(ins);
+    }
+
+    PASS();
+}
+
+static TEST_FUNC0(state, instructions_string) {
+    struct instruction_buf ins = {0};
+    code_make(&ins, OP_ADD, 0, 0);
+    code_make(&ins, OP_GET_LOCAL, 1, 0);
+    code_make(&ins, OP_CONSTANT, 2, 0);
+    code_make(&ins, OP_CONSTANT, 65535, 0);
+    code_make(&ins, OP_CLOSURE, 65535, 0);
+    code_make(&ins, OP_GET_CAPTURED, 1, 255);
+
+    struct string expected = STRING_REF(
+        "0000 ADD\n"
+        "0001 GET_LOCAL 1\n"
+        "0003 CONSTANT 2\n"
+        "0006 CONSTANT 65535\n"
+        "0009 CLOSURE 65535\n"
+        "0012 GET_CAPTURED 1 255\n"
+    );
+    struct string actual = code_instructions_string(ins);
+    BUF_FREE(ins);
+
+    TEST_ASSERT(
+        state,
+        STRING_EQUAL(actual, expected),
+        CLEANUP(STRING_FREE(actual)),
+        "instructions wrongly formatted.\nwant=" STRING_FMT "\ngot=" STRING_FMT,
+        STRING_ARG(expected),
+        STRING_ARG(actual)
+    );
+    STRING_FREE(actual);
+    PASS();
+}
+
+static TEST_FUNC0(state, read_operands) {
+    struct {
+        enum opcode op;
+        size_t operands[2];
+        size_t bytes_read;
+    } tests[] = {
+        {OP_CONSTANT, {65535}, 2},
+        {OP_GET_LOCAL, {255}, 1},
+        {OP_CLOSURE, {65535}, 2},
+        {OP_GET_CAPTURED, {255, 254}, 2},
+    };
+
+    for (size_t i = 0; i < sizeof(tests) / sizeof(*tests); i++) {
+        struct instruction_buf ins = {0};
+        code_make(&ins, tests[i].op, tests[i].operands[0], tests[i].operands[1]);
+        const struct opcode_definition* def = opcode_lookup(ins.ptr[0]);
+        size_t operands[2] = {0};
+        size_t n = code_read_operands(def, ins.ptr + 1, operands);
+        BUF_FREE(ins);
+
+        TEST_ASSERT(
+            state,
+            n == tests[i].bytes_read,
+            NO_CLEANUP,
+            "n wrong. want=%zu, got=%zu",
+            tests[i].bytes_read,
+            n
+        );
+        for (size_t j = 0; j < def->operand_count; j++) {
+            TEST_ASSERT(
+                state,
+                operands[j] == tests[i].operands[j],
+                NO_CLEANUP,
+                "operand wrong. want=%zu, got=%zu",
+                tests[i].operands[j],
+                operands[j]
+            );
+        }
+    }
+
+    PASS();
+}
+
+SUITE_FUNC(state, code) {
+    RUN_TEST0(state, make, STRING_REF("code_make()"));
+    RUN_TEST0(state, instructions_string, STRING_REF("code_instructions_string()"));
+    RUN_TEST0(state, read_operands, STRING_REF("code_read_operands()"));
+}
@@ -0,0 +1,220 @@
+#include "monkey/test/compiler.h"
+
+#include <iso646.h>
+
+#include "monkey/compiler.h"
+#include "monkey/test/framework.h"
+
+#define S(x) STRING_REF(x)
+
+// Appends the disassembly of `fn` followed by its constant pool. Compiled functions inspect as
+// an address, so nested functions are disassembled in braces instead.
+static void disassemble(struct string* out, struct compiled_function* fn) {
+    struct string code = code_instructions_string(fn->instructions);
+    string_append(out, code);
+    STRING_FREE(code);
+    for (size_t i = 0; i < fn->constants.len; i++) {
+        struct object* constant = fn->constants.ptr[i];
+        if (object_type(constant) == OBJECT_COMPILED_FUNCTION) {
+            string_append_printf(out, "%zu: fn {\n", i);
+            disassemble(out, ((struct object_compiled_function*)constant)->fn);
+            string_append(out, STRING_REF("}\n"));
+        } else {
+            struct string inspected = object_inspect(constant);
+            string_append_printf(out, "%zu: " STRING_FMT "\n", i, STRING_ARG(inspected));
+            STRING_FREE(inspected);
+        }
+    }
+}
+
+static TEST_FUNC(state, compiler, struct string input, struct string expected) {
+    struct ast_program* program;
+    RUN_SUBTEST(state, parse, NO_CLEANUP, input, &program);
+    struct compiler c;
+    compiler_init(&c);
+    bool ok = compile(&c, &program->node);
+    ast_node_decref(&program->node);
+    TEST_ASSERT(
+        state,
+        ok,
+        CLEANUP(compiler_deinit(&c)),
+        "compiler error: " STRING_FMT,
+        STRING_ARG(c.errors.ptr[0])
+    );
+    struct bytecode bytecode = compiler_bytecode(&c);
+    compiler_deinit(&c);
+
+    struct string actual = {0};
+    disassemble(&actual, bytecode.main);
+    bytecode_free(bytecode);
+
+    TEST_ASSERT(
+        state,
+        STRING_EQUAL(actual, expected),
+        CLEANUP(STRING_FREE(actual)),
+        "wrong bytecode.\nwant=\n" STRING_FMT "got=\n" STRING_FMT,
+        STRING_ARG(expected),
+        STRING_ARG(actual)
+    );
+    STRING_FREE(actual);
+    PASS();
+}
+
+SUITE_FUNC(state, compiler) {
+    struct {
+        struct string input;
+        struct string expected;
+    } tests[] = {
+        {
+            S("1 + 2"),
+            S("0000 CONSTANT 0\n"
+              "0003 CONSTANT 1\n"
+              "0006 ADD\n"
+              "0007 RETURN_VALUE\n"
+              "0: 1\n"
+              "1: 2\n"),
+        },
+        {
+            S("if (true) { 10 }; 3333;"),
+            S("0000 TRUE\n"
+              "0001 JUMP_NOT_TRUTHY 10\n"
+              "0004 CONSTANT 0\n"
+              "0007 JUMP 11\n"
+              "0010 NULL\n"
+              "0011 POP\n"
+              "0012 CONSTANT 1\n"
+              "0015 RETURN_VALUE\n"
+              "0: 10\n"
+              "1: 3333\n"),
+        },
+        {
+            S("let one = 1; one;"),
+            S("0000 CONSTANT 0\n"
+              "0003 SET_GLOBAL 1\n"
+              "0006 GET_GLOBAL 1\n"
+              "0009 RETURN_VALUE\n"
+              "0: 1\n"
+              "1: one\n"),
+        },
+        {
+            S("fn(a) { let b = a; b }(1)"),
+            S("0000 CLOSURE 0\n"
+              "0003 CONSTANT 1\n"
+              "0006 CALL 1\n"
+              "0008 RETURN_VALUE\n"
+              "0: fn {\n"
+              "0000 GET_LOCAL 0\n"
+              "0002 SET_LOCAL 1\n"
+              "0004 GET_LOCAL 1\n"
+              "0006 RETURN_VALUE\n"
+              "}\n"
+              "1: 1\n"),
+        },
+        {
+            // the captured parameter moves to the environment the closure shares
+            S("fn(a) { fn(b) { a + b } }"),
+            S("0000 CLOSURE 0\n"
+              "0003 RETURN_VALUE\n"
+              "0: fn {\n"
+              "0000 GET_LOCAL 0\n"
+              "0002 SET_CAPTURED 0\n"
+              "0004 CLOSURE 0\n"
+              "0007 RETURN_VALUE\n"
+              "0: fn {\n"
+              "0000 GET_CAPTURED 0 0\n"
+              "0003 GET_LOCAL 0\n"
+              "0005 ADD\n"
+              "0006 RETURN_VALUE\n"
+              "}\n"
+              "}\n"),
+        },
+        {
+            // rebinding `y` after the closure is made changes what the closure sees
+            S("fn() { let y = 1; let g = fn() { y }; let y = 2; g() }"),
+            S("0000 CLOSURE 0\n"
+              "0003 RETURN_VALUE\n"
+              "0: fn {\n"
+              "0000 CONSTANT 0\n"
+              "0003 SET_CAPTURED 0\n"
+              "0005 CLOSURE 1\n"
+              "0008 SET_LOCAL 1\n"
+              "0010 CONSTANT 2\n"
+              "0013 SET_CAPTURED 0\n"
+              "0015 GET_LOCAL 1\n"
+              "0017 CALL 0\n"
+              "0019 RETURN_VALUE\n"
+              "0: 1\n"
+              "1: fn {\n"
+              "0000 GET_CAPTURED 0 0\n"
+              "0003 RETURN_VALUE\n"
+              "}\n"
+              "2: 2\n"
+              "}\n"),
+        },
+        {
+            // the last of the repeated parameters is the one bound
+            S("fn(x, x) { x }"),
+            S("0000 CLOSURE 0\n"
+              "0003 RETURN_VALUE\n"
+              "0: fn {\n"
+              "0000 GET_LOCAL 1\n"
+              "0002 SET_LOCAL 0\n"
+              "0004 GET_LOCAL 0\n"
+              "0006 RETURN_VALUE\n"
+              "}\n"),
+        },
+        {
+            // globals are looked up by name, so rebinding `f` is seen by its own calls
+            S("let f = fn() { f() };"),
+            S("0000 CLOSURE 0\n"
+              "0003 SET_GLOBAL 1\n"
+              "0006 RETURN\n"
+              "0: fn {\n"
+              "0000 GET_GLOBAL 0\n"
+              "0003 CALL 0\n"
+              "0005 RETURN_VALUE\n"
+              "0: f\n"
+              "}\n"
+              "1: f\n"),
+        },
+        {
+            S("let g = 1; fn() { g + 2 }"),
+            S("0000 CONSTANT 0\n"
+              "0003 SET_GLOBAL 1\n"
+              "0006 CLOSURE 2\n"
+              "0009 RETURN_VALUE\n"
+              "0: 1\n"
+              "1: g\n"
+              "2: fn {\n"
+              "0000 GET_GLOBAL 0\n"
+              "0003 CONSTANT 1\n"
+              "0006 ADD\n"
+              "0007 RETURN_VALUE\n"
+              "0: g\n"
+              "1: 2\n"
+              "}\n"),
+        },
+        {
+            S("[if (true) { return 5; 6 } else { 0 }]"),
+            S("0000 TRUE\n"
+              "0001 JUMP_NOT_TRUTHY 20\n"
+              "0004 CONSTANT 0\n"
+              "0007 WRAP_RETURN\n"
+              "0008 JUMP 26\n"
+              "0011 CONSTANT 1\n"
+              "0014 JUMP_RETURNED 26\n"
+              "0017 JUMP 26\n"
+              "0020 CONSTANT 2\n"
+              "0023 JUMP_RETURNED 26\n"
+              "0026 ARRAY 1\n"
+              "0029 RETURN_VALUE\n"
+              "0: 5\n"
+              "1: 6\n"
+              "2: 0\n"),
+        },
+    };
+
+    for (size_t i = 0; i < sizeof(tests) / sizeof(*tests); i++) {
+        RUN_TEST(state, compiler, string_dup(tests[i].input), tests[i].input, tests[i].expected);
+    }
+}
@@ -3,24 +3,31 @@
 #include <inttypes.h>
 #include <iso646.h>
 
+#include "monkey/engine.h"
 #include "monkey/evaluator.h"
+#include "monkey/jit.h"
 #include "monkey/lexer.h"
 #include "monkey/object.h"
+#include "monkey/optimizer.h"
 #include "monkey/parser.h"
+#include "monkey/stack_evaluator.h"
 #include "monkey/test/value.h"
 
 #define S(x) STRING_REF(x)
 
+// every test in this suite runs once per engine
+static enum engine engine;
+
 static struct string show_obj_type(struct object* obj) {
     if (obj == NULL) return S("<NULL>");
-    switch (obj->type) {
+    switch (object_type(obj)) {
         case OBJECT_ERROR:
             return string_printf(
                 "ERROR: " STRING_FMT,
                 STRING_ARG(((struct object_error*)obj)->message)
             );
         default:
-            return object_type_string(obj->type);
+            return object_type_string(object_type(obj));
     }
 }
 
@@ -30,11 +37,10 @@ static struct object* test_eval(struct string input) {
     struct parser p;
     parser_init(&p, &l);
     struct ast_program* program = parse_program(&p);
-    struct environment env;
-    environment_init(&env);
+    struct environment* env = environment_new();
 
-    struct object* result = eval(&program->node, &env);
-    environment_free(env);
+    struct object* result = engine_eval(engine, &program->node, env);
+    environment_decref(env);
     ast_node_decref(&program->node);
     return result;
 }
@@ -43,19 +49,19 @@ static SUBTEST_FUNC(state, integer_object, struct object* evaluated, int64_t exp
     struct string type = show_obj_type(evaluated);
     TEST_ASSERT(
         state,
-        evaluated and evaluated->type == OBJECT_INTEGER,
+        evaluated and object_type(evaluated) == OBJECT_INTEGER,
         CLEANUP(STRING_FREE(type)),
         "object is not integer. got=" STRING_FMT,
         STRING_ARG(type)
     );
     STRING_FREE(type);
-    struct object_int64* int_obj = (struct object_int64*)evaluated;
+    int64_t value = object_int64_value(evaluated);
     TEST_ASSERT(
         state,
-        int_obj->value == expected,
+        value == expected,
         NO_CLEANUP,
         "object has wrong value. got=%" PRId64 ", want=%" PRId64,
-        int_obj->value,
+        value,
         expected
     );
 
@@ -66,19 +72,19 @@ static SUBTEST_FUNC(state, boolean_object, struct object* evaluated, bool expect
     struct string type = show_obj_type(evaluated);
     TEST_ASSERT(
         state,
-        evaluated and evaluated->type == OBJECT_BOOLEAN,
+        evaluated and object_type(evaluated) == OBJECT_BOOLEAN,
         CLEANUP(STRING_FREE(type)),
         "object is not boolean. got=" STRING_FMT,
         STRING_ARG(type)
     );
     STRING_FREE(type);
-    struct object_boolean* bool_obj = (struct object_boolean*)evaluated;
+    bool value = object_boolean_value(evaluated);
     TEST_ASSERT(
         state,
-        bool_obj->value == expected,
+        value == expected,
         NO_CLEANUP,
         "object has wrong value. got=%s, want=%s",
-        bool_obj->value ? "true" : "false",
+        value ? "true" : "false",
         expected ? "true" : "false"
     );
 
@@ -89,7 +95,7 @@ static SUBTEST_FUNC(state, null_object, struct object* evaluated) {
     struct string type = show_obj_type(evaluated);
     TEST_ASSERT(
         state,
-        evaluated and evaluated->type == OBJECT_NULL,
+        evaluated and object_type(evaluated) == OBJECT_NULL,
         CLEANUP(STRING_FREE(type)),
         "object is not null. got=" STRING_FMT,
         STRING_ARG(type)
@@ -98,17 +104,45 @@ static SUBTEST_FUNC(state, null_object, struct object* evaluated) {
     PASS();
 }
 
+// Evaluates each program in turn against one environment, like successive REPL lines, and checks
+// the value of the last one.
+static TEST_FUNC(state, session, struct string first, struct string second, int64_t expected) {
+    struct environment* env = environment_new();
+    struct string inputs[] = {first, second};
+    struct object* value = NULL;
+    for (size_t i = 0; i < sizeof(inputs) / sizeof(*inputs); i++) {
+        struct lexer l;
+        lexer_init(&l, inputs[i]);
+        struct parser p;
+        parser_init(&p, &l);
+        struct ast_program* program = parse_program(&p);
+        object_decref(value);
+        value = engine_eval(engine, &program->node, env);
+        ast_node_decref(&program->node);
+    }
+    RUN_SUBTEST(
+        state,
+        integer_object,
+        CLEANUP(object_decref(value); environment_decref(env)),
+        value,
+        expected
+    );
+    object_decref(value);
+    environment_decref(env);
+    PASS();
+}
+
 static TEST_FUNC(state, integer_expression, struct string input, int64_t expected) {
     struct object* evaluated = test_eval(input);
-    RUN_SUBTEST(state, integer_object, CLEANUP(object_free(evaluated)), evaluated, expected);
-    object_free(evaluated);
+    RUN_SUBTEST(state, integer_object, CLEANUP(object_decref(evaluated)), evaluated, expected);
+    object_decref(evaluated);
     PASS();
 }
 
 static TEST_FUNC(state, boolean_expression, struct string input, bool expected) {
     struct object* evaluated = test_eval(input);
-    RUN_SUBTEST(state, boolean_object, CLEANUP(object_free(evaluated)), evaluated, expected);
-    object_free(evaluated);
+    RUN_SUBTEST(state, boolean_object, CLEANUP(object_decref(evaluated)), evaluated, expected);
+    object_decref(evaluated);
     PASS();
 }
 
@@ -116,7 +150,7 @@ static SUBTEST_FUNC(state, error, struct object* evaluated, struct string expect
     struct string type = show_obj_type(evaluated);
     TEST_ASSERT(
         state,
-        evaluated and evaluated->type == OBJECT_ERROR,
+        evaluated and object_type(evaluated) == OBJECT_ERROR,
         CLEANUP(STRING_FREE(type)),
         "object is not error. got=" STRING_FMT,
         STRING_ARG(type)
@@ -141,13 +175,13 @@ static TEST_FUNC(state, object, struct string input, struct test_value expected)
     struct object* evaluated = test_eval(input);
     switch (expected.type) {
         case TEST_VALUE_NULL:
-            RUN_SUBTEST(state, null_object, CLEANUP(object_free(evaluated)), evaluated);
+            RUN_SUBTEST(state, null_object, CLEANUP(object_decref(evaluated)), evaluated);
             break;
         case TEST_VALUE_INT64:
             RUN_SUBTEST(
                 state,
                 integer_object,
-                CLEANUP(object_free(evaluated)),
+                CLEANUP(object_decref(evaluated)),
                 evaluated,
                 expected.int64
             );
@@ -156,28 +190,43 @@ static TEST_FUNC(state, object, struct string input, struct test_value expected)
             RUN_SUBTEST(
                 state,
                 boolean_object,
-                CLEANUP(object_free(evaluated)),
+                CLEANUP(object_decref(evaluated)),
                 evaluated,
                 expected.boolean
             );
             break;
         case TEST_VALUE_ERROR:
-            RUN_SUBTEST(state, error, CLEANUP(object_free(evaluated)), evaluated, expected.string);
+            RUN_SUBTEST(state, error, CLEANUP(object_decref(evaluated)), evaluated, expected.string);
             break;
         case TEST_VALUE_STRING:
             // [TODO] implement string object checking
-            FAIL(state, CLEANUP(object_free(evaluated)), "string object checking not implemented");
+            FAIL(state, CLEANUP(object_decref(evaluated)), "string object checking not implemented");
     }
-    object_free(evaluated);
+    object_decref(evaluated);
     PASS();
 }
 
 static TEST_FUNC(state, error, struct string input, struct string expected_message) {
     struct object* evaluated = test_eval(input);
 
-    RUN_SUBTEST(state, error, CLEANUP(object_free(evaluated)), evaluated, expected_message);
+    RUN_SUBTEST(state, error, CLEANUP(object_decref(evaluated)), evaluated, expected_message);
 
-    object_free(evaluated);
+    object_decref(evaluated);
+    PASS();
+}
+
+// Builtins are immortal, and the same object in every environment.
+static TEST_FUNC0(state, shared_builtins) {
+    struct object* first = test_eval(S("len"));
+    struct object* second = test_eval(S("len"));
+    TEST_ASSERT(
+        state,
+        first != NULL and object_type(first) == OBJECT_BUILTIN and first == second,
+        CLEANUP(object_decref(first); object_decref(second)),
+        "builtins differ between environments"
+    );
+    object_decref(first);
+    object_decref(second);
     PASS();
 }
 
@@ -188,46 +237,56 @@ static TEST_FUNC0(state, function_object) {
     struct string type = show_obj_type(evaluated);
     TEST_ASSERT(
         state,
-        evaluated and evaluated->type == OBJECT_FUNCTION,
-        CLEANUP(STRING_FREE(type); object_free(evaluated)),
+        evaluated and (object_type(evaluated) == OBJECT_FUNCTION or object_type(evaluated) == OBJECT_CLOSURE),
+        CLEANUP(STRING_FREE(type); object_decref(evaluated)),
         "object is not function. got=" STRING_FMT,
         STRING_ARG(type)
     );
     STRING_FREE(type);
 
-    struct object_function* function = (struct object_function*)evaluated;
+    struct function_parameter_buf parameters;
+    struct ast_block_statement* body;
+    if (object_type(evaluated) == OBJECT_FUNCTION) {
+        struct object_function* function = (struct object_function*)evaluated;
+        parameters = function->parameters;
+        body = function->body;
+    } else {
+        struct object_closure* closure = (struct object_closure*)evaluated;
+        parameters = closure->fn->literal->parameters;
+        body = closure->fn->literal->body;
+    }
 
     TEST_ASSERT(
         state,
-        function->parameters.len == 1,
-        CLEANUP(object_free(evaluated)),
+        parameters.len == 1,
+        CLEANUP(object_decref(evaluated)),
         "function has wrong parameters. Parameters=%zu",
-        function->parameters.len
+        parameters.len
     );
 
-    struct string param_str = ast_expression_string(&function->parameters.ptr[0]->expression);
+    struct string param_str = ast_expression_string(&parameters.ptr[0]->expression);
     TEST_ASSERT(
         state,
         STRING_EQUAL(param_str, S("x")),
-        CLEANUP(STRING_FREE(param_str); object_free(evaluated)),
+        CLEANUP(STRING_FREE(param_str); object_decref(evaluated)),
         "parameter is not 'x'. got=\"" STRING_FMT "\"",
         STRING_ARG(param_str)
     );
     STRING_FREE(param_str);
 
-    struct string body_str = ast_statement_string(&function->body->statement);
+    struct string body_str = ast_statement_string(&body->statement);
     struct string expected_body = S("(x + 2)");
     TEST_ASSERT(
         state,
         STRING_EQUAL(body_str, expected_body),
-        CLEANUP(STRING_FREE(body_str); object_free(evaluated)),
+        CLEANUP(STRING_FREE(body_str); object_decref(evaluated)),
         "body is not \"" STRING_FMT "\". got=\"" STRING_FMT "\"",
         STRING_ARG(expected_body),
         STRING_ARG(body_str)
     );
     STRING_FREE(body_str);
 
-    object_free(evaluated);
+    object_decref(evaluated);
     PASS();
 }
 
@@ -237,8 +296,8 @@ static TEST_FUNC(state, string_literal, struct string input, struct string expec
     struct string type = show_obj_type(evaluated);
     TEST_ASSERT(
         state,
-        evaluated and evaluated->type == OBJECT_STRING,
-        CLEANUP(STRING_FREE(type); object_free(evaluated)),
+        evaluated and object_type(evaluated) == OBJECT_STRING,
+        CLEANUP(STRING_FREE(type); object_decref(evaluated)),
         "object is not string. got=" STRING_FMT,
         STRING_ARG(type)
     );
@@ -249,13 +308,29 @@ static TEST_FUNC(state, string_literal, struct string input, struct string expec
     TEST_ASSERT(
         state,
         STRING_EQUAL(string->value, expected),
-        CLEANUP(object_free(evaluated)),
+        CLEANUP(object_decref(evaluated)),
         "string has wrong value. expected=\"" STRING_FMT "\", got=\"" STRING_FMT "\"",
         STRING_ARG(expected),
         STRING_ARG(string->value)
     );
 
-    object_free(evaluated);
+    object_decref(evaluated);
+    PASS();
+}
+
+static TEST_FUNC(state, inspected, struct string input, struct string expected) {
+    struct object* evaluated = test_eval(input);
+    struct string inspected = object_inspect(evaluated);
+    TEST_ASSERT(
+        state,
+        STRING_EQUAL(inspected, expected),
+        CLEANUP(STRING_FREE(inspected); object_decref(evaluated)),
+        "wrong value. expected=\"" STRING_FMT "\", got=\"" STRING_FMT "\"",
+        STRING_ARG(expected),
+        STRING_ARG(inspected)
+    );
+    STRING_FREE(inspected);
+    object_decref(evaluated);
     PASS();
 }
 
@@ -266,8 +341,8 @@ static TEST_FUNC0(state, array_literals) {
     struct string type = show_obj_type(evaluated);
     TEST_ASSERT(
         state,
-        evaluated and evaluated->type == OBJECT_ARRAY,
-        CLEANUP(STRING_FREE(type); object_free(evaluated)),
+        evaluated and object_type(evaluated) == OBJECT_ARRAY,
+        CLEANUP(STRING_FREE(type); object_decref(evaluated)),
         "object is not array. got=" STRING_FMT,
         STRING_ARG(type)
     );
@@ -278,16 +353,16 @@ static TEST_FUNC0(state, array_literals) {
     TEST_ASSERT(
         state,
         array->elements.len == 3,
-        CLEANUP(object_free(evaluated)),
+        CLEANUP(object_decref(evaluated)),
         "array has wrong number of elements. got=%zu",
         array->elements.len
     );
 
-    RUN_SUBTEST(state, integer_object, CLEANUP(object_free(evaluated)), array->elements.ptr[0], 1);
-    RUN_SUBTEST(state, integer_object, CLEANUP(object_free(evaluated)), array->elements.ptr[1], 4);
-    RUN_SUBTEST(state, integer_object, CLEANUP(object_free(evaluated)), array->elements.ptr[2], 6);
+    RUN_SUBTEST(state, integer_object, CLEANUP(object_decref(evaluated)), array->elements.ptr[0], 1);
+    RUN_SUBTEST(state, integer_object, CLEANUP(object_decref(evaluated)), array->elements.ptr[1], 4);
+    RUN_SUBTEST(state, integer_object, CLEANUP(object_decref(evaluated)), array->elements.ptr[2], 6);
 
-    object_free(evaluated);
+    object_decref(evaluated);
     PASS();
 }
 
@@ -307,8 +382,8 @@ static TEST_FUNC0(state, hash_literals) {
     struct string type = show_obj_type(evaluated);
     TEST_ASSERT(
         state,
-        evaluated and evaluated->type == OBJECT_HASH,
-        CLEANUP(STRING_FREE(type); object_free(evaluated)),
+        evaluated and object_type(evaluated) == OBJECT_HASH,
+        CLEANUP(STRING_FREE(type); object_decref(evaluated)),
         "object is not hash. got=" STRING_FMT,
         STRING_ARG(type)
     );
@@ -319,7 +394,7 @@ static TEST_FUNC0(state, hash_literals) {
     TEST_ASSERT(
         state,
         hash->pairs.count == 6,
-        CLEANUP(object_free(evaluated)),
+        CLEANUP(object_decref(evaluated)),
         "hash has wrong number of pairs. got=%zu",
         hash->pairs.count
     );
@@ -339,22 +414,22 @@ static TEST_FUNC0(state, hash_literals) {
     struct object* temp;
     temp = object_string_init_base(S("one"));
     expected[0].key = object_hash_key(temp);
-    object_free(temp);
+    object_decref(temp);
     temp = object_string_init_base(S("two"));
     expected[1].key = object_hash_key(temp);
-    object_free(temp);
+    object_decref(temp);
     temp = object_string_init_base(S("three"));
     expected[2].key = object_hash_key(temp);
-    object_free(temp);
+    object_decref(temp);
     temp = object_int64_init_base(4);
     expected[3].key = object_hash_key(temp);
-    object_free(temp);
+    object_decref(temp);
     temp = object_boolean_init_base(true);
     expected[4].key = object_hash_key(temp);
-    object_free(temp);
+    object_decref(temp);
     temp = object_boolean_init_base(false);
     expected[5].key = object_hash_key(temp);
-    object_free(temp);
+    object_decref(temp);
 
     for (size_t i = 0; i < hash->pairs.buckets.len; ++i) {
         struct object_hash_bucket bucket = hash->pairs.buckets.ptr[i];
@@ -367,21 +442,51 @@ static TEST_FUNC0(state, hash_literals) {
                 RUN_SUBTEST(
                     state,
                     integer_object,
-                    CLEANUP(object_free(evaluated)),
+                    CLEANUP(object_decref(evaluated)),
                     bucket.value.value,
                     expected[j].value
                 );
             }
         }
 
-        TEST_ASSERT(state, found, CLEANUP(object_free(evaluated)), "unexpected key in hash");
+        TEST_ASSERT(state, found, CLEANUP(object_decref(evaluated)), "unexpected key in hash");
     }
 
-    object_free(evaluated);
+    object_decref(evaluated);
     PASS();
 }
 
-SUITE_FUNC(state, evaluator) {
+// `f`'s addition specializes to integers, then has to fall back when it sees strings. Versions of
+// `f` and `g` made for constant arguments would take over some of the calls, so none are made.
+static TEST_FUNC0(state, quickening) {
+    int level = optimizer_level();
+    optimizer_set_level(0);
+    struct quickening_stats before = quickening_stats();
+    struct object* evaluated = test_eval(
+        S("let f = fn(a, b) { a + b };"
+          "let g = fn(n) { if (n == 0) { 0 } else { f(n, 1); g(n - 1) } };"
+          "g(10);"
+          "len(f(\"a\", \"b\")) + f(1, 2)")
+    );
+    struct quickening_stats after = quickening_stats();
+    optimizer_set_level(level);
+    RUN_SUBTEST(state, integer_object, CLEANUP(object_decref(evaluated)), evaluated, 5);
+    object_decref(evaluated);
+
+    TEST_ASSERT(
+        state,
+        after.hits - before.hits >= 10 and after.misses - before.misses >= 1 and
+            after.deoptimizations - before.deoptimizations >= 1,
+        NO_CLEANUP,
+        "wrong quickening stats. got hits=%zu, misses=%zu, deoptimizations=%zu",
+        after.hits - before.hits,
+        after.misses - before.misses,
+        after.deoptimizations - before.deoptimizations
+    );
+    PASS();
+}
+
+static void run_evaluator_tests(struct test_state* state) {
     struct {
         struct string input;
         int64_t expected;
@@ -439,6 +544,10 @@ SUITE_FUNC(state, evaluator) {
         {S("(1 < 2) == false"), false},
         {S("(1 > 2) == true"), false},
         {S("(1 > 2) == false"), true},
+        {S("1 == true"), false},
+        {S("true != 1"), true},
+        {S("if (false) { 1 } == if (false) { 2 }"), true},
+        {S("[1] == [1]"), false},
     };
     for (size_t i = 0; i < sizeof(boolean_expression_tests) / sizeof(*boolean_expression_tests);
          i++) {
@@ -519,6 +628,9 @@ SUITE_FUNC(state, evaluator) {
            "  return 1;\n"
            "}\n"),
          10},
+        {S("let f = fn(x) { if (x) { if (x) { return 1; } } return 2; }; f(true) * 10 + f(false)"),
+         12},
+        {S("let f = fn() { let a = 1; return a + 1; a }; f() + f()"), 4},
     };
     for (size_t i = 0; i < sizeof(return_statement_tests) / sizeof(*return_statement_tests); i++) {
         RUN_TEST(
@@ -552,6 +664,10 @@ SUITE_FUNC(state, evaluator) {
          S("unknown operator: BOOLEAN + BOOLEAN")},
         {S("foobar"), S("identifier not found: foobar")},
         {S("\"Hello\" - \"World\""), S("unknown operator: STRING - STRING")},
+        {S("let f = fn(x, y) { x }; f(1, f(2, -true))"), S("unknown operator: -BOOLEAN")},
+        {S("fn(x) { x }(1, 2)"), S("wrong number of arguments: expected 1, got 2")},
+        {S("len(fn(x) { x })"), S("argument to `len` not supported, got FUNCTION")},
+        {S("let f = fn() { 1 }; f + 1"), S("type mismatch: FUNCTION + INTEGER")},
     };
     for (size_t i = 0; i < sizeof(error_handling_tests) / sizeof(*error_handling_tests); i++) {
         RUN_TEST(
@@ -600,6 +716,8 @@ SUITE_FUNC(state, evaluator) {
         {S("let add = fn(x, y) { x + y; }; add(5, 5);"), 10},
         {S("let add = fn(x, y) { x + y; }; add(5 + 5, add(5, 5));"), 20},
         {S("fn(x) { x; }(5)"), 5},
+        {S("let sub = fn(x, y) { x - y }; sub(sub(10, 3), sub(4, 2))"), 5},
+        {S("let k = fn(x, y) { fn() { x * y } }; k(k(2, 3)(), 4)()"), 24},
     };
     for (size_t i = 0; i < sizeof(function_application_tests) / sizeof(*function_application_tests);
          i++) {
@@ -623,6 +741,136 @@ SUITE_FUNC(state, evaluator) {
           "addTwo(2);\n");
     RUN_TEST(state, integer_expression, S("closure"), closure_input, 4);
 
+    // closures share the variables they capture, so they see them rebound after they're made
+    struct {
+        struct string input;
+        int64_t expected;
+    } captured_rebinding_tests[] = {
+        {S("let f = fn() { let y = 1; let g = fn() { y }; let y = 2; g() }; f()"), 2},
+        {S("let k = fn(a, b) { let x = a; let h = fn() { x + b }; let x = 100; h() }; k(1, 2)"),
+         102},
+        {S("let f = fn(x) { let g = fn() { x }; let x = x * 10; g() }; f(2)"), 20},
+        {S("let f = fn() { let g = fn() { y }; let y = 3; g() }; f()"), 3},
+        {S("let f = fn() { let y = 1; let g = fn() { y }; let y = 2; g }; f()()"), 2},
+        {S("let f = fn() { let y = 1; let g = fn() { fn() { y } }; let y = 5; g()() }; f()"), 5},
+        {S("let f = fn(x, x) { x }; f(1, 2)"), 2},
+    };
+    int level = optimizer_level();
+    for (int l = 0; l <= OPTIMIZER_MAX_LEVEL; l++) {
+        optimizer_set_level(l);
+        for (size_t i = 0; i < sizeof(captured_rebinding_tests) / sizeof(*captured_rebinding_tests);
+             i++) {
+            RUN_TEST(
+                state,
+                integer_expression,
+                string_printf(
+                    "captured variable rebound at -O%d (\"" STRING_FMT "\")",
+                    l,
+                    STRING_ARG(captured_rebinding_tests[i].input)
+                ),
+                captured_rebinding_tests[i].input,
+                captured_rebinding_tests[i].expected
+            );
+        }
+    }
+
+    // a `return` in an `if` nested in an expression makes a wrapped value of the `if`, which ends
+    // the call only once it reaches a statement
+    struct {
+        struct string input;
+        struct string expected;
+    } nested_return_tests[] = {
+        {S("let f = fn() { [if (true) { return 5; } else { 0 }, 2] }; f()"), S("[5, 2]")},
+        {S("let id = fn(x) { x }; let f = fn() { id(if (true) { return 5; } else { 0 }) + 1 }; "
+           "f()"),
+         S("6")},
+        {S("let f = fn() { 1 + if (true) { return 5; } else { 0 } }; f()"),
+         S("ERROR: type mismatch: INTEGER + RETURN_VALUE")},
+        {S("let f = fn() { let x = if (true) { return 5; } else { 0 }; x; 7 }; f()"), S("5")},
+        {S("let f = fn() { [if (true) { let x = if (true) { return 1; } else { 0 }; x; 2 } "
+           "else { 3 }] }; f()"),
+         S("[1]")},
+        {S("let f = fn() { [if (true) { if (true) { return 4; } 9 } else { 3 }, 1] }; f()"),
+         S("[4, 1]")},
+        {S("let f = fn() { [if (true) { return if (false) { 1 } else { return 8; }; } else { 3 }] "
+           "}; f()"),
+         S("[8]")},
+    };
+    for (int l = 0; l <= OPTIMIZER_MAX_LEVEL; l++) {
+        optimizer_set_level(l);
+        for (size_t i = 0; i < sizeof(nested_return_tests) / sizeof(*nested_return_tests); i++) {
+            RUN_TEST(
+                state,
+                inspected,
+                string_printf(
+                    "nested return at -O%d (\"" STRING_FMT "\")",
+                    l,
+                    STRING_ARG(nested_return_tests[i].input)
+                ),
+                nested_return_tests[i].input,
+                nested_return_tests[i].expected
+            );
+        }
+    }
+
+    // however the optimizer rewrites a function's body, the function prints as written
+    struct {
+        struct string input;
+        struct string expected;
+    } written_function_tests[] = {
+        {S("let k = fn(x) { let add = fn(a, b) { a + b }; let y = len(x) + len(x); add(y, 1) }; k"),
+         S("fn(x) {\nlet add = fn(a, b) (a + b);let y = (len(x) + len(x));add(y, 1)\n}")},
+        {S("let mk = fn(a) { fn(b) { a + 2 * 3 + b } }; mk(1)"),
+         S("fn(b) {\n((a + (2 * 3)) + b)\n}")},
+        {S("let g = fn(k) { let f = fn(n, k) { if (n > len(k)) { n } else { f(n + 1, k) } }; f }; "
+           "g(\"abc\")"),
+         S("fn(n, k) {\nif(n > len(k)) n else f((n + 1), k)\n}")},
+    };
+    for (int l = 0; l <= OPTIMIZER_MAX_LEVEL; l++) {
+        optimizer_set_level(l);
+        for (size_t i = 0; i < sizeof(written_function_tests) / sizeof(*written_function_tests);
+             i++) {
+            RUN_TEST(
+                state,
+                inspected,
+                string_printf(
+                    "function as written at -O%d (\"" STRING_FMT "\")",
+                    l,
+                    STRING_ARG(written_function_tests[i].input)
+                ),
+                written_function_tests[i].input,
+                written_function_tests[i].expected
+            );
+        }
+    }
+    optimizer_set_level(level);
+
+    // deep enough to overflow the C stack unless tail calls run in their caller's frame
+    struct {
+        struct string input;
+        int64_t expected;
+    } tail_call_tests[] = {
+        {S("let f = fn(n, acc) { if (n == 0) { acc } else { f(n - 1, acc + 1) } }; f(100000, 0)"),
+         100000},
+        {S("let f = fn(n) { if (n == 0) { return 7; } return f(n - 1); }; f(100000)"), 7},
+        {S("let even = fn(n) { if (n == 0) { 1 } else { odd(n - 1) } };"
+           "let odd = fn(n) { if (n == 0) { 0 } else { even(n - 1) } };"
+           "even(100001)"),
+         0},
+        {S("let f = fn(n, g) { if (n == 0) { g(0) } else { f(n - 1, fn(x) { x + n }) } };"
+           "f(100000, fn(x) { x })"),
+         1},
+    };
+    for (size_t i = 0; i < sizeof(tail_call_tests) / sizeof(*tail_call_tests); i++) {
+        RUN_TEST(
+            state,
+            integer_expression,
+            string_printf("tail call (\"" STRING_FMT "\")", STRING_ARG(tail_call_tests[i].input)),
+            tail_call_tests[i].input,
+            tail_call_tests[i].expected
+        );
+    }
+
     RUN_TEST(
         state,
         string_literal,
@@ -648,6 +896,8 @@ SUITE_FUNC(state, evaluator) {
         {S("len(1)"), test_value_error(S("argument to `len` not supported, got INTEGER"))},
         {S("len(\"one\", \"two\")"),
          test_value_error(S("wrong number of arguments. got=2, want=1"))},
+        {S("len(\"one\", -true)"), test_value_error(S("unknown operator: -BOOLEAN"))},
+        {S("let f = fn(a) { push(a, len(a)) }; last(f(f(f([]))))"), test_value_int64(2)},
     };
     for (size_t i = 0; i < sizeof(builtin_function_tests) / sizeof(*builtin_function_tests); i++) {
         RUN_TEST(
@@ -662,6 +912,8 @@ SUITE_FUNC(state, evaluator) {
         );
     }
 
+    RUN_TEST0(state, shared_builtins, S("shared builtins"));
+
     RUN_TEST0(state, array_literals, S("array literals"));
 
     struct {
@@ -695,4 +947,171 @@ SUITE_FUNC(state, evaluator) {
     }
 
     RUN_TEST0(state, hash_literals, S("hash literals"));
+
+    RUN_TEST(
+        state,
+        session,
+        S("closure across evaluations"),
+        S("let adder = fn(x) { fn(y) { x + y } }; let addTwo = adder(2);"),
+        S("addTwo(3)"),
+        5
+    );
+    RUN_TEST(
+        state,
+        session,
+        S("global rebound across evaluations"),
+        S("let x = 1; let f = fn() { x }; f()"),
+        S("let x = 2; f()"),
+        2
+    );
+    RUN_TEST(
+        state,
+        session,
+        S("global read after the globals grow"),
+        S("let x = 1; let f = fn() { x + len([]) }; f()"),
+        S("let a = 1; let b = 2; let c = 3; let d = 4; let e = 5; let g = 6; let h = 7; f()"),
+        1
+    );
+}
+
+SUITE_FUNC(state, evaluator) {
+    engine = ENGINE_TREE;
+    run_evaluator_tests(state);
+    RUN_TEST0(state, quickening, S("quickening"));
+}
+
+SUITE_FUNC(state, vm) {
+    engine = ENGINE_VM;
+    run_evaluator_tests(state);
+}
+
+SUITE_FUNC(state, stack) {
+    engine = ENGINE_STACK;
+    run_evaluator_tests(state);
+    RUN_TEST0(state, quickening, S("quickening"));
+
+    // far deeper than the C stack allows the tree evaluator
+    RUN_TEST(
+        state,
+        integer_expression,
+        S("deep recursion"),
+        S("let f = fn(n) { if (n == 0) { 0 } else { 1 + f(n - 1) } }; f(200000)"),
+        200000
+    );
+    stack_eval_set_budget(4096);
+    RUN_TEST(
+        state,
+        error,
+        S("stack budget"),
+        S("let f = fn(n) { if (n == 0) { 0 } else { 1 + f(n - 1) } }; f(1000)"),
+        S("stack overflow: evaluation needs more than 4096 bytes of stack")
+    );
+    stack_eval_set_budget(STACK_EVAL_DEFAULT_BUDGET);
+}
+
+SUITE_FUNC(state, thunk) {
+    engine = ENGINE_THUNK;
+    run_evaluator_tests(state);
+    RUN_TEST0(state, quickening, S("quickening"));
+}
+
+static TEST_FUNC(state, jit_compiled, struct jit_stats before) {
+#if defined(__x86_64__) and defined(__linux__)
+    TEST_ASSERT(
+        state,
+        jit_stats().compiled > before.compiled,
+        NO_CLEANUP,
+        "no function was compiled"
+    );
+    PASS();
+#else
+    (void)before;
+    SKIP();
+#endif
+}
+
+// The tree evaluator again, with every function compiled on its first call.
+SUITE_FUNC(state, jit) {
+    engine = ENGINE_TREE;
+    jit_set_threshold(0);
+    struct jit_stats before = jit_stats();
+    run_evaluator_tests(state);
+
+    // results that leave the immediate range take the slow path
+    struct {
+        struct string input;
+        int64_t expected;
+    } overflow_tests[] = {
+        {S("let f = fn(a, b) { a + b }; f(4611686018427387903, 1)"), 4611686018427387904},
+        {S("let f = fn(a, b) { a - b }; f(-4611686018427387904, 1)"), -4611686018427387905},
+        {S("let f = fn(a, b) { a * b }; f(4611686018427387903, 2)"), 9223372036854775806},
+        {S("let f = fn(a, b) { if (a < b) { 1 } else { 0 } }; f(1, 4611686018427387904)"), 1},
+    };
+    for (size_t i = 0; i < sizeof(overflow_tests) / sizeof(*overflow_tests); i++) {
+        RUN_TEST(
+            state,
+            integer_expression,
+            string_dup(overflow_tests[i].input),
+            overflow_tests[i].input,
+            overflow_tests[i].expected
+        );
+    }
+
+    // reads and writes of globals and captured variables, and calls made from compiled code; the
+    // arguments aren't literals, which would have the calls go to versions made for them, and a
+    // callee compiled on its first call is called directly after that
+    struct {
+        struct string input;
+        int64_t expected;
+    } variable_tests[] = {
+        {S("let fib = fn(n) { if (n < 2) { n } else { fib(n - 1) + fib(n - 2) } }; let ten = 10; "
+           "fib(ten)"),
+         55},
+        {S("let f = fn(x) { x * 2 }; let g = fn(a) { f(a) + f(a) }; let one = 1; let r = g(one); "
+           "let f = fn(x) { x * 3 }; r + g(one)"),
+         10},
+        {S("let mk = fn(n) { let k = n + 1; let get = fn() { k }; let k = k * 10; get() }; "
+           "let one = 1; mk(one) + mk(one)"),
+         40},
+        {S("let f = fn(x, x) { x }; let g = fn(a, b) { f(a, b) + f(a, b) }; let one = 1; "
+           "let two = 2; g(one, two)"),
+         4},
+        {S("let g = fn(a) { len(a) + len(a) }; let a = [1, 2, 3]; g(a)"), 6},
+        {S("let adder = fn(a) { fn(b) { a + b } }; let g = fn(x) { adder(x)(x) + adder(x)(x) }; "
+           "let two = 2; g(two)"),
+         8},
+    };
+    for (size_t i = 0; i < sizeof(variable_tests) / sizeof(*variable_tests); i++) {
+        RUN_TEST(
+            state,
+            integer_expression,
+            string_dup(variable_tests[i].input),
+            variable_tests[i].input,
+            variable_tests[i].expected
+        );
+    }
+    RUN_TEST(
+        state,
+        integer_expression,
+        S("wrapped return value dropped by compiled code"),
+        S("let f = fn(x) { x; 7 }; let g = fn() { f(if (true) { return 5; } else { 0 }) }; g()"),
+        5
+    );
+    RUN_TEST(
+        state,
+        error,
+        S("wrong arity from compiled code"),
+        S("let f = fn(x) { x }; let g = fn(a) { f(a) + f(a, a) }; let one = 1; g(one)"),
+        S("wrong number of arguments: expected 1, got 2")
+    );
+    RUN_TEST(
+        state,
+        error,
+        S("error from a direct call"),
+        S("let f = fn(x) { if (x > 1) { x + true } else { x } }; "
+          "let g = fn(a) { f(a) + f(a + 1) }; let one = 1; g(one)"),
+        S("type mismatch: INTEGER + BOOLEAN")
+    );
+    RUN_TEST(state, jit_compiled, S("functions are compiled"), before);
+    jit_set_threshold(JIT_DEFAULT_THRESHOLD);
 }
@@ -0,0 +1,28 @@
+#include "monkey/test/framework.h"
+
+#include <monkey/lexer.h>
+#include <monkey/parser.h>
+
+SUBTEST_FUNC(state, parse, struct string input, struct ast_program** program) {
+    (void)state;
+    struct lexer l;
+    lexer_init(&l, input);
+    struct parser p;
+    parser_init(&p, &l);
+    *program = parse_program(&p);
+    if (p.errors.len == 0) {
+        parser_deinit(&p);
+        PASS();
+    }
+
+    struct string msg = string_printf("parser has %zu error(s)", p.errors.len);
+    for (size_t i = 0; i < p.errors.len; i++) {
+        struct string temp =
+            string_printf("\nparser error: \"" STRING_FMT "\"", STRING_ARG(p.errors.ptr[i]));
+        string_append(&msg, temp);
+        STRING_FREE(temp);
+    }
+    ast_node_decref(&(*program)->node);
+    parser_deinit(&p);
+    FAIL(state, CLEANUP(STRING_FREE(msg)), STRING_FMT, STRING_ARG(msg));
+}
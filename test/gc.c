@@ -0,0 +1,127 @@
+#include "monkey/test/gc.h"
+
+#include <iso646.h>
+#include <monkey/engine.h>
+#include <monkey/gc.h>
+
+#include "monkey/test/framework.h"
+
+static SUBTEST_FUNC(
+    state,
+    run,
+    struct string input,
+    struct environment* env,
+    struct object** result
+) {
+    struct ast_program* program;
+    RUN_SUBTEST(state, parse, NO_CLEANUP, input, &program);
+    *result = engine_eval(ENGINE_TREE, &program->node, env);
+    ast_node_decref(&program->node);
+    PASS();
+}
+
+static TEST_FUNC0(state, cycle) {
+    gc_collect();
+    size_t baseline = gc_stats().tracked;
+
+    // the function lives in the environment it closes over
+    struct environment* env = environment_new();
+    struct object* value;
+    RUN_SUBTEST(
+        state,
+        run,
+        CLEANUP(environment_decref(env)),
+        STRING_REF("let f = fn() { f };"),
+        env,
+        &value
+    );
+    object_decref(value);
+    environment_decref(env);
+    TEST_ASSERT(
+        state,
+        gc_stats().tracked > baseline,
+        NO_CLEANUP,
+        "the cycle should keep its members alive until a collection"
+    );
+
+    size_t collected = gc_collect();
+    TEST_ASSERT(
+        state,
+        collected >= 2 and gc_stats().tracked == baseline,
+        NO_CLEANUP,
+        "the cycle should be collected. collected=%zu tracked=%zu baseline=%zu",
+        collected,
+        gc_stats().tracked,
+        baseline
+    );
+    PASS();
+}
+
+static TEST_FUNC0(state, reachable) {
+    struct environment* env = environment_new();
+    struct object* value;
+    RUN_SUBTEST(
+        state,
+        run,
+        CLEANUP(environment_decref(env)),
+        STRING_REF("let xs = [1, 2]; let f = fn() { xs }; let g = fn() { g }; let h = [[f], g];"),
+        env,
+        &value
+    );
+    object_decref(value);
+    gc_collect();
+
+    RUN_SUBTEST(
+        state,
+        run,
+        CLEANUP(environment_decref(env)),
+        STRING_REF("h[0][0]()[1] + len(xs)"),
+        env,
+        &value
+    );
+    TEST_ASSERT(
+        state,
+        value != NULL and object_type(value) == OBJECT_INTEGER and
+            object_int64_value(value) == 4,
+        CLEANUP(object_decref(value); environment_decref(env)),
+        "objects reachable from a live environment should survive a collection"
+    );
+    object_decref(value);
+    environment_decref(env);
+    gc_collect();
+    PASS();
+}
+
+static void count_collections(const struct gc_stats* stats, void* data) {
+    *(size_t*)data = stats->collections;
+}
+
+static TEST_FUNC0(state, stats_callback) {
+    size_t reported = 0;
+    gc_set_stats_callback(count_collections, &reported);
+    gc_collect();
+    gc_set_stats_callback(NULL, NULL);
+
+    struct gc_stats stats = gc_stats();
+    TEST_ASSERT(
+        state,
+        reported > 0 and reported == stats.collections,
+        NO_CLEANUP,
+        "the callback should see the collection. reported=%zu collections=%zu",
+        reported,
+        stats.collections
+    );
+    TEST_ASSERT(
+        state,
+        stats.max_pause_ns >= stats.pause_ns and stats.total_pause_ns >= stats.max_pause_ns,
+        NO_CLEANUP,
+        "pause times are inconsistent"
+    );
+    PASS();
+}
+
+SUITE_FUNC(state, gc) {
+    RUN_TEST0(state, cycle, STRING_REF("reference cycle"));
+    RUN_TEST0(state, reachable, STRING_REF("reachable objects"));
+    RUN_TEST0(state, stats_callback, STRING_REF("stats callback"));
+}
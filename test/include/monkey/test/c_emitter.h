@@ -0,0 +1,8 @@
+#ifndef MONKEY_TEST_C_EMITTER_H_
+#define MONKEY_TEST_C_EMITTER_H_
+
+#include "monkey/test/framework.h"
+
+extern SUITE_FUNC(state, c_emitter);
+
+#endif  // MONKEY_TEST_C_EMITTER_H_
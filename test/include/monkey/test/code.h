@@ -0,0 +1,8 @@
+#ifndef MONKEY_TEST_CODE_H_
+#define MONKEY_TEST_CODE_H_
+
+#include "monkey/test/framework.h"
+
+extern SUITE_FUNC(state, code);
+
+#endif  // MONKEY_TEST_CODE_H_
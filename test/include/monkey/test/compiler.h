@@ -0,0 +1,8 @@
+#ifndef MONKEY_TEST_COMPILER_H_
+#define MONKEY_TEST_COMPILER_H_
+
+#include "monkey/test/framework.h"
+
+extern SUITE_FUNC(state, compiler);
+
+#endif  // MONKEY_TEST_COMPILER_H_
@@ -4,5 +4,9 @@
 #include "monkey/test/framework.h"
 
 extern SUITE_FUNC(state, evaluator);
+extern SUITE_FUNC(state, vm);
+extern SUITE_FUNC(state, stack);
+extern SUITE_FUNC(state, thunk);
+extern SUITE_FUNC(state, jit);
 
 #endif // MONKEY_TEST_EVALUATOR_H_
@@ -140,4 +140,10 @@ struct test_result {
 
 #define SKIP() return TEST_SKIP()
 
+struct ast_program;
+
+// Parses `input` into `*program`, failing with the parser's errors if it reports any, in which
+// case nothing is left to release.
+extern SUBTEST_FUNC(state, parse, struct string input, struct ast_program** program);
+
 #endif  // MONKEY_TEST_FRAMEWORK_H_
@@ -0,0 +1,8 @@
+#ifndef MONKEY_TEST_GC_H_
+#define MONKEY_TEST_GC_H_
+
+#include "monkey/test/framework.h"
+
+extern SUITE_FUNC(state, gc);
+
+#endif // MONKEY_TEST_GC_H_
@@ -0,0 +1,8 @@
+#ifndef MONKEY_TEST_INFERENCE_H_
+#define MONKEY_TEST_INFERENCE_H_
+
+#include "monkey/test/framework.h"
+
+extern SUITE_FUNC(state, inference);
+
+#endif  // MONKEY_TEST_INFERENCE_H_
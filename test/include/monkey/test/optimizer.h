@@ -0,0 +1,8 @@
+#ifndef MONKEY_TEST_OPTIMIZER_H_
+#define MONKEY_TEST_OPTIMIZER_H_
+
+#include "monkey/test/framework.h"
+
+extern SUITE_FUNC(state, optimizer);
+
+#endif  // MONKEY_TEST_OPTIMIZER_H_
@@ -0,0 +1,8 @@
+#ifndef MONKEY_TEST_RESOLVER_H_
+#define MONKEY_TEST_RESOLVER_H_
+
+#include "monkey/test/framework.h"
+
+extern SUITE_FUNC(state, resolver);
+
+#endif  // MONKEY_TEST_RESOLVER_H_
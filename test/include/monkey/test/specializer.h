@@ -0,0 +1,8 @@
+#ifndef MONKEY_TEST_SPECIALIZER_H_
+#define MONKEY_TEST_SPECIALIZER_H_
+
+#include "monkey/test/framework.h"
+
+extern SUITE_FUNC(state, specializer);
+
+#endif  // MONKEY_TEST_SPECIALIZER_H_
@@ -0,0 +1,155 @@
+#include "monkey/test/inference.h"
+
+#include <iso646.h>
+#include <monkey/engine.h>
+#include <monkey/inference.h>
+
+#include "monkey/test/framework.h"
+
+#define S(s) STRING_REF(s)
+
+static TEST_FUNC(state, types, struct string input, struct string expected) {
+    struct ast_program* program;
+    RUN_SUBTEST(state, parse, NO_CLEANUP, input, &program);
+    infer_types(program);
+    struct string actual = inferred_types_string(program);
+    ast_node_decref(&program->node);
+    TEST_ASSERT(
+        state,
+        STRING_EQUAL(actual, expected),
+        CLEANUP(STRING_FREE(actual)),
+        "expected=\"" STRING_FMT "\", got=\"" STRING_FMT "\"",
+        STRING_ARG(expected),
+        STRING_ARG(actual)
+    );
+    STRING_FREE(actual);
+    PASS();
+}
+
+// The first statement of `input` binds a function whose body is an infix expression.
+static struct ast_infix_expression* body_infix(struct ast_program* program) {
+    struct ast_let_statement* let = (struct ast_let_statement*)program->statements.ptr[0];
+    struct ast_function_literal* function = (struct ast_function_literal*)let->value;
+    struct ast_expression_statement* statement =
+        (struct ast_expression_statement*)function->body->statements.ptr[0];
+    return (struct ast_infix_expression*)statement->expression;
+}
+
+static TEST_FUNC(state, proven, struct string input, bool expected) {
+    struct ast_program* program;
+    RUN_SUBTEST(state, parse, NO_CLEANUP, input, &program);
+    infer_types(program);
+    bool actual = body_infix(program)->quickening.proven;
+    ast_node_decref(&program->node);
+    TEST_ASSERT(
+        state,
+        actual == expected,
+        NO_CLEANUP,
+        "expected proven=%d, got=%d",
+        expected,
+        actual
+    );
+    PASS();
+}
+
+// A call inference didn't see passes a string to a function proven to add integers.
+static TEST_FUNC(state, deoptimizes, enum engine engine) {
+    struct ast_program* program;
+    RUN_SUBTEST(
+        state,
+        parse,
+        NO_CLEANUP,
+        S("let dbl = fn(x) { x + x }; let apply = fn(f, v) { f(v) }; "
+          "let a = dbl(2); [a, apply(dbl, \"ab\"), dbl(3)]"),
+        &program
+    );
+    struct environment* env = environment_new();
+    struct object* result = engine_eval(engine, &program->node, env);
+    struct string actual = object_inspect(result);
+    bool proven = body_infix(program)->quickening.proven;
+    object_decref(result);
+    environment_decref(env);
+    ast_node_decref(&program->node);
+    TEST_ASSERT(
+        state,
+        STRING_EQUAL(actual, S("[4, abab, 6]")) and !proven,
+        CLEANUP(STRING_FREE(actual)),
+        "expected=\"[4, abab, 6]\" and no proof, got=\"" STRING_FMT "\" and proven=%d",
+        STRING_ARG(actual),
+        proven
+    );
+    STRING_FREE(actual);
+    PASS();
+}
+
+SUITE_FUNC(state, inference) {
+    struct {
+        struct string input;
+        struct string expected;
+    } types_tests[] = {
+        {S("let a = 1; let b = \"s\" + \"t\"; let c = [1]; let d = {}; let e = a"),
+         S("a: int\nb: string\nc: array\nd: hash\ne: any\n")},
+        {S("let f = fn(x, y) { x * y }; f(2, 3)"),
+         S("f: fn(int, int) -> int\n  x: int\n  y: int\n")},
+        {S("let f = fn(x) { x }; f(1); f(true)"), S("f: fn(any) -> any\n  x: any\n")},
+        // nothing is known about the arguments of functions no call is seen for
+        {S("let f = fn(x) { x + 1 }"), S("f: fn(any) -> any\n  x: any\n")},
+        {S("let f = fn(n) { let g = fn(m) { m < n }; let b = g(n); if (b) { 1 } else { 2 } }; "
+           "f(0)"),
+         S("f: fn(int) -> int\n  n: int\n  g: fn(int) -> bool\n    m: int\n  b: bool\n")},
+        {S("let f = fn(n) { if (n > 0) { return \"pos\"; } \"neg\" }; f(1)"),
+         S("f: fn(int) -> string\n  n: int\n")},
+        {S("let f = fn(n) { if (n > 0) { 1 } }; f(1)"), S("f: fn(int) -> any\n  n: int\n")},
+        // a let on a branch might not have run, leaving the name bound outside
+        {S("let f = fn(n) { if (n) { let v = 1; }; let w = v; w }; f(true)"),
+         S("f: fn(bool) -> any\n  n: bool\n  v: int\n  w: any\n")},
+        {S("let f = fn(n) { if (true) { let v = 1; }; let w = v; w }; f(true)"),
+         S("f: fn(bool) -> int\n  n: bool\n  v: int\n  w: int\n")},
+        // calls through globals only pass on their arguments, since the global can change
+        {S("let g = fn(a) { a }; let h = fn(b) { g(b) + 1 }; h(1)"),
+         S("g: fn(int) -> int\n  a: int\nh: fn(int) -> any\n  b: int\n")},
+        {S("fn() { let f = fn(n) { f(n) }; f(1) }"),
+         S("fn() -> none\n  f: fn(int) -> none\n    n: int\n")},
+        {S("fn(s) { s + s }(\"a\")"), S("fn(string) -> string\n  s: string\n")},
+    };
+    for (size_t i = 0; i < sizeof(types_tests) / sizeof(*types_tests); i++) {
+        RUN_TEST(
+            state,
+            types,
+            string_printf("types of \"" STRING_FMT "\"", STRING_ARG(types_tests[i].input)),
+            types_tests[i].input,
+            types_tests[i].expected
+        );
+    }
+
+    struct {
+        struct string input;
+        bool expected;
+    } proven_tests[] = {
+        {S("let f = fn(x) { x + 1 }; f(2)"), true},
+        {S("let f = fn(x) { x == true }; f(false)"), true},
+        {S("let f = fn(x) { x + x }; f(\"a\")"), true},
+        {S("let f = fn(x) { x + 1 }; f(2); f(\"a\")"), false},
+        {S("let f = fn(x) { x + 1 }"), false},
+        {S("let f = fn(x) { x == x }; f(\"a\")"), false},
+    };
+    for (size_t i = 0; i < sizeof(proven_tests) / sizeof(*proven_tests); i++) {
+        RUN_TEST(
+            state,
+            proven,
+            string_printf("proof of \"" STRING_FMT "\"", STRING_ARG(proven_tests[i].input)),
+            proven_tests[i].input,
+            proven_tests[i].expected
+        );
+    }
+
+    for (enum engine engine = ENGINE_TREE; engine <= ENGINE_THUNK; engine++) {
+        if (engine == ENGINE_VM) continue;
+        RUN_TEST(
+            state,
+            deoptimizes,
+            string_printf("deoptimizes on " STRING_FMT, STRING_ARG(engine_name(engine))),
+            engine
+        );
+    }
+}
@@ -1,11 +1,19 @@
 #include <inttypes.h>
 
 #include "monkey/test/ast.h"
+#include "monkey/test/c_emitter.h"
+#include "monkey/test/code.h"
+#include "monkey/test/compiler.h"
 #include "monkey/test/evaluator.h"
 #include "monkey/test/framework.h"
+#include "monkey/test/gc.h"
+#include "monkey/test/inference.h"
 #include "monkey/test/lexer.h"
 #include "monkey/test/object.h"
+#include "monkey/test/optimizer.h"
 #include "monkey/test/parser.h"
+#include "monkey/test/resolver.h"
+#include "monkey/test/specializer.h"
 
 int main(int argc, char** argv) {
     bool verbose = false;
@@ -20,10 +28,22 @@ int main(int argc, char** argv) {
     }
     struct test_state state = {.verbose = verbose};
     RUN_SUITE(&state, ast, STRING_REF("ast"));
+    RUN_SUITE(&state, c_emitter, STRING_REF("c_emitter"));
+    RUN_SUITE(&state, code, STRING_REF("code"));
+    RUN_SUITE(&state, compiler, STRING_REF("compiler"));
     RUN_SUITE(&state, evaluator, STRING_REF("evaluator"));
+    RUN_SUITE(&state, gc, STRING_REF("gc"));
+    RUN_SUITE(&state, inference, STRING_REF("inference"));
+    RUN_SUITE(&state, jit, STRING_REF("jit"));
     RUN_SUITE(&state, lexer, STRING_REF("lexer"));
     RUN_SUITE(&state, object, STRING_REF("object"));
+    RUN_SUITE(&state, optimizer, STRING_REF("optimizer"));
     RUN_SUITE(&state, parser, STRING_REF("parser"));
+    RUN_SUITE(&state, resolver, STRING_REF("resolver"));
+    RUN_SUITE(&state, specializer, STRING_REF("specializer"));
+    RUN_SUITE(&state, stack, STRING_REF("stack"));
+    RUN_SUITE(&state, thunk, STRING_REF("thunk"));
+    RUN_SUITE(&state, vm, STRING_REF("vm"));
 
     fprintf(
         stderr,
@@ -1,5 +1,6 @@
 #include "monkey/test/object.h"
 
+#include <inttypes.h>
 #include <monkey/object.h>
 
 #include "monkey/test/framework.h"
@@ -13,29 +14,210 @@ static TEST_FUNC0(state, hash_key) {
     TEST_ASSERT(
         state,
         object_hash_key_equal(object_hash_key(hello1), object_hash_key(hello2)),
-        CLEANUP(object_free(hello1); object_free(hello2); object_free(diff1); object_free(diff2)),
+        CLEANUP(object_decref(hello1); object_decref(hello2); object_decref(diff1); object_decref(diff2)),
         "strings with same content have different hash keys"
     );
     TEST_ASSERT(
         state,
         object_hash_key_equal(object_hash_key(diff1), object_hash_key(diff2)),
-        CLEANUP(object_free(hello1); object_free(hello2); object_free(diff1); object_free(diff2)),
+        CLEANUP(object_decref(hello1); object_decref(hello2); object_decref(diff1); object_decref(diff2)),
         "strings with same content have different hash keys"
     );
     TEST_ASSERT(
         state,
         !object_hash_key_equal(object_hash_key(hello1), object_hash_key(diff1)),
-        CLEANUP(object_free(hello1); object_free(hello2); object_free(diff1); object_free(diff2)),
+        CLEANUP(object_decref(hello1); object_decref(hello2); object_decref(diff1); object_decref(diff2)),
         "strings with different content have same hash keys"
     );
 
-    object_free(hello1);
-    object_free(hello2);
-    object_free(diff1);
-    object_free(diff2);
+    object_decref(hello1);
+    object_decref(hello2);
+    object_decref(diff1);
+    object_decref(diff2);
+    PASS();
+}
+
+static TEST_FUNC(state, integer_value, int64_t value, bool immediate) {
+    struct object* obj = object_int64_init_base(value);
+    TEST_ASSERT(
+        state,
+        object_type(obj) == OBJECT_INTEGER,
+        CLEANUP(object_decref(obj)),
+        "object is not integer"
+    );
+    TEST_ASSERT(
+        state,
+        object_is_immediate(obj) == immediate,
+        CLEANUP(object_decref(obj)),
+        "integer %" PRId64 " should %sbe immediate",
+        value,
+        immediate ? "" : "not "
+    );
+    TEST_ASSERT(
+        state,
+        object_int64_value(obj) == value,
+        CLEANUP(object_decref(obj)),
+        "integer has wrong value. got=%" PRId64 ", want=%" PRId64,
+        object_int64_value(obj),
+        value
+    );
+    struct object* copy = object_incref(obj);
+    TEST_ASSERT(
+        state,
+        object_hash_key_equal(object_hash_key(obj), object_hash_key(copy)),
+        CLEANUP(object_decref(obj); object_decref(copy)),
+        "copies of %" PRId64 " have different hash keys",
+        value
+    );
+    object_decref(copy);
+    object_decref(obj);
+    PASS();
+}
+
+static TEST_FUNC0(state, reference_counting) {
+    struct object_buf elements = {0};
+    BUF_PUSH(&elements, object_string_init_base(string_dup(STRING_REF("shared"))));
+    struct object* array = object_array_init_base(elements);
+
+    struct object* other = object_incref(array);
+    TEST_ASSERT(
+        state,
+        other == array and array->rc == 2,
+        CLEANUP(object_decref(array); object_decref(other)),
+        "incref should share the object. rc=%zu",
+        array->rc
+    );
+    object_decref(other);
+
+    struct object* element = object_incref(((struct object_array*)array)->elements.ptr[0]);
+    object_decref(array);
+    TEST_ASSERT(
+        state,
+        element->rc == 1,
+        CLEANUP(object_decref(element)),
+        "element should outlive its array. rc=%zu",
+        element->rc
+    );
+    object_decref(element);
+    PASS();
+}
+
+static TEST_FUNC0(state, alloc_stats) {
+    struct object_alloc_stats before = object_alloc_stats(OBJECT_STRING);
+    struct object* a = object_string_init_base(STRING_REF("a"));
+    struct object* b = object_string_init_base(STRING_REF("b"));
+    struct object_alloc_stats during = object_alloc_stats(OBJECT_STRING);
+    object_decref(a);
+    object_decref(b);
+    struct object_alloc_stats after = object_alloc_stats(OBJECT_STRING);
+    TEST_ASSERT(
+        state,
+        during.live == before.live + 2 and during.allocated == before.allocated + 2,
+        NO_CLEANUP,
+        "two strings should be live. live=%zu, was %zu",
+        during.live,
+        before.live
+    );
+    TEST_ASSERT(
+        state,
+        during.peak >= during.live,
+        NO_CLEANUP,
+        "peak is below live. peak=%zu, live=%zu",
+        during.peak,
+        during.live
+    );
+    TEST_ASSERT(
+        state,
+        after.live == before.live and after.peak == during.peak,
+        NO_CLEANUP,
+        "freed strings should no longer be live. live=%zu, was %zu",
+        after.live,
+        before.live
+    );
+
+    size_t integers = object_alloc_stats(OBJECT_INTEGER).allocated;
+    struct object* boxed = object_int64_init_base(INT64_MAX);
+    struct object* small = object_int64_init_base(1);
+    TEST_ASSERT(
+        state,
+        object_alloc_stats(OBJECT_INTEGER).allocated == integers + 1,
+        CLEANUP(object_decref(boxed); object_decref(small)),
+        "only the boxed integer should be allocated. allocated=%zu, was %zu",
+        object_alloc_stats(OBJECT_INTEGER).allocated,
+        integers
+    );
+    object_decref(boxed);
+    object_decref(small);
+    PASS();
+}
+
+static TEST_FUNC0(state, immediates) {
+    struct object* t = object_boolean_init_base(true);
+    struct object* f = object_boolean_init_base(false);
+    struct object* null = object_null_init_base();
+
+    TEST_ASSERT(
+        state,
+        object_type(t) == OBJECT_BOOLEAN and object_type(f) == OBJECT_BOOLEAN,
+        NO_CLEANUP,
+        "booleans have wrong type"
+    );
+    TEST_ASSERT(
+        state,
+        object_boolean_value(t) and !object_boolean_value(f),
+        NO_CLEANUP,
+        "booleans have wrong value"
+    );
+    TEST_ASSERT(state, object_type(null) == OBJECT_NULL, NO_CLEANUP, "null has wrong type");
+    TEST_ASSERT(state, !object_is_hashable(null), NO_CLEANUP, "null is hashable");
+    TEST_ASSERT(
+        state,
+        !object_hash_key_equal(object_hash_key(t), object_hash_key(f)),
+        NO_CLEANUP,
+        "true and false have the same hash key"
+    );
+    TEST_ASSERT(
+        state,
+        !object_hash_key_equal(object_hash_key(t), object_hash_key(object_int64_init_base(1))),
+        NO_CLEANUP,
+        "true and 1 have the same hash key"
+    );
+
+    struct string inspected = object_inspect(null);
+    TEST_ASSERT(
+        state,
+        STRING_EQUAL(inspected, STRING_REF("null")),
+        CLEANUP(STRING_FREE(inspected)),
+        "null inspects as " STRING_FMT,
+        STRING_ARG(inspected)
+    );
+    STRING_FREE(inspected);
     PASS();
 }
 
 SUITE_FUNC(state, object) {
     RUN_TEST0(state, hash_key, STRING_REF("hash_key()"));
+    struct {
+        int64_t value;
+        bool immediate;
+    } integer_tests[] = {
+        {0, true},
+        {-1, true},
+        {INT64_MAX / 2, true},
+        {INT64_MIN / 2, true},
+        {INT64_MAX, false},
+        {INT64_MIN, false},
+    };
+    for (size_t i = 0; i < sizeof(integer_tests) / sizeof(*integer_tests); i++) {
+        RUN_TEST(
+            state,
+            integer_value,
+            string_printf("integer %" PRId64, integer_tests[i].value),
+            integer_tests[i].value,
+            integer_tests[i].immediate
+        );
+    }
+    RUN_TEST0(state, immediates, STRING_REF("immediates"));
+    RUN_TEST0(state, reference_counting, STRING_REF("reference counting"));
+    RUN_TEST0(state, alloc_stats, STRING_REF("allocation counts"));
 }
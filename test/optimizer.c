@@ -0,0 +1,316 @@
+#include "monkey/test/optimizer.h"
+
+#include <inttypes.h>
+#include <iso646.h>
+#include <monkey/engine.h>
+#include <monkey/optimizer.h>
+
+#include "monkey/test/framework.h"
+
+#define S(s) STRING_REF(s)
+
+static TEST_FUNC(
+    state,
+    pass,
+    optimizer_pass_t* pass,
+    struct string input,
+    struct string expected
+) {
+    struct ast_program* program;
+    RUN_SUBTEST(state, parse, NO_CLEANUP, input, &program);
+
+    pass(program);
+    struct string actual = ast_node_string(&program->node);
+    TEST_ASSERT(
+        state,
+        STRING_EQUAL(actual, expected),
+        CLEANUP(STRING_FREE(actual); ast_node_decref(&program->node)),
+        "expected=\"" STRING_FMT "\", got=\"" STRING_FMT "\"",
+        STRING_ARG(expected),
+        STRING_ARG(actual)
+    );
+
+    STRING_FREE(actual);
+    ast_node_decref(&program->node);
+    PASS();
+}
+
+// Optimized and unoptimized programs must evaluate the same on every engine.
+static TEST_FUNC(state, same_result, enum engine engine, struct string input) {
+    struct string results[OPTIMIZER_MAX_LEVEL + 1];
+    for (int level = 0; level <= OPTIMIZER_MAX_LEVEL; level++) {
+        struct ast_program* program;
+        RUN_SUBTEST(
+            state,
+            parse,
+            CLEANUP(for (int i = 0; i < level; i++) STRING_FREE(results[i]);
+                    optimizer_set_level(OPTIMIZER_DEFAULT_LEVEL)),
+            input,
+            &program
+        );
+
+        optimizer_set_level(level);
+        struct environment* env = environment_new();
+        struct object* result = engine_eval(engine, &program->node, env);
+        results[level] = result != NULL ? object_inspect(result) : string_dup(S("(nil)"));
+        object_decref(result);
+        environment_decref(env);
+        ast_node_decref(&program->node);
+    }
+    optimizer_set_level(OPTIMIZER_DEFAULT_LEVEL);
+
+    TEST_ASSERT(
+        state,
+        STRING_EQUAL(results[0], results[OPTIMIZER_MAX_LEVEL]),
+        CLEANUP(for (int i = 0; i <= OPTIMIZER_MAX_LEVEL; i++) STRING_FREE(results[i])),
+        "-O0 gave \"" STRING_FMT "\", -O%d gave \"" STRING_FMT "\"",
+        STRING_ARG(results[0]),
+        OPTIMIZER_MAX_LEVEL,
+        STRING_ARG(results[OPTIMIZER_MAX_LEVEL])
+    );
+    for (int i = 0; i <= OPTIMIZER_MAX_LEVEL; i++) STRING_FREE(results[i]);
+    PASS();
+}
+
+SUITE_FUNC(state, optimizer) {
+    struct {
+        enum optimizer_pass pass;
+        optimizer_pass_t* fn;
+        struct string input;
+        struct string expected;
+    } pass_tests[] = {
+        {OPTIMIZER_PASS_INLINE_FUNCTIONS,
+         optimize_inline_functions,
+         S("fn(x) { let add = fn(a, b) { a + b }; add(x, 1) }"),
+         S("fn(x) let add = fn(a, b) (a + b);iftrue let a@1 = x;(a@1 + 1)")},
+        {OPTIMIZER_PASS_INLINE_FUNCTIONS,
+         optimize_inline_functions,
+         S("fn() { let sq = fn(n) { n * n }; sq(3) }"),
+         S("fn() let sq = fn(n) (n * n);(3 * 3)")},
+        {OPTIMIZER_PASS_INLINE_FUNCTIONS,
+         optimize_inline_functions,
+         S("fn(a) { -a }(2)"),
+         S("(-2)")},
+        {OPTIMIZER_PASS_INLINE_FUNCTIONS,
+         optimize_inline_functions,
+         S("fn(x) { fn(a) { a + 1 }(x) }"),
+         S("fn(x) iftrue let a@1 = x;(a@1 + 1)")},
+        // the inlined body's `y` would mean h's parameter
+        {OPTIMIZER_PASS_INLINE_FUNCTIONS,
+         optimize_inline_functions,
+         S("fn(y) { let g = fn(a) { a + y }; let h = fn(y) { g(y) }; 0 }"),
+         S("fn(y) let g = fn(a) (a + y);let h = fn(y) g(y);0")},
+        {OPTIMIZER_PASS_INLINE_FUNCTIONS,
+         optimize_inline_functions,
+         S("fn(n) { let f = fn(m) { f(m - 1) }; f(n) }"),
+         S("fn(n) let f = fn(m) f((m - 1));f(n)")},
+        {OPTIMIZER_PASS_INLINE_FUNCTIONS,
+         optimize_inline_functions,
+         S("fn() { let f = fn() { 1 }; let f = fn() { 2 }; f() }"),
+         S("fn() let f = fn() 1;let f = fn() 2;f()")},
+        {OPTIMIZER_PASS_INLINE_FUNCTIONS,
+         optimize_inline_functions,
+         S("let one = fn() { 1 }; fn() { one() }"),
+         S("let one = fn() 1;fn() one()")},
+        {OPTIMIZER_PASS_FOLD_CONSTANTS, optimize_fold_constants, S("1 + 2 * 3"), S("7")},
+        {OPTIMIZER_PASS_FOLD_CONSTANTS, optimize_fold_constants, S("-(5 - 10)"), S("5")},
+        {OPTIMIZER_PASS_FOLD_CONSTANTS,
+         optimize_fold_constants,
+         S("1 < 2 == !false"),
+         S("true")},
+        {OPTIMIZER_PASS_FOLD_CONSTANTS,
+         optimize_fold_constants,
+         S("\"foo\" + \"bar\""),
+         S("foobar")},
+        {OPTIMIZER_PASS_FOLD_CONSTANTS, optimize_fold_constants, S("x + 2 * 3"), S("(x + 6)")},
+        {OPTIMIZER_PASS_FOLD_CONSTANTS,
+         optimize_fold_constants,
+         S("fn() { 2 * 2 }"),
+         S("fn() 4")},
+        {OPTIMIZER_PASS_FOLD_CONSTANTS, optimize_fold_constants, S("[1 + 1][0]"), S("([2][0])")},
+        // errors and faults are left for the evaluator to report
+        {OPTIMIZER_PASS_FOLD_CONSTANTS, optimize_fold_constants, S("1 / 0"), S("(1 / 0)")},
+        {OPTIMIZER_PASS_FOLD_CONSTANTS, optimize_fold_constants, S("5 + true"), S("(5 + true)")},
+        {OPTIMIZER_PASS_FOLD_CONSTANTS, optimize_fold_constants, S("-true"), S("(-true)")},
+        {OPTIMIZER_PASS_FOLD_CONSTANTS,
+         optimize_fold_constants,
+         S("\"a\" == \"a\""),
+         S("(a == a)")},
+        {OPTIMIZER_PASS_FOLD_CONSTANTS,
+         optimize_fold_constants,
+         S("9223372036854775807 + 1"),
+         S("(9223372036854775807 + 1)")},
+        {OPTIMIZER_PASS_SIMPLIFY_ALGEBRA,
+         optimize_simplify_algebra,
+         S("x + 1 + 2 - 4"),
+         S("(x + -1)")},
+        {OPTIMIZER_PASS_SIMPLIFY_ALGEBRA,
+         optimize_simplify_algebra,
+         S("x - 1 + 3"),
+         S("(x - -2)")},
+        {OPTIMIZER_PASS_SIMPLIFY_ALGEBRA, optimize_simplify_algebra, S("x * 2 * 3"), S("(x * 6)")},
+        {OPTIMIZER_PASS_SIMPLIFY_ALGEBRA,
+         optimize_simplify_algebra,
+         S("x * 2 + 3"),
+         S("((x * 2) + 3)")},
+        {OPTIMIZER_PASS_SIMPLIFY_ALGEBRA,
+         optimize_simplify_algebra,
+         S("1 + x + 2"),
+         S("((1 + x) + 2)")},
+        {OPTIMIZER_PASS_PRUNE_BRANCHES,
+         optimize_prune_branches,
+         S("if (true) { let x = 1; x } else { 2 }; x"),
+         S("let x = 1;xx")},
+        {OPTIMIZER_PASS_PRUNE_BRANCHES, optimize_prune_branches, S("if (0) { 1 }; 2"), S("12")},
+        {OPTIMIZER_PASS_PRUNE_BRANCHES, optimize_prune_branches, S("if (false) { 1 }; 2"), S("2")},
+        {OPTIMIZER_PASS_PRUNE_BRANCHES,
+         optimize_prune_branches,
+         S("1; if (false) { 2 }"),
+         S("1iffalse 2")},
+        {OPTIMIZER_PASS_PRUNE_BRANCHES,
+         optimize_prune_branches,
+         S("let y = if (false) { 1 } else { 2 };"),
+         S("let y = 2;")},
+        {OPTIMIZER_PASS_PRUNE_BRANCHES,
+         optimize_prune_branches,
+         S("f(if (false) { 1 } else { g(); 2 })"),
+         S("f(iftrue g()2)")},
+        {OPTIMIZER_PASS_PRUNE_BRANCHES,
+         optimize_prune_branches,
+         S("if (x) { 1 } else { 2 }"),
+         S("ifx 1 else 2")},
+        {OPTIMIZER_PASS_HOIST_INVARIANTS,
+         optimize_hoist_invariants,
+         S("fn(k) { let f = fn(n, k) { if (n > len(k)) { n } else { f(n + 1, k) } }; f(0, k) }"),
+         S("fn(k) let f = fn(n, k) let @inv1 = len(k);let f@loop = fn(n) if(n > @inv1) n else "
+           "f@loop((n + 1));f@loop(n);f(0, k)")},
+        // `k` changes from call to call
+        {OPTIMIZER_PASS_HOIST_INVARIANTS,
+         optimize_hoist_invariants,
+         S("fn(k) { let f = fn(n, k) { if (n > len(k)) { n } else { f(n + 1, rest(k)) } }; 0 }"),
+         S("fn(k) let f = fn(n, k) if(n > len(k)) n else f((n + 1), rest(k));0")},
+        // only calls that get past `n > 0` evaluate `len(k)`
+        {OPTIMIZER_PASS_HOIST_INVARIANTS,
+         optimize_hoist_invariants,
+         S("fn(k) { let f = fn(n, k) { if (n > 0) { f(n - 1, k) } else { len(k) } }; 0 }"),
+         S("fn(k) let f = fn(n, k) if(n > 0) f((n - 1), k) else len(k);0")},
+        {OPTIMIZER_PASS_ELIMINATE_COMMON_SUBEXPRESSIONS,
+         optimize_eliminate_common_subexpressions,
+         S("fn(a) { len(a) * len(a) }"),
+         S("fn(a) (iftrue let @cse1 = len(a);@cse1 * @cse1)")},
+        {OPTIMIZER_PASS_ELIMINATE_COMMON_SUBEXPRESSIONS,
+         optimize_eliminate_common_subexpressions,
+         S("fn(a) { let n = len(a) - 1; if (n > 0) { a[len(a) - 1] } else { 0 } }"),
+         S("fn(a) let n = (len(a) - 1);if(n > 0) (a[n]) else 0")},
+        {OPTIMIZER_PASS_ELIMINATE_COMMON_SUBEXPRESSIONS,
+         optimize_eliminate_common_subexpressions,
+         S("fn(a, f) { let sq = fn(x) { x * x }; sq(len(a)) + sq(len(a)) + f(a) + f(a) }"),
+         S("fn(a, f) let sq = fn(x) (x * x);(((iftrue let @cse1 = sq(len(a));@cse1 + @cse1) + "
+           "f(a)) + f(a))")},
+        // each `rest` makes a new array, which `==` tells apart
+        {OPTIMIZER_PASS_ELIMINATE_COMMON_SUBEXPRESSIONS,
+         optimize_eliminate_common_subexpressions,
+         S("fn(a) { rest(a) == rest(a) }"),
+         S("fn(a) (rest(a) == rest(a))")},
+        {OPTIMIZER_PASS_ELIMINATE_COMMON_SUBEXPRESSIONS,
+         optimize_eliminate_common_subexpressions,
+         S("fn(a) { if (a) { first(a) } else { 0 } + first(a) }"),
+         S("fn(a) (ifa first(a) else 0 + first(a))")},
+        {OPTIMIZER_PASS_ELIMINATE_COMMON_SUBEXPRESSIONS,
+         optimize_eliminate_common_subexpressions,
+         S("fn(a) { let x = first(a); let a = rest(a); first(a) + x + first(a) }"),
+         S("fn(a) let x = first(a);let a = rest(a);((first(a) + x) + first(a))")},
+        {OPTIMIZER_PASS_ELIMINATE_COMMON_SUBEXPRESSIONS,
+         optimize_eliminate_common_subexpressions,
+         S("len(a) + len(a)"),
+         S("(len(a) + len(a))")},
+        {OPTIMIZER_PASS_REMOVE_UNUSED_LETS,
+         optimize_remove_unused_lets,
+         S("fn(a) { let b = 1; let c = [2, \"three\"]; a }"),
+         S("fn(a) a")},
+        {OPTIMIZER_PASS_REMOVE_UNUSED_LETS,
+         optimize_remove_unused_lets,
+         S("fn() { let f = fn() { g }; let g = 1; 2 }"),
+         S("fn() 2")},
+        {OPTIMIZER_PASS_REMOVE_UNUSED_LETS,
+         optimize_remove_unused_lets,
+         S("fn() { let b = 1; fn() { b } }"),
+         S("fn() let b = 1;fn() b")},
+        {OPTIMIZER_PASS_REMOVE_UNUSED_LETS,
+         optimize_remove_unused_lets,
+         S("fn() { let b = f(); let c = 1; }"),
+         S("fn() let b = f();let c = 1;")},
+        {OPTIMIZER_PASS_REMOVE_UNUSED_LETS,
+         optimize_remove_unused_lets,
+         S("fn(x) { let v = x; let w = [v, x]; 1 }"),
+         S("fn(x) 1")},
+        // `w` isn't bound yet, and reading it fails unless there's a global `w`
+        {OPTIMIZER_PASS_REMOVE_UNUSED_LETS,
+         optimize_remove_unused_lets,
+         S("fn(x) { let v = w; let w = x; 1 }"),
+         S("fn(x) let v = w;let w = x;1")},
+        {OPTIMIZER_PASS_REMOVE_UNUSED_LETS,
+         optimize_remove_unused_lets,
+         S("let a = 1; 2"),
+         S("let a = 1;2")},
+    };
+    for (size_t i = 0; i < sizeof(pass_tests) / sizeof(*pass_tests); i++) {
+        RUN_TEST(
+            state,
+            pass,
+            string_printf(
+                STRING_FMT " (\"" STRING_FMT "\")",
+                STRING_ARG(optimizer_pass_name(pass_tests[i].pass)),
+                STRING_ARG(pass_tests[i].input)
+            ),
+            pass_tests[i].fn,
+            pass_tests[i].input,
+            pass_tests[i].expected
+        );
+    }
+
+    struct string same_result_tests[] = {
+        S("let x = 2; if (1 < 2) { let x = 10; }; x + 3 * 4"),
+        S("let f = fn(n) { let unused = [1, 2]; n * 2 * 3 + 1 - 1 }; f(7)"),
+        S("let f = fn(s) { s + 1 + 2 }; f(\"a\")"),
+        S("let y = if (false) { 1 }; y"),
+        S("\"mon\" + \"key\""),
+        S("!(-(3 - 5) > 1)"),
+        S("let f = fn(x) { let add = fn(a, b) { a + b }; add(x, 1) * add(2, x) }; f(3)"),
+        S("let f = fn(y) { let g = fn(a) { a + y }; let h = fn(y) { g(y) }; h(10) }; f(1)"),
+        S("let f = fn() { let k = fn(a, b) { b }; k(missing, 2) }; f()"),
+        S("let f = fn(x) { let pick = fn(c) { if (c) { x } else { 0 } }; pick(x > 1) }; f(5)"),
+        S("let f = fn(a) { let g = fn(n, a) { if (n < len(a)) { g(n + 1, a) } else { n } }; "
+          "g(0, a) }; f([1, 2, 3])"),
+        S("let f = fn(a) { let g = fn(n, a) { n + len(a) + g(n, a) }; g(0, a) }; f(1)"),
+        S("let f = fn(a) { let g = fn(n, a) { if (n > 0) { g(n - 1, a) } else { len(a) } }; "
+          "g(2, a) }; f(1)"),
+        S("let f = fn(a) { [len(a) + first(a), len(a) + first(a), a[1] * a[1]] }; f([2, 3])"),
+        S("let f = fn(a) { if (len(a) > 0) { first(a) } else { 0 } + first(a) }; f([])"),
+        S("let f = fn(a) { rest(a) == rest(a) }; f([1])"),
+        S("let f = fn(a, n) { if (n > 0) { a[n] * a[n] + a[n] * a[n] } else { a[n] } }; "
+          "[f([1, 2], 1), f([], 0)]"),
+        S("let reduce = fn(a, acc, f) { if (len(a) == 0) { acc } else { "
+          "reduce(rest(a), f(acc, first(a)), f) } }; "
+          "reduce([1, 2, 3], 0, fn(x, y) { x * 10 + y })"),
+        S("let f = fn(n, g) { if (n == 0) { g(true) } else { f(n - 1, g) } }; "
+          "f(3, fn(b) { if (b) { 1 } else { 2 } })"),
+        S("let f = fn(n) { let k = fn(m) { m * n }; k(n) + k(2) }; f(3) + f(3)"),
+        S("let f = fn(a, b) { a + b }; [f(1, true), f(1, 2)]"),
+    };
+    for (size_t i = 0; i < sizeof(same_result_tests) / sizeof(*same_result_tests); i++) {
+        for (enum engine engine = ENGINE_TREE; engine <= ENGINE_THUNK; engine++) {
+            RUN_TEST(
+                state,
+                same_result,
+                string_printf(
+                    "same result on " STRING_FMT " (\"" STRING_FMT "\")",
+                    STRING_ARG(engine_name(engine)),
+                    STRING_ARG(same_result_tests[i])
+                ),
+                engine,
+                same_result_tests[i]
+            );
+        }
+    }
+}
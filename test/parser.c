@@ -207,11 +207,11 @@ static SUBTEST_FUNC(
     RUN_SUBTEST(state, literal_expression, NO_CLEANUP, infix->left, left);
     TEST_ASSERT(
         state,
-        STRING_EQUAL(infix->op, op),
+        STRING_EQUAL(ast_operator_string(infix->op), op),
         NO_CLEANUP,
         "infix.op is not '" STRING_FMT "'. got=" STRING_FMT,
         STRING_ARG(op),
-        STRING_ARG(infix->op)
+        STRING_ARG(ast_operator_string(infix->op))
     );
     RUN_SUBTEST(state, literal_expression, NO_CLEANUP, infix->right, right);
     PASS();
@@ -502,11 +502,11 @@ static TEST_FUNC(
     struct ast_prefix_expression* exp = (struct ast_prefix_expression*)stmt->expression;
     TEST_ASSERT(
         state,
-        STRING_EQUAL(exp->op, op),
+        STRING_EQUAL(ast_operator_string(exp->op), op),
         CLEANUP(ast_node_decref(&program->node)),
         "exp.op is not '" STRING_FMT "'. got=" STRING_FMT,
         STRING_ARG(op),
-        STRING_ARG(exp->op)
+        STRING_ARG(ast_operator_string(exp->op))
     );
     RUN_SUBTEST(
         state,
@@ -0,0 +1,219 @@
+#include "monkey/test/resolver.h"
+
+#include <inttypes.h>
+#include <iso646.h>
+#include <monkey/engine.h>
+#include <monkey/resolver.h>
+
+#include "monkey/test/framework.h"
+
+static SUBTEST_FUNC(
+    state,
+    address,
+    struct ast_identifier* identifier,
+    bool resolved,
+    size_t depth,
+    size_t slot,
+    size_t env_depth,
+    size_t env_slot
+) {
+    struct ast_lexical_address got = identifier->address;
+    TEST_ASSERT(
+        state,
+        got.resolved == resolved and
+            (!resolved or (got.depth == depth and got.slot == slot and
+                           got.env_depth == env_depth and got.env_slot == env_slot)),
+        NO_CLEANUP,
+        STRING_FMT " has wrong address. got=%s %zu:%zu (%zu:%zu), want=%s %zu:%zu (%zu:%zu)",
+        STRING_ARG(identifier->value),
+        got.resolved ? "local" : "global",
+        got.depth,
+        got.slot,
+        got.env_depth,
+        got.env_slot,
+        resolved ? "local" : "global",
+        depth,
+        slot,
+        env_depth,
+        env_slot
+    );
+    PASS();
+}
+
+static TEST_FUNC0(state, addresses) {
+    struct ast_program* program;
+    RUN_SUBTEST(
+        state,
+        parse,
+        NO_CLEANUP,
+        STRING_REF("let f = fn(a) { let b = a; fn(c) { a + b + c + len } };"),
+        &program
+    );
+    resolve(&program->node);
+
+    struct ast_let_statement* let_f = (struct ast_let_statement*)program->statements.ptr[0];
+    struct ast_function_literal* outer = (struct ast_function_literal*)let_f->value;
+    struct ast_let_statement* let_b = (struct ast_let_statement*)outer->body->statements.ptr[0];
+    struct ast_expression_statement* inner_statement =
+        (struct ast_expression_statement*)outer->body->statements.ptr[1];
+    struct ast_function_literal* inner = (struct ast_function_literal*)inner_statement->expression;
+    struct ast_expression_statement* sum_statement =
+        (struct ast_expression_statement*)inner->body->statements.ptr[0];
+    // ((a + b) + c) + len
+    struct ast_infix_expression* sum = (struct ast_infix_expression*)sum_statement->expression;
+    struct ast_infix_expression* sum_abc = (struct ast_infix_expression*)sum->left;
+    struct ast_infix_expression* sum_ab = (struct ast_infix_expression*)sum_abc->left;
+
+    TEST_ASSERT(
+        state,
+        outer->escapes and !inner->escapes,
+        CLEANUP(ast_node_decref(&program->node)),
+        "functions have wrong escapes. got=%d, %d",
+        outer->escapes,
+        inner->escapes
+    );
+    TEST_ASSERT(
+        state,
+        outer->locals == 2 and inner->locals == 1,
+        CLEANUP(ast_node_decref(&program->node)),
+        "functions have wrong slot counts. got=%zu, %zu",
+        outer->locals,
+        inner->locals
+    );
+    TEST_ASSERT(
+        state,
+        outer->captured == 2 and inner->captured == 0,
+        CLEANUP(ast_node_decref(&program->node)),
+        "functions have wrong captured counts. got=%zu, %zu",
+        outer->captured,
+        inner->captured
+    );
+    struct {
+        struct ast_expression* identifier;
+        bool resolved;
+        size_t depth;
+        size_t slot;
+        size_t env_depth;
+        size_t env_slot;
+    } tests[] = {
+        {&let_f->name->expression, false, 0, 0, 0, 0},
+        {&outer->parameters.ptr[0]->expression, true, 0, 0, 1, 0},
+        {&let_b->name->expression, true, 0, 1, 1, 1},
+        {let_b->value, true, 0, 0, 1, 0},
+        {&inner->parameters.ptr[0]->expression, true, 0, 0, 0, 0},
+        {sum_ab->left, true, 1, 0, 1, 0},
+        {sum_ab->right, true, 1, 1, 1, 1},
+        {sum_abc->right, true, 0, 0, 0, 0},
+        {sum->right, false, 0, 0, 0, 0},
+    };
+    for (size_t i = 0; i < sizeof(tests) / sizeof(*tests); i++) {
+        RUN_SUBTEST(
+            state,
+            address,
+            CLEANUP(ast_node_decref(&program->node)),
+            (struct ast_identifier*)tests[i].identifier,
+            tests[i].resolved,
+            tests[i].depth,
+            tests[i].slot,
+            tests[i].env_depth,
+            tests[i].env_slot
+        );
+    }
+    ast_node_decref(&program->node);
+    PASS();
+}
+
+// The tree evaluator looks names up dynamically; resolving them must not change what they mean.
+static TEST_FUNC(state, scoping, struct string input, int64_t expected) {
+    struct ast_program* program;
+    RUN_SUBTEST(state, parse, NO_CLEANUP, input, &program);
+    struct environment* env = environment_new();
+    struct object* result = engine_eval(ENGINE_TREE, &program->node, env);
+    environment_decref(env);
+    ast_node_decref(&program->node);
+
+    TEST_ASSERT(
+        state,
+        result != NULL and object_type(result) == OBJECT_INTEGER and
+            object_int64_value(result) == expected,
+        CLEANUP(object_decref(result)),
+        "wrong result, want=%" PRId64,
+        expected
+    );
+    object_decref(result);
+    PASS();
+}
+
+// A closure keeps the variables it captures, and none of the other variables of the call that
+// made it.
+static TEST_FUNC(state, closure_env, enum engine engine) {
+    struct ast_program* program;
+    RUN_SUBTEST(
+        state,
+        parse,
+        NO_CLEANUP,
+        STRING_REF("let f = fn(n) { let big = [1, 2, 3]; let x = n; fn() { x } }; f(1)"),
+        &program
+    );
+    struct environment* env = environment_new();
+    struct object* result = engine_eval(engine, &program->node, env);
+    environment_decref(env);
+    ast_node_decref(&program->node);
+
+    TEST_ASSERT(
+        state,
+        result != NULL and object_type(result) == OBJECT_FUNCTION,
+        CLEANUP(object_decref(result)),
+        "result is not a function"
+    );
+    struct environment* captured = ((struct object_function*)result)->env;
+    TEST_ASSERT(
+        state,
+        captured->slots.len == 1 and object_int64_value(captured->slots.ptr[0]) == 1,
+        CLEANUP(object_decref(result)),
+        "closure keeps wrong variables. got=%zu slots",
+        captured->slots.len
+    );
+    object_decref(result);
+    PASS();
+}
+
+SUITE_FUNC(state, resolver) {
+    RUN_TEST0(state, addresses, STRING_REF("lexical addresses"));
+    for (enum engine engine = ENGINE_TREE; engine <= ENGINE_THUNK; engine++) {
+        if (engine == ENGINE_VM) continue;
+        RUN_TEST(
+            state,
+            closure_env,
+            string_printf("closure environment (" STRING_FMT ")", STRING_ARG(engine_name(engine))),
+            engine
+        );
+    }
+
+    struct {
+        struct string input;
+        int64_t expected;
+    } scoping_tests[] = {
+        {STRING_REF("let x = 1; let f = fn() { let y = x; let x = 2; x + y }; f()"), 3},
+        {STRING_REF("let f = fn(x) { let x = x * 10; x }; f(2)"), 20},
+        {STRING_REF("let f = fn(x, x) { x }; f(1, 2)"), 2},
+        {STRING_REF("let f = fn() { let g = fn() { h() }; let h = fn() { 7 }; g() }; f()"), 7},
+        {STRING_REF("let x = 5; let f = fn(c) { if (c) { let x = 1; }; x }; f(false)"), 5},
+        {STRING_REF("let f = fn() { g() }; let g = fn() { 3 }; f()"), 3},
+        {STRING_REF("let f = fn(a, b) { fn(c) { fn() { a + b + c } } }; f(1, 2)(3)()"), 6},
+        {STRING_REF("let f = fn() { let x = 1; let g = fn() { x }; let x = 2; g() }; f()"), 2},
+        {STRING_REF("let f = fn(n) { let go = fn(i) { if (i == 0) { n } else { go(i - 1) } }; "
+                    "go(3) }; f(4)"),
+         4},
+        {STRING_REF("let f = fn(a) { let g = fn(b) { fn() { a + b } }; g(a * 10) }; f(2)()"), 22},
+    };
+    for (size_t i = 0; i < sizeof(scoping_tests) / sizeof(*scoping_tests); i++) {
+        RUN_TEST(
+            state,
+            scoping,
+            string_printf("scoping (\"" STRING_FMT "\")", STRING_ARG(scoping_tests[i].input)),
+            scoping_tests[i].input,
+            scoping_tests[i].expected
+        );
+    }
+}
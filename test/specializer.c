@@ -0,0 +1,172 @@
+#include "monkey/test/specializer.h"
+
+#include <iso646.h>
+#include <monkey/engine.h>
+#include <monkey/specializer.h>
+
+#include "monkey/test/framework.h"
+
+#define S(s) STRING_REF(s)
+
+static TEST_FUNC(
+    state,
+    versions,
+    enum engine engine,
+    struct string input,
+    struct string expected,
+    size_t versions,
+    size_t calls
+) {
+    struct ast_program* program;
+    RUN_SUBTEST(state, parse, NO_CLEANUP, input, &program);
+
+    struct specializer_stats before = specializer_stats();
+    struct environment* env = environment_new();
+    struct object* result = engine_eval(engine, &program->node, env);
+    struct specializer_stats after = specializer_stats();
+    struct string actual = result != NULL ? object_inspect(result) : string_dup(S("(nil)"));
+    object_decref(result);
+    environment_decref(env);
+    ast_node_decref(&program->node);
+
+    TEST_ASSERT(
+        state,
+        STRING_EQUAL(actual, expected),
+        CLEANUP(STRING_FREE(actual)),
+        "expected=\"" STRING_FMT "\", got=\"" STRING_FMT "\"",
+        STRING_ARG(expected),
+        STRING_ARG(actual)
+    );
+    STRING_FREE(actual);
+    TEST_ASSERT(
+        state,
+        after.versions - before.versions == versions and after.calls - before.calls >= calls,
+        NO_CLEANUP,
+        "expected %zu version(s) and %zu call(s) or more, got %zu and %zu",
+        versions,
+        calls,
+        after.versions - before.versions,
+        after.calls - before.calls
+    );
+    PASS();
+}
+
+// Versions are made when a function is called, which may be long after the source defining it was
+// freed, as in the REPL.
+static TEST_FUNC(state, freed_source, enum engine engine) {
+    struct environment* env = environment_new();
+    struct string definition = string_dup(
+        S("let f = fn(n, m) { let k = [n, \"m\"]; if (n < m) { k[0] + m } else { -n } };")
+    );
+    struct ast_program* defining;
+    RUN_SUBTEST(
+        state,
+        parse,
+        CLEANUP(STRING_FREE(definition); environment_decref(env)),
+        definition,
+        &defining
+    );
+    object_decref(engine_eval(engine, &defining->node, env));
+    STRING_FREE(definition);
+
+    struct specializer_stats before = specializer_stats();
+    struct string call = string_dup(S("f(1, 2) + f(3, 2)"));
+    struct ast_program* calling;
+    RUN_SUBTEST(
+        state,
+        parse,
+        CLEANUP(STRING_FREE(call); environment_decref(env); ast_node_decref(&defining->node)),
+        call,
+        &calling
+    );
+    STRING_FREE(call);
+    struct object* result = engine_eval(engine, &calling->node, env);
+    struct specializer_stats after = specializer_stats();
+    struct string actual = result != NULL ? object_inspect(result) : string_dup(S("(nil)"));
+    object_decref(result);
+    environment_decref(env);
+    ast_node_decref(&calling->node);
+    ast_node_decref(&defining->node);
+
+    TEST_ASSERT(
+        state,
+        STRING_EQUAL(actual, S("0")),
+        CLEANUP(STRING_FREE(actual)),
+        "expected=\"0\", got=\"" STRING_FMT "\"",
+        STRING_ARG(actual)
+    );
+    STRING_FREE(actual);
+    TEST_ASSERT(
+        state,
+        after.versions - before.versions == 2,
+        NO_CLEANUP,
+        "expected 2 versions, got %zu",
+        after.versions - before.versions
+    );
+    PASS();
+}
+
+SUITE_FUNC(state, specializer) {
+    struct {
+        struct string input;
+        struct string expected;
+        size_t versions;
+        size_t calls;
+    } tests[] = {
+        // the recursive calls pass the literal on, so they share the version without the `0`
+        {S("let reduce = fn(a, acc, f) { "
+           "if (len(a) == 0) { acc } else { reduce(rest(a), f(acc, first(a)), f) } }; "
+           "reduce([1, 2, 3], 0, fn(x, y) { x + y }) + reduce([4], 0, fn(x, y) { x + y })"),
+         S("10"),
+         2,
+         6},
+        {S("let f = fn(n, m) { n * m }; f(2, 3) + f(2, 3) + f(2, 4)"), S("20"), 2, 3},
+        // strings made by separate evaluations of a literal aren't `==`
+        {S("let f = fn(s) { s == s }; f(\"a\")"), S("true"), 0, 0},
+        // nor are closures
+        {S("let f = fn(g) { g == g }; f(fn() { 1 })"), S("true"), 0, 0},
+        {S("let f = fn(g, h) { h(g, g) }; f(fn() { 1 }, fn(a, b) { a == b })"), S("true"), 1, 1},
+        // the literal refers to a variable of the function calling
+        {S("let f = fn(g) { g(len([1])) }; let h = fn(k) { f(fn(x) { x + k }) }; h(len([1]))"),
+         S("2"),
+         0,
+         0},
+        // inside `f`, the literal's `y` would be the parameter
+        {S("let y = 5; let f = fn(g, y) { g() + y }; f(fn() { y }, 1)"), S("6"), 1, 1},
+        {S("let f = fn(n) { let n = n + 1; n }; f(1)"), S("2"), 0, 0},
+        {S("let f = fn(n) { fn() { n } }; f(7)()"), S("7"), 1, 1},
+        {S("let f = fn(n) { n }; f(1) + f(2) + f(3) + f(4) + f(5) + f(6) + f(7) + f(8) + f(9)"),
+         S("45"),
+         SPECIALIZER_MAX_VERSIONS,
+         SPECIALIZER_MAX_VERSIONS},
+    };
+    for (size_t i = 0; i < sizeof(tests) / sizeof(*tests); i++) {
+        for (enum engine engine = ENGINE_TREE; engine <= ENGINE_THUNK; engine++) {
+            // the VM runs compiled bytecode, which has no versions
+            if (engine == ENGINE_VM) continue;
+            RUN_TEST(
+                state,
+                versions,
+                string_printf(
+                    "versions on " STRING_FMT " (\"" STRING_FMT "\")",
+                    STRING_ARG(engine_name(engine)),
+                    STRING_ARG(tests[i].input)
+                ),
+                engine,
+                tests[i].input,
+                tests[i].expected,
+                tests[i].versions,
+                tests[i].calls
+            );
+        }
+    }
+    for (enum engine engine = ENGINE_TREE; engine <= ENGINE_THUNK; engine++) {
+        if (engine == ENGINE_VM) continue;
+        RUN_TEST(
+            state,
+            freed_source,
+            string_printf("freed source on " STRING_FMT, STRING_ARG(engine_name(engine))),
+            engine
+        );
+    }
+}